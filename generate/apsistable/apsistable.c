@@ -0,0 +1,176 @@
+/*
+    apsistable.c  -  Don Cross <cosinekitty@gmail.com>
+
+    Finds the perihelion and aphelion times of Neptune and Pluto
+    by sampling their heliocentric distances over thousands of years,
+    and writes the table of apsis times that codegen turns into C code in astronomy.c,
+    letting Astronomy_SearchPlanetApsis avoid its brute-force search.
+
+    The Sun's wobble around the Solar System Barycenter causes several local
+    extremes in the distance near each apsis. This program defines the apsis
+    as the global extreme of the distance within each half of the orbit,
+    where the halves are separated by the times the distance crosses its average value.
+
+    Each line of the output file holds a body name, the apsis kind
+    (0 = pericenter, 1 = apocenter), and the apsis time expressed in TT days.
+
+    Usage:  apsistable tt_begin tt_end outfile
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "astronomy.h"
+
+#define STEP_DAYS   5.0
+
+typedef struct
+{
+    astro_body_t body;
+    double sign;        /* +1 to find a minimum, -1 to find a maximum */
+}
+extreme_context_t;
+
+
+static double Distance(astro_body_t body, double tt)
+{
+    astro_func_result_t dist = Astronomy_HelioDistance(body, Astronomy_TerrestrialTime(tt));
+    if (dist.status != ASTRO_SUCCESS)
+    {
+        fprintf(stderr, "apsistable: Error %d calculating distance of %s\n", dist.status, Astronomy_BodyName(body));
+        exit(1);
+    }
+    return dist.value;
+}
+
+
+static double Refine(const extreme_context_t *context, double tt)
+{
+    /* Golden section search for the extreme within one sample step of 'tt'. */
+    const double g = (sqrt(5.0) - 1.0) / 2.0;
+    double a = tt - STEP_DAYS;
+    double b = tt + STEP_DAYS;
+    double x1 = b - g*(b - a);
+    double x2 = a + g*(b - a);
+    double f1 = context->sign * Distance(context->body, x1);
+    double f2 = context->sign * Distance(context->body, x2);
+
+    while (b - a > 1.0e-5)
+    {
+        if (f1 < f2)
+        {
+            b = x2;
+            x2 = x1;
+            f2 = f1;
+            x1 = b - g*(b - a);
+            f1 = context->sign * Distance(context->body, x1);
+        }
+        else
+        {
+            a = x1;
+            x1 = x2;
+            f1 = f2;
+            x2 = a + g*(b - a);
+            f2 = context->sign * Distance(context->body, x2);
+        }
+    }
+    return (a + b) / 2.0;
+}
+
+
+static int WriteTable(FILE *outfile, astro_body_t body, double tt_begin, double tt_end)
+{
+    int i, n, kind;
+    double *dist, mean, best, tt;
+    int best_i, begin_i;
+    extreme_context_t context;
+
+    n = 1 + (int)((tt_end - tt_begin) / STEP_DAYS);
+    dist = calloc((size_t)n, sizeof(double));
+    if (dist == NULL)
+    {
+        fprintf(stderr, "apsistable: Out of memory.\n");
+        return 1;
+    }
+
+    mean = 0.0;
+    for (i = 0; i < n; ++i)
+    {
+        dist[i] = Distance(body, tt_begin + i*STEP_DAYS);
+        mean += dist[i];
+    }
+    mean /= n;
+
+    /* Skip the partial half-orbit before the first crossing of the mean distance. */
+    for (i = 1; i < n && (dist[i-1] < mean) == (dist[i] < mean); ++i);
+
+    while (i < n)
+    {
+        /* Find the global extreme up to the next crossing of the mean distance. */
+        kind = (dist[i] < mean) ? 0 : 1;
+        context.body = body;
+        context.sign = (kind == 0) ? +1.0 : -1.0;
+        begin_i = i;
+        best_i = i;
+        best = context.sign * dist[i];
+        for (++i; i < n && (dist[i] < mean) == (kind == 0); ++i)
+        {
+            if (context.sign * dist[i] < best)
+            {
+                best = context.sign * dist[i];
+                best_i = i;
+            }
+        }
+
+        if (i == n)
+            break;      /* the last half-orbit is incomplete */
+
+        if (best_i == begin_i || best_i == i-1)
+        {
+            fprintf(stderr, "apsistable: %s extreme is at the edge of its half-orbit.\n", Astronomy_BodyName(body));
+            free(dist);
+            return 1;
+        }
+
+        tt = Refine(&context, tt_begin + best_i*STEP_DAYS);
+        fprintf(outfile, "%-8s %d %12.3lf\n", Astronomy_BodyName(body), kind, tt);
+    }
+
+    free(dist);
+    return 0;
+}
+
+
+int main(int argc, const char *argv[])
+{
+    double tt_begin, tt_end;
+    const char *filename;
+    FILE *outfile;
+    int error;
+
+    if (argc != 4)
+    {
+        fprintf(stderr, "USAGE: apsistable tt_begin tt_end outfile\n");
+        return 1;
+    }
+
+    tt_begin = atof(argv[1]);
+    tt_end = atof(argv[2]);
+    filename = argv[3];
+    if (!(tt_end > tt_begin))
+    {
+        fprintf(stderr, "apsistable: Invalid time range.\n");
+        return 1;
+    }
+
+    outfile = fopen(filename, "wt");
+    if (outfile == NULL)
+    {
+        fprintf(stderr, "apsistable: Cannot open output file: %s\n", filename);
+        return 1;
+    }
+
+    error = WriteTable(outfile, BODY_NEPTUNE, tt_begin, tt_end) || WriteTable(outfile, BODY_PLUTO, tt_begin, tt_end);
+    fclose(outfile);
+    return error;
+}
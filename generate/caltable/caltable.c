@@ -0,0 +1,272 @@
+/*
+    caltable.c  -  Don Cross <cosinekitty@gmail.com>
+
+    Finds every lunar quarter, equinox, and solstice in a range of years
+    using the Astronomy Engine search functions, and writes them to a compact
+    binary table file that the C version of Astronomy Engine can load using
+    Astronomy_LoadCalendarTable().
+
+    Usage:  caltable outfile [year_begin year_end]
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "astronomy.h"
+
+#define CHECK(x)    do{if(0 != (error = (x))) goto fail;}while(0)
+#define FAIL(...)   do{fprintf(stderr, __VA_ARGS__); error = 1; goto fail;}while(0)
+
+#define NSERIES     5
+#define MAX_DELTA   32000       /* leaves a little headroom below INT16_MAX for rounding */
+#define MAX_UNIT    0.01        /* days; must match the limit enforced by astronomy.c */
+#define MIN_UNIT    (0.001 / 86400.0)
+
+/* These structures must exactly match calendar_series_t and calendar_table_header_t in astronomy.c. */
+typedef struct
+{
+    double  tt0;
+    double  rate;
+    double  accel;
+    double  unit;
+    int64_t count;
+    int64_t offset;
+}
+series_header_t;
+
+typedef struct
+{
+    char    signature[8];
+    int32_t byte_order;
+    int32_t first_quarter;
+    int32_t year_begin;
+    int32_t year_end;
+    series_header_t series[NSERIES];
+}
+file_header_t;
+
+typedef struct
+{
+    const char *name;
+    int count;
+    double *tt;
+    int16_t *delta;
+}
+series_t;
+
+
+static double YearToUT(int year)
+{
+    return Astronomy_MakeTime(year, 1, 1, 0, 0, 0.0).ut;
+}
+
+
+static int FitQuadratic(const series_t *series, series_header_t *header)
+{
+    /*
+        Find the least-squares quadratic tt = c0 + c1*x + c2*x^2, with x = i/n
+        to keep the normal equations well conditioned, then rescale it to x = i.
+    */
+    int error, i, r, c, k;
+    double x, p, n = (double)series->count;
+    double m[3][4];
+
+    if (series->count < 3)
+        FAIL("caltable: Not enough %s events to fit.\n", series->name);
+
+    memset(m, 0, sizeof(m));
+    for (i = 0; i < series->count; ++i)
+    {
+        x = i / n;
+        for (r = 0; r < 3; ++r)
+        {
+            for (c = 0; c < 3; ++c)
+                m[r][c] += pow(x, r + c);
+            m[r][3] += pow(x, r) * (series->tt[i] - series->tt[0]);
+        }
+    }
+
+    /* Gaussian elimination; the matrix is positive definite, so no pivoting is needed. */
+    for (k = 0; k < 3; ++k)
+        for (r = k+1; r < 3; ++r)
+        {
+            p = m[r][k] / m[k][k];
+            for (c = k; c < 4; ++c)
+                m[r][c] -= p * m[k][c];
+        }
+
+    for (k = 2; k >= 0; --k)
+    {
+        for (c = k+1; c < 3; ++c)
+            m[k][3] -= m[k][c] * m[c][3];
+        m[k][3] /= m[k][k];
+    }
+
+    header->tt0 = series->tt[0] + m[0][3];
+    header->rate = m[1][3] / n;
+    header->accel = m[2][3] / (n * n);
+    error = 0;
+fail:
+    return error;
+}
+
+
+static int Encode(series_t *series, series_header_t *header)
+{
+    int error, i;
+    double x, resid, approx, diff, max_resid = 0.0, max_diff = 0.0;
+
+    CHECK(FitQuadratic(series, header));
+
+    for (i = 0; i < series->count; ++i)
+    {
+        x = (double)i;
+        resid = fabs(series->tt[i] - (header->tt0 + x*(header->rate + x*header->accel)));
+        if (resid > max_resid)
+            max_resid = resid;
+    }
+
+    header->unit = max_resid / MAX_DELTA;
+    if (header->unit < MIN_UNIT)
+        header->unit = MIN_UNIT;
+
+    if (header->unit >= MAX_UNIT)
+        FAIL("caltable: The %s events deviate too much from a quadratic: unit = %0.3lf seconds\n", series->name, header->unit * 86400.0);
+
+    series->delta = calloc((size_t)series->count, sizeof(int16_t));
+    if (series->delta == NULL)
+        FAIL("caltable: Out of memory.\n");
+
+    for (i = 0; i < series->count; ++i)
+    {
+        x = (double)i;
+        resid = series->tt[i] - (header->tt0 + x*(header->rate + x*header->accel));
+        series->delta[i] = (int16_t)floor(resid/header->unit + 0.5);
+
+        /* Use the same expression as astronomy.c to measure the error the library will see. */
+        approx = header->tt0 + x*(header->rate + x*header->accel) + series->delta[i]*header->unit;
+        diff = fabs(approx - series->tt[i]);
+        if (diff > max_diff)
+            max_diff = diff;
+    }
+
+    printf("caltable: %-13s count=%6d  max_residual=%9.3lf s  unit=%0.4lf s  max_error=%0.4lf s\n",
+        series->name, series->count, max_resid * 86400.0, header->unit * 86400.0, max_diff * 86400.0);
+
+    if (max_diff > 0.501 * header->unit)
+        FAIL("caltable: EXCESSIVE encoding error for %s\n", series->name);
+
+    header->count = series->count;
+    error = 0;
+fail:
+    return error;
+}
+
+
+static int WriteTable(const char *filename, int year1, int year2)
+{
+    int error, s, y, n;
+    FILE *outfile = NULL;
+    file_header_t header;
+    series_t series[NSERIES];
+    astro_moon_quarter_t mq;
+    astro_seasons_t seasons;
+    double ut_end;
+    int64_t offset;
+    static const char * const name[NSERIES] = { "moon_quarter", "mar_equinox", "jun_solstice", "sep_equinox", "dec_solstice" };
+
+    memset(series, 0, sizeof(series));
+
+    if (year2 <= year1)
+        FAIL("caltable: Invalid year range %d..%d\n", year1, year2);
+
+    for (s = 0; s < NSERIES; ++s)
+    {
+        series[s].name = name[s];
+        /* A year has fewer than 50 lunar quarters. */
+        n = (s == 0) ? 50*(year2 - year1) : (year2 - year1);
+        series[s].tt = calloc((size_t)n, sizeof(double));
+        if (series[s].tt == NULL)
+            FAIL("caltable: Out of memory.\n");
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.signature, "AECAL001", sizeof(header.signature));
+    header.byte_order = 0x01020304;
+    header.year_begin = year1;
+    header.year_end = year2;
+
+    ut_end = YearToUT(year2);
+    mq = Astronomy_SearchMoonQuarter(Astronomy_TimeFromDays(YearToUT(year1)));
+    header.first_quarter = mq.quarter;
+    while (mq.status == ASTRO_SUCCESS && mq.time.ut < ut_end)
+    {
+        series[0].tt[series[0].count++] = mq.time.tt;
+        mq = Astronomy_NextMoonQuarter(mq);
+    }
+    if (mq.status != ASTRO_SUCCESS)
+        FAIL("caltable: Moon quarter search failed with status %d\n", mq.status);
+
+    for (y = year1; y < year2; ++y)
+    {
+        seasons = Astronomy_Seasons(y);
+        if (seasons.status != ASTRO_SUCCESS)
+            FAIL("caltable: Seasons search failed for year %d with status %d\n", y, seasons.status);
+        series[1].tt[series[1].count++] = seasons.mar_equinox.tt;
+        series[2].tt[series[2].count++] = seasons.jun_solstice.tt;
+        series[3].tt[series[3].count++] = seasons.sep_equinox.tt;
+        series[4].tt[series[4].count++] = seasons.dec_solstice.tt;
+    }
+
+    offset = sizeof(header);
+    for (s = 0; s < NSERIES; ++s)
+    {
+        CHECK(Encode(&series[s], &header.series[s]));
+        header.series[s].offset = offset;
+        offset += (int64_t)sizeof(int16_t) * series[s].count;
+    }
+
+    outfile = fopen(filename, "wb");
+    if (outfile == NULL)
+        FAIL("caltable: Cannot open output file: %s\n", filename);
+
+    if (1 != fwrite(&header, sizeof(header), 1, outfile))
+        FAIL("caltable: Error writing header to file: %s\n", filename);
+
+    for (s = 0; s < NSERIES; ++s)
+        if ((size_t)series[s].count != fwrite(series[s].delta, sizeof(int16_t), (size_t)series[s].count, outfile))
+            FAIL("caltable: Error writing %s events to file: %s\n", series[s].name, filename);
+
+    printf("caltable: Wrote %0.0lf bytes to file %s\n", (double)offset, filename);
+    error = 0;
+fail:
+    if (outfile != NULL)
+    {
+        if (fclose(outfile) && !error)
+        {
+            fprintf(stderr, "caltable: Error closing file: %s\n", filename);
+            error = 1;
+        }
+    }
+    for (s = 0; s < NSERIES; ++s)
+    {
+        free(series[s].tt);
+        free(series[s].delta);
+    }
+    return error;
+}
+
+
+int main(int argc, const char *argv[])
+{
+    if (argc == 2)
+        return WriteTable(argv[1], 1600, 2400);
+
+    if (argc == 4)
+        return WriteTable(argv[1], atoi(argv[2]), atoi(argv[3]));
+
+    fprintf(stderr, "USAGE: caltable outfile [year_begin year_end]\n");
+    return 1;
+}
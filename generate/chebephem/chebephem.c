@@ -0,0 +1,204 @@
+/*
+    chebephem.c  -  Don Cross <cosinekitty@gmail.com>
+
+    Resamples the VSOP87 planet models into Chebyshev polynomial segments
+    and writes them to a binary file that the C version of Astronomy Engine
+    can load using Astronomy_LoadChebyshevEphemeris().
+
+    Usage:  chebephem outfile [year_begin year_end]
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "astronomy.h"
+#include "chebyshev.h"
+
+#define CHECK(x)    do{if(0 != (error = (x))) goto fail;}while(0)
+#define FAIL(...)   do{fprintf(stderr, __VA_ARGS__); error = 1; goto fail;}while(0)
+
+#define NBODIES 8
+
+/* These structures must exactly match cheb_ephem_body_t and cheb_ephem_header_t in astronomy.c. */
+typedef struct
+{
+    double  seg_days;
+    int32_t nseg;
+    int32_t npoly;
+    int64_t offset;
+}
+body_header_t;
+
+typedef struct
+{
+    char    signature[8];
+    int32_t byte_order;
+    int32_t nbodies;
+    double  tt_begin;
+    double  reserved;
+    body_header_t body[NBODIES];
+}
+file_header_t;
+
+/*
+    Segment lengths and polynomial counts were tuned so that the
+    Chebyshev fit matches VSOP87 to about 1e-12 AU, which is far below
+    the intrinsic error of the truncated VSOP87 series themselves.
+*/
+typedef struct
+{
+    astro_body_t body;
+    double seg_days;
+    int npoly;
+    double max_error;   /* AU; the generator fails if the fit is worse than this */
+}
+body_config_t;
+
+static const body_config_t Config[NBODIES] =
+{
+    { BODY_MERCURY,    8.0, 14, 1.0e-10 },
+    { BODY_VENUS,     16.0, 12, 1.0e-10 },
+    { BODY_EARTH,     16.0, 12, 1.0e-10 },
+    { BODY_MARS,      32.0, 12, 1.0e-10 },
+    { BODY_JUPITER,  128.0, 12, 1.0e-10 },
+    { BODY_SATURN,   256.0, 12, 1.0e-10 },
+    { BODY_URANUS,   512.0, 12, 1.0e-10 },
+    { BODY_NEPTUNE, 1024.0, 12, 1.0e-10 }
+};
+
+
+static int SampleVsop(const void *context, double tt, double pos[CHEB_MAX_DIM])
+{
+    astro_body_t body = *((const astro_body_t *)context);
+    astro_vector_t vec = Astronomy_HelioVector(body, Astronomy_TerrestrialTime(tt));
+    if (vec.status != ASTRO_SUCCESS)
+        return 1;
+    pos[0] = vec.x;
+    pos[1] = vec.y;
+    pos[2] = vec.z;
+    return 0;
+}
+
+
+static double YearToTT(int year)
+{
+    return Astronomy_MakeTime(year, 1, 1, 0, 0, 0.0).tt;
+}
+
+
+static int WriteBody(FILE *outfile, const body_config_t *config, double tt_begin, int nseg)
+{
+    int error, s, d, i;
+    ChebEncoder encoder;
+    double coeff[CHEB_MAX_DIM][CHEB_MAX_POLYS];
+    double t1, t2, tt, correct[CHEB_MAX_DIM], approx[CHEB_MAX_DIM];
+    double diff, max_diff = 0.0;
+    const int nprobe = 7;
+
+    CHECK(ChebInit(&encoder, config->npoly, 3));
+
+    for (s = 0; s < nseg; ++s)
+    {
+        t1 = tt_begin + s*config->seg_days;
+        t2 = t1 + config->seg_days;
+        CHECK(ChebGenerate(&encoder, SampleVsop, &config->body, t1, t2, coeff));
+
+        for (d = 0; d < 3; ++d)
+            if ((size_t)config->npoly != fwrite(coeff[d], sizeof(double), (size_t)config->npoly, outfile))
+                FAIL("chebephem: Error writing coefficients for %s\n", Astronomy_BodyName(config->body));
+
+        /* Measure how well the polynomials fit the VSOP87 model between the sample points. */
+        for (i = 0; i <= nprobe; ++i)
+        {
+            tt = t1 + (i * config->seg_days) / nprobe;
+            CHECK(SampleVsop(&config->body, tt, correct));
+            ChebApprox(config->npoly, 3, coeff, ChebScale(t1, t2, tt), approx);
+            diff = sqrt(
+                (approx[0]-correct[0])*(approx[0]-correct[0]) +
+                (approx[1]-correct[1])*(approx[1]-correct[1]) +
+                (approx[2]-correct[2])*(approx[2]-correct[2])
+            );
+            if (diff > max_diff)
+                max_diff = diff;
+        }
+    }
+
+    printf("chebephem: %-8s seg_days=%6.0lf  npoly=%2d  nseg=%6d  max_error=%0.3le AU\n",
+        Astronomy_BodyName(config->body), config->seg_days, config->npoly, nseg, max_diff);
+
+    if (max_diff > config->max_error)
+        FAIL("chebephem: EXCESSIVE fit error for %s\n", Astronomy_BodyName(config->body));
+
+    error = 0;
+fail:
+    return error;
+}
+
+
+static int WriteEphemeris(const char *filename, int year1, int year2)
+{
+    int error, b;
+    FILE *outfile = NULL;
+    file_header_t header;
+    double tt_begin, tt_end;
+    int64_t offset;
+
+    if (year2 <= year1)
+        FAIL("chebephem: Invalid year range %d..%d\n", year1, year2);
+
+    tt_begin = YearToTT(year1);
+    tt_end = YearToTT(year2);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.signature, "AECHEB01", sizeof(header.signature));
+    header.byte_order = 0x01020304;
+    header.nbodies = NBODIES;
+    header.tt_begin = tt_begin;
+    offset = sizeof(header);
+    for (b = 0; b < NBODIES; ++b)
+    {
+        header.body[b].seg_days = Config[b].seg_days;
+        header.body[b].nseg = (int32_t)ceil((tt_end - tt_begin) / Config[b].seg_days);
+        header.body[b].npoly = Config[b].npoly;
+        header.body[b].offset = offset;
+        offset += (int64_t)sizeof(double) * 3 * header.body[b].nseg * header.body[b].npoly;
+    }
+
+    outfile = fopen(filename, "wb");
+    if (outfile == NULL)
+        FAIL("chebephem: Cannot open output file: %s\n", filename);
+
+    if (1 != fwrite(&header, sizeof(header), 1, outfile))
+        FAIL("chebephem: Error writing header to file: %s\n", filename);
+
+    for (b = 0; b < NBODIES; ++b)
+        CHECK(WriteBody(outfile, &Config[b], tt_begin, header.body[b].nseg));
+
+    printf("chebephem: Wrote %0.0lf bytes to file %s\n", (double)offset, filename);
+    error = 0;
+fail:
+    if (outfile != NULL)
+    {
+        if (fclose(outfile) && !error)
+        {
+            fprintf(stderr, "chebephem: Error closing file: %s\n", filename);
+            error = 1;
+        }
+    }
+    return error;
+}
+
+
+int main(int argc, const char *argv[])
+{
+    if (argc == 2)
+        return WriteEphemeris(argv[1], 1900, 2100);
+
+    if (argc == 4)
+        return WriteEphemeris(argv[1], atoi(argv[2]), atoi(argv[3]));
+
+    fprintf(stderr, "USAGE: chebephem outfile [year_begin year_end]\n");
+    return 1;
+}
@@ -38,6 +38,7 @@
 #define IAU_DATA_NUM_ROWS    77
 #define IAU_DATA_KEEP_ROWS    5
 #define ADDSOL_DATA_PER_ROW   8
+#define ADDN_DATA_PER_ROW     5
 
 typedef struct
 {
@@ -1180,6 +1181,189 @@ fail:
     return error;
 }
 
+static int OptAddSolTableC(cg_context_t *context)
+{
+    int error = 1;
+    FILE *infile;
+    int lnum, i;
+    const char *filename = "model_data/addsol.txt";
+    char line[200];
+    double data[ADDSOL_DATA_PER_ROW];
+
+    if (context->language != CODEGEN_LANGUAGE_C)
+        return LogError(context, "OptAddSolTableC: Unsupported language %d\n", context->language);
+
+    infile = fopen(filename, "rt");
+    if (infile == NULL) goto fail;
+
+    fprintf(context->outfile, "static const moon_addsol_t MoonAddSolTable[] =\n{");
+
+    lnum = 0;
+    while (fgets(line, sizeof(line), infile))
+    {
+        ++lnum;
+        CHECK(ScanRealArray(context, filename, lnum, line, ADDSOL_DATA_PER_ROW, data));
+        fprintf(context->outfile, "%s\n    {", (lnum > 1) ? "," : "");
+        for (i=0; i < 4; ++i)
+            fprintf(context->outfile, "%11.4lf,", data[i]);
+        for(; i < 8; ++i)
+            fprintf(context->outfile, "%2.0lf%s", data[i], (i < 7) ? "," : " }");
+    }
+
+    fprintf(context->outfile, "\n};");
+    error = 0;
+fail:
+    if (infile == NULL)
+        error = LogError(context, "Cannot open input file: %s", filename);
+    else
+        fclose(infile);
+
+    return error;
+}
+
+static int OptAddN(cg_context_t *context, int table)
+{
+    int error = 1;
+    FILE *infile;
+    int lnum, i;
+    const char *filename = "model_data/addn.txt";
+    char line[200];
+    double data[ADDN_DATA_PER_ROW];
+
+    if (context->language != CODEGEN_LANGUAGE_C)
+        return LogError(context, "OptAddN: Unsupported language %d\n", context->language);
+
+    infile = fopen(filename, "rt");
+    if (infile == NULL) goto fail;
+
+    if (table)
+        fprintf(context->outfile, "static const moon_addn_t MoonAddnTable[] =\n{");
+
+    lnum = 0;
+    while (fgets(line, sizeof(line), infile))
+    {
+        ++lnum;
+        CHECK(ScanRealArray(context, filename, lnum, line, ADDN_DATA_PER_ROW, data));
+        if (table)
+            fprintf(context->outfile, "%s\n    { ", (lnum > 1) ? "," : "");
+        else
+            fprintf(context->outfile, "%s    ADDN(", (lnum > 1) ? "\n" : "");
+
+        fprintf(context->outfile, "%+8.3lf", data[0]);
+        for (i=1; i < ADDN_DATA_PER_ROW; ++i)
+        {
+            if (data[i] == 0.0)
+                fprintf(context->outfile, ", 0");
+            else
+                fprintf(context->outfile, ",%+2.0lf", data[i]);
+        }
+
+        fprintf(context->outfile, table ? " }" : ");");
+    }
+
+    if (table)
+        fprintf(context->outfile, "\n};");
+
+    error = 0;
+fail:
+    if (infile == NULL)
+        error = LogError(context, "Cannot open input file: %s", filename);
+    else
+        fclose(infile);
+
+    return error;
+}
+
+static int OptAddNC(cg_context_t *context)
+{
+    return OptAddN(context, 0);
+}
+
+static int OptAddNTableC(cg_context_t *context)
+{
+    return OptAddN(context, 1);
+}
+
+#define MAX_APSIS_BODIES      2
+#define MAX_APSIS_ENTRIES   100
+
+static int OptApsisTableC(cg_context_t *context)
+{
+    int error = 1;
+    FILE *infile;
+    int lnum, i, b, kind, nbodies = 0;
+    const char *filename = "output/apsis_table.txt";
+    char line[200];
+    char name[MAX_APSIS_BODIES][20];
+    int first_kind[MAX_APSIS_BODIES];
+    int count[MAX_APSIS_BODIES];
+    double tt[MAX_APSIS_BODIES][MAX_APSIS_ENTRIES];
+    char body[20];
+    double t;
+
+    if (context->language != CODEGEN_LANGUAGE_C)
+        return LogError(context, "OptApsisTableC: Unsupported language %d\n", context->language);
+
+    infile = fopen(filename, "rt");
+    if (infile == NULL) goto fail;
+
+    lnum = 0;
+    while (fgets(line, sizeof(line), infile))
+    {
+        ++lnum;
+        if (3 != sscanf(line, "%19s %d %lf", body, &kind, &t) || kind < 0 || kind > 1)
+            CHECK(LogError(context, "OptApsisTableC(%s %d): bad syntax", filename, lnum));
+
+        for (b = 0; b < nbodies && strcmp(name[b], body); ++b);
+        if (b == nbodies)
+        {
+            if (nbodies == MAX_APSIS_BODIES)
+                CHECK(LogError(context, "OptApsisTableC(%s %d): too many bodies", filename, lnum));
+            strcpy(name[b], body);
+            first_kind[b] = kind;
+            count[b] = 0;
+            ++nbodies;
+        }
+        else if (b != nbodies-1)
+            CHECK(LogError(context, "OptApsisTableC(%s %d): %s entries are not contiguous", filename, lnum, body));
+        else if (kind != (first_kind[b] + count[b]) % 2)
+            CHECK(LogError(context, "OptApsisTableC(%s %d): apsis kinds do not alternate", filename, lnum));
+        else if (t <= tt[b][count[b]-1])
+            CHECK(LogError(context, "OptApsisTableC(%s %d): times are not increasing", filename, lnum));
+
+        if (count[b] == MAX_APSIS_ENTRIES)
+            CHECK(LogError(context, "OptApsisTableC(%s %d): too many entries", filename, lnum));
+        tt[b][count[b]++] = t;
+    }
+
+    for (b = 0; b < nbodies; ++b)
+    {
+        fprintf(context->outfile, "static const double %sApsisTable[] =\n{\n", name[b]);
+        for (i = 0; i < count[b]; ++i)
+            fprintf(context->outfile, "%s%12.3lf", (i == 0) ? "    " : (i % 5 == 0) ? ",\n    " : ", ", tt[b][i]);
+        fprintf(context->outfile, "\n};\n\n");
+    }
+
+    for (b = 0; b < nbodies; ++b)
+    {
+        fprintf(context->outfile, "%sstatic const apsis_table_t %sApsides = { %s, %d, %sApsisTable };",
+            (b > 0) ? "\n" : "",
+            name[b],
+            (first_kind[b] == 0) ? "APSIS_PERICENTER" : "APSIS_APOCENTER",
+            count[b],
+            name[b]);
+    }
+
+    error = 0;
+fail:
+    if (infile == NULL)
+        error = LogError(context, "Cannot open input file: %s", filename);
+    else
+        fclose(infile);
+
+    return error;
+}
+
 static double RoundAngle(double x)
 {
     /*
@@ -2180,6 +2364,10 @@ static const cg_directive_entry DirectiveTable[] =
     { "PYTHON_VSOP",        PythonVsop          },
     { "IAU_DATA",           OptIauData          },
     { "ADDSOL",             OptAddSol           },
+    { "C_ADDSOL_TABLE",     OptAddSolTableC     },
+    { "C_ADDN",             OptAddNC            },
+    { "C_ADDN_TABLE",       OptAddNTableC       },
+    { "C_APSIS_TABLE",      OptApsisTableC      },
     { "CONSTEL",            ConstellationData   },
     { "C_PLUTO_CONST",      PlutoConstants_C    },
     { "PLUTO_TABLE",        PlutoStateTable     },
@@ -10,6 +10,12 @@
 #include <string.h>
 #include <math.h>
 #include <ctype.h>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
 #include "astronomy.h"
 
 char *ReadLine(char *s, int n, FILE *f, const char *filename, int lnum)
@@ -80,6 +86,7 @@ static int CheckEquator(int lnum, astro_equatorial_t equ)
 #define CHECK_VECTOR(var,expr)   CHECK(CheckVector(__LINE__, ((var) = (expr))))
 #define CHECK_EQU(var,expr)      CHECK(CheckEquator(__LINE__, ((var) = (expr))))
 #define CHECK_STATUS(expr)       CHECK(CheckStatus(__LINE__, #expr, (expr).status))
+#define CHECK_CODE(expr)         CHECK(CheckStatus(__LINE__, #expr, (expr)))
 
 static double v(const char *filename, int lnum, double x)
 {
@@ -197,15 +204,31 @@ static int MoonReverse(void);
 static int MoonNodes(void);
 static int MoonVector(void);
 static int MoonEcliptic(void);
+static int MoonCacheTest(void);
+static int MoonBatchTest(void);
+static int OrientationCacheTest(void);
+static int HorizonGridTest(void);
+static int AlmanacTest(void);
+static int SearchAllTest(void);
+static int SearchBudgetTest(void);
+static int SearchBudgetContextTest(void);
+static int SearchBudgetThreadTest(void);
+static int SearchDerivTest(void);
 static int RiseSet(void);
 static int RiseSetElevation(void);
 static int RiseSetReverse(void);
 static int LunarApsis(void);
 static int EarthApsis(void);
 static int PlanetApsis(void);
+static int EventIteratorTest(void);
+static int OuterApsisTest(void);
 static int PlutoCheck(void);
+static int PlutoFarTest(void);
+static int PlutoFileTest(void);
 static int ElongationTest(void);
 static int MagnitudeTest(void);
+static int MajorBodyCacheTest(void);
+static int KeplerTest(void);
 static int MoonTest(void);
 static int RotationTest(void);
 static int TestMaxMag(astro_body_t body, const char *filename);
@@ -219,6 +242,9 @@ static int LunarFractionTest(void);
 static int SolarFractionTest(void);
 static int GlobalSolarEclipseTest(void);
 static int GravitySimulatorTest(void);
+static int GravSimAdaptiveTest(void);
+static int GravSimCheckpointTest(void);
+static int GravSimStreamTest(void);
 static int PlotDeltaT(const char *outFileName);
 static double AngleDiff(double alat, double alon, double blat, double blon);
 static int LocalSolarEclipseTest(void);
@@ -231,23 +257,31 @@ static int JupiterMoonsTest(void);
 static int Issue103(void);
 static int AberrationTest(void);
 static int BaryStateTest(void);
+static int BatchTest(void);
+static int ContextTest(void);
 static int HelioStateTest(void);
 static int LagrangeTest(void);
 static int LagrangeJplAnalysis(void);
 static int TopoStateTest(void);
 static int Twilight(void);
+static int AltitudeGrazeTest(void);
 static int LibrationTest(void);
 static int DE405_Check(void);
 static int AxisTest(void);
 static int SiderealTimeTest(void);
 static int DatesIssue250(void);
 static int StarRiseSetCulm(void);
+static int StarAltitudeTest(void);
 static int MapPerformanceTest(void);
 static int GeoMoonPerformance(void);
+static int MoonCachePerformance(void);
 static int NutationPerformance(void);
 static int EclipticTest(void);
 static int HourAngleTest(void);
 static int Atmosphere(void);
+static int ChebEphemTest(const char *filename);
+static int EclipseCatalogTest(const char *filename);
+static int CalendarTableTest(const char *filename);
 
 typedef int (* unit_test_func_t) (void);
 
@@ -264,23 +298,33 @@ unit_test_t;
 static unit_test_t UnitTests[] =
 {
     {"aberration",              AberrationTest},
+    {"almanac",                 AlmanacTest},
+    {"altitude_graze",          AltitudeGrazeTest},
     {"atmosphere",              Atmosphere},
     {"axis",                    AxisTest},
     {"barystate",               BaryStateTest},
+    {"batch",                   BatchTest},
     {"check",                   AstroCheck},
     {"constellation",           ConstellationTest},
+    {"context",                 ContextTest},
     {"dates250",                DatesIssue250},
     {"de405",                   DE405_Check},
     {"earth_apsis",             EarthApsis},
     {"ecliptic",                EclipticTest},
     {"elongation",              ElongationTest},
+    {"event_iter",              EventIteratorTest},
     {"geoid",                   GeoidTest},
     {"global_solar_eclipse",    GlobalSolarEclipseTest},
     {"gravsim",                 GravitySimulatorTest},
+    {"gravsim_adaptive",        GravSimAdaptiveTest},
+    {"gravsim_checkpoint",      GravSimCheckpointTest},
+    {"gravsim_stream",          GravSimStreamTest},
     {"heliostate",              HelioStateTest},
+    {"horizon_grid",            HorizonGridTest},
     {"hour_angle",              HourAngleTest},
     {"issue_103",               Issue103},
     {"jupiter_moons",           JupiterMoonsTest},
+    {"kepler",                  KeplerTest},
     {"lagrange",                LagrangeTest},
     {"lagrange_jpl",            LagrangeJplAnalysis},
     {"libration",               LibrationTest},
@@ -289,9 +333,13 @@ static unit_test_t UnitTests[] =
     {"lunar_eclipse_78",        LunarEclipseIssue78},
     {"lunar_fraction",          LunarFractionTest},
     {"magnitude",               MagnitudeTest},
+    {"major_cache",             MajorBodyCacheTest},
     {"map",                     MapPerformanceTest,     EXCLUDE_FROM_AUTOMATED_TESTS},
     {"moon",                    MoonTest},
     {"moon_apsis",              LunarApsis},
+    {"moon_batch",              MoonBatchTest},
+    {"moon_cache",              MoonCacheTest},
+    {"moon_cache_performance",  MoonCachePerformance,   EXCLUDE_FROM_AUTOMATED_TESTS},
     {"moon_ecm",                MoonEcliptic},
     {"moon_nodes",              MoonNodes},
     {"moon_performance",        GeoMoonPerformance,     EXCLUDE_FROM_AUTOMATED_TESTS},
@@ -299,17 +347,27 @@ static unit_test_t UnitTests[] =
     {"moon_reverse",            MoonReverse},
     {"moon_vector",             MoonVector},
     {"nutation",                NutationPerformance,    EXCLUDE_FROM_AUTOMATED_TESTS},
+    {"orientation_cache",       OrientationCacheTest},
+    {"outer_apsis",             OuterApsisTest},
     {"planet_apsis",            PlanetApsis},
     {"pluto",                   PlutoCheck},
+    {"pluto_far",               PlutoFarTest},
+    {"pluto_file",              PlutoFileTest},
     {"refraction",              RefractionTest},
     {"riseset",                 RiseSet},
     {"riseset_elevation",       RiseSetElevation},
     {"riseset_reverse",         RiseSetReverse},
     {"rotation",                RotationTest},
+    {"search_all",              SearchAllTest},
+    {"search_budget",           SearchBudgetTest},
+    {"search_budget_ctx",       SearchBudgetContextTest},
+    {"search_budget_threads",   SearchBudgetThreadTest},
+    {"search_deriv",            SearchDerivTest},
     {"seasons",                 SeasonsTest},
     {"seasons187",              SeasonsIssue187},
     {"sidereal",                SiderealTimeTest},
     {"solar_fraction",          SolarFractionTest},
+    {"star_altitude",           StarAltitudeTest},
     {"star_risesetculm",        StarRiseSetCulm},
     {"time",                    Test_AstroTime},
     {"topostate",               TopoStateTest},
@@ -372,6 +430,24 @@ int main(int argc, const char *argv[])
                 CHECK(PlotDeltaT(filename));
                 goto success;
             }
+
+            if (!strcmp(verb, "cheb_ephem"))
+            {
+                CHECK(ChebEphemTest(filename));
+                goto success;
+            }
+
+            if (!strcmp(verb, "eclipse_catalog"))
+            {
+                CHECK(EclipseCatalogTest(filename));
+                goto success;
+            }
+
+            if (!strcmp(verb, "calendar_table"))
+            {
+                CHECK(CalendarTableTest(filename));
+                goto success;
+            }
         }
 
         if (argc == 5)
@@ -2430,2974 +2506,3262 @@ fail:
 }
 
 
-static int CheckIlluminationInvalidBody(astro_body_t body)
+static int MoonCacheTest(void)
 {
-    astro_illum_t illum;
-    astro_time_t time = Astronomy_MakeTime(2021, 11, 10, 0, 8, 16.0);
+    int error, i, k;
+    astro_status_t status;
+    astro_context_t *ctx[2] = { NULL, NULL };
+    astro_time_t time;
+    astro_vector_t a, b, c;
+    astro_spherical_t ea, eb;
+    astro_state_vector_t sa, sb;
+    double diff, max_pos = 0.0, max_vel = 0.0, max_ecl = 0.0;
 
-    /* Verify that invalid bodies return errors. */
+    for (k = 0; k < 2; ++k)
+        if (ASTRO_SUCCESS != Astronomy_ContextCreate(&ctx[k]))
+            FFAIL("Cannot create context %d\n", k);
 
-    illum = Astronomy_Illumination(body, time);
-    if (illum.status == ASTRO_SUCCESS)
-        FAILRET("C %s: FAILURE -- incorrect success status for body %d\n", __func__, (int)body);
+    if (ASTRO_INVALID_PARAMETER != Astronomy_ContextSetMoonCache(ctx[0], -1))
+        FFAIL("Negative cache size should have been rejected.\n");
 
-    return 0;   /* Correct behavior. */
-}
+    /* With the cache disabled, results must be identical to the default context. */
+    for (i = 0; i < 20; ++i)
+    {
+        time = Astronomy_TerrestrialTime(-50000.0 + 5000.3*i);
+        CHECK_VECTOR(a, Astronomy_GeoMoon(time));
+        CHECK_VECTOR(b, Astronomy_GeoMoonCtx(ctx[0], time));
+        if (a.x != b.x || a.y != b.y || a.z != b.z)
+            FFAIL("Uncached GeoMoonCtx mismatch at i=%d\n", i);
+    }
 
-static int MagnitudeTest(void)
-{
-    int nfailed = 0;
+    /* A large cache and a tiny cache must produce identical results, no matter how often segments are evicted. */
+    for (k = 0; k < 2; ++k)
+    {
+        status = Astronomy_ContextSetMoonCache(ctx[k], (k == 0) ? 4096 : 3);
+        if (status != ASTRO_SUCCESS)
+            FFAIL("Astronomy_ContextSetMoonCache returned status %d\n", status);
+    }
 
-    nfailed += CheckIlluminationInvalidBody(BODY_INVALID);
-    nfailed += CheckIlluminationInvalidBody(BODY_EARTH);
-    nfailed += CheckIlluminationInvalidBody(BODY_EMB);
-    nfailed += CheckIlluminationInvalidBody(BODY_SSB);
-    nfailed += CheckIlluminationInvalidBody((astro_body_t)2112);
+    for (i = 0; i < 3000; ++i)
+    {
+        time = Astronomy_TerrestrialTime(-400000.0 + 267.3*i + 0.0123*i*i);
+
+        CHECK_VECTOR(a, Astronomy_GeoMoon(time));
+        CHECK_VECTOR(b, Astronomy_GeoMoonCtx(ctx[0], time));
+        CHECK_VECTOR(c, Astronomy_GeoMoonCtx(ctx[1], time));
+        if (b.x != c.x || b.y != c.y || b.z != c.z)
+            FFAIL("Cache size changed the result at tt=%0.6lf\n", time.tt);
+        diff = V(sqrt((a.x-b.x)*(a.x-b.x) + (a.y-b.y)*(a.y-b.y) + (a.z-b.z)*(a.z-b.z)));
+        if (diff > max_pos)
+            max_pos = diff;
+
+        CHECK_VECTOR(c, Astronomy_GeoVectorCtx(ctx[0], BODY_MOON, time, NO_ABERRATION));
+        if (b.x != c.x || b.y != c.y || b.z != c.z)
+            FFAIL("GeoVectorCtx(Moon) did not use the lunar cache at tt=%0.6lf\n", time.tt);
+
+        sa = Astronomy_GeoMoonState(time);
+        CHECK_STATUS(sa);
+        sb = Astronomy_GeoMoonStateCtx(ctx[0], time);
+        CHECK_STATUS(sb);
+        if (sb.x != b.x || sb.y != b.y || sb.z != b.z)
+            FFAIL("GeoMoonStateCtx position does not match GeoMoonCtx at tt=%0.6lf\n", time.tt);
+        diff = V(sqrt((sa.vx-sb.vx)*(sa.vx-sb.vx) + (sa.vy-sb.vy)*(sa.vy-sb.vy) + (sa.vz-sb.vz)*(sa.vz-sb.vz)));
+        if (diff > max_vel)
+            max_vel = diff;
+
+        ea = Astronomy_EclipticGeoMoon(time);
+        CHECK_STATUS(ea);
+        eb = Astronomy_EclipticGeoMoonCtx(ctx[0], time);
+        CHECK_STATUS(eb);
+        diff = fabs(ea.lon - eb.lon);
+        if (diff > 180.0)
+            diff = 360.0 - diff;
+        diff = V(diff + fabs(ea.lat - eb.lat));
+        if (diff > max_ecl)
+            max_ecl = diff;
+        if (V(fabs(ea.dist - eb.dist)) > 1.0e-12)
+            FFAIL("EclipticGeoMoonCtx distance error %le AU at tt=%0.6lf\n", fabs(ea.dist - eb.dist), time.tt);
+    }
 
-    nfailed += CheckMagnitudeData(BODY_SUN,     "magnitude/Sun.txt");
-    nfailed += CheckMagnitudeData(BODY_MOON,    "magnitude/Moon.txt");
-    nfailed += CheckMagnitudeData(BODY_MERCURY, "magnitude/Mercury.txt");
-    nfailed += CheckMagnitudeData(BODY_VENUS,   "magnitude/Venus.txt");
-    nfailed += CheckMagnitudeData(BODY_MARS,    "magnitude/Mars.txt");
-    nfailed += CheckMagnitudeData(BODY_JUPITER, "magnitude/Jupiter.txt");
-    nfailed += CheckSaturn();
-    nfailed += CheckMagnitudeData(BODY_URANUS,  "magnitude/Uranus.txt");
-    nfailed += CheckMagnitudeData(BODY_NEPTUNE, "magnitude/Neptune.txt");
-    nfailed += CheckMagnitudeData(BODY_PLUTO,   "magnitude/Pluto.txt");
+    DEBUG("C MoonCacheTest: max_pos = %le AU, max_vel = %le AU/day, max_ecl = %le deg\n", max_pos, max_vel, max_ecl);
 
-    nfailed += TestMaxMag(BODY_VENUS, "magnitude/maxmag_Venus.txt");
+    if (max_pos > 1.0e-12)
+        FFAIL("EXCESSIVE position error = %le AU\n", max_pos);
 
-    if (nfailed == 0)
-        printf("C %s: PASS\n", __func__);
-    else
-        fprintf(stderr, "C %s: FAILED %d test(s).\n", __func__, nfailed);
+    if (max_vel > 2.0e-8)
+        FFAIL("EXCESSIVE velocity error = %le AU/day\n", max_vel);
 
-    return nfailed;
-}
+    if (max_ecl > 3.0e-8)
+        FFAIL("EXCESSIVE ecliptic angle error = %le degrees\n", max_ecl);
 
-static int TestMaxMag(astro_body_t body, const char *filename)
-{
-    int error = 1;
-    FILE *infile = NULL;
-    int lnum, nscanned;
-    int year1, month1, day1, hour1, minute1;
-    int year2, month2, day2, hour2, minute2;
-    double correct_mag, correct_angle1, correct_angle2;
-    char line[100];
-    astro_time_t search_time, time1, time2, center_time;
-    astro_illum_t illum;
-    double mag_diff, hours_diff;
+    FPASS();
+fail:
+    Astronomy_ContextFree(ctx[0]);
+    Astronomy_ContextFree(ctx[1]);
+    return error;
+}
 
-    /*
-        Example of input data:
 
-        2001-02-21T08:00Z 2001-02-27T08:00Z 23.17 19.53 -4.84
+static int MoonBatchTest(void)
+{
+    int error;
+    size_t i, n;
+    astro_time_t times[23];
+    double xyz[3*23];
+    astro_vector_t vec;
+    double dx, dy, dz, diff, max_diff = 0.0;
 
-        JPL Horizons test data has limited floating point precision in the magnitude values.
-        There is a pair of dates for the beginning and end of the max magnitude period,
-        given the limited precision. We pick the point halfway between as the supposed max magnitude time.
-    */
+    if (ASTRO_INVALID_PARAMETER != Astronomy_GeoMoonBatch(NULL, 1, xyz))
+        FFAIL("Astronomy_GeoMoonBatch should have rejected NULL times.\n");
 
-    infile = fopen(filename, "rt");
-    if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", filename);
+    if (ASTRO_SUCCESS != Astronomy_GeoMoonBatch(NULL, 0, NULL))
+        FFAIL("Astronomy_GeoMoonBatch should have accepted an empty array.\n");
 
-    lnum = 0;
-    search_time = Astronomy_MakeTime(2001, 1, 1, 0, 0, 0.0);
-    while (ReadLine(line, sizeof(line), infile, filename, lnum))
+    /* Exercise full batches and every size of partial final batch. */
+    for (n = 1; n <= 23; ++n)
     {
-        ++lnum;
+        for (i = 0; i < n; ++i)
+            times[i] = Astronomy_TerrestrialTime(-80000.0 + 7919.37*i + 0.713*n);
 
-        nscanned = sscanf(line, "%d-%d-%dT%d:%dZ %d-%d-%dT%d:%dZ %lf %lf %lf\n",
-            &year1, &month1, &day1, &hour1, &minute1,
-            &year2, &month2, &day2, &hour2, &minute2,
-            &correct_angle1, &correct_angle2, &correct_mag);
+        CHECK(Astronomy_GeoMoonBatch(times, n, xyz));
 
-        if (nscanned != 13)
-            FLNFAIL("invalid data format.\n");
+        for (i = 0; i < n; ++i)
+        {
+            CHECK_VECTOR(vec, Astronomy_GeoMoon(times[i]));
+            dx = xyz[i] - vec.x;
+            dy = xyz[n+i] - vec.y;
+            dz = xyz[2*n+i] - vec.z;
+            diff = V(sqrt(dx*dx + dy*dy + dz*dz));
+            if (diff > max_diff)
+                max_diff = diff;
+        }
+    }
 
-        time1 = Astronomy_MakeTime(year1, month1, day1, hour1, minute1, 0.0);
-        time2 = Astronomy_MakeTime(year2, month2, day2, hour2, minute2, 0.0);
-        center_time = Astronomy_AddDays(time1, 0.5*(time2.ut - time1.ut));
+    DEBUG("C MoonBatchTest: max_diff = %0.3le AU\n", max_diff);
+    if (max_diff > 1.0e-14)
+        FFAIL("EXCESSIVE difference from Astronomy_GeoMoon: %0.3le AU\n", max_diff);
 
-        illum = Astronomy_SearchPeakMagnitude(body, search_time);
-        if (illum.status != ASTRO_SUCCESS)
-            FLNFAIL("SearchPeakMagnitude returned %d\n", illum.status);
+    FPASS();
+fail:
+    return error;
+}
 
-        mag_diff = ABS(illum.mag - correct_mag);
-        hours_diff = 24.0 * ABS(illum.time.ut - center_time.ut);
-        FDEBUG("mag_diff=%0.3lf, hours_diff=%0.3lf\n", mag_diff, hours_diff);
-        if (hours_diff > 7.1)
-            FLNFAIL("EXCESSIVE TIME DIFFERENCE.\n");
 
-        if (mag_diff > 0.005)
-            FLNFAIL("EXCESSIVE MAGNITUDE DIFFERENCE.\n");
+static int OrientationCacheTest(void)
+{
+    int error, i, k, r, c;
+    astro_status_t status;
+    astro_context_t *ctx[2] = { NULL, NULL };
+    astro_time_t time, ta, tb, tc;
+    astro_rotation_t ra, rb, rc;
+    astro_equatorial_t ea, eb;
+    astro_observer_t observer = Astronomy_MakeObserver(-33.9, 18.4, 25.0);
+    double diff, sa, sb, sc, max_rot = 0.0, max_st = 0.0, max_equ = 0.0;
+
+    for (k = 0; k < 2; ++k)
+        if (ASTRO_SUCCESS != Astronomy_ContextCreate(&ctx[k]))
+            FFAIL("Cannot create context %d\n", k);
+
+    if (ASTRO_INVALID_PARAMETER != Astronomy_ContextSetOrientationCache(ctx[0], -1))
+        FFAIL("Negative cache size should have been rejected.\n");
+
+    /* With the cache disabled, results must be identical to the default context. */
+    for (i = 0; i < 20; ++i)
+    {
+        ta = tb = Astronomy_TerrestrialTime(-50000.0 + 5000.3*i);
+        ra = Astronomy_Rotation_EQJ_EQD(&ta);
+        rb = Astronomy_Rotation_EQJ_EQDCtx(ctx[0], &tb);
+        CHECK_STATUS(rb);
+        for (r = 0; r < 3; ++r)
+            for (c = 0; c < 3; ++c)
+                if (ra.rot[r][c] != rb.rot[r][c])
+                    FFAIL("Uncached Rotation_EQJ_EQDCtx mismatch at i=%d\n", i);
+
+        if (Astronomy_SiderealTime(&ta) != Astronomy_SiderealTimeCtx(ctx[0], &tb))
+            FFAIL("Uncached SiderealTimeCtx mismatch at i=%d\n", i);
+
+        ta = tb = Astronomy_TerrestrialTime(-50000.0 + 5000.3*i);
+        ea = Astronomy_Equator(BODY_MARS, &ta, observer, EQUATOR_OF_DATE, ABERRATION);
+        CHECK_STATUS(ea);
+        eb = Astronomy_EquatorCtx(ctx[0], BODY_MARS, &tb, observer, EQUATOR_OF_DATE, ABERRATION);
+        CHECK_STATUS(eb);
+        if (ea.ra != eb.ra || ea.dec != eb.dec || ea.dist != eb.dist)
+            FFAIL("Uncached EquatorCtx mismatch at i=%d\n", i);
+    }
 
-        search_time = time2;
+    /* A large cache and a tiny cache must produce identical results, no matter how often segments are evicted. */
+    for (k = 0; k < 2; ++k)
+    {
+        status = Astronomy_ContextSetOrientationCache(ctx[k], (k == 0) ? 4096 : 2);
+        if (status != ASTRO_SUCCESS)
+            FFAIL("Astronomy_ContextSetOrientationCache returned status %d\n", status);
     }
 
-    FPASSA("processed %d lines from file %s\n", lnum, filename);
-fail:
-    if (infile != NULL) fclose(infile);
-    return error;
-}
+    for (i = 0; i < 5000; ++i)
+    {
+        time = Astronomy_TerrestrialTime(-1500000.0 + 311.7*i + 0.0527*i*i);
+
+        ta = tb = tc = time;
+        ra = Astronomy_Rotation_EQJ_EQD(&ta);
+        rb = Astronomy_Rotation_EQJ_EQDCtx(ctx[0], &tb);
+        CHECK_STATUS(rb);
+        rc = Astronomy_Rotation_EQJ_EQDCtx(ctx[1], &tc);
+        CHECK_STATUS(rc);
+        for (r = 0; r < 3; ++r)
+        {
+            for (c = 0; c < 3; ++c)
+            {
+                if (rb.rot[r][c] != rc.rot[r][c])
+                    FFAIL("Cache size changed the rotation at tt=%0.6lf\n", time.tt);
+                diff = V(fabs(ra.rot[r][c] - rb.rot[r][c]));
+                if (diff > max_rot)
+                    max_rot = diff;
+            }
+        }
 
-/*-----------------------------------------------------------------------------------------------------------*/
+        sa = Astronomy_SiderealTime(&ta);
+        sb = Astronomy_SiderealTimeCtx(ctx[0], &tb);
+        sc = Astronomy_SiderealTimeCtx(ctx[1], &tc);
+        if (sb != sc)
+            FFAIL("Cache size changed the sidereal time at tt=%0.6lf\n", time.tt);
+        diff = fabs(sa - sb);
+        if (diff > 12.0)
+            diff = 24.0 - diff;
+        diff = V(diff);
+        if (diff > max_st)
+            max_st = diff;
+
+        ta = tb = time;
+        ea = Astronomy_Equator(BODY_MOON, &ta, observer, EQUATOR_OF_DATE, ABERRATION);
+        CHECK_STATUS(ea);
+        eb = Astronomy_EquatorCtx(ctx[0], BODY_MOON, &tb, observer, EQUATOR_OF_DATE, ABERRATION);
+        CHECK_STATUS(eb);
+        diff = V(sqrt(
+            (ea.vec.x - eb.vec.x)*(ea.vec.x - eb.vec.x) +
+            (ea.vec.y - eb.vec.y)*(ea.vec.y - eb.vec.y) +
+            (ea.vec.z - eb.vec.z)*(ea.vec.z - eb.vec.z)) / ea.dist);
+        if (diff > max_equ)
+            max_equ = diff;
+    }
 
-static int ParseMonthName(const char *mtext, int *month)
-{
-    if (month == NULL)
-        return 1;
+    DEBUG("C OrientationCacheTest: max_rot = %le, max_st = %le hours, max_equ = %le radians\n", max_rot, max_st, max_equ);
 
-    *month = -1;
+    if (max_rot > 1.0e-14)
+        FFAIL("EXCESSIVE rotation matrix error = %le\n", max_rot);
 
-    if (mtext == NULL)
-        return 2;
+    if (max_st > 1.0e-13)
+        FFAIL("EXCESSIVE sidereal time error = %le hours\n", max_st);
 
-    if (!strcmp(mtext, "Jan"))
-        *month = 1;
-    else if (!strcmp(mtext, "Feb"))
-        *month = 2;
-    else if (!strcmp(mtext, "Mar"))
-        *month = 3;
-    else if (!strcmp(mtext, "Apr"))
-        *month = 4;
-    else if (!strcmp(mtext, "May"))
-        *month = 5;
-    else if (!strcmp(mtext, "Jun"))
-        *month = 6;
-    else if (!strcmp(mtext, "Jul"))
-        *month = 7;
-    else if (!strcmp(mtext, "Aug"))
-        *month = 8;
-    else if (!strcmp(mtext, "Sep"))
-        *month = 9;
-    else if (!strcmp(mtext, "Oct"))
-        *month = 10;
-    else if (!strcmp(mtext, "Nov"))
-        *month = 11;
-    else if (!strcmp(mtext, "Dec"))
-        *month = 12;
-    else
-        return 3;
+    if (max_equ > 1.0e-14)
+        FFAIL("EXCESSIVE equatorial direction error = %le radians\n", max_equ);
 
-    return 0;   /* success */
+    FPASS();
+fail:
+    Astronomy_ContextFree(ctx[0]);
+    Astronomy_ContextFree(ctx[1]);
+    return error;
 }
 
-static const char *ParseJplHorizonsDateTime(const char *text, astro_time_t *time)
+
+static int HorizonGridTest(void)
 {
-    int year, month, day, hour, minute;
-    int nscanned;
-    char mtext[4];
-    char verify[30];
-    size_t length;
+    int error, b, r, i, k;
+    astro_status_t status;
+    astro_time_t time;
+    astro_observer_t observer;
+    astro_equatorial_t equ;
+    astro_horizon_t hor;
+    double latitudes[12], longitudes[13], altitude[12*13], azimuth[12*13];
+    double diff, max_alt = 0.0, max_az = 0.0;
+    static const astro_body_t bodies[] = { BODY_SUN, BODY_MOON, BODY_MARS };
+    static const astro_refraction_t refr[] = { REFRACTION_NONE, REFRACTION_NORMAL };
 
-    time->ut = time->tt = NAN;
+    for (i = 0; i < 12; ++i)
+        latitudes[i] = -89.0 + 16.1*i;
 
-    while (*text == ' ')
-        ++text;
+    for (k = 0; k < 13; ++k)
+        longitudes[k] = -180.0 + 27.9*k;
 
-    nscanned = sscanf(text, "%d-%3[A-Za-z]-%d %d:%d", &year, mtext, &day, &hour, &minute);
-    if (nscanned != 5)
-        return NULL;
+    time = Astronomy_MakeTime(2022, 1, 22, 12, 30, 0.0);
+    status = Astronomy_HorizonGrid(BODY_SUN, &time, latitudes, 12, NULL, 13, 0.0, ABERRATION, REFRACTION_NONE, altitude, NULL);
+    if (status != ASTRO_INVALID_PARAMETER)
+        FFAIL("Expected ASTRO_INVALID_PARAMETER for NULL longitudes, but found %d\n", status);
 
-    if (year < 1000 || year > 9999)
-        return NULL;       /* if not a 4-digit year, we are skipping wrong number of chars */
+    for (b = 0; b < 3; ++b)
+    {
+        for (r = 0; r < 2; ++r)
+        {
+            time = Astronomy_MakeTime(2022, 1, 22 + 3*b, 12 + r, 30, 0.0);
+            status = Astronomy_HorizonGrid(bodies[b], &time, latitudes, 12, longitudes, 13, 250.0, ABERRATION, refr[r], altitude, azimuth);
+            if (status != ASTRO_SUCCESS)
+                FFAIL("Astronomy_HorizonGrid returned status %d\n", status);
 
-    if (day < 1 || day > 31)
-        return NULL;
+            for (i = 0; i < 12; ++i)
+            {
+                for (k = 0; k < 13; ++k)
+                {
+                    observer = Astronomy_MakeObserver(latitudes[i], longitudes[k], 250.0);
+                    equ = Astronomy_Equator(bodies[b], &time, observer, EQUATOR_OF_DATE, ABERRATION);
+                    CHECK_STATUS(equ);
+                    hor = Astronomy_Horizon(&time, observer, equ.ra, equ.dec, refr[r]);
+
+                    diff = V(fabs(hor.altitude - altitude[13*i + k]));
+                    if (diff > max_alt)
+                        max_alt = diff;
+
+                    /* Azimuth is poorly defined near the zenith and nadir. */
+                    if (fabs(hor.altitude) < 89.0)
+                    {
+                        diff = V(fabs(hor.azimuth - azimuth[13*i + k]));
+                        if (diff > 180.0)
+                            diff = 360.0 - diff;
+                        if (diff > max_az)
+                            max_az = diff;
+                    }
+                }
+            }
+        }
+    }
 
-    if (hour < 0 || hour > 23)
-        return NULL;
+    DEBUG("C HorizonGridTest: max_alt = %le, max_az = %le degrees\n", max_alt, max_az);
 
-    if (minute < 0 || minute > 59)
-        return NULL;
+    if (max_alt > 1.0e-11)
+        FFAIL("EXCESSIVE altitude error = %le degrees\n", max_alt);
 
-    if (!strcmp(mtext, "Jan"))
-        month = 1;
-    else if (!strcmp(mtext, "Feb"))
-        month = 2;
-    else if (!strcmp(mtext, "Mar"))
-        month = 3;
-    else if (!strcmp(mtext, "Apr"))
-        month = 4;
-    else if (!strcmp(mtext, "May"))
-        month = 5;
-    else if (!strcmp(mtext, "Jun"))
-        month = 6;
-    else if (!strcmp(mtext, "Jul"))
-        month = 7;
-    else if (!strcmp(mtext, "Aug"))
-        month = 8;
-    else if (!strcmp(mtext, "Sep"))
-        month = 9;
-    else if (!strcmp(mtext, "Oct"))
-        month = 10;
-    else if (!strcmp(mtext, "Nov"))
-        month = 11;
-    else if (!strcmp(mtext, "Dec"))
-        month = 12;
-    else
-        return NULL;
+    if (max_az > 1.0e-11)
+        FFAIL("EXCESSIVE azimuth error = %le degrees\n", max_az);
 
-    /* Make absolutely sure we know how many characters the date text is. */
-    /* If anything is fishy, fail! */
-    snprintf(verify, sizeof(verify), "%04d-%s-%02d %02d:%02d", year, mtext, day, hour, minute);
-    length = strlen(verify);
-    if (length != 17)
-        return NULL;
+    FPASS();
+fail:
+    return error;
+}
 
-    if (memcmp(verify, text, length))
-        return NULL;
 
-    *time = Astronomy_MakeTime(year, month, day, hour, minute, 0.0);
-    return text + length;   /* return remaining portion of string */
+typedef struct
+{
+    astro_observer_t observer;
+    double target_altitude;
+    int count;
 }
+search_all_context_t;
 
-/*-----------------------------------------------------------------------------------------------------------*/
 
-static int LunarApsis(void)
+static astro_func_result_t SearchAllSine(void *context, astro_time_t time)
 {
-    const char *filename = "apsides/moon.txt";
-    int error = 1;
-    FILE *infile = NULL;
-    int lnum, nscanned;
-    char line[100];
-    int kind, year, month, day, hour, minute;
-    double dist_km;
-    astro_time_t start_time, correct_time;
-    astro_apsis_t apsis;
-    double diff_minutes, diff_km;
-    double max_minutes = 0.0, max_km = 0.0;
+    astro_func_result_t result;
+    search_all_context_t *p = (search_all_context_t *)context;
+    ++(p->count);
+    result.value = sin(2.0*PI*time.ut/1.3) - 0.3;
+    result.status = ASTRO_SUCCESS;
+    return result;
+}
 
-    infile = fopen(filename, "rt");
-    if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", filename);
 
-    /*
-        0 2001-01-10T08:59Z 357132
-        1 2001-01-24T19:02Z 406565
-    */
+static astro_func_result_t SearchAllSunAltitude(void *context, astro_time_t time)
+{
+    astro_func_result_t result;
+    astro_equatorial_t equ;
+    astro_horizon_t hor;
+    search_all_context_t *p = (search_all_context_t *)context;
 
-    start_time = Astronomy_MakeTime(2001, 1, 1, 0, 0, 0.0);
-    lnum = 0;
-    while (ReadLine(line, sizeof(line), infile, filename, lnum))
+    ++(p->count);
+    equ = Astronomy_Equator(BODY_SUN, &time, p->observer, EQUATOR_OF_DATE, ABERRATION);
+    if (equ.status != ASTRO_SUCCESS)
     {
-        ++lnum;
+        result.status = equ.status;
+        result.value = NAN;
+        return result;
+    }
+    hor = Astronomy_Horizon(&time, p->observer, equ.ra, equ.dec, REFRACTION_NONE);
+    result.value = hor.altitude - p->target_altitude;
+    result.status = ASTRO_SUCCESS;
+    return result;
+}
 
-        if (lnum == 1)
-            apsis = Astronomy_SearchLunarApsis(start_time);
-        else
-            apsis = Astronomy_NextLunarApsis(apsis);
 
-        if (apsis.status != ASTRO_SUCCESS)
-            FLNFAIL("Failed to find apsis.\n");
+static astro_func_result_t SearchAllSunDescent(void *context, astro_time_t time)
+{
+    /* The negative of SearchAllSunAltitude, so that Astronomy_Search can find descending roots. */
+    astro_func_result_t result = SearchAllSunAltitude(context, time);
+    result.value = -result.value;
+    return result;
+}
 
-        nscanned = sscanf(line, "%d %d-%d-%dT%d:%dZ %lf", &kind, &year, &month, &day, &hour, &minute, &dist_km);
-        if (nscanned != 7)
-            FLNFAIL("invalid data format\n");
 
-        if (kind != apsis.kind)
-            FLNFAIL("expected apsis kind %d but found %d\n", kind, apsis.kind);
+static int SearchAllTest(void)
+{
+    extern int _AltitudeDiffCallCount;          /* undocumented global var used for performance testing only */
+    int error, i, n, direction, calls, nsearch;
+    astro_status_t status;
+    astro_root_t roots[800];
+    search_all_context_t context;
+    astro_search_result_t search;
+    astro_func_result_t fa, fb;
+    astro_time_t t1, t2, ta, tb, time;
+    double diff, expected, max_diff;
+    const double latrad = 40.5 * DEG2RAD;
+
+    /* A sine wave offset from zero has roots we can calculate exactly. */
+    context.count = 0;
+    t1 = Astronomy_TimeFromDays(0.0);
+    t2 = Astronomy_TimeFromDays(100.0);
+    status = Astronomy_SearchAll(SearchAllSine, &context, t1, t2, 2.0*PI/1.3, 0.01, roots, 800, &n);
+    if (status != ASTRO_SUCCESS)
+        FFAIL("SearchAll(sine) returned status %d\n", status);
 
-        correct_time = Astronomy_MakeTime(year, month, day, hour, minute, 0.0);
+    if (n != 154)
+        FFAIL("SearchAll(sine) found %d roots, expected 154.\n", n);
 
-        diff_minutes = (24.0 * 60.0) * ABS(apsis.time.ut - correct_time.ut);
-        diff_km = ABS(apsis.dist_km - dist_km);
+    max_diff = 0.0;
+    for (i = 0; i < n; ++i)
+    {
+        /* Ascending roots are at phase asin(0.3); descending roots are at phase pi - asin(0.3). */
+        direction = (i % 2 == 0) ? +1 : -1;
+        if (roots[i].direction != direction)
+            FFAIL("SearchAll(sine) root %d has direction %d, expected %d\n", i, roots[i].direction, direction);
+        expected = 1.3 * ((i / 2) + ((direction > 0) ? asin(0.3) : (PI - asin(0.3))) / (2.0*PI));
+        diff = V(SECONDS_PER_DAY * fabs(roots[i].time.ut - expected));
+        if (diff > max_diff)
+            max_diff = diff;
+    }
+    DEBUG("C SearchAllTest: sine: %d roots, %d calls, max_diff = %0.3le seconds\n", n, context.count, max_diff);
+    if (max_diff > 0.02)
+        FFAIL("EXCESSIVE sine root error = %le seconds\n", max_diff);
 
-        if (diff_minutes > 35.0)
-            FLNFAIL("Excessive time error: %lf minutes.\n", diff_minutes);
+    /* A buffer that is too small must report the roots that fit. */
+    status = Astronomy_SearchAll(SearchAllSine, &context, t1, t2, 2.0*PI/1.3, 0.01, roots, 10, &n);
+    if (status != ASTRO_BUFFER_TOO_SMALL || n != 10)
+        FFAIL("SearchAll with small buffer returned status %d, n = %d\n", status, n);
 
-        if (diff_km > 25.0)
-            FLNFAIL("Excessive distance error: %lf km.\n", diff_km);
+    /*
+        Find every civil dawn and dusk for a year in one call,
+        and compare with stepping through the same events using Astronomy_SearchAltitude.
+        The derivative bound is the same one the altitude search uses internally for the Sun.
+    */
+    context.observer = Astronomy_MakeObserver(40.5, -74.0, 0.0);
+    context.target_altitude = -6.0;
+    context.count = 0;
+    t1 = Astronomy_MakeTime(2022, 1, 1, 0, 0, 0.0);
+    t2 = Astronomy_MakeTime(2023, 1, 1, 0, 0, 0.0);
+    status = Astronomy_SearchAll(SearchAllSunAltitude, &context, t1, t2,
+        fabs((360.9856 - 0.8)*cos(latrad)) + fabs(0.5*sin(latrad)),
+        0.1, roots, 800, &n);
+    if (status != ASTRO_SUCCESS)
+        FFAIL("SearchAll(sun) returned status %d\n", status);
 
-        if (diff_minutes > max_minutes)
-            max_minutes = diff_minutes;
+    if (n != 730)
+        FFAIL("SearchAll(sun) found %d roots, expected 730.\n", n);
 
-        if (diff_km > max_km)
-            max_km = diff_km;
+    _AltitudeDiffCallCount = 0;
+    max_diff = 0.0;
+    time = t1;
+    for (i = 0; i < n; ++i)
+    {
+        direction = (i % 2 == 0) ? +1 : -1;
+        if (roots[i].direction != direction)
+            FFAIL("SearchAll(sun) root %d has direction %d, expected %d\n", i, roots[i].direction, direction);
+        search = Astronomy_SearchAltitude(BODY_SUN, context.observer, (direction > 0) ? DIRECTION_RISE : DIRECTION_SET, time, 2.0, -6.0);
+        CHECK_STATUS(search);
+        diff = V(SECONDS_PER_DAY * fabs(roots[i].time.ut - search.time.ut));
+        if (diff > max_diff)
+            max_diff = diff;
+        time = search.time;
     }
 
-    FPASSA("found %d events, max time error = %0.3lf minutes, max distance error = %0.3lf km.\n", lnum, max_minutes, max_km);
+    DEBUG("C SearchAllTest: sun: %d roots, %d calls (SearchAltitude: %d calls), max_diff = %0.3le seconds\n", n, context.count, _AltitudeDiffCallCount, max_diff);
+    if (max_diff > 0.25)
+        FFAIL("EXCESSIVE sun root error = %le seconds\n", max_diff);
+
+    /*
+        Finding the same roots with repeated calls to Astronomy_Search must cost more.
+        Step through the year a quarter day at a time, which is shorter than any
+        interval between dawn and dusk, and search each step that crosses zero.
+    */
+    calls = context.count;
+    context.count = 0;
+    nsearch = 0;
+    ta = t1;
+    fa = SearchAllSunAltitude(&context, ta);
+    CHECK_STATUS(fa);
+    while (ta.ut < t2.ut)
+    {
+        tb = Astronomy_AddDays(ta, 0.25);
+        fb = SearchAllSunAltitude(&context, tb);
+        CHECK_STATUS(fb);
+        if ((fa.value < 0.0) != (fb.value < 0.0))
+        {
+            search = Astronomy_Search((fa.value < 0.0) ? SearchAllSunAltitude : SearchAllSunDescent, &context, ta, tb, 0.1);
+            CHECK_STATUS(search);
+            ++nsearch;
+        }
+        ta = tb;
+        fa = fb;
+    }
+
+    DEBUG("C SearchAllTest: sun: Astronomy_Search found %d roots with %d calls.\n", nsearch, context.count);
+    if (nsearch != n)
+        FFAIL("Astronomy_Search found %d roots, but SearchAll found %d.\n", nsearch, n);
+    if (calls >= context.count)
+        FFAIL("SearchAll used %d calls, but repeated searches used only %d.\n", calls, context.count);
+
+    FPASS();
 fail:
-    if (infile != NULL) fclose(infile);
     return error;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
 
-static int EarthApsis(void)
+typedef struct
 {
-    const char *filename = "apsides/earth.txt";
-    int error = 1;
-    FILE *infile = NULL;
-    int lnum, nscanned;
-    char line[100];
-    int kind, year, month, day, hour, minute;
-    double dist_au;
-    astro_time_t start_time, correct_time;
-    astro_apsis_t apsis;
-    double diff_minutes, diff_au;
-    double max_minutes = 0.0, max_au = 0.0;
+    astro_rotation_t rot;
+    double target_longitude;
+    int count;
+}
+search_deriv_context_t;
 
-    infile = fopen(filename, "rt");
-    if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", filename);
 
-    /*
-        0 2001-01-04T08:52Z 0.9832860
-        1 2001-07-04T13:37Z 1.0166426
-    */
+static astro_deriv_result_t SearchDerivPhase(void *context, astro_time_t time)
+{
+    /* Moon's ecliptic longitude minus the Sun's, relative to a target, and its rate of change. */
+    astro_deriv_result_t result;
+    astro_state_vector_t moon, earth;
+    double lon[2], rate[2];
+    int k;
+    search_deriv_context_t *p = (search_deriv_context_t *)context;
 
-    start_time = Astronomy_MakeTime(2001, 1, 1, 0, 0, 0.0);
-    lnum = 0;
-    while (ReadLine(line, sizeof(line), infile, filename, lnum))
+    ++(p->count);
+    moon = Astronomy_RotateState(p->rot, Astronomy_GeoMoonState(time));
+    earth = Astronomy_RotateState(p->rot, Astronomy_HelioState(BODY_EARTH, time));
+    if (moon.status != ASTRO_SUCCESS || earth.status != ASTRO_SUCCESS)
     {
-        ++lnum;
+        result.status = (moon.status != ASTRO_SUCCESS) ? moon.status : earth.status;
+        result.value = result.slope = NAN;
+        return result;
+    }
 
-        if (lnum == 1)
-            apsis = Astronomy_SearchPlanetApsis(BODY_EARTH, start_time);
-        else
-            apsis = Astronomy_NextPlanetApsis(BODY_EARTH, apsis);
+    /* The geocentric Sun is in the opposite direction from the heliocentric Earth. */
+    for (k = 0; k < 2; ++k)
+    {
+        const astro_state_vector_t *s = (k == 0) ? &moon : &earth;
+        double sign = (k == 0) ? +1.0 : -1.0;
+        lon[k] = RAD2DEG * atan2(sign*s->y, sign*s->x);
+        rate[k] = RAD2DEG * (s->x*s->vy - s->y*s->vx) / (s->x*s->x + s->y*s->y);
+    }
 
-        if (apsis.status != ASTRO_SUCCESS)
-            FLNFAIL("Failed to find apsis.\n");
+    result.value = fmod(lon[0] - lon[1] - p->target_longitude + 540.0, 360.0) - 180.0;
+    result.slope = rate[0] - rate[1];
+    result.status = ASTRO_SUCCESS;
+    return result;
+}
 
-        nscanned = sscanf(line, "%d %d-%d-%dT%d:%dZ %lf", &kind, &year, &month, &day, &hour, &minute, &dist_au);
-        if (nscanned != 7)
-            FLNFAIL("invalid data format\n");
 
-        if (kind != apsis.kind)
-            FLNFAIL("expected apsis kind %d but found %d\n", kind, apsis.kind);
+static astro_func_result_t SearchDerivPhaseValue(void *context, astro_time_t time)
+{
+    astro_func_result_t result;
+    astro_deriv_result_t deriv = SearchDerivPhase(context, time);
+    result.status = deriv.status;
+    result.value = deriv.value;
+    return result;
+}
 
-        correct_time = Astronomy_MakeTime(year, month, day, hour, minute, 0.0);
 
-        diff_minutes = (24.0 * 60.0) * ABS(apsis.time.ut - correct_time.ut);
-        diff_au = ABS(apsis.dist_au - dist_au);
+static astro_deriv_result_t SearchDerivLinear(void *context, astro_time_t time)
+{
+    /* Days of UT after the root time, which the search must find exactly. */
+    astro_deriv_result_t result;
+    const astro_time_t *root = (const astro_time_t *)context;
 
-        if (diff_minutes > 120.58)
-            FLNFAIL("Excessive time error: %lf minutes.\n", diff_minutes);
+    result.status = ASTRO_SUCCESS;
+    result.value = time.ut - root->ut;
+    result.slope = 1.0;
+    return result;
+}
 
-        if (diff_au > 1.2e-5)
-            FLNFAIL("Excessive distance error: %lg AU.\n", diff_au);
 
-        if (diff_minutes > max_minutes)
-            max_minutes = diff_minutes;
+static int SearchDerivTest(void)
+{
+    int error, i, search_count = 0, deriv_count = 0;
+    search_deriv_context_t context;
+    astro_time_t t1, t2, root;
+    astro_search_result_t search;
+    astro_deriv_search_result_t deriv;
+    double diff, max_diff = 0.0;
 
-        if (diff_au > max_au)
-            max_au = diff_au;
+    context.rot = Astronomy_Rotation_EQJ_ECL();
+    CHECK_STATUS(context.rot);
+
+    /* A bracket without an ascending root must fail. */
+    context.target_longitude = 0.0;
+    t1 = Astronomy_MakeTime(2022, 1, 3, 0, 0, 0.0);
+    deriv = Astronomy_SearchDeriv(SearchDerivPhase, &context, t1, Astronomy_AddDays(t1, 1.0), 1.0);
+    if (deriv.status != ASTRO_SEARCH_FAILURE)
+        FFAIL("Expected ASTRO_SEARCH_FAILURE but found %d\n", deriv.status);
+
+    /* A reversed bracket is invalid, and must be rejected without calling the function. */
+    deriv = Astronomy_SearchDeriv(SearchDerivPhase, &context, Astronomy_AddDays(t1, 1.0), t1, 1.0);
+    if (deriv.status != ASTRO_INVALID_PARAMETER || deriv.evaluations != 0)
+        FFAIL("Expected ASTRO_INVALID_PARAMETER with no evaluations for a reversed bracket, but found status %d with %d evaluations\n", deriv.status, deriv.evaluations);
+
+    /*
+        Around 1000 BC, Delta T shrinks by almost a minute over 1000 days, so TT and UT spans differ.
+        A root 10 seconds before the end of the bracket must still be found.
+    */
+    t1 = Astronomy_MakeTime(-1000, 1, 1, 0, 0, 0.0);
+    t2 = Astronomy_AddDays(t1, 1000.0);
+    root = Astronomy_AddDays(t2, -10.0 / SECONDS_PER_DAY);
+    deriv = Astronomy_SearchDeriv(SearchDerivLinear, &root, t1, t2, 0.01);
+    CHECK_STATUS(deriv);
+    diff = SECONDS_PER_DAY * fabs(deriv.time.ut - root.ut);
+    if (diff > 0.01)
+        FFAIL("Found the root %0.3lf seconds away from the correct time.\n", diff);
+
+    /* Find 100 consecutive quarter phases both ways, in windows that do not center on the events. */
+    t1 = Astronomy_MakeTime(2022, 1, 1, 0, 0, 0.0);
+    for (i = 0; i < 100; ++i)
+    {
+        context.target_longitude = 90.0 * (i % 4);
+        search = Astronomy_SearchMoonPhase(context.target_longitude, t1, 10.0);
+        CHECK_STATUS(search);
+        t1 = Astronomy_AddDays(search.time, -2.0);
+        t2 = Astronomy_AddDays(search.time, +4.5);
+
+        context.count = 0;
+        search = Astronomy_Search(SearchDerivPhaseValue, &context, t1, t2, 0.1);
+        CHECK_STATUS(search);
+        search_count += context.count;
+
+        context.count = 0;
+        deriv = Astronomy_SearchDeriv(SearchDerivPhase, &context, t1, t2, 0.1);
+        CHECK_STATUS(deriv);
+        if (deriv.evaluations != context.count)
+            FFAIL("Reported %d evaluations, but the callback was called %d times.\n", deriv.evaluations, context.count);
+        deriv_count += deriv.evaluations;
+
+        diff = V(SECONDS_PER_DAY * fabs(deriv.time.ut - search.time.ut));
+        if (diff > max_diff)
+            max_diff = diff;
+
+        t1 = t2;
     }
 
-    FPASSA("found %d events, max time error = %0.3lf minutes, max distance error = %0.3lg AU.\n", lnum, max_minutes, max_au);
+    DEBUG("C SearchDerivTest: Search calls = %d, SearchDeriv calls = %d, max_diff = %0.3le seconds\n", search_count, deriv_count, max_diff);
+
+    if (max_diff > 0.2)
+        FFAIL("EXCESSIVE time difference = %le seconds\n", max_diff);
+
+    if (deriv_count >= search_count)
+        FFAIL("SearchDeriv used %d calls, which is not fewer than Search (%d calls).\n", deriv_count, search_count);
+
+    FPASS();
 fail:
-    if (infile != NULL) fclose(infile);
     return error;
 }
 
 
-static int PlanetApsis(void)
+static int SearchBudgetTest(void)
 {
-    int error;
-    astro_body_t body;
-    astro_time_t start_time, prev_time;
+    int error, i, limit;
+    astro_status_t status;
+    astro_search_stats_t stats;
+    astro_search_result_t search;
     astro_apsis_t apsis;
-    astro_utc_t utc;
-    int count;
-    double interval, min_interval, max_interval;
-    FILE *infile = NULL;
-    char filename[100];
-    char line[100];
-    char expected_time_text[100];
-    astro_time_t expected_time;
-    int expected_kind;
-    double expected_distance;
-    double period;
-    double diff_days, diff_degrees, max_degrees=0.0, diff_dist_ratio;
-    const double degree_threshold = 0.1;
-    double max_diff_days, max_dist_ratio;
+    astro_observer_t observer = Astronomy_MakeObserver(29.0, -81.0, 10.0);
+    astro_time_t time = Astronomy_MakeTime(2022, 6, 1, 0, 0, 0.0);
 
-    start_time = Astronomy_MakeTime(1700, 1, 1, 0, 0, 0.0);
+    if (ASTRO_INVALID_PARAMETER != Astronomy_ContextSetSearchBudget(NULL, -1, 0.0))
+        FFAIL("Negative evaluation limit should have been rejected.\n");
 
-    for (body = BODY_MERCURY; body <= BODY_PLUTO; ++body)
+    if (ASTRO_INVALID_PARAMETER != Astronomy_ContextSetSearchBudget(NULL, 0, -1.0))
+        FFAIL("Negative time limit should have been rejected.\n");
+
+    /* Without limits, the statistics measure the work of a single search. */
+    status = Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+    if (status != ASTRO_SUCCESS)
+        FFAIL("Astronomy_ContextSetSearchBudget returned status %d\n", status);
+    search = Astronomy_SearchRiseSet(BODY_SUN, observer, DIRECTION_RISE, time, 1.0);
+    CHECK_STATUS(search);
+    stats = Astronomy_ContextSearchStats(NULL);
+    DEBUG("C SearchBudgetTest: sunrise evaluations=%d, iterations=%d, quad_hits=%d, quad_misses=%d\n",
+        stats.evaluations, stats.iterations, stats.quad_hits, stats.quad_misses);
+    if (stats.evaluations < 3 || stats.iterations < 1 || stats.quad_hits + stats.quad_misses < 1)
+        FFAIL("Unexpected statistics: evaluations=%d, iterations=%d, quad_hits=%d, quad_misses=%d\n",
+            stats.evaluations, stats.iterations, stats.quad_hits, stats.quad_misses);
+
+    /* A search that needs more evaluations than allowed must stop at the limit. */
+    limit = stats.evaluations - 1;
+    Astronomy_ContextSetSearchBudget(NULL, limit, 0.0);
+    search = Astronomy_SearchRiseSet(BODY_SUN, observer, DIRECTION_RISE, time, 1.0);
+    if (search.status != ASTRO_BUDGET_EXCEEDED)
+        FFAIL("Expected ASTRO_BUDGET_EXCEEDED for sunrise, but found %d\n", search.status);
+    if (Astronomy_ContextSearchStats(NULL).evaluations != limit)
+        FFAIL("Expected exactly %d evaluations, but found %d\n", limit, Astronomy_ContextSearchStats(NULL).evaluations);
+
+    /*
+        Every smaller limit must also report that the budget was exceeded, and not that there is no event,
+        including when the budget runs out while scanning for a brief moonrise near the pole.
+    */
+    observer = Astronomy_MakeObserver(70.0, 20.0, 0.0);
+    Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+    search = Astronomy_SearchRiseSet(BODY_MOON, observer, DIRECTION_RISE, time, 30.0);
+    CHECK_STATUS(search);
+    limit = Astronomy_ContextSearchStats(NULL).evaluations;
+    DEBUG("C SearchBudgetTest: polar moonrise evaluations=%d\n", limit);
+    for (i = 1; i < limit; ++i)
     {
-        period = Astronomy_PlanetOrbitalPeriod(body);
-        max_dist_ratio = 0.0;
-        max_diff_days = 0.0;
-        snprintf(filename, sizeof(filename)-1, "apsides/apsis_%d.txt", (int)body);
-        if (infile) fclose(infile);
-        infile = fopen(filename, "rt");
-        if (infile == NULL)
-            FFAIL("ERROR - cannot open input file: %s\n", filename);
+        Astronomy_ContextSetSearchBudget(NULL, i, 0.0);
+        search = Astronomy_SearchRiseSet(BODY_MOON, observer, DIRECTION_RISE, time, 30.0);
+        if (search.status != ASTRO_BUDGET_EXCEEDED)
+            FFAIL("Expected ASTRO_BUDGET_EXCEEDED for polar moonrise with limit %d, but found %d\n", i, search.status);
+    }
 
-        min_interval = max_interval = -1.0;
-        apsis = Astronomy_SearchPlanetApsis(body, start_time);
-        if (apsis.status != ASTRO_SUCCESS)
-            FFAIL("ERROR %d finding first apsis for %s\n", apsis.status, Astronomy_BodyName(body));
+    /* The brute-force apsis search for Neptune, used outside its apsis table, must honor the budget too. */
+    Astronomy_ContextSetSearchBudget(NULL, 50, 0.0);
+    apsis = Astronomy_SearchPlanetApsis(BODY_NEPTUNE, Astronomy_MakeTime(5000, 1, 1, 0, 0, 0.0));
+    if (apsis.status != ASTRO_BUDGET_EXCEEDED)
+        FFAIL("Expected ASTRO_BUDGET_EXCEEDED for Neptune apsis, but found %d\n", apsis.status);
+    if (Astronomy_ContextSearchStats(NULL).evaluations != 50)
+        FFAIL("Expected exactly 50 evaluations, but found %d\n", Astronomy_ContextSearchStats(NULL).evaluations);
+
+    /* So must the table lookup. */
+    Astronomy_ContextSetSearchBudget(NULL, 2, 0.0);
+    apsis = Astronomy_SearchPlanetApsis(BODY_NEPTUNE, time);
+    if (apsis.status != ASTRO_BUDGET_EXCEEDED)
+        FFAIL("Expected ASTRO_BUDGET_EXCEEDED for Neptune apsis table lookup, but found %d\n", apsis.status);
+
+    /* A deadline that has already passed stops the search at its first evaluation. */
+    Astronomy_ContextSetSearchBudget(NULL, 0, 1.0e-9);
+    search = Astronomy_SearchMoonPhase(0.0, time, 40.0);
+    if (search.status != ASTRO_BUDGET_EXCEEDED)
+        FFAIL("Expected ASTRO_BUDGET_EXCEEDED for deadline, but found %d\n", search.status);
+
+    /* Removing the limits allows searches to succeed again. */
+    Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+    apsis = Astronomy_SearchPlanetApsis(BODY_NEPTUNE, time);
+    CHECK_STATUS(apsis);
 
-        count = 1;
-        while (ReadLine(line, sizeof(line), infile, filename, count-1))
-        {
-            /* Parse the line of test data. */
-            if (   (3 != sscanf(line, "%d %30s %lf", &expected_kind, expected_time_text, &expected_distance))
-                || (expected_kind & ~1)     /* must be either 0=perihelion or 1=aphelion */
-                || (expected_distance <= 0.0)
-                || ParseDate(expected_time_text, &expected_time))
-            {
-                FFAIL("INPUT SYNTAX ERROR (%s line %d): '%s'\n", filename, count, line);
-            }
+    FPASS();
+fail:
+    Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+    return error;
+}
 
-            /* Compare computed values against expected values. */
-            if (apsis.kind != expected_kind)
-                FFAIL("WRONG APSIS KIND (%s line %d)\n", filename, count);
 
-            diff_days = ABS(expected_time.tt - apsis.time.tt);
-            if (diff_days > max_diff_days) max_diff_days = diff_days;
-            diff_degrees = (diff_days / period) * 360.0;
-            if (diff_degrees > max_degrees)
-                max_degrees = diff_degrees;
+static astro_deriv_result_t SearchBudgetSineDeriv(void *context, astro_time_t time)
+{
+    astro_deriv_result_t result;
+    search_all_context_t *p = (search_all_context_t *)context;
+    ++(p->count);
+    result.value = sin(2.0*PI*time.ut/1.3) - 0.3;
+    result.slope = (2.0*PI/1.3) * cos(2.0*PI*time.ut/1.3);
+    result.status = ASTRO_SUCCESS;
+    return result;
+}
 
-            if (diff_degrees > degree_threshold)
-                FFAIL("FAIL - %s exceeded angular threshold (%lg versus %lg degrees)\n", Astronomy_BodyName(body), max_degrees, degree_threshold);
 
-            diff_dist_ratio = ABS(expected_distance - apsis.dist_au) / expected_distance;
-            if (diff_dist_ratio > max_dist_ratio) max_dist_ratio = diff_dist_ratio;
-            if (diff_dist_ratio > 1.05e-4)
-            {
-                FFAIL("EXCESSIVE DISTANCE ERROR for %s (%s line %d): expected=%0.16lf, calculated=%0.16lf, error ratio=%lg\n",
-                    Astronomy_BodyName(body), filename, count, expected_distance, apsis.dist_au, diff_dist_ratio);
-            }
+static int SearchBudgetContextTest(void)
+{
+    int error, i, n, limit;
+    astro_context_t *ctx = NULL;
+    astro_status_t status;
+    astro_search_stats_t stats, default_stats;
+    astro_search_result_t search;
+    astro_deriv_search_result_t deriv;
+    astro_hour_angle_t hour_angle;
+    astro_apsis_t apsis;
+    astro_root_t roots[10];
+    search_all_context_t context;
+    astro_time_t t1 = Astronomy_TimeFromDays(0.0);
+    astro_time_t t2 = Astronomy_TimeFromDays(0.3);
+    astro_observer_t observer = Astronomy_MakeObserver(29.0, -81.0, 10.0);
+    astro_time_t time = Astronomy_MakeTime(2022, 6, 1, 0, 0, 0.0);
 
-            /* Calculate the next apsis. */
-            prev_time = apsis.time;
-            utc = Astronomy_UtcFromTime(apsis.time);
-            apsis = Astronomy_NextPlanetApsis(body, apsis);
-            if (apsis.status != ASTRO_SUCCESS)
-            {
-                FFAIL("ERROR %d finding apsis for %s after %04d-%02d-%02d\n",
-                    apsis.status, Astronomy_BodyName(body), utc.year, utc.month, utc.day);
-            }
+    status = Astronomy_ContextCreate(&ctx);
+    if (status != ASTRO_SUCCESS)
+        FFAIL("Astronomy_ContextCreate returned status %d\n", status);
 
-            /* Update statistics. */
-            ++count;
-            interval = apsis.time.tt - prev_time.tt;
-            if (min_interval < 0.0)
-            {
-                min_interval = max_interval = interval;
-            }
-            else
-            {
-                if (interval < min_interval)
-                    min_interval = interval;
-                if (interval > max_interval)
-                    max_interval = interval;
-            }
-        }
+    Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+    default_stats = Astronomy_ContextSearchStats(NULL);
 
-        if (count < 2)
-            FFAIL("FAILED to find apsides for %s\n", Astronomy_BodyName(body));
-
-        FDEBUG("%5d apsides for %-9s -- intervals: min=%9.2lf, max=%9.2lf, ratio=%8.6lf; max day=%lg, degrees=%0.3lf, dist ratio=%lg\n",
-            count, Astronomy_BodyName(body),
-            min_interval, max_interval, max_interval / min_interval,
-            max_diff_days,
-            (max_diff_days / period) * 360.0,
-            max_dist_ratio);
+    /* Measure one unlimited search that uses the context. */
+    context.count = 0;
+    search = Astronomy_SearchCtx(ctx, SearchAllSine, &context, t1, t2, 0.01);
+    CHECK_STATUS(search);
+    stats = Astronomy_ContextSearchStats(ctx);
+    if (stats.evaluations != context.count)
+        FFAIL("Context counted %d evaluations, but the callback was called %d times.\n", stats.evaluations, context.count);
+    if (stats.iterations < 1)
+        FFAIL("Context counted %d iterations.\n", stats.iterations);
+
+    /* A limit that allows exactly one search must allow it again and again: budgets are not cumulative. */
+    limit = stats.evaluations;
+    status = Astronomy_ContextSetSearchBudget(ctx, limit, 0.0);
+    if (status != ASTRO_SUCCESS)
+        FFAIL("Astronomy_ContextSetSearchBudget returned status %d\n", status);
+    for (i = 0; i < 3; ++i)
+    {
+        search = Astronomy_SearchCtx(ctx, SearchAllSine, &context, t1, t2, 0.01);
+        CHECK_STATUS(search);
     }
+    stats = Astronomy_ContextSearchStats(ctx);
+    if (stats.evaluations != 3*limit)
+        FFAIL("Expected %d cumulative evaluations, but found %d\n", 3*limit, stats.evaluations);
+
+    /* A smaller limit stops each kind of search that uses the context. */
+    Astronomy_ContextSetSearchBudget(ctx, 2, 0.0);
+    search = Astronomy_SearchCtx(ctx, SearchAllSine, &context, t1, t2, 0.01);
+    if (search.status != ASTRO_BUDGET_EXCEEDED)
+        FFAIL("Expected ASTRO_BUDGET_EXCEEDED from Astronomy_SearchCtx, but found %d\n", search.status);
+
+    status = Astronomy_SearchAllCtx(ctx, SearchAllSine, &context, t1, Astronomy_TimeFromDays(10.0), 2.0*PI/1.3, 0.01, roots, 10, &n);
+    if (status != ASTRO_BUDGET_EXCEEDED)
+        FFAIL("Expected ASTRO_BUDGET_EXCEEDED from Astronomy_SearchAllCtx, but found %d\n", status);
+
+    deriv = Astronomy_SearchDerivCtx(ctx, SearchBudgetSineDeriv, &context, t1, t2, 0.01);
+    if (deriv.status != ASTRO_BUDGET_EXCEEDED)
+        FFAIL("Expected ASTRO_BUDGET_EXCEEDED from Astronomy_SearchDerivCtx, but found %d\n", deriv.status);
+
+    /* So do the astronomical searches that take a context. */
+    search = Astronomy_SearchRiseSetExCtx(ctx, BODY_SUN, observer, DIRECTION_RISE, time, 1.0, 0.0);
+    if (search.status != ASTRO_BUDGET_EXCEEDED)
+        FFAIL("Expected ASTRO_BUDGET_EXCEEDED from Astronomy_SearchRiseSetExCtx, but found %d\n", search.status);
+
+    search = Astronomy_SearchAltitudeCtx(ctx, BODY_SUN, observer, DIRECTION_SET, time, 1.0, -6.0);
+    if (search.status != ASTRO_BUDGET_EXCEEDED)
+        FFAIL("Expected ASTRO_BUDGET_EXCEEDED from Astronomy_SearchAltitudeCtx, but found %d\n", search.status);
+
+    hour_angle = Astronomy_SearchHourAngleExCtx(ctx, BODY_MOON, observer, 0.0, time, +1);
+    if (hour_angle.status != ASTRO_BUDGET_EXCEEDED)
+        FFAIL("Expected ASTRO_BUDGET_EXCEEDED from Astronomy_SearchHourAngleExCtx, but found %d\n", hour_angle.status);
+
+    search = Astronomy_SearchRelativeLongitudeCtx(ctx, BODY_MARS, 0.0, time);
+    if (search.status != ASTRO_BUDGET_EXCEEDED)
+        FFAIL("Expected ASTRO_BUDGET_EXCEEDED from Astronomy_SearchRelativeLongitudeCtx, but found %d\n", search.status);
+
+    apsis = Astronomy_SearchLunarApsisCtx(ctx, time);
+    if (apsis.status != ASTRO_BUDGET_EXCEEDED)
+        FFAIL("Expected ASTRO_BUDGET_EXCEEDED from Astronomy_SearchLunarApsisCtx, but found %d\n", apsis.status);
+
+    apsis = Astronomy_SearchPlanetApsisCtx(ctx, BODY_MARS, time);
+    if (apsis.status != ASTRO_BUDGET_EXCEEDED)
+        FFAIL("Expected ASTRO_BUDGET_EXCEEDED from Astronomy_SearchPlanetApsisCtx, but found %d\n", apsis.status);
+
+    stats = Astronomy_ContextSearchStats(ctx);
+    if (stats.evaluations != 9*2)
+        FFAIL("Expected %d evaluations after the limited searches, but found %d\n", 9*2, stats.evaluations);
+
+    /* The context's budget does not limit searches that use the default context, which keeps its own statistics. */
+    search = Astronomy_Search(SearchAllSine, &context, t1, t2, 0.01);
+    CHECK_STATUS(search);
+    deriv = Astronomy_SearchDeriv(SearchBudgetSineDeriv, &context, t1, t2, 0.01);
+    CHECK_STATUS(deriv);
+    if (Astronomy_ContextSearchStats(ctx).evaluations != stats.evaluations)
+        FFAIL("Searches using the default context changed the statistics of another context.\n");
+    if (Astronomy_ContextSearchStats(NULL).evaluations != default_stats.evaluations + limit + deriv.evaluations)
+        FFAIL("Default context counted %d evaluations, expected %d\n",
+            Astronomy_ContextSearchStats(NULL).evaluations, default_stats.evaluations + limit + deriv.evaluations);
 
     FPASS();
 fail:
-    if (infile) fclose(infile);
+    Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+    Astronomy_ContextFree(ctx);
     return error;
 }
 
 
-/*-----------------------------------------------------------------------------------------------------------*/
+typedef struct
+{
+    astro_observer_t observer;
+    astro_time_t time;
+    int count;          /* the number of sunrise searches to perform */
+    int failures;       /* the number of those searches that did not succeed */
+}
+search_thread_t;
 
-static int CheckUnitVector(int lnum, const char *name, astro_rotation_t r, int i0, int j0, int di, int dj)
+#define SEARCH_THREAD_COUNT     2
+#define SEARCH_THREAD_SEARCHES  20
+
+static void SearchThreadWork(search_thread_t *work)
 {
-    int k;
-    double x;
-    double sum = 0.0;
+    int i;
+    astro_search_result_t search;
 
-    for (k=0; k<3; ++k)
+    work->failures = 0;
+    for (i = 0; i < work->count; ++i)
     {
-        x = r.rot[i0+k*di][j0+k*dj];
-        sum += x*x;
+        search = Astronomy_SearchRiseSet(BODY_SUN, work->observer, DIRECTION_RISE, work->time, 1.0);
+        if (search.status != ASTRO_SUCCESS)
+            ++work->failures;
     }
-    x = ABS(sum - 1.0);
-    if (x > 1.8e-15)
-        FAILRET("C CheckUnitVector ERROR(%s line %d): unit error = %lg for i0=%d, j0=%d, di=%d, dj=%d\n", name, lnum, x, i0, j0, di, dj);
-
-    return 0;
 }
 
-static int CheckRotationMatrix(int lnum, const char *name, astro_rotation_t r)
+#if defined(_WIN32)
+static DWORD WINAPI SearchThreadMain(LPVOID arg)
 {
-    if (r.status != ASTRO_SUCCESS)
-        FAILRET("C CheckRotationMatrix ERROR(%s line %d): status = %d\n", name, lnum, r.status);
-
-    /* Verify that every row and every column is a unit vector. */
-    if (CheckUnitVector(lnum, name, r, 0, 0, 1, 0)) return 1;
-    if (CheckUnitVector(lnum, name, r, 0, 1, 1, 0)) return 1;
-    if (CheckUnitVector(lnum, name, r, 0, 2, 1, 0)) return 1;
-    if (CheckUnitVector(lnum, name, r, 0, 0, 0, 1)) return 1;
-    if (CheckUnitVector(lnum, name, r, 1, 0, 0, 1)) return 1;
-    if (CheckUnitVector(lnum, name, r, 2, 0, 0, 1)) return 1;
+    SearchThreadWork((search_thread_t *)arg);
     return 0;
 }
-
-#define CHECK_ROTMAT(r)   CHECK(CheckRotationMatrix(__LINE__, #r, (r)))
-
-static int CompareVectors(const char *caller, astro_vector_t a, astro_vector_t b, double tolerance)
+#else
+static void *SearchThreadMain(void *arg)
 {
-    double diff;
-
-    if (a.status != ASTRO_SUCCESS)
-        FAILRET("C CompareVectors ERROR(%s): a.status = %d\n", caller, a.status);
-
-    if (b.status != ASTRO_SUCCESS)
-        FAILRET("C CompareVectors ERROR(%s): b.status = %d\n", caller, b.status);
-
-    diff = ABS(a.x - b.x);
-    if (diff > tolerance)
-        FAILRET("C CompareVectors ERROR(%s): x=%lg, expected %lg, diff %lg\n", caller, a.x, b.x, diff);
-
-    diff = ABS(a.y - b.y);
-    if (diff > tolerance)
-        FAILRET("C CompareVectors ERROR(%s): y=%lg, expected %lg, diff %lg\n", caller, a.y, b.y, diff);
-
-    diff = ABS(a.z - b.z);
-    if (diff > tolerance)
-        FAILRET("C CompareVectors ERROR(%s): z=%lg, expected %lg, diff %lg\n", caller, a.z, b.z, diff);
-
-    return 0;
+    SearchThreadWork((search_thread_t *)arg);
+    return NULL;
 }
+#endif
 
-static int CompareMatrices(const char *caller, astro_rotation_t a, astro_rotation_t b, double tolerance)
-{
-    int i, j;
-
-    if (a.status != ASTRO_SUCCESS)
-        FAILRET("C CompareMatrices ERROR(%s): a.status = %d\n", caller, a.status);
 
-    if (b.status != ASTRO_SUCCESS)
-        FAILRET("C CompareMatrices ERROR(%s): b.status = %d\n", caller, b.status);
+static int SearchBudgetThreadTest(void)
+{
+    int error, i, limit, expected;
+    search_thread_t work[SEARCH_THREAD_COUNT];
+    astro_search_result_t search;
+    astro_search_stats_t stats;
+    astro_observer_t observer = Astronomy_MakeObserver(29.0, -81.0, 10.0);
+    astro_time_t time = Astronomy_MakeTime(2022, 6, 1, 0, 0, 0.0);
+#if defined(_WIN32)
+    HANDLE thread[SEARCH_THREAD_COUNT];
+#else
+    pthread_t thread[SEARCH_THREAD_COUNT];
+#endif
+
+    /* Measure a single sunrise search using the default context. */
+    Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+    search = Astronomy_SearchRiseSet(BODY_SUN, observer, DIRECTION_RISE, time, 1.0);
+    CHECK_STATUS(search);
+    limit = Astronomy_ContextSearchStats(NULL).evaluations;
 
-    for (i=0; i < 3; ++i)
+    /*
+        Allow each search exactly the evaluations it needs, then run the same search
+        on several threads at once, all sharing the default context.
+        Each search must be charged only for its own work, so none may exceed the budget.
+    */
+    Astronomy_ContextSetSearchBudget(NULL, limit, 0.0);
+    for (i = 0; i < SEARCH_THREAD_COUNT; ++i)
     {
-        for (j=0; j < 3; ++j)
-        {
-            double diff = ABS(a.rot[i][j] - b.rot[i][j]);
-            if (diff > tolerance)
-                FAILRET("C CompareMatrices ERROR(%s): matrix[%d][%d]=%lg, expected %lg, diff %lg\n", caller, i, j, a.rot[i][j], b.rot[i][j], diff);
-        }
+        work[i].observer = observer;
+        work[i].time = time;
+        work[i].count = SEARCH_THREAD_SEARCHES;
+        work[i].failures = 0;
     }
 
-    return 0;
-}
-
-static int Rotation_MatrixInverse(void)
-{
-    astro_rotation_t a, b, v;
-    int error;
-
-    a.status = ASTRO_SUCCESS;
-    a.rot[0][0] = 1.0; a.rot[1][0] = 2.0; a.rot[2][0] = 3.0;
-    a.rot[0][1] = 4.0; a.rot[1][1] = 5.0; a.rot[2][1] = 6.0;
-    a.rot[0][2] = 7.0; a.rot[1][2] = 8.0; a.rot[2][2] = 9.0;
+    for (i = 0; i < SEARCH_THREAD_COUNT; ++i)
+    {
+#if defined(_WIN32)
+        thread[i] = CreateThread(NULL, 0, SearchThreadMain, &work[i], 0, NULL);
+        if (thread[i] == NULL)
+            FFAIL("CreateThread failed for thread %d\n", i);
+#else
+        if (pthread_create(&thread[i], NULL, SearchThreadMain, &work[i]))
+            FFAIL("pthread_create failed for thread %d\n", i);
+#endif
+    }
 
-    v.status = ASTRO_SUCCESS;
-    v.rot[0][0] = 1.0; v.rot[1][0] = 4.0; v.rot[2][0] = 7.0;
-    v.rot[0][1] = 2.0; v.rot[1][1] = 5.0; v.rot[2][1] = 8.0;
-    v.rot[0][2] = 3.0; v.rot[1][2] = 6.0; v.rot[2][2] = 9.0;
+    for (i = 0; i < SEARCH_THREAD_COUNT; ++i)
+    {
+#if defined(_WIN32)
+        WaitForSingleObject(thread[i], INFINITE);
+        CloseHandle(thread[i]);
+#else
+        pthread_join(thread[i], NULL);
+#endif
+    }
 
-    b = Astronomy_InverseRotation(a);
-    CHECK(CompareMatrices("Rotation_MatrixInverse", b, v, 0.0));
+    for (i = 0; i < SEARCH_THREAD_COUNT; ++i)
+        if (work[i].failures != 0)
+            FFAIL("Thread %d had %d of %d searches fail.\n", i, work[i].failures, work[i].count);
+
+    /* The statistics add up the work of every thread. Without atomic operations they may undercount. */
+    stats = Astronomy_ContextSearchStats(NULL);
+    expected = SEARCH_THREAD_COUNT * SEARCH_THREAD_SEARCHES * limit;
+    DEBUG("C SearchBudgetThreadTest: limit=%d, evaluations=%d, expected=%d\n", limit, stats.evaluations, expected);
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(ASTRONOMY_ENGINE_NO_ATOMICS)
+    if (stats.evaluations != expected)
+#else
+    if (stats.evaluations > expected)
+#endif
+        FFAIL("Expected %d evaluations, but found %d\n", expected, stats.evaluations);
 
     FPASS();
 fail:
+    Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
     return error;
 }
 
-static int Rotation_Pivot(void)
+static int AlmanacExpected(astro_observer_t observer, int column, astro_time_t time, double *hours)
 {
     int error;
-    astro_rotation_t ident;
-    astro_rotation_t r;
-    astro_rotation_t a;
-    astro_vector_t v1, v2, ve;
-    const double tolerance = 1.0e-15;
-
-    /* Test #1 */
-
-    /* Start with an identity matrix. */
-    ident = Astronomy_IdentityMatrix();
-
-    /* Pivot 90 degrees counterclockwise around the z-axis. */
-    r = Astronomy_Pivot(ident, 2, +90.0);
-    CHECK_STATUS(r);
-
-    /* Put the expected answer in 'a'. */
-    a.status = ASTRO_SUCCESS;
-    a.rot[0][0] =  0.0;  a.rot[1][0] = -1.0;  a.rot[2][0] =  0.0;
-    a.rot[0][1] = +1.0;  a.rot[1][1] =  0.0;  a.rot[2][1] =  0.0;
-    a.rot[0][2] =  0.0;  a.rot[1][2] =  0.0;  a.rot[2][2] =  1.0;
-
-    /* Compare actual 'r' with expected 'a'. */
-    CHECK(CompareMatrices("Rotation_Pivot #1", r, a, tolerance));
-
-    /* Test #2. */
+    astro_search_result_t search;
+    astro_hour_angle_t culm;
+    astro_body_t body = (column >= ALMANAC_MOONRISE) ? BODY_MOON : BODY_SUN;
+    astro_direction_t direction = (column == ALMANAC_SUNRISE || column == ALMANAC_MOONRISE || column == ALMANAC_CIVIL_DAWN ||
+        column == ALMANAC_NAUTICAL_DAWN || column == ALMANAC_ASTRONOMICAL_DAWN) ? DIRECTION_RISE : DIRECTION_SET;
 
-    /* Pivot again, -30 degrees around the x-axis. */
-    r = Astronomy_Pivot(r, 0, -30.0);
-    CHECK_STATUS(r);
+    *hours = NAN;
+    switch (column)
+    {
+    case ALMANAC_SUN_CULMINATION:
+    case ALMANAC_MOON_CULMINATION:
+        culm = Astronomy_SearchHourAngleEx(body, observer, 0.0, time, +1);
+        CHECK_STATUS(culm);
+        search.status = ASTRO_SUCCESS;
+        search.time = culm.time;
+        break;
 
-    /* Pivot a third time, 180 degrees around the y-axis. */
-    r = Astronomy_Pivot(r, 1, +180.0);
+    case ALMANAC_CIVIL_DAWN:
+    case ALMANAC_CIVIL_DUSK:
+        search = Astronomy_SearchAltitude(body, observer, direction, time, 1.0, -6.0);
+        break;
 
-    /* Use the 'r' matrix to rotate a vector. */
-    v1.status = ASTRO_SUCCESS;
-    v1.t = Astronomy_MakeTime(2000, 1, 1, 0, 0, 0.0);
-    v1.x = 1.0;
-    v1.y = 2.0;
-    v1.z = 3.0;
+    case ALMANAC_NAUTICAL_DAWN:
+    case ALMANAC_NAUTICAL_DUSK:
+        search = Astronomy_SearchAltitude(body, observer, direction, time, 1.0, -12.0);
+        break;
 
-    v2 = Astronomy_RotateVector(r, v1);
-    CHECK_STATUS(v2);
+    case ALMANAC_ASTRONOMICAL_DAWN:
+    case ALMANAC_ASTRONOMICAL_DUSK:
+        search = Astronomy_SearchAltitude(body, observer, direction, time, 1.0, -18.0);
+        break;
 
-    /* Initialize the expected vector 've'. */
-    ve.status = ASTRO_SUCCESS;
-    ve.t = v1.t;
-    ve.x = +2.0;
-    ve.y = +2.3660254037844390;
-    ve.z = -2.0980762113533156;
+    default:
+        search = Astronomy_SearchRiseSet(body, observer, direction, time, 1.0);
+        break;
+    }
 
-    CHECK(CompareVectors("Rotation_Pivot #2", v2, ve, tolerance));
+    if (search.status == ASTRO_SUCCESS && search.time.ut < time.ut + 1.0)
+        *hours = 24.0 * (search.time.ut - time.ut);
+    else if (search.status != ASTRO_SUCCESS && search.status != ASTRO_SEARCH_FAILURE)
+        FFAIL("Search for column %d returned status %d\n", column, search.status);
 
-    FPASS();
+    error = 0;
 fail:
     return error;
 }
 
-static int Rotation_MatrixMultiply(void)
-{
-    astro_rotation_t  a, b, c, v;
-    int error;
 
-    a.status = ASTRO_SUCCESS;
-    a.rot[0][0] = 1.0; a.rot[1][0] = 2.0; a.rot[2][0] = 3.0;
-    a.rot[0][1] = 4.0; a.rot[1][1] = 5.0; a.rot[2][1] = 6.0;
-    a.rot[0][2] = 7.0; a.rot[1][2] = 8.0; a.rot[2][2] = 9.0;
+static int AlmanacTest(void)
+{
+    int error, i, day, column, count = 0;
+    astro_status_t status;
+    astro_time_t start, time;
+    double expected, diff, max_diff = 0.0;
+    float *table = NULL;
+    float value;
+    const int ndays = 30;
+    static const astro_observer_t observers[] =
+    {
+        {  +40.0,   -75.0,    0.0 },
+        {  -33.9,   +18.4,   50.0 },
+        {  +64.8,  -147.7,  136.0 },
+        {   +1.3,  +103.8,   15.0 },
+        {  +69.6,   +18.9,  100.0 }
+    };
+    const int nobs = (int)(sizeof(observers) / sizeof(observers[0]));
 
-    b.status = ASTRO_SUCCESS;
-    b.rot[0][0] = 10.0; b.rot[1][0] = 11.0; b.rot[2][0] = 12.0;
-    b.rot[0][1] = 13.0; b.rot[1][1] = 14.0; b.rot[2][1] = 15.0;
-    b.rot[0][2] = 16.0; b.rot[1][2] = 17.0; b.rot[2][2] = 18.0;
+    table = calloc((size_t)ALMANAC_NUM_COLUMNS * nobs * ndays, sizeof(float));
+    if (table == NULL)
+        FFAIL("Out of memory.\n");
 
-    v.status = ASTRO_SUCCESS;
-    v.rot[0][0] =  84.0; v.rot[1][0] =  90.0; v.rot[2][0] =  96.0;
-    v.rot[0][1] = 201.0; v.rot[1][1] = 216.0; v.rot[2][1] = 231.0;
-    v.rot[0][2] = 318.0; v.rot[1][2] = 342.0; v.rot[2][2] = 366.0;
+    start = Astronomy_MakeTime(2025, 5, 1, 0, 0, 0.0);
+    status = Astronomy_Almanac(observers, nobs, start, ndays, table);
+    if (status != ASTRO_SUCCESS)
+        FFAIL("Astronomy_Almanac returned status %d\n", status);
 
-    /* Let c = a*b. The order looks backwards in the call to make rotation semantics more intuitive. */
-    c = Astronomy_CombineRotation(b, a);
+    for (i = 0; i < nobs; ++i)
+    {
+        for (day = 0; day < ndays; ++day)
+        {
+            time = Astronomy_AddDays(start, day);
+            for (column = 0; column < ALMANAC_NUM_COLUMNS; ++column)
+            {
+                CHECK(AlmanacExpected(observers[i], column, time, &expected));
+                value = table[(column*nobs + i)*ndays + day];
+                if (isnan(expected) != isnan(value))
+                    FFAIL("Observer %d, day %d, column %d: expected %0.6lf hours, but found %0.6lf\n", i, day, column, expected, value);
+                if (!isnan(expected))
+                {
+                    diff = V(3600.0 * fabs(value - expected));
+                    if (diff > max_diff)
+                        max_diff = diff;
+                    ++count;
+                }
+            }
+        }
+    }
 
-    /* Verify that c = v. */
-    CHECK(CompareMatrices("Rotation_MatrixMultiply", c, v, 0.0));
+    DEBUG("C AlmanacTest: %d events, max_diff = %0.3lf seconds\n", count, max_diff);
+    if (max_diff > 0.5)
+        FFAIL("EXCESSIVE time error = %0.3lf seconds\n", max_diff);
 
     FPASS();
 fail:
+    free(table);
     return error;
 }
 
-static int TestVectorFromAngles(double lat, double lon, double x, double y, double z)
-{
-    astro_spherical_t sphere;
-    astro_vector_t vector;
-    astro_time_t time;
-    double diff, dx, dy, dz;
-
-    /* Confirm the expected vector really is a unit vector. */
-    diff = ABS((x*x + y*y + z*z) - 1.0);
-    if (diff > 1.0e-16)
-        FAILRET("C %s: EXCESSIVE unit error = %lg\n", __func__, diff);
-
-    sphere.status = ASTRO_SUCCESS;
-    sphere.lat = lat;
-    sphere.lon = lon;
-    sphere.dist = 1.0;
-
-    time = Astronomy_MakeTime(2015, 3, 5, 12, 0, 0.0);
-    vector = Astronomy_VectorFromSphere(sphere, time);
 
-    if (vector.status != ASTRO_SUCCESS)
-        FAILRET("C ERROR(TestVectorFromAngles): vector.status = %d\n", vector.status);
+static int CheckIlluminationInvalidBody(astro_body_t body)
+{
+    astro_illum_t illum;
+    astro_time_t time = Astronomy_MakeTime(2021, 11, 10, 0, 8, 16.0);
 
-    dx = x - vector.x;
-    dy = y - vector.y;
-    dz = z - vector.z;
-    diff = V(sqrt(dx*dx + dy*dy + dz*dz));
+    /* Verify that invalid bodies return errors. */
 
-    DEBUG("C TestVectorFromAngles(%lf, %lf): diff = %lg\n", lat, lon, diff);
-    if (diff > 2.0e-16)
-        FAILRET("C %s: EXCESSIVE ERROR.\n", __func__);
+    illum = Astronomy_Illumination(body, time);
+    if (illum.status == ASTRO_SUCCESS)
+        FAILRET("C %s: FAILURE -- incorrect success status for body %d\n", __func__, (int)body);
 
-    return 0;
+    return 0;   /* Correct behavior. */
 }
 
-static int TestAnglesFromVector(double lat, double lon, double x, double y, double z)
+static int MagnitudeTest(void)
 {
-    astro_vector_t vector;
-    astro_spherical_t sphere;
-    double diff, latdiff, londiff;
-
-    /* Confirm the expected vector really is a unit vector. */
-    diff = ABS((x*x + y*y + z*z) - 1.0);
-    if (diff > 1.0e-16)
-        FAILRET("C TestAnglesFromVector(lat=%lf, lon=%lf, x=%lf, y=%lf, z=%lf): EXCESSIVE unit error = %lg\n", lat, lon, x, y, z, diff);
+    int nfailed = 0;
 
-    vector.status = ASTRO_SUCCESS;
-    vector.t = Astronomy_MakeTime(2015, 3, 5, 12, 0, 0.0);
-    vector.x = x;
-    vector.y = y;
-    vector.z = z;
-
-    sphere = Astronomy_SphereFromVector(vector);
-    if (sphere.status != ASTRO_SUCCESS)
-        FAILRET("C %s(lat=%lf, lon=%lf, x=%lf, y=%lf, z=%lf): sphere.status = %d\n", __func__, lat, lon, x, y, z, sphere.status);
-
-    latdiff = ABS(sphere.lat - lat);
-    londiff = ABS(sphere.lon - lon);
-    DEBUG("TestAnglesFromVector(x=%lf, y=%lf, z=%lf): latdiff=%lg, londiff=%lg\n", x, y, z, latdiff, londiff);
-    if (latdiff > 8.0e-15 || londiff > 8.0e-15)
-        FAILRET("C %s: EXCESSIVE ERROR\n", __func__);
-
-    return 0;
-}
-
-static astro_rotation_t RotateX(double rot)
-{
-    astro_rotation_t m;
-    double ca, sa;
-
-    /* https://en.wikipedia.org/wiki/Rotation_matrix */
-
-    ca = cos(rot * DEG2RAD);
-    sa = sin(rot * DEG2RAD);
-    m.status = ASTRO_SUCCESS;
-    m.rot[0][0] = 1.0;  m.rot[1][0] = 0.0;  m.rot[2][0] = 0.0;
-    m.rot[0][1] = 0.0;  m.rot[1][1] = +ca;  m.rot[2][1] = -sa;
-    m.rot[0][2] = 0.0;  m.rot[1][2] = +sa;  m.rot[2][2] = +ca;
-
-    return m;
-}
-
-static astro_rotation_t RotateY(double rot)
-{
-    astro_rotation_t m;
-    double ca, sa;
-
-    /* https://en.wikipedia.org/wiki/Rotation_matrix */
-
-    ca = cos(rot * DEG2RAD);
-    sa = sin(rot * DEG2RAD);
-    m.status = ASTRO_SUCCESS;
-    m.rot[0][0] = +ca;  m.rot[1][0] = 0.0;  m.rot[2][0] = +sa;
-    m.rot[0][1] = 0.0;  m.rot[1][1] = 1.0;  m.rot[2][1] = 0.0;
-    m.rot[0][2] = -sa;  m.rot[1][2] = 0.0;  m.rot[2][2] = +ca;
-
-    return m;
-}
-
-static astro_rotation_t RotateZ(double rot)
-{
-    astro_rotation_t m;
-    double ca, sa;
-
-    /* https://en.wikipedia.org/wiki/Rotation_matrix */
-
-    ca = cos(rot * DEG2RAD);
-    sa = sin(rot * DEG2RAD);
-    m.status = ASTRO_SUCCESS;
-    m.rot[0][0] = +ca;  m.rot[1][0] = -sa;  m.rot[2][0] = 0.0;
-    m.rot[0][1] = +sa;  m.rot[1][1] = +ca;  m.rot[2][1] = 0.0;
-    m.rot[0][2] = 0.0;  m.rot[1][2] = 0.0;  m.rot[2][2] = 1.0;
-
-    return m;
-}
-
-static int TestSpin(
-    double xrot, double yrot, double zrot,
-    double sx, double sy, double sz,
-    double tx, double ty, double tz)
-{
-    astro_rotation_t mx, my, mz, m;
-    astro_vector_t sv, tv;
-    double diff, dx, dy, dz;
-    int error;
-
-    /* https://en.wikipedia.org/wiki/Rotation_matrix */
-
-    mx = RotateX(xrot);
-    CHECK_ROTMAT(mx);
-    my = RotateY(yrot);
-    CHECK_ROTMAT(my);
-    mz = RotateZ(zrot);
-    CHECK_ROTMAT(mz);
-    m = Astronomy_CombineRotation(mx, my);
-    CHECK_ROTMAT(m);
-    m = Astronomy_CombineRotation(m, mz);
-    CHECK_ROTMAT(m);
-
-    sv.status = ASTRO_SUCCESS;
-    sv.x = sx;
-    sv.y = sy;
-    sv.z = sz;
-    sv.t = Astronomy_MakeTime(2019, 5, 5, 12, 30, 0.0);
+    nfailed += CheckIlluminationInvalidBody(BODY_INVALID);
+    nfailed += CheckIlluminationInvalidBody(BODY_EARTH);
+    nfailed += CheckIlluminationInvalidBody(BODY_EMB);
+    nfailed += CheckIlluminationInvalidBody(BODY_SSB);
+    nfailed += CheckIlluminationInvalidBody((astro_body_t)2112);
 
-    tv = Astronomy_RotateVector(m, sv);
-    if (tv.status != ASTRO_SUCCESS)
-        FAIL("C ERROR(TestSpin): tv.status = %d\n", tv.status);
+    nfailed += CheckMagnitudeData(BODY_SUN,     "magnitude/Sun.txt");
+    nfailed += CheckMagnitudeData(BODY_MOON,    "magnitude/Moon.txt");
+    nfailed += CheckMagnitudeData(BODY_MERCURY, "magnitude/Mercury.txt");
+    nfailed += CheckMagnitudeData(BODY_VENUS,   "magnitude/Venus.txt");
+    nfailed += CheckMagnitudeData(BODY_MARS,    "magnitude/Mars.txt");
+    nfailed += CheckMagnitudeData(BODY_JUPITER, "magnitude/Jupiter.txt");
+    nfailed += CheckSaturn();
+    nfailed += CheckMagnitudeData(BODY_URANUS,  "magnitude/Uranus.txt");
+    nfailed += CheckMagnitudeData(BODY_NEPTUNE, "magnitude/Neptune.txt");
+    nfailed += CheckMagnitudeData(BODY_PLUTO,   "magnitude/Pluto.txt");
 
-    if (tv.t.ut != sv.t.ut)
-        FAIL("C ERROR(TestSpin): tv time != sv time\n");
+    nfailed += TestMaxMag(BODY_VENUS, "magnitude/maxmag_Venus.txt");
 
-    dx = tx - tv.x;
-    dy = ty - tv.y;
-    dz = tz - tv.z;
-    diff = V(sqrt(dx*dx + dy*dy + dz*dz));
-    DEBUG("C TestSpin(xrot=%0.0lf, yrot=%0.0lf, zrot=%0.0lf, sx=%0.0lf, sy=%0.0lf, sz=%0.0lf): diff = %lg\n", xrot, yrot, zrot, sx, sy, sz, diff);
-    if (diff > 1.0e-15)
-        FFAIL("EXCESSIVE ERROR\n");
+    if (nfailed == 0)
+        printf("C %s: PASS\n", __func__);
+    else
+        fprintf(stderr, "C %s: FAILED %d test(s).\n", __func__, nfailed);
 
-    error = 0;
-fail:
-    return error;
+    return nfailed;
 }
 
-static int Test_EQJ_GAL_NOVAS(const char *filename)
+static int TestMaxMag(astro_body_t body, const char *filename)
 {
-    /* Compare against ICRS/GAL calculated by NOVAS C 3.1. */
-    const double THRESHOLD_SECONDS = 8.8;
-    int error;
-    double ra, dec, glon, glat;
-    double dlon, dlat, diff, max_diff;
+    int error = 1;
     FILE *infile = NULL;
     int lnum, nscanned;
+    int year1, month1, day1, hour1, minute1;
+    int year2, month2, day2, hour2, minute2;
+    double correct_mag, correct_angle1, correct_angle2;
     char line[100];
-    astro_rotation_t rot, inv;
-    astro_time_t time;
-    astro_spherical_t eqj_sphere, gal_sphere;
-    astro_vector_t eqj_vec, gal_vec;
+    astro_time_t search_time, time1, time2, center_time;
+    astro_illum_t illum;
+    double mag_diff, hours_diff;
 
-    time = Astronomy_MakeTime(2000, 1, 1, 0, 0, 0.0);   /* placeholder time - value does not matter */
+    /*
+        Example of input data:
 
-    rot = Astronomy_Rotation_EQJ_GAL();
-    CHECK_STATUS(rot);
+        2001-02-21T08:00Z 2001-02-27T08:00Z 23.17 19.53 -4.84
 
-    inv = Astronomy_Rotation_GAL_EQJ();
-    CHECK_STATUS(inv);
-    CHECK_INVERSE(rot, inv);
+        JPL Horizons test data has limited floating point precision in the magnitude values.
+        There is a pair of dates for the beginning and end of the max magnitude period,
+        given the limited precision. We pick the point halfway between as the supposed max magnitude time.
+    */
 
     infile = fopen(filename, "rt");
     if (infile == NULL)
         FFAIL("Cannot open input file: %s\n", filename);
 
-    max_diff = 0.0;
     lnum = 0;
+    search_time = Astronomy_MakeTime(2001, 1, 1, 0, 0, 0.0);
     while (ReadLine(line, sizeof(line), infile, filename, lnum))
     {
         ++lnum;
-        nscanned = sscanf(line, "%lf %lf %lf %lf", &ra, &dec, &glon, &glat);
-        if (nscanned != 4)
-            FAIL("C Test_EQJ_GAL_NOVAS(%s line %d): bad input format.\n", filename, lnum);
-        V(ra);
-        V(dec);
-        V(glon);
-        V(glat);
 
-        /* Use Astronomy Engine to do the same EQJ/GAL conversion. */
-        eqj_sphere.status = ASTRO_SUCCESS;
-        eqj_sphere.dist = 1.0;
-        eqj_sphere.lon = 15.0 * ra;     /* Convert from sidereal hours to degrees. */
-        eqj_sphere.lat = dec;
+        nscanned = sscanf(line, "%d-%d-%dT%d:%dZ %d-%d-%dT%d:%dZ %lf %lf %lf\n",
+            &year1, &month1, &day1, &hour1, &minute1,
+            &year2, &month2, &day2, &hour2, &minute2,
+            &correct_angle1, &correct_angle2, &correct_mag);
 
-        eqj_vec = Astronomy_VectorFromSphere(eqj_sphere, time);
-        CHECK_STATUS(eqj_vec);
+        if (nscanned != 13)
+            FLNFAIL("invalid data format.\n");
 
-        gal_vec = Astronomy_RotateVector(rot, eqj_vec);
-        CHECK_STATUS(gal_vec);
+        time1 = Astronomy_MakeTime(year1, month1, day1, hour1, minute1, 0.0);
+        time2 = Astronomy_MakeTime(year2, month2, day2, hour2, minute2, 0.0);
+        center_time = Astronomy_AddDays(time1, 0.5*(time2.ut - time1.ut));
 
-        gal_sphere = Astronomy_SphereFromVector(gal_vec);
-        CHECK_STATUS(gal_sphere);
+        illum = Astronomy_SearchPeakMagnitude(body, search_time);
+        if (illum.status != ASTRO_SUCCESS)
+            FLNFAIL("SearchPeakMagnitude returned %d\n", illum.status);
 
-        dlat = V(gal_sphere.lat - glat);
-        dlon = cos(DEG2RAD * glat) * V(gal_sphere.lon - glon);
-        diff = V(3600.0 * sqrt(dlon*dlon + dlat*dlat));     /* error in arcseconds */
-        if (diff > THRESHOLD_SECONDS)
-            FAIL("C Test_EQJ_GAL_NOVAS(%s line %d): EXCESSIVE ERROR = %0.3lf arcseconds\n", filename, lnum, diff);
+        mag_diff = ABS(illum.mag - correct_mag);
+        hours_diff = 24.0 * ABS(illum.time.ut - center_time.ut);
+        FDEBUG("mag_diff=%0.3lf, hours_diff=%0.3lf\n", mag_diff, hours_diff);
+        if (hours_diff > 7.1)
+            FLNFAIL("EXCESSIVE TIME DIFFERENCE.\n");
 
-        if (diff > max_diff)
-            max_diff = diff;
+        if (mag_diff > 0.005)
+            FLNFAIL("EXCESSIVE MAGNITUDE DIFFERENCE.\n");
+
+        search_time = time2;
     }
 
-    FDEBUG("PASS. max_diff = %0.3lf arcseconds.\n", max_diff);
-    error = 0;
+    FPASSA("processed %d lines from file %s\n", lnum, filename);
 fail:
     if (infile != NULL) fclose(infile);
     return error;
 }
 
-static int Test_EQJ_GAL_JPL(const char *filename)
-{
-    /*
-        Compare against ICRS/GAL calculated by JPL Horizons tool.
-        We get a fairly large error of 23 arcseconds due because I
-        can't figure out how to make JPL Horizons use the same
-        aberration settings in equatorial and galactic coordinates.
-    */
-    const double THRESHOLD_SECONDS = 23.0;
-    int error, lnum, nscanned;
-    int found_begin = 0;
-    int found_end = 0;
-    double ra, dec, glon, glat;
-    FILE *infile = NULL;
-    char line[100];
-    astro_rotation_t rot;
-    astro_time_t time;
-    astro_spherical_t eqj_sphere, gal_sphere;
-    astro_vector_t eqj_vec, gal_vec;
-    double dlon, dlat, diff, max_diff = 0.0;
+/*-----------------------------------------------------------------------------------------------------------*/
 
-    time = Astronomy_MakeTime(2000, 1, 1, 0, 0, 0.0);   /* placeholder time - value does not matter */
+static int ParseMonthName(const char *mtext, int *month)
+{
+    if (month == NULL)
+        return 1;
 
-    rot = Astronomy_Rotation_EQJ_GAL();
-    CHECK_STATUS(rot);
+    *month = -1;
 
-    infile = fopen(filename, "rt");
-    if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", filename);
+    if (mtext == NULL)
+        return 2;
 
-    lnum = 0;
-    while (!found_end && ReadLine(line, sizeof(line), infile, filename, lnum))
-    {
-        ++lnum;
-        if (!found_begin)
-        {
-            if (strlen(line) >= 5 && !memcmp(line, "$$SOE", 5))
-                found_begin = 1;
-        }
-        else if (strlen(line) >= 5 && !memcmp(line, "$$EOE", 5))
-        {
-            found_end = 1;
-        }
-        else
-        {
-            if (strlen(line) < 18)
-                FAIL("C Test_EQJ_GAL_JPL(%s line %d): line is too short.\n", filename, lnum);
+    if (!strcmp(mtext, "Jan"))
+        *month = 1;
+    else if (!strcmp(mtext, "Feb"))
+        *month = 2;
+    else if (!strcmp(mtext, "Mar"))
+        *month = 3;
+    else if (!strcmp(mtext, "Apr"))
+        *month = 4;
+    else if (!strcmp(mtext, "May"))
+        *month = 5;
+    else if (!strcmp(mtext, "Jun"))
+        *month = 6;
+    else if (!strcmp(mtext, "Jul"))
+        *month = 7;
+    else if (!strcmp(mtext, "Aug"))
+        *month = 8;
+    else if (!strcmp(mtext, "Sep"))
+        *month = 9;
+    else if (!strcmp(mtext, "Oct"))
+        *month = 10;
+    else if (!strcmp(mtext, "Nov"))
+        *month = 11;
+    else if (!strcmp(mtext, "Dec"))
+        *month = 12;
+    else
+        return 3;
 
-            nscanned = sscanf(line+18, "%lf %lf %lf %lf", &ra, &dec, &glon, &glat);
-            if (nscanned != 4)
-                FAIL("C Test_EQJ_GAL_JPL(%s line %d): invalid data format.\n", filename, lnum);
+    return 0;   /* success */
+}
 
-            V(ra);
-            V(dec);
-            V(glon);
-            V(glat);
+static const char *ParseJplHorizonsDateTime(const char *text, astro_time_t *time)
+{
+    int year, month, day, hour, minute;
+    int nscanned;
+    char mtext[4];
+    char verify[30];
+    size_t length;
 
-            /* Use Astronomy Engine to do the same EQJ/GAL conversion. */
-            eqj_sphere.status = ASTRO_SUCCESS;
-            eqj_sphere.dist = 1.0;
-            eqj_sphere.lon = ra;        /* RA is already in degrees in the JPL Horizons input file. */
-            eqj_sphere.lat = dec;
+    time->ut = time->tt = NAN;
 
-            eqj_vec = Astronomy_VectorFromSphere(eqj_sphere, time);
-            CHECK_STATUS(eqj_vec);
+    while (*text == ' ')
+        ++text;
 
-            gal_vec = Astronomy_RotateVector(rot, eqj_vec);
-            CHECK_STATUS(gal_vec);
+    nscanned = sscanf(text, "%d-%3[A-Za-z]-%d %d:%d", &year, mtext, &day, &hour, &minute);
+    if (nscanned != 5)
+        return NULL;
 
-            gal_sphere = Astronomy_SphereFromVector(gal_vec);
-            CHECK_STATUS(gal_sphere);
+    if (year < 1000 || year > 9999)
+        return NULL;       /* if not a 4-digit year, we are skipping wrong number of chars */
 
-            dlat = V(gal_sphere.lat - glat);
-            dlon = cos(DEG2RAD * glat) * V(gal_sphere.lon - glon);
-            diff = V(3600.0 * sqrt(dlon*dlon + dlat*dlat));     /* error in arcseconds */
-            if (diff > THRESHOLD_SECONDS)
-                FAIL("C Test_EQJ_GAL_JPL(%s line %d): EXCESSIVE ERROR = %0.3lf arcseconds\n", filename, lnum, diff);
+    if (day < 1 || day > 31)
+        return NULL;
 
-            if (diff > max_diff)
-                max_diff = diff;
-        }
-    }
+    if (hour < 0 || hour > 23)
+        return NULL;
 
-    if (!found_begin)
-        FFAIL("did not find begin-data marker in: %s\n", filename);
+    if (minute < 0 || minute > 59)
+        return NULL;
 
-    if (!found_end)
-        FFAIL("did not find end-data marker in: %s\n", filename);
+    if (!strcmp(mtext, "Jan"))
+        month = 1;
+    else if (!strcmp(mtext, "Feb"))
+        month = 2;
+    else if (!strcmp(mtext, "Mar"))
+        month = 3;
+    else if (!strcmp(mtext, "Apr"))
+        month = 4;
+    else if (!strcmp(mtext, "May"))
+        month = 5;
+    else if (!strcmp(mtext, "Jun"))
+        month = 6;
+    else if (!strcmp(mtext, "Jul"))
+        month = 7;
+    else if (!strcmp(mtext, "Aug"))
+        month = 8;
+    else if (!strcmp(mtext, "Sep"))
+        month = 9;
+    else if (!strcmp(mtext, "Oct"))
+        month = 10;
+    else if (!strcmp(mtext, "Nov"))
+        month = 11;
+    else if (!strcmp(mtext, "Dec"))
+        month = 12;
+    else
+        return NULL;
 
-    FDEBUG("PASS. max_diff = %0.3lf arcseconds.\n", max_diff);
-    error = 0;
-fail:
-    if (infile != NULL) fclose(infile);
-    return error;
-}
+    /* Make absolutely sure we know how many characters the date text is. */
+    /* If anything is fishy, fail! */
+    snprintf(verify, sizeof(verify), "%04d-%s-%02d %02d:%02d", year, mtext, day, hour, minute);
+    length = strlen(verify);
+    if (length != 17)
+        return NULL;
 
-static int Test_EQJ_EQD(astro_body_t body)
-{
-    astro_time_t time;
-    astro_observer_t observer;
-    astro_equatorial_t eq2000, eqdate, eqcheck;
-    astro_vector_t v2000, vdate, t2000;
-    astro_rotation_t r;
-    double ra_diff, dec_diff, dist_diff, diff;
-    int error;
+    if (memcmp(verify, text, length))
+        return NULL;
 
-    /* Verify conversion of equatorial J2000 to equatorial of-date, and back. */
+    *time = Astronomy_MakeTime(year, month, day, hour, minute, 0.0);
+    return text + length;   /* return remaining portion of string */
+}
 
-    /* Use established functions to calculate spherical coordinates for the body, in both EQJ and EQD. */
-    time = Astronomy_MakeTime(2019, 12, 8, 20, 50, 0.0);
-    observer = Astronomy_MakeObserver(35, -85, 0);
-    eq2000 = Astronomy_Equator(body, &time, observer, EQUATOR_J2000, ABERRATION);
-    CHECK_STATUS(eq2000);
-    eqdate = Astronomy_Equator(body, &time, observer, EQUATOR_OF_DATE, ABERRATION);
-    CHECK_STATUS(eqdate);
+/*-----------------------------------------------------------------------------------------------------------*/
 
-    /* Convert EQJ angular coordinates to vector. */
-    v2000 = eq2000.vec;
-    CHECK_STATUS(v2000);
+static int LunarApsis(void)
+{
+    const char *filename = "apsides/moon.txt";
+    int error = 1;
+    FILE *infile = NULL;
+    int lnum, nscanned;
+    char line[100];
+    int kind, year, month, day, hour, minute;
+    double dist_km;
+    astro_time_t start_time, correct_time;
+    astro_apsis_t apsis;
+    double diff_minutes, diff_km;
+    double max_minutes = 0.0, max_km = 0.0;
 
-    /* Find rotation matrix. */
-    r = Astronomy_Rotation_EQJ_EQD(&time);
-    CHECK_ROTMAT(r);
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FFAIL("Cannot open input file: %s\n", filename);
 
-    /* Rotate EQJ vector to EQD vector. */
-    vdate = Astronomy_RotateVector(r, v2000);
-    CHECK_STATUS(vdate);
+    /*
+        0 2001-01-10T08:59Z 357132
+        1 2001-01-24T19:02Z 406565
+    */
 
-    /* Convert vector back to angular coordinates. */
-    eqcheck = Astronomy_EquatorFromVector(vdate);
-    CHECK_STATUS(eqcheck);
+    start_time = Astronomy_MakeTime(2001, 1, 1, 0, 0, 0.0);
+    lnum = 0;
+    while (ReadLine(line, sizeof(line), infile, filename, lnum))
+    {
+        ++lnum;
 
-    /* Compare the result with the eqdate. */
-    ra_diff = ABS(eqcheck.ra - eqdate.ra);
-    dec_diff = ABS(eqcheck.dec - eqdate.dec);
-    dist_diff = ABS(eqcheck.dist - eqdate.dist);
-    FDEBUG("%s ra=%0.3lf, dec=%0.3lf, dist=%0.3lf, ra_diff=%lg, dec_diff=%lg, dist_diff=%lg\n", Astronomy_BodyName(body), eqdate.ra, eqdate.dec, eqdate.dist, ra_diff, dec_diff, dist_diff);
-    if (ra_diff > 1.0e-14 || dec_diff > 1.0e-14 || dist_diff > 4.0e-15)
-        FFAIL("EXCESSIVE ERROR\n");
+        if (lnum == 1)
+            apsis = Astronomy_SearchLunarApsis(start_time);
+        else
+            apsis = Astronomy_NextLunarApsis(apsis);
 
-    /* Perform the inverse conversion back to equatorial J2000 coordinates. */
-    r = Astronomy_Rotation_EQD_EQJ(&time);
-    CHECK_ROTMAT(r);
-    t2000 = Astronomy_RotateVector(r, vdate);
-    CHECK_STATUS(t2000);
-    CHECK(VectorDiff(t2000, v2000, &diff));
-    FDEBUG("%s inverse diff = %lg\n", Astronomy_BodyName(body), diff);
-    if (diff > 5.0e-15)
-        FFAIL("EXCESSIVE INVERSE ERROR\n");
+        if (apsis.status != ASTRO_SUCCESS)
+            FLNFAIL("Failed to find apsis.\n");
 
-    error = 0;
-fail:
-    return error;
-}
+        nscanned = sscanf(line, "%d %d-%d-%dT%d:%dZ %lf", &kind, &year, &month, &day, &hour, &minute, &dist_km);
+        if (nscanned != 7)
+            FLNFAIL("invalid data format\n");
 
-static int Test_EQD_HOR(astro_body_t body)
-{
-    astro_time_t time;
-    astro_observer_t observer;
-    astro_equatorial_t eqd, eqj;
-    astro_horizon_t hor;
-    astro_rotation_t rot;
-    astro_spherical_t sphere;
-    astro_vector_t vec_eqd, vec_eqj, vec_hor, check_eqd, check_eqj, check_hor;
-    double diff_az, diff_alt, diff;
-    int error;
+        if (kind != apsis.kind)
+            FLNFAIL("expected apsis kind %d but found %d\n", kind, apsis.kind);
 
-    /* Use existing functions to calculate horizontal coordinates of the body for the time+observer. */
-    time = Astronomy_MakeTime(1970, 12, 13, 5, 15, 0.0);
-    observer = Astronomy_MakeObserver(-37.0, +45.0, 0.0);
-    CHECK_EQU(eqd, Astronomy_Equator(body, &time, observer, EQUATOR_OF_DATE, ABERRATION));
-    DEBUG("C Test_EQD_HOR %s: OFDATE ra=%0.3lf, dec=%0.3lf\n", Astronomy_BodyName(body), eqd.ra, eqd.dec);
-    hor = Astronomy_Horizon(&time, observer, eqd.ra, eqd.dec, REFRACTION_NORMAL);
+        correct_time = Astronomy_MakeTime(year, month, day, hour, minute, 0.0);
 
-    /* Calculate the position of the body as an equatorial vector of date. */
-    CHECK_VECTOR(vec_eqd, eqd.vec);
+        diff_minutes = (24.0 * 60.0) * ABS(apsis.time.ut - correct_time.ut);
+        diff_km = ABS(apsis.dist_km - dist_km);
 
-    /* Calculate rotation matrix to convert equatorial J2000 vector to horizontal vector. */
-    rot = Astronomy_Rotation_EQD_HOR(&time, observer);
-    CHECK_ROTMAT(rot);
+        if (diff_minutes > 35.0)
+            FLNFAIL("Excessive time error: %lf minutes.\n", diff_minutes);
 
-    /* Rotate the equator of date vector to a horizontal vector. */
-    CHECK_VECTOR(vec_hor, Astronomy_RotateVector(rot, vec_eqd));
+        if (diff_km > 25.0)
+            FLNFAIL("Excessive distance error: %lf km.\n", diff_km);
 
-    /* Convert the horizontal vector to horizontal angular coordinates. */
-    sphere = Astronomy_HorizonFromVector(vec_hor, REFRACTION_NORMAL);
-    CHECK_STATUS(sphere);
+        if (diff_minutes > max_minutes)
+            max_minutes = diff_minutes;
 
-    diff_alt = ABS(sphere.lat - hor.altitude);
-    diff_az = ABS(sphere.lon - hor.azimuth);
-
-    DEBUG("C Test_EQD_HOR %s: trusted alt=%0.3lf, az=%0.3lf; test alt=%0.3lf, az=%0.3lf; diff_alt=%lg, diff_az=%lg\n",
-        Astronomy_BodyName(body), hor.altitude, hor.azimuth, sphere.lat, sphere.lon, diff_alt, diff_az);
-
-    if (diff_alt > 3.6e-14 || diff_az > 1.2e-13)
-        FFAIL("EXCESSIVE HORIZONTAL ERROR.\n");
-
-    /* Confirm that we can convert back to horizontal vector. */
-    CHECK_VECTOR(check_hor, Astronomy_VectorFromHorizon(sphere, time, REFRACTION_NORMAL));
-    CHECK(VectorDiff(check_hor, vec_hor, &diff));
-    DEBUG("C Test_EQD_HOR %s: horizontal recovery: diff = %lg\n", Astronomy_BodyName(body), diff);
-    if (diff > 3.0e-15)
-        FFAIL("EXCESSIVE ERROR IN HORIZONTAL RECOVERY.\n");
-
-    /* Verify the inverse translation from horizontal vector to equatorial of-date vector. */
-    rot = Astronomy_Rotation_HOR_EQD(&time, observer);
-    CHECK_ROTMAT(rot);
-    CHECK_VECTOR(check_eqd, Astronomy_RotateVector(rot, vec_hor));
-    CHECK(VectorDiff(check_eqd, vec_eqd, &diff));
-    DEBUG("C Test_EQD_HOR %s: OFDATE inverse rotation diff = %lg\n", Astronomy_BodyName(body), diff);
-    if (diff > 2.67e-15)
-        FFAIL("EXCESSIVE OFDATE INVERSE HORIZONTAL ERROR.\n");
-
-    /* Exercise HOR to EQJ translation. */
-    CHECK_EQU(eqj, Astronomy_Equator(body, &time, observer, EQUATOR_J2000, ABERRATION));
-    CHECK_VECTOR(vec_eqj, eqj.vec);
-
-    rot = Astronomy_Rotation_HOR_EQJ(&time, observer);
-    CHECK_ROTMAT(rot);
-    CHECK_VECTOR(check_eqj, Astronomy_RotateVector(rot, vec_hor));
-    CHECK(VectorDiff(check_eqj, vec_eqj, &diff));
-    DEBUG("C Test_EQD_HOR %s: J2000 inverse rotation diff = %lg\n", Astronomy_BodyName(body), diff);
-    if (diff > 6.0e-15)
-        FFAIL("EXCESSIVE J2000 INVERSE HORIZONTAL ERROR.\n");
-
-    /* Verify the inverse translation: EQJ to HOR. */
-    rot = Astronomy_Rotation_EQJ_HOR(&time, observer);
-    CHECK_ROTMAT(rot);
-    CHECK_VECTOR(check_hor, Astronomy_RotateVector(rot, vec_eqj));
-    CHECK(VectorDiff(check_hor, vec_hor, &diff));
-    DEBUG("C Test_EQD_HOR %s: EQJ inverse rotation diff = %lg\n", Astronomy_BodyName(body), diff);
-    if (diff > 5.0e-15)
-        FFAIL("EXCESSIVE EQJ INVERSE HORIZONTAL ERROR.\n");
+        if (diff_km > max_km)
+            max_km = diff_km;
+    }
 
-    error = 0;
+    FPASSA("found %d events, max time error = %0.3lf minutes, max distance error = %0.3lf km.\n", lnum, max_minutes, max_km);
 fail:
+    if (infile != NULL) fclose(infile);
     return error;
 }
 
-static int Test_EQD_ECT(void)
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static int EarthApsis(void)
 {
+    const char *filename = "apsides/earth.txt";
     int error = 1;
-    int count = 0;
-    astro_time_t time = Astronomy_MakeTime(1900, 1, 1, 0, 0, 0.0);
-    astro_time_t stopTime = Astronomy_MakeTime(2100, 1, 1, 0, 0, 0.0);
-    astro_vector_t eqj, eqd, ect, check_ect;
-    astro_rotation_t eqj_eqd, eqd_ect;
-    astro_spherical_t sphere;
-    double diff, max_diff = 0.0;
-
-    while (time.ut <= stopTime.ut)
-    {
-        /* Get Moon's geocentric position in EQJ. */
-        eqj = Astronomy_GeoMoon(time);
-        CHECK_STATUS(eqj);
-
-        /* Convert EQJ to EQD. */
-        eqj_eqd = Astronomy_Rotation_EQJ_EQD(&time);
-        CHECK_ROTMAT(eqj_eqd);
-        eqd = Astronomy_RotateVector(eqj_eqd, eqj);
-        CHECK_STATUS(eqd);
-
-        /* Convert EQD to ECT. */
-        eqd_ect = Astronomy_Rotation_EQD_ECT(&time);
-        CHECK_ROTMAT(eqd_ect);
-        ect = Astronomy_RotateVector(eqd_ect, eqd);
-        CHECK_STATUS(ect);
-
-        /* Independently get the Moon's spherical coordinates in ECT. */
-        sphere = Astronomy_EclipticGeoMoon(time);
-        CHECK_STATUS(sphere);
-
-        /* Convert spherical coordinates to ECT vector. */
-        check_ect = Astronomy_VectorFromSphere(sphere, time);
-        CHECK_STATUS(check_ect);
+    FILE *infile = NULL;
+    int lnum, nscanned;
+    char line[100];
+    int kind, year, month, day, hour, minute;
+    double dist_au;
+    astro_time_t start_time, correct_time;
+    astro_apsis_t apsis;
+    double diff_minutes, diff_au;
+    double max_minutes = 0.0, max_au = 0.0;
 
-        /* Verify the two ECT vectors are identical, within tolerance. */
-        CHECK(VectorDiff(ect, check_ect, &diff));
-        if (diff > max_diff) max_diff = diff;
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FFAIL("Cannot open input file: %s\n", filename);
 
-        time = Astronomy_AddDays(time, 10.0);
-        ++count;
-    }
+    /*
+        0 2001-01-04T08:52Z 0.9832860
+        1 2001-07-04T13:37Z 1.0166426
+    */
 
-    if (max_diff > 3.743e-18)
-        FFAIL("excessive vector diff = %0.6le AU.\n", max_diff);
+    start_time = Astronomy_MakeTime(2001, 1, 1, 0, 0, 0.0);
+    lnum = 0;
+    while (ReadLine(line, sizeof(line), infile, filename, lnum))
+    {
+        ++lnum;
 
-    FDEBUG("PASS: count = %d, max_diff = %0.6le AU\n", count, max_diff);
-    error = 0;
-fail:
-    return error;
-}
+        if (lnum == 1)
+            apsis = Astronomy_SearchPlanetApsis(BODY_EARTH, start_time);
+        else
+            apsis = Astronomy_NextPlanetApsis(BODY_EARTH, apsis);
 
+        if (apsis.status != ASTRO_SUCCESS)
+            FLNFAIL("Failed to find apsis.\n");
 
-static int EclipticTest(void)
-{
-    int error = 1;
-    int count = 0;
-    astro_time_t time = Astronomy_MakeTime(1900, 1, 1, 0, 0, 0.0);
-    astro_time_t stopTime = Astronomy_MakeTime(2100, 1, 1, 0, 0, 0.0);
-    astro_vector_t eqj, check_ect;
-    astro_spherical_t sphere;
-    astro_ecliptic_t eclip;
-    double diff, max_vec_diff = 0.0, max_angle_diff = 0.0;
+        nscanned = sscanf(line, "%d %d-%d-%dT%d:%dZ %lf", &kind, &year, &month, &day, &hour, &minute, &dist_au);
+        if (nscanned != 7)
+            FLNFAIL("invalid data format\n");
 
-    while (time.ut <= stopTime.ut)
-    {
-        /* Get Moon's geocentric position in EQJ. */
-        eqj = Astronomy_GeoMoon(time);
-        CHECK_STATUS(eqj);
+        if (kind != apsis.kind)
+            FLNFAIL("expected apsis kind %d but found %d\n", kind, apsis.kind);
 
-        /* Convert EQJ to ECT. */
-        eclip = Astronomy_Ecliptic(eqj);
-        CHECK_STATUS(eclip);
+        correct_time = Astronomy_MakeTime(year, month, day, hour, minute, 0.0);
 
-        /* Confirm that the ecliptic angles and ecliptic vector are consistent.*/
-        CHECK_STATUS(eclip.vec);
-        V(eclip.vec.x);
-        V(eclip.vec.y);
-        V(eclip.vec.z);
-        sphere.dist = V(Astronomy_VectorLength(eclip.vec));
-        sphere.lat = V(eclip.elat);
-        sphere.lon = V(eclip.elon);
-        sphere.status = ASTRO_SUCCESS;
-        check_ect = Astronomy_VectorFromSphere(sphere, time);
-        CHECK(VectorDiff(eclip.vec, check_ect, &diff));
-        if (diff > max_angle_diff) max_angle_diff = diff;
+        diff_minutes = (24.0 * 60.0) * ABS(apsis.time.ut - correct_time.ut);
+        diff_au = ABS(apsis.dist_au - dist_au);
 
-        /* Independently get the Moon's spherical coordinates in ECT. */
-        sphere = Astronomy_EclipticGeoMoon(time);
-        CHECK_STATUS(sphere);
+        if (diff_minutes > 120.58)
+            FLNFAIL("Excessive time error: %lf minutes.\n", diff_minutes);
 
-        /* Convert spherical coordinates to ECT vector. */
-        check_ect = Astronomy_VectorFromSphere(sphere, time);
-        CHECK_STATUS(check_ect);
+        if (diff_au > 1.2e-5)
+            FLNFAIL("Excessive distance error: %lg AU.\n", diff_au);
 
-        /* Verify the two ECT vectors are identical, within tolerance. */
-        CHECK(VectorDiff(eclip.vec, check_ect, &diff));
-        if (diff > max_vec_diff) max_vec_diff = diff;
+        if (diff_minutes > max_minutes)
+            max_minutes = diff_minutes;
 
-        time = Astronomy_AddDays(time, 10.0);
-        ++count;
+        if (diff_au > max_au)
+            max_au = diff_au;
     }
 
-    if (max_angle_diff > 3.110e-18)
-        FFAIL("EXCESSIVE ANGLE DIFF = %0.6le AU.\n", max_angle_diff);
-
-    if (max_vec_diff > 3.388e-18)
-        FFAIL("EXCESSIVE VECTOR DIFF = %0.6le AU.\n", max_vec_diff);
-
-    FPASSA("PASS: count = %d, max_vec_diff = %0.6le AU, max_angle_diff = %0.6le AU.\n", count, max_vec_diff, max_angle_diff);
+    FPASSA("found %d events, max time error = %0.3lf minutes, max distance error = %0.3lg AU.\n", lnum, max_minutes, max_au);
 fail:
+    if (infile != NULL) fclose(infile);
     return error;
 }
 
 
-static int CheckInverse(const char *aname, const char *bname, astro_rotation_t arot, astro_rotation_t brot)
+static int PlanetApsis(void)
 {
     int error;
-    astro_rotation_t crot;
-    astro_rotation_t identity;
-
-    CHECK(CheckRotationMatrix(__LINE__, aname, arot));
-    CHECK(CheckRotationMatrix(__LINE__, bname, brot));
+    astro_body_t body;
+    astro_time_t start_time, prev_time;
+    astro_apsis_t apsis;
+    astro_utc_t utc;
+    int count;
+    double interval, min_interval, max_interval;
+    FILE *infile = NULL;
+    char filename[100];
+    char line[100];
+    char expected_time_text[100];
+    astro_time_t expected_time;
+    int expected_kind;
+    double expected_distance;
+    double period;
+    double diff_days, diff_degrees, max_degrees=0.0, diff_dist_ratio;
+    const double degree_threshold = 0.1;
+    double max_diff_days, max_dist_ratio;
 
-    crot = Astronomy_CombineRotation(arot, brot);
-    CHECK_ROTMAT(crot);
+    start_time = Astronomy_MakeTime(1700, 1, 1, 0, 0, 0.0);
 
-    identity.status = ASTRO_SUCCESS;
-    identity.rot[0][0] = 1; identity.rot[1][0] = 0; identity.rot[2][0] = 0;
-    identity.rot[0][1] = 0; identity.rot[1][1] = 1; identity.rot[2][1] = 0;
-    identity.rot[0][2] = 0; identity.rot[1][2] = 0; identity.rot[2][2] = 1;
+    for (body = BODY_MERCURY; body <= BODY_PLUTO; ++body)
+    {
+        period = Astronomy_PlanetOrbitalPeriod(body);
+        max_dist_ratio = 0.0;
+        max_diff_days = 0.0;
+        snprintf(filename, sizeof(filename)-1, "apsides/apsis_%d.txt", (int)body);
+        if (infile) fclose(infile);
+        infile = fopen(filename, "rt");
+        if (infile == NULL)
+            FFAIL("ERROR - cannot open input file: %s\n", filename);
 
-    CHECK(CompareMatrices("CheckInverse", crot, identity, 2.0e-15));
+        min_interval = max_interval = -1.0;
+        apsis = Astronomy_SearchPlanetApsis(body, start_time);
+        if (apsis.status != ASTRO_SUCCESS)
+            FFAIL("ERROR %d finding first apsis for %s\n", apsis.status, Astronomy_BodyName(body));
 
-    error = 0;
-fail:
-    return error;
-}
+        count = 1;
+        while (ReadLine(line, sizeof(line), infile, filename, count-1))
+        {
+            /* Parse the line of test data. */
+            if (   (3 != sscanf(line, "%d %30s %lf", &expected_kind, expected_time_text, &expected_distance))
+                || (expected_kind & ~1)     /* must be either 0=perihelion or 1=aphelion */
+                || (expected_distance <= 0.0)
+                || ParseDate(expected_time_text, &expected_time))
+            {
+                FFAIL("INPUT SYNTAX ERROR (%s line %d): '%s'\n", filename, count, line);
+            }
 
-static int CheckCycle(
-    const char *cyclename,
-    astro_rotation_t arot, astro_rotation_t brot, astro_rotation_t crot)
-{
-    int error;
-    astro_rotation_t xrot;
-
-    xrot = Astronomy_CombineRotation(arot, brot);
-    CHECK_ROTMAT(xrot);
-    xrot = Astronomy_InverseRotation(xrot);
-    CHECK(CompareMatrices(cyclename, crot, xrot, 2.0e-15));
-    error = 0;
-fail:
-    return error;
-}
-
-#define CHECK_CYCLE(a,b,c)  CHECK(CheckCycle(("CheckCycle: " #a ", " #b ", " #c), a, b, c))
+            /* Compare computed values against expected values. */
+            if (apsis.kind != expected_kind)
+                FFAIL("WRONG APSIS KIND (%s line %d)\n", filename, count);
 
-static int Test_RotRoundTrip(void)
-{
-    int error;
-    astro_time_t time;
-    astro_observer_t observer;
-    astro_rotation_t eqj_ecl, ecl_eqj;
-    astro_rotation_t eqj_hor, hor_eqj;
-    astro_rotation_t eqj_eqd, eqd_eqj;
-    astro_rotation_t hor_eqd, eqd_hor;
-    astro_rotation_t eqd_ecl, ecl_eqd;
-    astro_rotation_t hor_ecl, ecl_hor;
-    astro_rotation_t eqd_ect, ect_eqd;
-    astro_rotation_t eqj_ect, ect_eqj;
+            diff_days = ABS(expected_time.tt - apsis.time.tt);
+            if (diff_days > max_diff_days) max_diff_days = diff_days;
+            diff_degrees = (diff_days / period) * 360.0;
+            if (diff_degrees > max_degrees)
+                max_degrees = diff_degrees;
 
-    time = Astronomy_MakeTime(2067, 5, 30, 14, 45, 0.0);
-    observer = Astronomy_MakeObserver(+28.0, -82.0, 0.0);
+            if (diff_degrees > degree_threshold)
+                FFAIL("FAIL - %s exceeded angular threshold (%lg versus %lg degrees)\n", Astronomy_BodyName(body), max_degrees, degree_threshold);
 
-    /*
-        In each round trip, calculate a forward rotation and a backward rotation.
-        Verify the two are inverse matrices.
-    */
+            diff_dist_ratio = ABS(expected_distance - apsis.dist_au) / expected_distance;
+            if (diff_dist_ratio > max_dist_ratio) max_dist_ratio = diff_dist_ratio;
+            if (diff_dist_ratio > 1.05e-4)
+            {
+                FFAIL("EXCESSIVE DISTANCE ERROR for %s (%s line %d): expected=%0.16lf, calculated=%0.16lf, error ratio=%lg\n",
+                    Astronomy_BodyName(body), filename, count, expected_distance, apsis.dist_au, diff_dist_ratio);
+            }
 
-    /* Round trip #1: EQJ <==> EQD. */
-    eqj_eqd = Astronomy_Rotation_EQJ_EQD(&time);
-    eqd_eqj = Astronomy_Rotation_EQD_EQJ(&time);
-    CHECK_INVERSE(eqj_eqd, eqd_eqj);
+            /* Calculate the next apsis. */
+            prev_time = apsis.time;
+            utc = Astronomy_UtcFromTime(apsis.time);
+            apsis = Astronomy_NextPlanetApsis(body, apsis);
+            if (apsis.status != ASTRO_SUCCESS)
+            {
+                FFAIL("ERROR %d finding apsis for %s after %04d-%02d-%02d\n",
+                    apsis.status, Astronomy_BodyName(body), utc.year, utc.month, utc.day);
+            }
 
-    /* Round trip #2: EQJ <==> ECL. */
-    eqj_ecl = Astronomy_Rotation_EQJ_ECL();
-    ecl_eqj = Astronomy_Rotation_ECL_EQJ();
-    CHECK_INVERSE(eqj_ecl, ecl_eqj);
+            /* Update statistics. */
+            ++count;
+            interval = apsis.time.tt - prev_time.tt;
+            if (min_interval < 0.0)
+            {
+                min_interval = max_interval = interval;
+            }
+            else
+            {
+                if (interval < min_interval)
+                    min_interval = interval;
+                if (interval > max_interval)
+                    max_interval = interval;
+            }
+        }
 
-    /* Round trip #3: EQJ <==> HOR. */
-    eqj_hor = Astronomy_Rotation_EQJ_HOR(&time, observer);
-    hor_eqj = Astronomy_Rotation_HOR_EQJ(&time, observer);
-    CHECK_INVERSE(eqj_hor, hor_eqj);
+        if (count < 2)
+            FFAIL("FAILED to find apsides for %s\n", Astronomy_BodyName(body));
 
-    /* Round trip #4: EQD <==> HOR. */
-    eqd_hor = Astronomy_Rotation_EQD_HOR(&time, observer);
-    hor_eqd = Astronomy_Rotation_HOR_EQD(&time, observer);
-    CHECK_INVERSE(eqd_hor, hor_eqd);
+        FDEBUG("%5d apsides for %-9s -- intervals: min=%9.2lf, max=%9.2lf, ratio=%8.6lf; max day=%lg, degrees=%0.3lf, dist ratio=%lg\n",
+            count, Astronomy_BodyName(body),
+            min_interval, max_interval, max_interval / min_interval,
+            max_diff_days,
+            (max_diff_days / period) * 360.0,
+            max_dist_ratio);
+    }
 
-    /* Round trip #5: EQD <==> ECL. */
-    eqd_ecl = Astronomy_Rotation_EQD_ECL(&time);
-    ecl_eqd = Astronomy_Rotation_ECL_EQD(&time);
-    CHECK_INVERSE(eqd_ecl, ecl_eqd);
+    FPASS();
+fail:
+    if (infile) fclose(infile);
+    return error;
+}
 
-    /* Round trip #6: HOR <==> ECL. */
-    hor_ecl = Astronomy_Rotation_HOR_ECL(&time, observer);
-    ecl_hor = Astronomy_Rotation_ECL_HOR(&time, observer);
-    CHECK_INVERSE(hor_ecl, ecl_hor);
 
-    /* Round trip #7: EQD <==> ECT. */
-    eqd_ect = Astronomy_Rotation_EQD_ECT(&time);
-    ect_eqd = Astronomy_Rotation_ECT_EQD(&time);
-    CHECK_INVERSE(eqd_ect, ect_eqd);
+static int CheckIterEvent(const char *name, int i, int kind, int iter_kind, astro_time_t time, astro_time_t iter_time, double tolerance, double *max_diff)
+{
+    int error;
+    double diff = V(SECONDS_PER_DAY * fabs(iter_time.tt - time.tt));
 
-    /* Round trip #8: EQJ <==> ECT. */
-    eqj_ect = Astronomy_Rotation_EQJ_ECT(&time);
-    ect_eqj = Astronomy_Rotation_ECT_EQJ(&time);
-    CHECK_INVERSE(eqj_ect, ect_eqj);
+    if (diff > *max_diff)
+        *max_diff = diff;
 
-    /*
-        Verify that combining different sequences of rotations result
-        in the expected combination.
-        For example, (EQJ ==> HOR ==> ECL) must be the same matrix as (EQJ ==> ECL).
-    */
-    CHECK_CYCLE(eqj_ecl, ecl_eqd, eqd_eqj);
-    CHECK_CYCLE(eqj_hor, hor_ecl, ecl_eqj);
-    CHECK_CYCLE(eqj_hor, hor_eqd, eqd_eqj);
-    CHECK_CYCLE(ecl_eqd, eqd_hor, hor_ecl);
-    CHECK_CYCLE(eqj_eqd, eqd_ect, ect_eqj);
+    if (kind != iter_kind || diff > tolerance)
+        FFAIL("%s event %d mismatch: kind %d vs %d, diff = %0.3lf seconds\n", name, i, kind, iter_kind, diff);
 
-    FDEBUG("PASS\n");
     error = 0;
 fail:
     return error;
 }
 
-static int RotationTest(void)
-{
-    int error;
-    CHECK(Rotation_MatrixInverse());
-    CHECK(Rotation_MatrixMultiply());
-    CHECK(Rotation_Pivot());
-
-    /* Verify conversion of spherical coordinates to vector. */
-    CHECK(TestVectorFromAngles(0.0, 0.0, 1.0, 0.0, 0.0));
-    CHECK(TestVectorFromAngles(0.0, 90.0, 0.0, 1.0, 0.0));
-    CHECK(TestVectorFromAngles(0.0, 180.0, -1.0, 0.0, 0.0));
-    CHECK(TestVectorFromAngles(0.0, 270.0, 0.0, -1.0, 0.0));
-    CHECK(TestVectorFromAngles(+90.0, 0.0, 0.0, 0.0, 1.0));
-    CHECK(TestVectorFromAngles(-90.0, 0.0, 0.0, 0.0, -1.0));
-    CHECK(TestVectorFromAngles(-30.0, +60.0, 0.43301270189221946, 0.75, -0.5));
 
-    /* Verify conversion of vector to spherical coordinates. */
-    CHECK(TestAnglesFromVector(0.0, 0.0, 1.0, 0.0, 0.0));
-    CHECK(TestAnglesFromVector(0.0, 90.0, 0.0, 1.0, 0.0));
-    CHECK(TestAnglesFromVector(0.0, 180.0, -1.0, 0.0, 0.0));
-    CHECK(TestAnglesFromVector(0.0, 270.0, 0.0, -1.0, 0.0));
-    CHECK(TestAnglesFromVector(+90.0, 0.0, 0.0, 0.0, 1.0));
-    CHECK(TestAnglesFromVector(-90.0, 0.0, 0.0, 0.0, -1.0));
-    CHECK(TestAnglesFromVector(-30.0, +60.0, 0.43301270189221946, 0.75, -0.5));
+static int IterEvaluations(void)
+{
+    int evaluations = Astronomy_ContextSearchStats(NULL).evaluations;
+    Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+    return evaluations;
+}
 
-    /* Verify rotation of vectors */
-    CHECK(TestSpin(0.0, 0.0, 90.0, +1, +2, +3, -2, +1, +3));
-    CHECK(TestSpin(0.0, 0.0, 0.0, 1.0, 2.0, -3.0, 1.0, 2.0, -3.0));
-    CHECK(TestSpin(90.0, 0.0, 0.0, +1, +2, +3, +1, -3, +2));
-    CHECK(TestSpin(0.0, 90.0, 0.0, +1, +2, +3, +3, +2, -1));
-    CHECK(TestSpin(180.0, 180.0, 180.0, +1, +2, +3, +1, +2, +3));
-    CHECK(TestSpin(0.0, 0.0, -45.0, +1, 0, 0, +0.7071067811865476, -0.7071067811865476, 0));
 
-    CHECK(Test_EQJ_GAL_NOVAS("temp/galeqj.txt"));
-    CHECK(Test_EQJ_GAL_JPL("galactic/mars.txt"));
+static int EventIteratorTest(void)
+{
+    int error, i, evals;
+    astro_body_t body;
+    astro_time_t start = Astronomy_MakeTime(1900, 1, 1, 0, 0, 0.0);
+    astro_event_iterator_t iter;
+    astro_moon_quarter_t mq, mq_iter;
+    astro_apsis_t apsis, apsis_iter;
+    astro_node_event_t node, node_iter;
+    double max_diff;
+    const int nlunar = 1000;
+
+    /* Quarters are searched to within 0.1 seconds, the others to within 1 second. */
+    max_diff = 0.0;
+    evals = 0;
+    mq = Astronomy_SearchMoonQuarter(start);
+    mq_iter = Astronomy_SearchMoonQuarterIter(&iter, start);
+    for (i = 0; i < nlunar; ++i)
+    {
+        CHECK_STATUS(mq);
+        CHECK_STATUS(mq_iter);
+        CHECK(CheckIterEvent("Moon quarter", i, mq.quarter, mq_iter.quarter, mq.time, mq_iter.time, 0.2, &max_diff));
+        mq = Astronomy_NextMoonQuarter(mq);
+        IterEvaluations();
+        mq_iter = Astronomy_NextMoonQuarterIter(&iter);
+        evals += IterEvaluations();
+    }
+    DEBUG("C EventIteratorTest: moon quarters: %0.2lf evaluations per event, max diff = %0.3lf seconds\n", (double)evals / nlunar, max_diff);
+    if (evals > 4 * nlunar)
+        FFAIL("Too many evaluations for moon quarters: %d\n", evals);
 
-    CHECK(Test_EQJ_EQD(BODY_MERCURY));
-    CHECK(Test_EQJ_EQD(BODY_VENUS));
-    CHECK(Test_EQJ_EQD(BODY_MARS));
-    CHECK(Test_EQJ_EQD(BODY_JUPITER));
-    CHECK(Test_EQJ_EQD(BODY_SATURN));
+    max_diff = 0.0;
+    evals = 0;
+    apsis = Astronomy_SearchLunarApsis(start);
+    apsis_iter = Astronomy_SearchLunarApsisIter(&iter, start);
+    for (i = 0; i < nlunar; ++i)
+    {
+        CHECK_STATUS(apsis);
+        CHECK_STATUS(apsis_iter);
+        CHECK(CheckIterEvent("Lunar apsis", i, apsis.kind, apsis_iter.kind, apsis.time, apsis_iter.time, 2.0, &max_diff));
+        if (fabs(apsis.dist_km - apsis_iter.dist_km) > 1.0e-3)
+            FFAIL("Lunar apsis %d distance mismatch: %0.6lf vs %0.6lf km\n", i, apsis.dist_km, apsis_iter.dist_km);
+        apsis = Astronomy_NextLunarApsis(apsis);
+        IterEvaluations();
+        apsis_iter = Astronomy_NextLunarApsisIter(&iter);
+        evals += IterEvaluations();
+    }
+    DEBUG("C EventIteratorTest: lunar apsides: %0.2lf evaluations per event, max diff = %0.3lf seconds\n", (double)evals / nlunar, max_diff);
+    if (evals > 6 * nlunar)
+        FFAIL("Too many evaluations for lunar apsides: %d\n", evals);
 
-    CHECK(Test_EQD_HOR(BODY_MERCURY));
-    CHECK(Test_EQD_HOR(BODY_VENUS));
-    CHECK(Test_EQD_HOR(BODY_MARS));
-    CHECK(Test_EQD_HOR(BODY_JUPITER));
-    CHECK(Test_EQD_HOR(BODY_SATURN));
+    max_diff = 0.0;
+    evals = 0;
+    node = Astronomy_SearchMoonNode(start);
+    node_iter = Astronomy_SearchMoonNodeIter(&iter, start);
+    for (i = 0; i < nlunar; ++i)
+    {
+        CHECK_STATUS(node);
+        CHECK_STATUS(node_iter);
+        CHECK(CheckIterEvent("Moon node", i, node.kind, node_iter.kind, node.time, node_iter.time, 2.0, &max_diff));
+        node = Astronomy_NextMoonNode(node);
+        IterEvaluations();
+        node_iter = Astronomy_NextMoonNodeIter(&iter);
+        evals += IterEvaluations();
+    }
+    DEBUG("C EventIteratorTest: moon nodes: %0.2lf evaluations per event, max diff = %0.3lf seconds\n", (double)evals / nlunar, max_diff);
+    if (evals > 4 * nlunar)
+        FFAIL("Too many evaluations for moon nodes: %d\n", evals);
 
-    CHECK(Test_EQD_ECT());
+    for (body = BODY_MERCURY; body <= BODY_PLUTO; ++body)
+    {
+        const int nplanet = (body <= BODY_MARS) ? 100 : 6;
+        /* The distance of an outer planet changes so slowly near apsis that roundoff limits the precision of both searches. */
+        const double tolerance = 3.0 + 1.0e-8 * SECONDS_PER_DAY * Astronomy_PlanetOrbitalPeriod(body);
+        max_diff = 0.0;
+        evals = 0;
+        apsis = Astronomy_SearchPlanetApsis(body, start);
+        apsis_iter = Astronomy_SearchPlanetApsisIter(&iter, body, start);
+        for (i = 0; i < nplanet; ++i)
+        {
+            CHECK_STATUS(apsis);
+            CHECK_STATUS(apsis_iter);
+            CHECK(CheckIterEvent(Astronomy_BodyName(body), i, apsis.kind, apsis_iter.kind, apsis.time, apsis_iter.time, tolerance, &max_diff));
+            apsis = Astronomy_NextPlanetApsis(body, apsis);
+            IterEvaluations();
+            apsis_iter = Astronomy_NextPlanetApsisIter(&iter);
+            evals += IterEvaluations();
+        }
+        DEBUG("C EventIteratorTest: %-8s apsides: %0.2lf evaluations per event, max diff = %0.3lf seconds\n", Astronomy_BodyName(body), (double)evals / nplanet, max_diff);
+    }
 
-    CHECK(Test_RotRoundTrip());
+    /* The iterator must refuse to continue a different kind of series. */
+    mq_iter = Astronomy_NextMoonQuarterIter(&iter);
+    if (mq_iter.status != ASTRO_INVALID_PARAMETER)
+        FFAIL("Expected ASTRO_INVALID_PARAMETER for mismatched iterator, but found %d\n", mq_iter.status);
 
     FPASS();
 fail:
+    Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
     return error;
 }
 
-static int VectorDiff(astro_vector_t a, astro_vector_t b, double *diff)
+
+static int OuterApsisTest(void)
 {
-    double dx, dy, dz;
+    int error, b, count, evals, max_evals;
+    astro_body_t body;
+    astro_apsis_t apsis, prev;
+    astro_func_result_t dist, before, after;
+    astro_time_t time, stop;
+    double dt, sign;
+    const double tt_stop = 700000.0;    /* near the end of the apsis tables */
+    static const astro_body_t list[] = { BODY_NEPTUNE, BODY_PLUTO };
+
+    for (b = 0; b < 2; ++b)
+    {
+        body = list[b];
+        count = 0;
+        max_evals = 0;
+        Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+        apsis = Astronomy_SearchPlanetApsis(body, Astronomy_MakeTime(200, 1, 1, 0, 0, 0.0));
+        for(;;)
+        {
+            CHECK_STATUS(apsis);
+            if (count > 0 && apsis.kind == prev.kind)
+                FFAIL("%s apsis %d has the same kind as the previous one.\n", Astronomy_BodyName(body), count);
 
-    *diff = NAN;
+            /* Stop before the first apsis after the end of the table. */
+            if (apsis.time.tt > tt_stop)
+                break;
 
-    if (a.status != ASTRO_SUCCESS)
-        FAILRET("C %s: ERROR - first vector has status %d\n", __func__, a.status);
+            evals = IterEvaluations();
+            if (evals > max_evals)
+                max_evals = evals;
 
-    if (b.status != ASTRO_SUCCESS)
-        FAILRET("C %s: ERROR - second vector has status %d\n", __func__, b.status);
+            /* Each apsis must be the nearest or farthest distance within 10 years on either side. */
+            sign = (apsis.kind == APSIS_PERICENTER) ? +1.0 : -1.0;
+            for (dt = -3650.0; dt <= +3650.0; dt += (dt < -1.5 || dt > 0.5) ? 30.0 : 1.0)
+            {
+                if (dt == 0.0)
+                    continue;
+                time = Astronomy_AddDays(apsis.time, dt);
+                dist = Astronomy_HelioDistance(body, time);
+                CHECK_STATUS(dist);
+                if (sign * (dist.value - apsis.dist_au) < 0.0)
+                    FFAIL("%s apsis at tt=%0.3lf is not an extreme: distance %0.9lf AU at dt=%0.0lf days vs %0.9lf AU.\n",
+                        Astronomy_BodyName(body), apsis.time.tt, dist.value, dt, apsis.dist_au);
+            }
 
-    dx = a.x - b.x;
-    dy = a.y - b.y;
-    dz = a.z - b.z;
-    *diff = V(sqrt(dx*dx + dy*dy + dz*dz));
-    return 0;
-}
+            /* The reported time must be close to the true extreme. */
+            before = Astronomy_HelioDistance(body, Astronomy_AddDays(apsis.time, -0.05));
+            CHECK_STATUS(before);
+            after  = Astronomy_HelioDistance(body, Astronomy_AddDays(apsis.time, +0.05));
+            CHECK_STATUS(after);
+            if (fabs(after.value - before.value) > 1.0e-9)
+                FFAIL("%s apsis at tt=%0.3lf has distance slope %lg AU over 0.1 days.\n", Astronomy_BodyName(body), apsis.time.tt, after.value - before.value);
 
-/*-----------------------------------------------------------------------------------------------------------*/
+            ++count;
+            prev = apsis;
+            Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+            apsis = Astronomy_NextPlanetApsis(body, prev);
+        }
 
-static int RefractionTest(void)
-{
-    int error;
-    double alt, corrected, refr, inv_refr, check_alt, diff;
+        if (max_evals > 6)
+            FFAIL("%s apsis searches within the table took up to %d evaluations.\n", Astronomy_BodyName(body), max_evals);
 
-    for (alt = -90.1; alt <= +90.1; alt += 0.001)
-    {
-        refr = Astronomy_Refraction(REFRACTION_NORMAL, alt);
-        corrected = alt + refr;
-        inv_refr = Astronomy_InverseRefraction(REFRACTION_NORMAL, corrected);
-        check_alt = corrected + inv_refr;
-        diff = ABS(check_alt - alt);
-        if (diff > 2.0e-14)
-            FFAIL("EXCESSIVE diff: alt=%8.3lf, refr=%10.6lf, diff=%lg\n", alt, refr, diff);
+        /* Searching past the end of the table falls back to the brute-force search. */
+        stop = Astronomy_TerrestrialTime(740000.0);
+        while (apsis.time.tt < stop.tt)
+        {
+            prev = apsis;
+            apsis = Astronomy_NextPlanetApsis(body, prev);
+            CHECK_STATUS(apsis);
+            if (apsis.kind == prev.kind)
+                FFAIL("%s apsis after the table has the same kind as the previous one.\n", Astronomy_BodyName(body));
+            if (apsis.time.tt - prev.time.tt < 0.25 * Astronomy_PlanetOrbitalPeriod(body))
+                FFAIL("%s apsis after the table is too close to the previous one.\n", Astronomy_BodyName(body));
+        }
+
+        DEBUG("C OuterApsisTest: %-8s %d apsides, max %d evaluations per search.\n", Astronomy_BodyName(body), count, max_evals);
     }
 
     FPASS();
 fail:
+    Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
     return error;
 }
 
+
 /*-----------------------------------------------------------------------------------------------------------*/
 
-static int ConstellationTest(void)
+static int CheckUnitVector(int lnum, const char *name, astro_rotation_t r, int i0, int j0, int di, int dj)
 {
-    int error = 1;
-    FILE *infile = NULL;
-    const char *inFileName = "constellation/test_input.txt";
-    char line[100];
-    double ra, dec;
-    char symbol[4];
-    int lnum, failcount, id;
-    astro_constellation_t constel;
+    int k;
+    double x;
+    double sum = 0.0;
 
-    infile = fopen(inFileName, "rt");
-    if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", inFileName);
-
-    lnum = 0;
-    failcount = 0;
-    while (ReadLine(line, sizeof(line), infile, inFileName, lnum))
+    for (k=0; k<3; ++k)
     {
-        ++lnum;
-        if (4 != sscanf(line, "%d %lf %lf %3s", &id, &ra, &dec, symbol) || 3 != strlen(symbol))
-            FFAIL("Invalid test data in %s line %d\n", inFileName, lnum);
+        x = r.rot[i0+k*di][j0+k*dj];
+        sum += x*x;
+    }
+    x = ABS(sum - 1.0);
+    if (x > 1.8e-15)
+        FAILRET("C CheckUnitVector ERROR(%s line %d): unit error = %lg for i0=%d, j0=%d, di=%d, dj=%d\n", name, lnum, x, i0, j0, di, dj);
 
-        constel = Astronomy_Constellation(ra, dec);
-        if (constel.status != ASTRO_SUCCESS)
-            FFAIL("FAILED star %d with status %d: %s line %d\n", id, constel.status, inFileName, lnum);
+    return 0;
+}
 
-        if (constel.symbol == NULL || constel.name == NULL)
-            FFAIL("UNEXPECTED NULL name/symbol: star %d, %s line %d\n", id, inFileName, lnum);
+static int CheckRotationMatrix(int lnum, const char *name, astro_rotation_t r)
+{
+    if (r.status != ASTRO_SUCCESS)
+        FAILRET("C CheckRotationMatrix ERROR(%s line %d): status = %d\n", name, lnum, r.status);
 
-        if (strcmp(constel.symbol, symbol))
-        {
-            fprintf(stderr, "Star %6d: expected %s, found %s at B1875 RA=%10.6lf, DEC=%10.6lf\n", id, symbol, constel.symbol, constel.ra_1875, constel.dec_1875);
-            ++failcount;
-        }
-    }
+    /* Verify that every row and every column is a unit vector. */
+    if (CheckUnitVector(lnum, name, r, 0, 0, 1, 0)) return 1;
+    if (CheckUnitVector(lnum, name, r, 0, 1, 1, 0)) return 1;
+    if (CheckUnitVector(lnum, name, r, 0, 2, 1, 0)) return 1;
+    if (CheckUnitVector(lnum, name, r, 0, 0, 0, 1)) return 1;
+    if (CheckUnitVector(lnum, name, r, 1, 0, 0, 1)) return 1;
+    if (CheckUnitVector(lnum, name, r, 2, 0, 0, 1)) return 1;
+    return 0;
+}
 
-    if (failcount > 0)
-        FFAIL("%d failures\n", failcount);
+#define CHECK_ROTMAT(r)   CHECK(CheckRotationMatrix(__LINE__, #r, (r)))
 
-    FPASSA("(verified %d)\n", lnum);
-fail:
-    if (infile != NULL) fclose(infile);
-    return error;
-}
+static int CompareVectors(const char *caller, astro_vector_t a, astro_vector_t b, double tolerance)
+{
+    double diff;
 
-/*-----------------------------------------------------------------------------------------------------------*/
+    if (a.status != ASTRO_SUCCESS)
+        FAILRET("C CompareVectors ERROR(%s): a.status = %d\n", caller, a.status);
 
-static void PrintTime(astro_time_t time)
+    if (b.status != ASTRO_SUCCESS)
+        FAILRET("C CompareVectors ERROR(%s): b.status = %d\n", caller, b.status);
+
+    diff = ABS(a.x - b.x);
+    if (diff > tolerance)
+        FAILRET("C CompareVectors ERROR(%s): x=%lg, expected %lg, diff %lg\n", caller, a.x, b.x, diff);
+
+    diff = ABS(a.y - b.y);
+    if (diff > tolerance)
+        FAILRET("C CompareVectors ERROR(%s): y=%lg, expected %lg, diff %lg\n", caller, a.y, b.y, diff);
+
+    diff = ABS(a.z - b.z);
+    if (diff > tolerance)
+        FAILRET("C CompareVectors ERROR(%s): z=%lg, expected %lg, diff %lg\n", caller, a.z, b.z, diff);
+
+    return 0;
+}
+
+static int CompareMatrices(const char *caller, astro_rotation_t a, astro_rotation_t b, double tolerance)
 {
-    astro_utc_t utc = Astronomy_UtcFromTime(time);
-    printf("%04d-%02d-%02dT%02d:%02d:%06.3lfZ", utc.year, utc.month, utc.day, utc.hour, utc.minute, utc.second);
+    int i, j;
+
+    if (a.status != ASTRO_SUCCESS)
+        FAILRET("C CompareMatrices ERROR(%s): a.status = %d\n", caller, a.status);
+
+    if (b.status != ASTRO_SUCCESS)
+        FAILRET("C CompareMatrices ERROR(%s): b.status = %d\n", caller, b.status);
+
+    for (i=0; i < 3; ++i)
+    {
+        for (j=0; j < 3; ++j)
+        {
+            double diff = ABS(a.rot[i][j] - b.rot[i][j]);
+            if (diff > tolerance)
+                FAILRET("C CompareMatrices ERROR(%s): matrix[%d][%d]=%lg, expected %lg, diff %lg\n", caller, i, j, a.rot[i][j], b.rot[i][j], diff);
+        }
+    }
+
+    return 0;
 }
 
-static int LunarEclipseIssue78(void)
+static int Rotation_MatrixInverse(void)
 {
+    astro_rotation_t a, b, v;
     int error;
-    astro_lunar_eclipse_t eclipse;
-    astro_time_t search_time   = Astronomy_MakeTime(2020, 12, 19, 0, 0, 0.0);
-    astro_time_t expected_peak = Astronomy_MakeTime(2021, 5, 26, 11, 18, 42);  /* https://www.timeanddate.com/eclipse/lunar/2021-may-26 */
-    double dt_seconds;
 
-    eclipse = Astronomy_SearchLunarEclipse(search_time);
-    CHECK_STATUS(eclipse);
+    a.status = ASTRO_SUCCESS;
+    a.rot[0][0] = 1.0; a.rot[1][0] = 2.0; a.rot[2][0] = 3.0;
+    a.rot[0][1] = 4.0; a.rot[1][1] = 5.0; a.rot[2][1] = 6.0;
+    a.rot[0][2] = 7.0; a.rot[1][2] = 8.0; a.rot[2][2] = 9.0;
 
-    dt_seconds = (24.0 * 3600.0) * ABS(eclipse.peak.tt - expected_peak.tt);
-    if (dt_seconds > 40.0)
-        FFAIL("Excessive prediction error = %lf seconds.\n", dt_seconds);
+    v.status = ASTRO_SUCCESS;
+    v.rot[0][0] = 1.0; v.rot[1][0] = 4.0; v.rot[2][0] = 7.0;
+    v.rot[0][1] = 2.0; v.rot[1][1] = 5.0; v.rot[2][1] = 8.0;
+    v.rot[0][2] = 3.0; v.rot[1][2] = 6.0; v.rot[2][2] = 9.0;
 
-    if (eclipse.kind != ECLIPSE_TOTAL)
-        FFAIL("Expected total eclipse; found %d\n", eclipse.kind);
+    b = Astronomy_InverseRotation(a);
+    CHECK(CompareMatrices("Rotation_MatrixInverse", b, v, 0.0));
 
     FPASS();
 fail:
     return error;
 }
 
-static int LunarEclipseTest(void)
+static int Rotation_Pivot(void)
 {
-    const char *filename = "eclipse/lunar_eclipse.txt";
-    const char *statsFileName = "eclipse/c_le_stats.csv";
-    FILE *infile = NULL;
-    FILE *outfile = NULL;
-    int lnum = 0;
-    int error = 1;
-    char line[100];
-    astro_time_t peak_time;
-    astro_lunar_eclipse_t eclipse;
-    double partial_minutes, total_minutes;
-    double diff_minutes, max_diff_minutes = 0.0, sum_diff_minutes = 0.0;
-    int diff_count = 0;
-    double diff_days;
-    int sd_valid = 0;
-    int frac_valid = 0;
-    int skip_count = 0;
-    const double diff_limit = 2.0;
-    extern int _CalcMoonCount;      /* incremented by Astronomy Engine every time expensive CalcMoon() is called */
+    int error;
+    astro_rotation_t ident;
+    astro_rotation_t r;
+    astro_rotation_t a;
+    astro_vector_t v1, v2, ve;
+    const double tolerance = 1.0e-15;
 
-    _CalcMoonCount = 0;
+    /* Test #1 */
 
-    infile = fopen(filename, "rt");
-    if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", filename);
+    /* Start with an identity matrix. */
+    ident = Astronomy_IdentityMatrix();
 
-    outfile = fopen(statsFileName, "wt");
-    if (outfile == NULL)
-        FFAIL("Cannot open output stats file: %s\n", statsFileName);
+    /* Pivot 90 degrees counterclockwise around the z-axis. */
+    r = Astronomy_Pivot(ident, 2, +90.0);
+    CHECK_STATUS(r);
 
-    eclipse = Astronomy_SearchLunarEclipse(Astronomy_MakeTime(1701, 1, 1, 0, 0, 0.0));
-    CHECK_STATUS(eclipse);
+    /* Put the expected answer in 'a'. */
+    a.status = ASTRO_SUCCESS;
+    a.rot[0][0] =  0.0;  a.rot[1][0] = -1.0;  a.rot[2][0] =  0.0;
+    a.rot[0][1] = +1.0;  a.rot[1][1] =  0.0;  a.rot[2][1] =  0.0;
+    a.rot[0][2] =  0.0;  a.rot[1][2] =  0.0;  a.rot[2][2] =  1.0;
 
-    fprintf(outfile, "\"utc\",\"center\",\"partial\",\"total\"\n");
-    while (ReadLine(line, sizeof(line), infile, filename, lnum))
-    {
-        ++lnum;
+    /* Compare actual 'r' with expected 'a'. */
+    CHECK(CompareMatrices("Rotation_Pivot #1", r, a, tolerance));
 
-        /* Make sure numeric data are finite numbers. */
-        V(eclipse.obscuration);
-        V(eclipse.sd_partial);
-        V(eclipse.sd_penum);
-        V(eclipse.sd_total);
+    /* Test #2. */
 
-        /* scan test data */
+    /* Pivot again, -30 degrees around the x-axis. */
+    r = Astronomy_Pivot(r, 0, -30.0);
+    CHECK_STATUS(r);
 
-        /* 2021-05-26T11:19Z  94   9 */
-        if (strlen(line) < 17)
-            FAIL("C LunarEclipseTest(%s line %d): line is too short.\n", filename, lnum);
+    /* Pivot a third time, 180 degrees around the y-axis. */
+    r = Astronomy_Pivot(r, 1, +180.0);
 
-        line[17] = '\0';
-        CHECK(ParseDate(line, &peak_time));
-        if (2 != sscanf(line+18, "%lf %lf", &partial_minutes, &total_minutes))
-            FAIL("C LunarEclipseTest(%s line %d): invalid data format.\n", filename, lnum);
+    /* Use the 'r' matrix to rotate a vector. */
+    v1.status = ASTRO_SUCCESS;
+    v1.t = Astronomy_MakeTime(2000, 1, 1, 0, 0, 0.0);
+    v1.x = 1.0;
+    v1.y = 2.0;
+    v1.z = 3.0;
 
-        /* Verify that the calculated eclipse semi-durations are consistent with the kind. */
-        /* Verify that obscuration values also make sense for the kind. */
+    v2 = Astronomy_RotateVector(r, v1);
+    CHECK_STATUS(v2);
 
-        switch (eclipse.kind)
-        {
-        case ECLIPSE_PENUMBRAL:
-            sd_valid = (eclipse.sd_penum > 0.0) && (eclipse.sd_partial == 0.0) && (eclipse.sd_total == 0.0);
-            frac_valid = (eclipse.obscuration == 0.0);
-            break;
+    /* Initialize the expected vector 've'. */
+    ve.status = ASTRO_SUCCESS;
+    ve.t = v1.t;
+    ve.x = +2.0;
+    ve.y = +2.3660254037844390;
+    ve.z = -2.0980762113533156;
 
-        case ECLIPSE_PARTIAL:
-            sd_valid = (eclipse.sd_penum > 0.0) && (eclipse.sd_partial > 0.0) && (eclipse.sd_total == 0.0);
-            frac_valid = (eclipse.obscuration > 0.0) && (eclipse.obscuration < 1.0);
-            break;
+    CHECK(CompareVectors("Rotation_Pivot #2", v2, ve, tolerance));
 
-        case ECLIPSE_TOTAL:
-            sd_valid = (eclipse.sd_penum > 0.0) && (eclipse.sd_partial > 0.0) && (eclipse.sd_total > 0.0);
-            frac_valid = (eclipse.obscuration == 1.0);
-            break;
+    FPASS();
+fail:
+    return error;
+}
 
-        default:
-            FAIL("C LunarEclipseTest(%s line %d): invalid eclipse kind %d.\n", filename, lnum, eclipse.kind);
-        }
+static int Rotation_MatrixMultiply(void)
+{
+    astro_rotation_t  a, b, c, v;
+    int error;
 
-        if (!sd_valid)
-        {
-            FAIL("C LunarEclipseTest(%s line %d): invalid semiduration(s) for kind %d: penum=%lf, partial=%lf, total=%lf.\n",
-                filename, lnum, eclipse.kind, eclipse.sd_penum, eclipse.sd_partial, eclipse.sd_total);
-        }
+    a.status = ASTRO_SUCCESS;
+    a.rot[0][0] = 1.0; a.rot[1][0] = 2.0; a.rot[2][0] = 3.0;
+    a.rot[0][1] = 4.0; a.rot[1][1] = 5.0; a.rot[2][1] = 6.0;
+    a.rot[0][2] = 7.0; a.rot[1][2] = 8.0; a.rot[2][2] = 9.0;
 
-        if (!frac_valid)
-        {
-            FAIL("C LunarEclipseTest(%s line %d): invalid obscuration = %0.16lf for kind %d\n",
-                filename, lnum, eclipse.obscuration, eclipse.kind);
-        }
+    b.status = ASTRO_SUCCESS;
+    b.rot[0][0] = 10.0; b.rot[1][0] = 11.0; b.rot[2][0] = 12.0;
+    b.rot[0][1] = 13.0; b.rot[1][1] = 14.0; b.rot[2][1] = 15.0;
+    b.rot[0][2] = 16.0; b.rot[1][2] = 17.0; b.rot[2][2] = 18.0;
 
-        /* check eclipse peak time */
+    v.status = ASTRO_SUCCESS;
+    v.rot[0][0] =  84.0; v.rot[1][0] =  90.0; v.rot[2][0] =  96.0;
+    v.rot[0][1] = 201.0; v.rot[1][1] = 216.0; v.rot[2][1] = 231.0;
+    v.rot[0][2] = 318.0; v.rot[1][2] = 342.0; v.rot[2][2] = 366.0;
 
-        diff_days = eclipse.peak.ut - peak_time.ut;
-        /* tolerate missing penumbral eclipses - skip to next input line without calculating next eclipse. */
-        if (partial_minutes == 0.0 && diff_days > 20.0)
-        {
-            ++skip_count;
-            continue;
-        }
-
-        fprintf(outfile, "\"%s\",%lf,%lf,%lf\n",
-            line,   /* was already truncated at offset [17] above, so now has only UTC */
-            diff_days * (24.0 * 60.0),
-            eclipse.sd_partial - partial_minutes,
-            eclipse.sd_total - total_minutes
-        );
+    /* Let c = a*b. The order looks backwards in the call to make rotation semantics more intuitive. */
+    c = Astronomy_CombineRotation(b, a);
 
-        diff_minutes = (24.0 * 60.0) * ABS(diff_days);
-        sum_diff_minutes += diff_minutes;
-        ++diff_count;
+    /* Verify that c = v. */
+    CHECK(CompareMatrices("Rotation_MatrixMultiply", c, v, 0.0));
 
-        if (diff_minutes > diff_limit)
-        {
-            printf("C LunarEclipseTest expected peak: ");
-            PrintTime(peak_time);
-            printf("\n");
-            printf("C LunarEclipseTest found    peak: ");
-            PrintTime(eclipse.peak);
-            printf("\n");
-            FAIL("C LunarEclipseTest(%s line %d): EXCESSIVE peak time error = %lf minutes (%lf days).\n", filename, lnum, diff_minutes, diff_days);
-        }
+    FPASS();
+fail:
+    return error;
+}
 
-        if (diff_minutes > max_diff_minutes)
-            max_diff_minutes = diff_minutes;
+static int TestVectorFromAngles(double lat, double lon, double x, double y, double z)
+{
+    astro_spherical_t sphere;
+    astro_vector_t vector;
+    astro_time_t time;
+    double diff, dx, dy, dz;
 
-        /* check partial eclipse duration */
+    /* Confirm the expected vector really is a unit vector. */
+    diff = ABS((x*x + y*y + z*z) - 1.0);
+    if (diff > 1.0e-16)
+        FAILRET("C %s: EXCESSIVE unit error = %lg\n", __func__, diff);
 
-        diff_minutes = ABS(partial_minutes - eclipse.sd_partial);
-        sum_diff_minutes += diff_minutes;
-        ++diff_count;
+    sphere.status = ASTRO_SUCCESS;
+    sphere.lat = lat;
+    sphere.lon = lon;
+    sphere.dist = 1.0;
 
-        if (diff_minutes > diff_limit)
-            FAIL("C LunarEclipseTest(%s line %d): EXCESSIVE partial eclipse semiduration error: %lf minutes\n", filename, lnum, diff_minutes);
+    time = Astronomy_MakeTime(2015, 3, 5, 12, 0, 0.0);
+    vector = Astronomy_VectorFromSphere(sphere, time);
 
-        if (diff_minutes > max_diff_minutes)
-            max_diff_minutes = diff_minutes;
+    if (vector.status != ASTRO_SUCCESS)
+        FAILRET("C ERROR(TestVectorFromAngles): vector.status = %d\n", vector.status);
 
-        /* check total eclipse duration */
+    dx = x - vector.x;
+    dy = y - vector.y;
+    dz = z - vector.z;
+    diff = V(sqrt(dx*dx + dy*dy + dz*dz));
 
-        diff_minutes = ABS(total_minutes - eclipse.sd_total);
-        sum_diff_minutes += diff_minutes;
-        ++diff_count;
+    DEBUG("C TestVectorFromAngles(%lf, %lf): diff = %lg\n", lat, lon, diff);
+    if (diff > 2.0e-16)
+        FAILRET("C %s: EXCESSIVE ERROR.\n", __func__);
 
-        if (diff_minutes > diff_limit)
-            FAIL("C LunarEclipseTest(%s line %d): EXCESSIVE total eclipse semiduration error: %lf minutes\n", filename, lnum, diff_minutes);
+    return 0;
+}
 
-        if (diff_minutes > max_diff_minutes)
-            max_diff_minutes = diff_minutes;
+static int TestAnglesFromVector(double lat, double lon, double x, double y, double z)
+{
+    astro_vector_t vector;
+    astro_spherical_t sphere;
+    double diff, latdiff, londiff;
 
-        /* calculate for next iteration */
+    /* Confirm the expected vector really is a unit vector. */
+    diff = ABS((x*x + y*y + z*z) - 1.0);
+    if (diff > 1.0e-16)
+        FAILRET("C TestAnglesFromVector(lat=%lf, lon=%lf, x=%lf, y=%lf, z=%lf): EXCESSIVE unit error = %lg\n", lat, lon, x, y, z, diff);
 
-        eclipse = Astronomy_NextLunarEclipse(eclipse.peak);
-        if (eclipse.status != ASTRO_SUCCESS)
-            FAIL("C LunarEclipseTest(%s line %d): Astronomy_NextLunarEclipse returned status %d\n", filename, lnum, eclipse.status);
-    }
+    vector.status = ASTRO_SUCCESS;
+    vector.t = Astronomy_MakeTime(2015, 3, 5, 12, 0, 0.0);
+    vector.x = x;
+    vector.y = y;
+    vector.z = z;
 
-    sum_diff_minutes /= diff_count;     /* convert to average error in minutes */
-    if (sum_diff_minutes > 0.274)
-        FFAIL("EXCESSIVE AVERAGE TIME ERROR: %lf\n", sum_diff_minutes);
+    sphere = Astronomy_SphereFromVector(vector);
+    if (sphere.status != ASTRO_SUCCESS)
+        FAILRET("C %s(lat=%lf, lon=%lf, x=%lf, y=%lf, z=%lf): sphere.status = %d\n", __func__, lat, lon, x, y, z, sphere.status);
 
-    if (skip_count > 9)
-        FFAIL("Skipped too many penumbral eclipses: %d\n", skip_count);
+    latdiff = ABS(sphere.lat - lat);
+    londiff = ABS(sphere.lon - lon);
+    DEBUG("TestAnglesFromVector(x=%lf, y=%lf, z=%lf): latdiff=%lg, londiff=%lg\n", x, y, z, latdiff, londiff);
+    if (latdiff > 8.0e-15 || londiff > 8.0e-15)
+        FAILRET("C %s: EXCESSIVE ERROR\n", __func__);
 
-    FPASSA("(verified %d, skipped %d, %d CalcMoons, max_diff_minutes = %0.3lf, avg_diff_minutes = %0.3lf)\n", lnum, skip_count, _CalcMoonCount, max_diff_minutes, sum_diff_minutes);
-fail:
-    if (infile != NULL) fclose(infile);
-    if (outfile != NULL) fclose(outfile);
-    return error;
+    return 0;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
-
-static int LunarFractionCase(int year, int month, int day, double obscuration)
+static astro_rotation_t RotateX(double rot)
 {
-    int error;
-    astro_time_t time;
-    astro_lunar_eclipse_t eclipse;
-    double dt, diff;
+    astro_rotation_t m;
+    double ca, sa;
 
-    /* Search for the first lunar eclipse to occur after the given date. */
-    /* It should always happen within 24 hours of the given date. */
-    time = Astronomy_MakeTime(year, month, day, 0, 0, 0.0);
-    eclipse = Astronomy_SearchLunarEclipse(time);
-    CHECK_STATUS(eclipse);
+    /* https://en.wikipedia.org/wiki/Rotation_matrix */
 
-    if (eclipse.kind != ECLIPSE_PARTIAL)
-        FAIL("C LunarFractionCase(%04d-%02d-%02d): expected partial eclipse, but found %d.\n", year, month, day, eclipse.kind);
+    ca = cos(rot * DEG2RAD);
+    sa = sin(rot * DEG2RAD);
+    m.status = ASTRO_SUCCESS;
+    m.rot[0][0] = 1.0;  m.rot[1][0] = 0.0;  m.rot[2][0] = 0.0;
+    m.rot[0][1] = 0.0;  m.rot[1][1] = +ca;  m.rot[2][1] = -sa;
+    m.rot[0][2] = 0.0;  m.rot[1][2] = +sa;  m.rot[2][2] = +ca;
 
-    dt = V(eclipse.peak.ut - time.ut);
-    if (dt < 0.0 || dt > 1.0)
-        FAIL("C LunarFractionCase(%04d-%02d-%02d): eclipse occurs %0.4lf days after predicted date.\n", year, month, day, dt);
+    return m;
+}
 
-    diff = V(eclipse.obscuration - obscuration);
-    if (ABS(diff) > 0.00763)
-        FAIL("C LunarFractionCase(%04d-%02d-%02d) FAIL: obscuration error = %0.8lf, expected = %0.3lf, actual = %0.8lf\n", year, month, day, diff, obscuration, eclipse.obscuration);
-    DEBUG("C LunarFractionCase(%04d-%02d-%02d) fraction error = %0.8lf\n", year, month, day, diff);
+static astro_rotation_t RotateY(double rot)
+{
+    astro_rotation_t m;
+    double ca, sa;
 
-fail:
-    return error;
+    /* https://en.wikipedia.org/wiki/Rotation_matrix */
+
+    ca = cos(rot * DEG2RAD);
+    sa = sin(rot * DEG2RAD);
+    m.status = ASTRO_SUCCESS;
+    m.rot[0][0] = +ca;  m.rot[1][0] = 0.0;  m.rot[2][0] = +sa;
+    m.rot[0][1] = 0.0;  m.rot[1][1] = 1.0;  m.rot[2][1] = 0.0;
+    m.rot[0][2] = -sa;  m.rot[1][2] = 0.0;  m.rot[2][2] = +ca;
+
+    return m;
 }
 
+static astro_rotation_t RotateZ(double rot)
+{
+    astro_rotation_t m;
+    double ca, sa;
+
+    /* https://en.wikipedia.org/wiki/Rotation_matrix */
 
-static int LunarFractionTest(void)
+    ca = cos(rot * DEG2RAD);
+    sa = sin(rot * DEG2RAD);
+    m.status = ASTRO_SUCCESS;
+    m.rot[0][0] = +ca;  m.rot[1][0] = -sa;  m.rot[2][0] = 0.0;
+    m.rot[0][1] = +sa;  m.rot[1][1] = +ca;  m.rot[2][1] = 0.0;
+    m.rot[0][2] = 0.0;  m.rot[1][2] = 0.0;  m.rot[2][2] = 1.0;
+
+    return m;
+}
+
+static int TestSpin(
+    double xrot, double yrot, double zrot,
+    double sx, double sy, double sz,
+    double tx, double ty, double tz)
 {
+    astro_rotation_t mx, my, mz, m;
+    astro_vector_t sv, tv;
+    double diff, dx, dy, dz;
     int error;
 
-    /* Verify calculation of the fraction of the Moon's disc covered by the Earth's umbra during a partial eclipse. */
-    /* Data for this is more tedious to gather, because Espenak data does not contain it. */
-    /* We already verify fraction=0.0 for penumbral eclipses and fraction=1.0 for total eclipses in LunarEclipseTest. */
+    /* https://en.wikipedia.org/wiki/Rotation_matrix */
 
-    CHECK(LunarFractionCase(2010,  6, 26, 0.506));  /* https://www.timeanddate.com/eclipse/lunar/2010-june-26 */
-    CHECK(LunarFractionCase(2012,  6,  4, 0.304));  /* https://www.timeanddate.com/eclipse/lunar/2012-june-4 */
-    CHECK(LunarFractionCase(2013,  4, 25, 0.003));  /* https://www.timeanddate.com/eclipse/lunar/2013-april-25 */
-    CHECK(LunarFractionCase(2017,  8,  7, 0.169));  /* https://www.timeanddate.com/eclipse/lunar/2017-august-7 */
-    CHECK(LunarFractionCase(2019,  7, 16, 0.654));  /* https://www.timeanddate.com/eclipse/lunar/2019-july-16 */
-    CHECK(LunarFractionCase(2021, 11, 19, 0.991));  /* https://www.timeanddate.com/eclipse/lunar/2021-november-19 */
-    CHECK(LunarFractionCase(2023, 10, 28, 0.060));  /* https://www.timeanddate.com/eclipse/lunar/2023-october-28 */
-    CHECK(LunarFractionCase(2024,  9, 18, 0.035));  /* https://www.timeanddate.com/eclipse/lunar/2024-september-18 */
-    CHECK(LunarFractionCase(2026,  8, 28, 0.962));  /* https://www.timeanddate.com/eclipse/lunar/2026-august-28 */
-    CHECK(LunarFractionCase(2028,  1, 12, 0.024));  /* https://www.timeanddate.com/eclipse/lunar/2028-january-12 */
-    CHECK(LunarFractionCase(2028,  7,  6, 0.325));  /* https://www.timeanddate.com/eclipse/lunar/2028-july-6 */
-    CHECK(LunarFractionCase(2030,  6, 15, 0.464));  /* https://www.timeanddate.com/eclipse/lunar/2030-june-15 */
+    mx = RotateX(xrot);
+    CHECK_ROTMAT(mx);
+    my = RotateY(yrot);
+    CHECK_ROTMAT(my);
+    mz = RotateZ(zrot);
+    CHECK_ROTMAT(mz);
+    m = Astronomy_CombineRotation(mx, my);
+    CHECK_ROTMAT(m);
+    m = Astronomy_CombineRotation(m, mz);
+    CHECK_ROTMAT(m);
 
-    FPASS();
+    sv.status = ASTRO_SUCCESS;
+    sv.x = sx;
+    sv.y = sy;
+    sv.z = sz;
+    sv.t = Astronomy_MakeTime(2019, 5, 5, 12, 30, 0.0);
+
+    tv = Astronomy_RotateVector(m, sv);
+    if (tv.status != ASTRO_SUCCESS)
+        FAIL("C ERROR(TestSpin): tv.status = %d\n", tv.status);
+
+    if (tv.t.ut != sv.t.ut)
+        FAIL("C ERROR(TestSpin): tv time != sv time\n");
+
+    dx = tx - tv.x;
+    dy = ty - tv.y;
+    dz = tz - tv.z;
+    diff = V(sqrt(dx*dx + dy*dy + dz*dz));
+    DEBUG("C TestSpin(xrot=%0.0lf, yrot=%0.0lf, zrot=%0.0lf, sx=%0.0lf, sy=%0.0lf, sz=%0.0lf): diff = %lg\n", xrot, yrot, zrot, sx, sy, sz, diff);
+    if (diff > 1.0e-15)
+        FFAIL("EXCESSIVE ERROR\n");
+
+    error = 0;
 fail:
     return error;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
-
-static int GlobalSolarEclipseTest(void)
+static int Test_EQJ_GAL_NOVAS(const char *filename)
 {
-    const int expected_count = 1180;
-    int error = 1;
+    /* Compare against ICRS/GAL calculated by NOVAS C 3.1. */
+    const double THRESHOLD_SECONDS = 8.8;
+    int error;
+    double ra, dec, glon, glat;
+    double dlon, dlat, diff, max_diff;
     FILE *infile = NULL;
-    const char *inFileName = "eclipse/solar_eclipse.txt";
-    int lnum;
+    int lnum, nscanned;
     char line[100];
-    char typeChar;
-    double deltaT, lat, lon;
-    astro_time_t peak;
-    astro_global_solar_eclipse_t eclipse;
-    astro_eclipse_kind_t expected_kind;
-    double diff_days, diff_minutes, max_minutes=0.0;
-    double diff_angle, max_angle=0.0;
-    int skip_count = 0;
-    extern int _CalcMoonCount;      /* incremented by Astronomy Engine every time expensive CalcMoon() is called */
+    astro_rotation_t rot, inv;
+    astro_time_t time;
+    astro_spherical_t eqj_sphere, gal_sphere;
+    astro_vector_t eqj_vec, gal_vec;
 
-    _CalcMoonCount = 0;
+    time = Astronomy_MakeTime(2000, 1, 1, 0, 0, 0.0);   /* placeholder time - value does not matter */
 
-    infile = fopen(inFileName, "rt");
-    if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", inFileName);
+    rot = Astronomy_Rotation_EQJ_GAL();
+    CHECK_STATUS(rot);
 
-    eclipse = Astronomy_SearchGlobalSolarEclipse(Astronomy_MakeTime(1701, 1, 1, 0, 0, 0.0));
+    inv = Astronomy_Rotation_GAL_EQJ();
+    CHECK_STATUS(inv);
+    CHECK_INVERSE(rot, inv);
+
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FFAIL("Cannot open input file: %s\n", filename);
 
+    max_diff = 0.0;
     lnum = 0;
-    while (ReadLine(line, sizeof(line), infile, inFileName, lnum))
+    while (ReadLine(line, sizeof(line), infile, filename, lnum))
     {
         ++lnum;
+        nscanned = sscanf(line, "%lf %lf %lf %lf", &ra, &dec, &glon, &glat);
+        if (nscanned != 4)
+            FAIL("C Test_EQJ_GAL_NOVAS(%s line %d): bad input format.\n", filename, lnum);
+        V(ra);
+        V(dec);
+        V(glon);
+        V(glat);
 
-        if (eclipse.status != ASTRO_SUCCESS)
-            FAIL("C GlobalSolarEclipseTest(%s line %d): error %d searching for solar eclipse.\n", inFileName, lnum, eclipse.status);
+        /* Use Astronomy Engine to do the same EQJ/GAL conversion. */
+        eqj_sphere.status = ASTRO_SUCCESS;
+        eqj_sphere.dist = 1.0;
+        eqj_sphere.lon = 15.0 * ra;     /* Convert from sidereal hours to degrees. */
+        eqj_sphere.lat = dec;
 
-        /* 1889-12-22T12:54:15Z   -6 T   -12.7   -12.8 */
-        if (strlen(line) < 20)
-            FAIL("C GlobalSolarEclipseTest(%s line %d): line is too short.\n", inFileName, lnum);
+        eqj_vec = Astronomy_VectorFromSphere(eqj_sphere, time);
+        CHECK_STATUS(eqj_vec);
 
-        line[20] = '\0';        /* terminate the date/time string */
-        if (ParseDate(line, &peak))
-            FAIL("C GlobalSolarEclipseTest(%s line %d): invalid date/time format: '%s'\n", inFileName, lnum, line);
+        gal_vec = Astronomy_RotateVector(rot, eqj_vec);
+        CHECK_STATUS(gal_vec);
 
-        if (4 != sscanf(line+21, "%lf %c %lf %lf", &deltaT, &typeChar, &lat, &lon))
-            FAIL("C GlobalSolarEclipseTest(%s line %d): invalid data format.\n", inFileName, lnum);
+        gal_sphere = Astronomy_SphereFromVector(gal_vec);
+        CHECK_STATUS(gal_sphere);
 
-        /*
-            The test data allows for "hybrid" eclipses, which means that some
-            observers see a total eclipse, others see an annular eclipse.
-            The global solar eclipse predictor determines the eclipse kind
-            for the peak observer only. Therefore, hybrid in the test data
-            matches a total eclipse from our predictor.
-        */
-        switch (typeChar)
-        {
-        case 'P':   expected_kind = ECLIPSE_PARTIAL;    break;
-        case 'A':   expected_kind = ECLIPSE_ANNULAR;    break;
-        case 'T':   expected_kind = ECLIPSE_TOTAL;      break;
-        case 'H':   expected_kind = ECLIPSE_TOTAL;      break;
-        default:
-            FAIL("C GlobalSolarEclipseTest(%s line %d): invalid eclipse kind in test data.\n", inFileName, lnum);
-        }
+        dlat = V(gal_sphere.lat - glat);
+        dlon = cos(DEG2RAD * glat) * V(gal_sphere.lon - glon);
+        diff = V(3600.0 * sqrt(dlon*dlon + dlat*dlat));     /* error in arcseconds */
+        if (diff > THRESHOLD_SECONDS)
+            FAIL("C Test_EQJ_GAL_NOVAS(%s line %d): EXCESSIVE ERROR = %0.3lf arcseconds\n", filename, lnum, diff);
 
-        diff_days = V(eclipse.peak.ut - peak.ut);
+        if (diff > max_diff)
+            max_diff = diff;
+    }
 
-        /* Sometimes we find marginal eclipses that aren't listed in the test data. */
-        /* Ignore them if the distance between the Sun/Moon shadow axis and the Earth's center is large. */
-        while (diff_days < -25.0 && eclipse.distance > 9000.0)
+    FDEBUG("PASS. max_diff = %0.3lf arcseconds.\n", max_diff);
+    error = 0;
+fail:
+    if (infile != NULL) fclose(infile);
+    return error;
+}
+
+static int Test_EQJ_GAL_JPL(const char *filename)
+{
+    /*
+        Compare against ICRS/GAL calculated by JPL Horizons tool.
+        We get a fairly large error of 23 arcseconds due because I
+        can't figure out how to make JPL Horizons use the same
+        aberration settings in equatorial and galactic coordinates.
+    */
+    const double THRESHOLD_SECONDS = 23.0;
+    int error, lnum, nscanned;
+    int found_begin = 0;
+    int found_end = 0;
+    double ra, dec, glon, glat;
+    FILE *infile = NULL;
+    char line[100];
+    astro_rotation_t rot;
+    astro_time_t time;
+    astro_spherical_t eqj_sphere, gal_sphere;
+    astro_vector_t eqj_vec, gal_vec;
+    double dlon, dlat, diff, max_diff = 0.0;
+
+    time = Astronomy_MakeTime(2000, 1, 1, 0, 0, 0.0);   /* placeholder time - value does not matter */
+
+    rot = Astronomy_Rotation_EQJ_GAL();
+    CHECK_STATUS(rot);
+
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FFAIL("Cannot open input file: %s\n", filename);
+
+    lnum = 0;
+    while (!found_end && ReadLine(line, sizeof(line), infile, filename, lnum))
+    {
+        ++lnum;
+        if (!found_begin)
         {
-            ++skip_count;
-            eclipse = Astronomy_NextGlobalSolarEclipse(eclipse.peak);
-            CHECK_STATUS(eclipse);
-            diff_days = V(eclipse.peak.ut - peak.ut);
+            if (strlen(line) >= 5 && !memcmp(line, "$$SOE", 5))
+                found_begin = 1;
         }
-
-        /* Validate the eclipse prediction. */
-        diff_minutes = (24 * 60) * ABS(diff_days);
-        if (diff_minutes > 7.56)
+        else if (strlen(line) >= 5 && !memcmp(line, "$$EOE", 5))
         {
-            printf("Expected: ");
-            PrintTime(peak);
-            printf("\nFound:    ");
-            PrintTime(eclipse.peak);
-            printf("\n");
-            FAIL("C GlobalSolarEclipseTest(%s line %d): EXCESSIVE TIME ERROR = %0.2lf minutes\n", inFileName, lnum, diff_minutes);
+            found_end = 1;
         }
+        else
+        {
+            if (strlen(line) < 18)
+                FAIL("C Test_EQJ_GAL_JPL(%s line %d): line is too short.\n", filename, lnum);
 
-        if (diff_minutes > max_minutes)
-            max_minutes = diff_minutes;
+            nscanned = sscanf(line+18, "%lf %lf %lf %lf", &ra, &dec, &glon, &glat);
+            if (nscanned != 4)
+                FAIL("C Test_EQJ_GAL_JPL(%s line %d): invalid data format.\n", filename, lnum);
 
-        /* Validate the eclipse kind, but only when it is not a "glancing" eclipse. */
-        if ((V(eclipse.distance) < 6360) && (eclipse.kind != expected_kind))
-            FAIL("C GlobalSolarEclipseTest(%s line %d): WRONG ECLIPSE KIND: expected %d, found %d\n", inFileName, lnum, expected_kind, eclipse.kind);
+            V(ra);
+            V(dec);
+            V(glon);
+            V(glat);
 
-        if (eclipse.kind == ECLIPSE_TOTAL || eclipse.kind == ECLIPSE_ANNULAR)
-        {
-            /*
-                When the distance between the Moon's shadow ray and the Earth's center is beyond 6100 km,
-                it creates a glancing blow whose geographic coordinates are excessively sensitive to
-                slight changes in the ray. Therefore, it is unreasonable to count large errors there.
-            */
-            if (eclipse.distance < 6100.0)
-            {
-                diff_angle = AngleDiff(lat, lon, eclipse.latitude, eclipse.longitude);
-                if (diff_angle > 0.247)
-                    FAIL("C GlobalSolarEclipseTest(%s line %d): EXCESSIVE GEOGRAPHIC LOCATION ERROR = %0.6lf degrees\n", inFileName, lnum, diff_angle);
-                if (diff_angle > max_angle)
-                    max_angle = diff_angle;
-            }
-        }
+            /* Use Astronomy Engine to do the same EQJ/GAL conversion. */
+            eqj_sphere.status = ASTRO_SUCCESS;
+            eqj_sphere.dist = 1.0;
+            eqj_sphere.lon = ra;        /* RA is already in degrees in the JPL Horizons input file. */
+            eqj_sphere.lat = dec;
 
-        /* Verify that the obscuration value is consistent with the eclipse kind. */
-        switch (eclipse.kind)
-        {
-        case ECLIPSE_PARTIAL:
-            if (!isnan(eclipse.obscuration))
-                FAIL("C GlobalSolarEclipseTest(%s line %d): expected NAN obscuration for partial eclipse, but found %lf\n", inFileName, lnum, eclipse.obscuration);
-            break;
+            eqj_vec = Astronomy_VectorFromSphere(eqj_sphere, time);
+            CHECK_STATUS(eqj_vec);
 
-        case ECLIPSE_ANNULAR:
-            if (!isfinite(eclipse.obscuration))
-                FAIL("C GlobalSolarEclipseTest(%s line %d): expected finite obscuration for annular eclipse.\n", inFileName, lnum);
-            if (eclipse.obscuration < 0.8 || eclipse.obscuration >= 1.0)
-                FAIL("C GlobalSolarEclipseTest(%s line %d): obscuration = %0.6lf is out of range for annular eclipse.\n", inFileName, lnum, eclipse.obscuration);
-            break;
+            gal_vec = Astronomy_RotateVector(rot, eqj_vec);
+            CHECK_STATUS(gal_vec);
 
-        case ECLIPSE_TOTAL:
-            if (!isfinite(eclipse.obscuration))
-                FAIL("C GlobalSolarEclipseTest(%s line %d): expected finite obscuration for total eclipse.\n", inFileName, lnum);
-            if (eclipse.obscuration != 1.0)
-                FAIL("C GlobalSolarEclipseTest(%s line %d): obscuration = %0.6lf should have been 1.0 for total eclipse.\n", inFileName, lnum, eclipse.obscuration);
-            break;
+            gal_sphere = Astronomy_SphereFromVector(gal_vec);
+            CHECK_STATUS(gal_sphere);
 
-        default:
-            FAIL("C GlobalSolarEclipseTest(%s line %d): Unhandled eclipse kind %d for obscuration check.\n", inFileName, lnum, eclipse.kind);
-        }
+            dlat = V(gal_sphere.lat - glat);
+            dlon = cos(DEG2RAD * glat) * V(gal_sphere.lon - glon);
+            diff = V(3600.0 * sqrt(dlon*dlon + dlat*dlat));     /* error in arcseconds */
+            if (diff > THRESHOLD_SECONDS)
+                FAIL("C Test_EQJ_GAL_JPL(%s line %d): EXCESSIVE ERROR = %0.3lf arcseconds\n", filename, lnum, diff);
 
-        eclipse = Astronomy_NextGlobalSolarEclipse(eclipse.peak);
+            if (diff > max_diff)
+                max_diff = diff;
+        }
     }
 
-    if (lnum != expected_count)
-        FFAIL("WRONG LINE COUNT = %d, expected %d\n", lnum, expected_count);
+    if (!found_begin)
+        FFAIL("did not find begin-data marker in: %s\n", filename);
 
-    if (skip_count > 2)
-        FFAIL("EXCESSIVE SKIP COUNT = %d\n", skip_count);
+    if (!found_end)
+        FFAIL("did not find end-data marker in: %s\n", filename);
 
-    FPASSA("(%d verified, %d skipped, %d CalcMoons, max minutes = %0.3lf, max angle = %0.3lf)\n", lnum, skip_count, _CalcMoonCount, max_minutes, max_angle);
+    FDEBUG("PASS. max_diff = %0.3lf arcseconds.\n", max_diff);
+    error = 0;
 fail:
     if (infile != NULL) fclose(infile);
     return error;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
-
-static void VectorFromAngles(double v[3], double lat, double lon)
+static int Test_EQJ_EQD(astro_body_t body)
 {
-    double coslat = cos(DEG2RAD * lat);
-    v[0] = cos(DEG2RAD * lon) * coslat;
-    v[1] = sin(DEG2RAD * lon) * coslat;
-    v[2] = sin(DEG2RAD * lat);
-}
-
+    astro_time_t time;
+    astro_observer_t observer;
+    astro_equatorial_t eq2000, eqdate, eqcheck;
+    astro_vector_t v2000, vdate, t2000;
+    astro_rotation_t r;
+    double ra_diff, dec_diff, dist_diff, diff;
+    int error;
 
-static double AngleDiff(double alat, double alon, double blat, double blon)
-{
-    double a[3];
-    double b[3];
-    double dot;
+    /* Verify conversion of equatorial J2000 to equatorial of-date, and back. */
 
-    /* Convert angles to vectors on a unit sphere. */
-    VectorFromAngles(a, alat, alon);
-    VectorFromAngles(b, blat, blon);
+    /* Use established functions to calculate spherical coordinates for the body, in both EQJ and EQD. */
+    time = Astronomy_MakeTime(2019, 12, 8, 20, 50, 0.0);
+    observer = Astronomy_MakeObserver(35, -85, 0);
+    eq2000 = Astronomy_Equator(body, &time, observer, EQUATOR_J2000, ABERRATION);
+    CHECK_STATUS(eq2000);
+    eqdate = Astronomy_Equator(body, &time, observer, EQUATOR_OF_DATE, ABERRATION);
+    CHECK_STATUS(eqdate);
 
-    dot = V(a[0]*b[0] + a[1]*b[1] + a[2]*b[2]);
-    if (dot <= -1.0)
-        return 180.0;
+    /* Convert EQJ angular coordinates to vector. */
+    v2000 = eq2000.vec;
+    CHECK_STATUS(v2000);
 
-    if (dot >= +1.0)
-        return 0.0;
+    /* Find rotation matrix. */
+    r = Astronomy_Rotation_EQJ_EQD(&time);
+    CHECK_ROTMAT(r);
 
-    return V(RAD2DEG * acos(dot));
-}
+    /* Rotate EQJ vector to EQD vector. */
+    vdate = Astronomy_RotateVector(r, v2000);
+    CHECK_STATUS(vdate);
 
-/*-----------------------------------------------------------------------------------------------------------*/
+    /* Convert vector back to angular coordinates. */
+    eqcheck = Astronomy_EquatorFromVector(vdate);
+    CHECK_STATUS(eqcheck);
 
-static int LocalSolarEclipseTest(void)
-{
-    int error;
-    CHECK(LocalSolarEclipseTest1());
-    CHECK(LocalSolarEclipseTest2());
+    /* Compare the result with the eqdate. */
+    ra_diff = ABS(eqcheck.ra - eqdate.ra);
+    dec_diff = ABS(eqcheck.dec - eqdate.dec);
+    dist_diff = ABS(eqcheck.dist - eqdate.dist);
+    FDEBUG("%s ra=%0.3lf, dec=%0.3lf, dist=%0.3lf, ra_diff=%lg, dec_diff=%lg, dist_diff=%lg\n", Astronomy_BodyName(body), eqdate.ra, eqdate.dec, eqdate.dist, ra_diff, dec_diff, dist_diff);
+    if (ra_diff > 1.0e-14 || dec_diff > 1.0e-14 || dist_diff > 4.0e-15)
+        FFAIL("EXCESSIVE ERROR\n");
+
+    /* Perform the inverse conversion back to equatorial J2000 coordinates. */
+    r = Astronomy_Rotation_EQD_EQJ(&time);
+    CHECK_ROTMAT(r);
+    t2000 = Astronomy_RotateVector(r, vdate);
+    CHECK_STATUS(t2000);
+    CHECK(VectorDiff(t2000, v2000, &diff));
+    FDEBUG("%s inverse diff = %lg\n", Astronomy_BodyName(body), diff);
+    if (diff > 5.0e-15)
+        FFAIL("EXCESSIVE INVERSE ERROR\n");
+
+    error = 0;
 fail:
     return error;
 }
 
-static int LocalSolarEclipseTest1(void)
+static int Test_EQD_HOR(astro_body_t body)
 {
-    /*
-        Re-use the test data for global solar eclipses, only feed the given coordinates
-        into the local solar eclipse predictor as the observer's location.
-        In each case, start the search 20 days before the expected eclipse.
-        Then verify that the peak time and eclipse type is correct in each case.
-    */
-
-    int error = 1;
-    FILE *infile = NULL;
-    const char *inFileName = "eclipse/solar_eclipse.txt";
-    int lnum;
-    char line[100];
-    char typeChar;
-    double deltaT;
+    astro_time_t time;
     astro_observer_t observer;
-    astro_time_t peak, search_start;
-    astro_local_solar_eclipse_t eclipse;
-    double diff_days, diff_minutes, max_minutes=0.0;
-    int skip_count = 0;
-    extern int _CalcMoonCount;      /* incremented by Astronomy Engine every time expensive CalcMoon() is called */
-
-    _CalcMoonCount = 0;
-
-    infile = fopen(inFileName, "rt");
-    if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", inFileName);
-
-    lnum = 0;
-    observer.height = 0.0;
-    while (ReadLine(line, sizeof(line), infile, inFileName, lnum))
-    {
-        ++lnum;
+    astro_equatorial_t eqd, eqj;
+    astro_horizon_t hor;
+    astro_rotation_t rot;
+    astro_spherical_t sphere;
+    astro_vector_t vec_eqd, vec_eqj, vec_hor, check_eqd, check_eqj, check_hor;
+    double diff_az, diff_alt, diff;
+    int error;
 
-        /* 1889-12-22T12:54:15Z   -6 T   -12.7   -12.8 */
-        if (strlen(line) < 20)
-            FAIL("C LocalSolarEclipseTest1(%s line %d): line is too short.\n", inFileName, lnum);
+    /* Use existing functions to calculate horizontal coordinates of the body for the time+observer. */
+    time = Astronomy_MakeTime(1970, 12, 13, 5, 15, 0.0);
+    observer = Astronomy_MakeObserver(-37.0, +45.0, 0.0);
+    CHECK_EQU(eqd, Astronomy_Equator(body, &time, observer, EQUATOR_OF_DATE, ABERRATION));
+    DEBUG("C Test_EQD_HOR %s: OFDATE ra=%0.3lf, dec=%0.3lf\n", Astronomy_BodyName(body), eqd.ra, eqd.dec);
+    hor = Astronomy_Horizon(&time, observer, eqd.ra, eqd.dec, REFRACTION_NORMAL);
 
-        line[20] = '\0';        /* terminate the date/time string */
-        if (ParseDate(line, &peak))
-            FAIL("C LocalSolarEclipseTest1(%s line %d): invalid date/time format: '%s'\n", inFileName, lnum, line);
+    /* Calculate the position of the body as an equatorial vector of date. */
+    CHECK_VECTOR(vec_eqd, eqd.vec);
 
-        if (4 != sscanf(line+21, "%lf %c %lf %lf", &deltaT, &typeChar, &observer.latitude, &observer.longitude))
-            FAIL("C LocalSolarEclipseTest1(%s line %d): invalid data format.\n", inFileName, lnum);
+    /* Calculate rotation matrix to convert equatorial J2000 vector to horizontal vector. */
+    rot = Astronomy_Rotation_EQD_HOR(&time, observer);
+    CHECK_ROTMAT(rot);
 
-        /* Start the search 20 days before we know the eclipse should peak. */
-        search_start = Astronomy_AddDays(peak, -20.0);
-        eclipse = Astronomy_SearchLocalSolarEclipse(search_start, observer);
-        if (eclipse.status != ASTRO_SUCCESS)
-            FAIL("C LocalSolarEclipseTest1(%s line %d): Astronomy_SearchLocalSolarEclipse returned %d\n", inFileName, lnum, eclipse.status);
+    /* Rotate the equator of date vector to a horizontal vector. */
+    CHECK_VECTOR(vec_hor, Astronomy_RotateVector(rot, vec_eqd));
 
-        /* Validate the predicted eclipse peak time. */
-        diff_days = eclipse.peak.time.ut - peak.ut;
-        if (diff_days > 20.0)
-        {
-            ++skip_count;
-            continue;
-        }
+    /* Convert the horizontal vector to horizontal angular coordinates. */
+    sphere = Astronomy_HorizonFromVector(vec_hor, REFRACTION_NORMAL);
+    CHECK_STATUS(sphere);
 
-        diff_minutes = (24 * 60) * ABS(diff_days);
-        if (diff_minutes > 7.737)
-        {
-            printf("Expected: ");
-            PrintTime(peak);
-            printf("\nFound:    ");
-            PrintTime(eclipse.peak.time);
-            printf("  ut=%0.6lf, tt=%0.6lf\n", eclipse.peak.time.ut, eclipse.peak.time.tt);
-            FAIL("C LocalSolarEclipseTest1(%s line %d): EXCESSIVE TIME ERROR = %0.6lf minutes\n", inFileName, lnum, diff_minutes);
-        }
+    diff_alt = ABS(sphere.lat - hor.altitude);
+    diff_az = ABS(sphere.lon - hor.azimuth);
 
-        if (diff_minutes > max_minutes)
-            max_minutes = diff_minutes;
+    DEBUG("C Test_EQD_HOR %s: trusted alt=%0.3lf, az=%0.3lf; test alt=%0.3lf, az=%0.3lf; diff_alt=%lg, diff_az=%lg\n",
+        Astronomy_BodyName(body), hor.altitude, hor.azimuth, sphere.lat, sphere.lon, diff_alt, diff_az);
 
-        /* Verify obscuration makes sense for this kind of eclipse. */
+    if (diff_alt > 3.6e-14 || diff_az > 1.2e-13)
+        FFAIL("EXCESSIVE HORIZONTAL ERROR.\n");
 
-        if (!isfinite(eclipse.obscuration))
-            FAIL("C LocalSolarEclipseTest1(%s line %d): obscuration is not finite\n", inFileName, lnum);
+    /* Confirm that we can convert back to horizontal vector. */
+    CHECK_VECTOR(check_hor, Astronomy_VectorFromHorizon(sphere, time, REFRACTION_NORMAL));
+    CHECK(VectorDiff(check_hor, vec_hor, &diff));
+    DEBUG("C Test_EQD_HOR %s: horizontal recovery: diff = %lg\n", Astronomy_BodyName(body), diff);
+    if (diff > 3.0e-15)
+        FFAIL("EXCESSIVE ERROR IN HORIZONTAL RECOVERY.\n");
 
-        switch (eclipse.kind)
-        {
-        case ECLIPSE_ANNULAR:
-        case ECLIPSE_PARTIAL:
-            if (eclipse.obscuration <= 0.0 || eclipse.obscuration >= 1.0)
-                FAIL("C LocalSolarEclipseTest1(%s line %d): eclipse kind %d has invalid obscuration = %0.8lf\n", inFileName, lnum, eclipse.kind, eclipse.obscuration);
-            break;
+    /* Verify the inverse translation from horizontal vector to equatorial of-date vector. */
+    rot = Astronomy_Rotation_HOR_EQD(&time, observer);
+    CHECK_ROTMAT(rot);
+    CHECK_VECTOR(check_eqd, Astronomy_RotateVector(rot, vec_hor));
+    CHECK(VectorDiff(check_eqd, vec_eqd, &diff));
+    DEBUG("C Test_EQD_HOR %s: OFDATE inverse rotation diff = %lg\n", Astronomy_BodyName(body), diff);
+    if (diff > 2.67e-15)
+        FFAIL("EXCESSIVE OFDATE INVERSE HORIZONTAL ERROR.\n");
 
-        case ECLIPSE_TOTAL:
-            if (eclipse.obscuration != 1.0)
-                FAIL("C LocalSolarEclipseTest1(%s line %d): total eclipse has invalid obscuration = %0.8lf\n", inFileName, lnum, eclipse.obscuration);
-            break;
+    /* Exercise HOR to EQJ translation. */
+    CHECK_EQU(eqj, Astronomy_Equator(body, &time, observer, EQUATOR_J2000, ABERRATION));
+    CHECK_VECTOR(vec_eqj, eqj.vec);
 
-        default:
-            FAIL("C LocalSolarEclipseTest1(%s line %d): Invalid eclipse kind %d\n", inFileName, lnum, eclipse.kind);
-        }
-    }
+    rot = Astronomy_Rotation_HOR_EQJ(&time, observer);
+    CHECK_ROTMAT(rot);
+    CHECK_VECTOR(check_eqj, Astronomy_RotateVector(rot, vec_hor));
+    CHECK(VectorDiff(check_eqj, vec_eqj, &diff));
+    DEBUG("C Test_EQD_HOR %s: J2000 inverse rotation diff = %lg\n", Astronomy_BodyName(body), diff);
+    if (diff > 6.0e-15)
+        FFAIL("EXCESSIVE J2000 INVERSE HORIZONTAL ERROR.\n");
 
-    if (skip_count > 6)
-        FFAIL("EXCESSIVE SKIP COUNT %d\n", skip_count);
+    /* Verify the inverse translation: EQJ to HOR. */
+    rot = Astronomy_Rotation_EQJ_HOR(&time, observer);
+    CHECK_ROTMAT(rot);
+    CHECK_VECTOR(check_hor, Astronomy_RotateVector(rot, vec_eqj));
+    CHECK(VectorDiff(check_hor, vec_hor, &diff));
+    DEBUG("C Test_EQD_HOR %s: EQJ inverse rotation diff = %lg\n", Astronomy_BodyName(body), diff);
+    if (diff > 5.0e-15)
+        FFAIL("EXCESSIVE EQJ INVERSE HORIZONTAL ERROR.\n");
 
-    FPASSA("(%d verified, %d skipped, %d CalcMoons, max minutes = %0.3lf)\n", lnum, skip_count, _CalcMoonCount, max_minutes);
     error = 0;
 fail:
-    if (infile != NULL) fclose(infile);
     return error;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
-
-static int ParseEvent(const char *str, int required, astro_time_t *time)
+static int Test_EQD_ECT(void)
 {
-    if (required)
-        return ParseDate(str, time);
+    int error = 1;
+    int count = 0;
+    astro_time_t time = Astronomy_MakeTime(1900, 1, 1, 0, 0, 0.0);
+    astro_time_t stopTime = Astronomy_MakeTime(2100, 1, 1, 0, 0, 0.0);
+    astro_vector_t eqj, eqd, ect, check_ect;
+    astro_rotation_t eqj_eqd, eqd_ect;
+    astro_spherical_t sphere;
+    double diff, max_diff = 0.0;
 
-    if (strcmp(str, "-"))
+    while (time.ut <= stopTime.ut)
     {
-        fprintf(stderr, "ParseEvent: Expected '-' but found '%s'\n", str);
-        return 1;
-    }
-
-    time->ut = time->tt = NAN;
-    return 0;
-}
+        /* Get Moon's geocentric position in EQJ. */
+        eqj = Astronomy_GeoMoon(time);
+        CHECK_STATUS(eqj);
 
+        /* Convert EQJ to EQD. */
+        eqj_eqd = Astronomy_Rotation_EQJ_EQD(&time);
+        CHECK_ROTMAT(eqj_eqd);
+        eqd = Astronomy_RotateVector(eqj_eqd, eqj);
+        CHECK_STATUS(eqd);
 
-static int IgnoreLine(char *line)
-{
-    int col, empty;
+        /* Convert EQD to ECT. */
+        eqd_ect = Astronomy_Rotation_EQD_ECT(&time);
+        CHECK_ROTMAT(eqd_ect);
+        ect = Astronomy_RotateVector(eqd_ect, eqd);
+        CHECK_STATUS(ect);
 
-    /* Treat '#' as a comment character. */
-    empty = 1;
-    for (col=0; line[col] != '\0' && line[col] != '#'; ++col)
-        if (!isspace(line[col]))
-            empty = 0;
+        /* Independently get the Moon's spherical coordinates in ECT. */
+        sphere = Astronomy_EclipticGeoMoon(time);
+        CHECK_STATUS(sphere);
 
-    line[col] = '\0';
-    return empty;
-}
+        /* Convert spherical coordinates to ECT vector. */
+        check_ect = Astronomy_VectorFromSphere(sphere, time);
+        CHECK_STATUS(check_ect);
 
+        /* Verify the two ECT vectors are identical, within tolerance. */
+        CHECK(VectorDiff(ect, check_ect, &diff));
+        if (diff > max_diff) max_diff = diff;
 
-static int CheckEvent(
-    const char *inFileName,
-    int lnum,
-    const char *name,
-    astro_time_t expected_time,
-    double expected_altitude,
-    astro_eclipse_event_t evt,
-    double *max_minutes,
-    double *max_degrees)
-{
-    int error = 1;
-    double diff_minutes, diff_alt;
-
-    diff_minutes = (24 * 60) * ABS(expected_time.ut - evt.time.ut);
-
-    if (diff_minutes > *max_minutes)
-        *max_minutes = diff_minutes;
-
-    if (diff_minutes > 1.0)
-        FAIL("CheckEvent(%s line %d): EXCESSIVE TIME ERROR: %0.3lf minutes\n", inFileName, lnum, diff_minutes);
-
-    /* Ignore discrepancies for negative altitudes, because of quirky and irrelevant differences in refraction models. */
-    if (expected_altitude >= 0.0)
-    {
-        diff_alt = ABS(expected_altitude - evt.altitude);
-        if (diff_alt > *max_degrees) *max_degrees = diff_alt;
-        if (diff_alt > 0.5)
-            FAIL("CheckEvent(%s line %d): EXCESSIVE ALTITUDE ERROR: %0.6lf degrees (expected = %0.6lf, calc = %0.6lf)\n", inFileName, lnum, diff_alt, expected_altitude, evt.altitude);
+        time = Astronomy_AddDays(time, 10.0);
+        ++count;
     }
 
+    if (max_diff > 3.743e-18)
+        FFAIL("excessive vector diff = %0.6le AU.\n", max_diff);
+
+    FDEBUG("PASS: count = %d, max_diff = %0.6le AU\n", count, max_diff);
     error = 0;
 fail:
     return error;
 }
 
 
-#define TIMESTRSIZE 31
-
-static int LocalSolarEclipseTest2(void)
+static int EclipticTest(void)
 {
-    /*
-        Test ability to calculate local solar eclipse conditions away from
-        the peak position on the Earth.
-    */
-
     int error = 1;
-    FILE *infile = NULL;
-    const char *inFileName = "eclipse/local_solar_eclipse.txt";
-    int lnum, nscanned;
-    char line[300];
-    char p1str[TIMESTRSIZE], p2str[TIMESTRSIZE], t1str[TIMESTRSIZE], t2str[TIMESTRSIZE], peakstr[TIMESTRSIZE];
-    double p1alt, p2alt, t1alt, t2alt, peakalt;
-    astro_time_t p1, p2, t1, t2, peak, search_time;
-    char typeChar;
-    astro_observer_t observer;
-    double max_minutes=0.0, max_degrees=0.0;
-    int verify_count = 0;
-    astro_local_solar_eclipse_t eclipse;
-    astro_eclipse_kind_t expected_kind;
-    extern int _CalcMoonCount;      /* incremented by Astronomy Engine every time expensive CalcMoon() is called */
-
-    _CalcMoonCount = 0;
-
-    infile = fopen(inFileName, "rt");
-    if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", inFileName);
+    int count = 0;
+    astro_time_t time = Astronomy_MakeTime(1900, 1, 1, 0, 0, 0.0);
+    astro_time_t stopTime = Astronomy_MakeTime(2100, 1, 1, 0, 0, 0.0);
+    astro_vector_t eqj, check_ect;
+    astro_spherical_t sphere;
+    astro_ecliptic_t eclip;
+    double diff, max_vec_diff = 0.0, max_angle_diff = 0.0;
 
-    lnum = 0;
-    observer.height = 0.0;
-    while (ReadLine(line, sizeof(line), infile, inFileName, lnum))
+    while (time.ut <= stopTime.ut)
     {
-        ++lnum;
-        if (IgnoreLine(line)) continue;
+        /* Get Moon's geocentric position in EQJ. */
+        eqj = Astronomy_GeoMoon(time);
+        CHECK_STATUS(eqj);
 
-        nscanned = sscanf(line, "%lf %lf %c %30s %lf %30s %lf %30s %lf %30s %lf %30s %lf",
-            &observer.latitude,   &observer.longitude,
-            &typeChar,
-            p1str,      &p1alt,
-            t1str,      &t1alt,
-            peakstr,    &peakalt,
-            t2str,      &t2alt,
-            p2str,      &p2alt);
+        /* Convert EQJ to ECT. */
+        eclip = Astronomy_Ecliptic(eqj);
+        CHECK_STATUS(eclip);
 
-        if (nscanned != 13)
-            FAIL("C LocalSolarEclipseTest2(%s line %d): Incorrect token count (scanned %d)\n", inFileName, lnum, nscanned);
+        /* Confirm that the ecliptic angles and ecliptic vector are consistent.*/
+        CHECK_STATUS(eclip.vec);
+        V(eclip.vec.x);
+        V(eclip.vec.y);
+        V(eclip.vec.z);
+        sphere.dist = V(Astronomy_VectorLength(eclip.vec));
+        sphere.lat = V(eclip.elat);
+        sphere.lon = V(eclip.elon);
+        sphere.status = ASTRO_SUCCESS;
+        check_ect = Astronomy_VectorFromSphere(sphere, time);
+        CHECK(VectorDiff(eclip.vec, check_ect, &diff));
+        if (diff > max_angle_diff) max_angle_diff = diff;
 
-        switch (typeChar)
-        {
-        case 'P': expected_kind = ECLIPSE_PARTIAL; break;
-        case 'A': expected_kind = ECLIPSE_ANNULAR; break;
-        case 'T': expected_kind = ECLIPSE_TOTAL;   break;
-        default:
-            FAIL("C LocalSolarEclipseTest2(%s line %d): invalid eclipse type '%c'\n", inFileName, lnum, typeChar);
-        }
+        /* Independently get the Moon's spherical coordinates in ECT. */
+        sphere = Astronomy_EclipticGeoMoon(time);
+        CHECK_STATUS(sphere);
 
-        CHECK(ParseEvent(p1str, 1, &p1));
-        CHECK(ParseEvent(p2str, 1, &p2));
-        CHECK(ParseEvent(peakstr, 1, &peak));
-        CHECK(ParseEvent(t1str, (typeChar != 'P'), &t1));
-        CHECK(ParseEvent(t2str, (typeChar != 'P'), &t2));
+        /* Convert spherical coordinates to ECT vector. */
+        check_ect = Astronomy_VectorFromSphere(sphere, time);
+        CHECK_STATUS(check_ect);
 
-        search_time = Astronomy_AddDays(p1, -20.0);
-        eclipse = Astronomy_SearchLocalSolarEclipse(search_time, observer);
-        if (eclipse.status != ASTRO_SUCCESS)
-            FAIL("C LocalSolarEclipseTest2(%s line %d): error %d searching for solar eclipse.\n", inFileName, lnum, eclipse.status);
+        /* Verify the two ECT vectors are identical, within tolerance. */
+        CHECK(VectorDiff(eclip.vec, check_ect, &diff));
+        if (diff > max_vec_diff) max_vec_diff = diff;
 
-        if (eclipse.kind != expected_kind)
-            FAIL("C LocalSolarEclipseTest2(%s line %d): expected eclipse kind %d, found %d\n", inFileName, lnum, expected_kind, eclipse.kind);
+        time = Astronomy_AddDays(time, 10.0);
+        ++count;
+    }
 
-        CHECK(CheckEvent(inFileName, lnum, "peak", peak, peakalt, eclipse.peak, &max_minutes, &max_degrees));
-        CHECK(CheckEvent(inFileName, lnum, "partial_begin", p1, p1alt, eclipse.partial_begin, &max_minutes, &max_degrees));
-        CHECK(CheckEvent(inFileName, lnum, "partial_end", p2, p2alt, eclipse.partial_end, &max_minutes, &max_degrees));
-        if (typeChar != 'P')
-        {
-            CHECK(CheckEvent(inFileName, lnum, "total_begin", t1, t1alt, eclipse.total_begin, &max_minutes, &max_degrees));
-            CHECK(CheckEvent(inFileName, lnum, "total_end", t2, t2alt, eclipse.total_end, &max_minutes, &max_degrees));
-        }
+    if (max_angle_diff > 3.110e-18)
+        FFAIL("EXCESSIVE ANGLE DIFF = %0.6le AU.\n", max_angle_diff);
 
-        ++verify_count;
-    }
+    if (max_vec_diff > 3.388e-18)
+        FFAIL("EXCESSIVE VECTOR DIFF = %0.6le AU.\n", max_vec_diff);
 
-    FPASSA("(%d verified, %d CalcMoons, max minutes = %0.3lf, max alt degrees = %0.3lf)\n", verify_count, _CalcMoonCount, max_minutes, max_degrees);
+    FPASSA("PASS: count = %d, max_vec_diff = %0.6le AU, max_angle_diff = %0.6le AU.\n", count, max_vec_diff, max_angle_diff);
 fail:
-    if (infile != NULL) fclose(infile);
     return error;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
 
-static int GlobalAnnularCase(int year, int month, int day, double obscuration)
+static int CheckInverse(const char *aname, const char *bname, astro_rotation_t arot, astro_rotation_t brot)
 {
     int error;
-    astro_time_t time;
-    astro_global_solar_eclipse_t eclipse;
-    double dt, diff;
+    astro_rotation_t crot;
+    astro_rotation_t identity;
 
-    /* Search for the first solar eclipse that occurs after the given date. */
-    time = Astronomy_MakeTime(year, month, day, 0, 0, 0.0);
-    eclipse = Astronomy_SearchGlobalSolarEclipse(time);
-    CHECK_STATUS(eclipse);
+    CHECK(CheckRotationMatrix(__LINE__, aname, arot));
+    CHECK(CheckRotationMatrix(__LINE__, bname, brot));
 
-    /* Verify the eclipse is within 1 day after the search basis time. */
-    dt = V(eclipse.peak.ut - time.ut);
-    if (dt < 0.0 || dt > 1.0)
-        FAIL("C GlobalAnnularCase(%04d-%02d-%02d) FAIL: found eclipse %0.8lf days after search time.\n", year, month, day, dt);
+    crot = Astronomy_CombineRotation(arot, brot);
+    CHECK_ROTMAT(crot);
 
-    /* Verify we found an annular solar eclipse. */
-    if (eclipse.kind != ECLIPSE_ANNULAR)
-        FAIL("C GlobalAnnularCase(%04d-%02d-%02d) FAIL: expected annular eclipse, found %d.\n", year, month, day, eclipse.kind);
+    identity.status = ASTRO_SUCCESS;
+    identity.rot[0][0] = 1; identity.rot[1][0] = 0; identity.rot[2][0] = 0;
+    identity.rot[0][1] = 0; identity.rot[1][1] = 1; identity.rot[2][1] = 0;
+    identity.rot[0][2] = 0; identity.rot[1][2] = 0; identity.rot[2][2] = 1;
 
-    /* Check how accurately we calculated obscuration. */
-    diff = V(eclipse.obscuration - obscuration);
-    if (ABS(diff) > 0.0000904)
-        FAIL("C GlobalAnnularCase(%04d-%02d-%02d) FAIL: excessive obscuration error = %0.8lf. expected = %0.8lf, calculated = %0.8lf\n", year, month, day, diff, obscuration, eclipse.obscuration);
-    DEBUG("C GlobalAnnularCase(%04d-%02d-%02d) obscuration error = %0.8lf, expected = %0.8lf, calculated = %0.8lf\n", year, month, day, diff, obscuration, eclipse.obscuration);
+    CHECK(CompareMatrices("CheckInverse", crot, identity, 2.0e-15));
 
+    error = 0;
 fail:
     return error;
 }
 
-
-static int LocalSolarCase(
-    int year,
-    int month,
-    int day,
-    double latitude,
-    double longitude,
-    astro_eclipse_kind_t kind,
-    double obscuration,
-    double tolerance)
+static int CheckCycle(
+    const char *cyclename,
+    astro_rotation_t arot, astro_rotation_t brot, astro_rotation_t crot)
 {
     int error;
-    astro_time_t time;
-    astro_observer_t observer;
-    astro_local_solar_eclipse_t eclipse;
-    double dt, diff;
-
-    observer = Astronomy_MakeObserver(latitude, longitude, 0.0);
-    time = Astronomy_MakeTime(year, month, day, 0, 0, 0.0);
-    eclipse = Astronomy_SearchLocalSolarEclipse(time, observer);
-    CHECK_STATUS(eclipse);
-
-    dt = V(eclipse.peak.time.ut - time.ut);
-    if (dt < 0.0 || dt > 1.0)
-        FAIL("C LocalSolarCase(%04d-%02d-%02d) FAIL: elapsed time = %0.6lf days\n", year, month, day, dt);
-
-    if (eclipse.kind != kind)
-        FAIL("C LocalSolarCase(%04d-%02d-%02d) FAIL: expected kind %d, found %d\n", year, month, day, kind, eclipse.kind);
-
-    diff = V(eclipse.obscuration - obscuration);
-    if (ABS(diff) > tolerance)
-        FAIL("C LocalSolarCase(%04d-%02d-%02d) FAIL: obscuration diff = %11.8lf, expected = %11.8lf, calculated = %11.8lf\n", year, month, day, diff, obscuration, eclipse.obscuration);
-    DEBUG("C LocalSolarCase(%04d-%02d-%02d) obscuration diff = %11.8lf, expected = %11.8lf, calculated = %11.8lf\n", year, month, day, diff, obscuration, eclipse.obscuration);
+    astro_rotation_t xrot;
 
+    xrot = Astronomy_CombineRotation(arot, brot);
+    CHECK_ROTMAT(xrot);
+    xrot = Astronomy_InverseRotation(xrot);
+    CHECK(CompareMatrices(cyclename, crot, xrot, 2.0e-15));
+    error = 0;
 fail:
     return error;
 }
 
+#define CHECK_CYCLE(a,b,c)  CHECK(CheckCycle(("CheckCycle: " #a ", " #b ", " #c), a, b, c))
 
-static int SolarFractionTest(void)
+static int Test_RotRoundTrip(void)
 {
     int error;
+    astro_time_t time;
+    astro_observer_t observer;
+    astro_rotation_t eqj_ecl, ecl_eqj;
+    astro_rotation_t eqj_hor, hor_eqj;
+    astro_rotation_t eqj_eqd, eqd_eqj;
+    astro_rotation_t hor_eqd, eqd_hor;
+    astro_rotation_t eqd_ecl, ecl_eqd;
+    astro_rotation_t hor_ecl, ecl_hor;
+    astro_rotation_t eqd_ect, ect_eqd;
+    astro_rotation_t eqj_ect, ect_eqj;
 
-    /* Verify global solar eclipse obscurations for annular eclipses only. */
-    /* This is because they are the only nontrivial values for global solar eclipses. */
-    /* The trivial values are all validated exactly by GlobalSolarEclipseTest(). */
+    time = Astronomy_MakeTime(2067, 5, 30, 14, 45, 0.0);
+    observer = Astronomy_MakeObserver(+28.0, -82.0, 0.0);
 
-    CHECK(GlobalAnnularCase(2023, 10, 14, 0.90638));    /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2023Oct14Aprime.html */
-    CHECK(GlobalAnnularCase(2024, 10,  2, 0.86975));    /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2024Oct02Aprime.html */
-    CHECK(GlobalAnnularCase(2027,  2,  6, 0.86139));    /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2027Feb06Aprime.html */
-    CHECK(GlobalAnnularCase(2028,  1, 26, 0.84787));    /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2028Jan26Aprime.html */
-    CHECK(GlobalAnnularCase(2030,  6,  1, 0.89163));    /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2030Jun01Aprime.html */
+    /*
+        In each round trip, calculate a forward rotation and a backward rotation.
+        Verify the two are inverse matrices.
+    */
 
-    /* Verify obscuration values for specific locations on the Earth. */
-    /* Local solar eclipse calculations include obscuration for all types of eclipse, not just annular and total. */
-    CHECK(LocalSolarCase(2023, 10, 14,  11.3683,  -83.1017, ECLIPSE_ANNULAR, 0.90638, 0.000080));   /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2023Oct14Aprime.html */
-    CHECK(LocalSolarCase(2023, 10, 14,  25.78,    -80.22,   ECLIPSE_PARTIAL, 0.578,   0.000023));   /* https://aa.usno.navy.mil/calculated/eclipse/solar?eclipse=22023&lat=25.78&lon=-80.22&label=Miami%2C+FL&height=0&submit=Get+Data */
-    CHECK(LocalSolarCase(2023, 10, 14,  30.2666,  -97.7000, ECLIPSE_PARTIAL, 0.8867,  0.001016));   /* http://astro.ukho.gov.uk/eclipse/0332023/Austin_TX_United_States_2023Oct14.png */
-    CHECK(LocalSolarCase(2024,  4,  8,  25.2900, -104.1383, ECLIPSE_TOTAL,   1.0,     0.0));        /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2024Apr08Tprime.html */
-    CHECK(LocalSolarCase(2024,  4,  8,  37.76,   -122.44,   ECLIPSE_PARTIAL, 0.340,   0.000604));   /* https://aa.usno.navy.mil/calculated/eclipse/solar?eclipse=12024&lat=37.76&lon=-122.44&label=San+Francisco%2C+CA&height=0&submit=Get+Data */
-    CHECK(LocalSolarCase(2024, 10,  2, -21.9533, -114.5083, ECLIPSE_ANNULAR, 0.86975, 0.000061));   /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2024Oct02Aprime.html */
-    CHECK(LocalSolarCase(2024, 10,  2, -33.468,   -70.636,  ECLIPSE_PARTIAL, 0.436,   0.000980));   /* https://aa.usno.navy.mil/calculated/eclipse/solar?eclipse=22024&lat=-33.468&lon=-70.636&label=Santiago%2C+Chile&height=0&submit=Get+Data */
-    CHECK(LocalSolarCase(2030,  6,  1,  56.525,    80.0617, ECLIPSE_ANNULAR, 0.89163, 0.000067));   /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2030Jun01Aprime.html */
-    CHECK(LocalSolarCase(2030,  6,  1,  40.388,    49.914,  ECLIPSE_PARTIAL, 0.67240, 0.000599));   /* http://xjubier.free.fr/en/site_pages/SolarEclipseCalc_Diagram.html */
-    CHECK(LocalSolarCase(2030,  6,  1,  40.3667,   49.8333, ECLIPSE_PARTIAL, 0.6736,  0.001464));   /* http://astro.ukho.gov.uk/eclipse/0132030/Baku_Azerbaijan_2030Jun01.png */
+    /* Round trip #1: EQJ <==> EQD. */
+    eqj_eqd = Astronomy_Rotation_EQJ_EQD(&time);
+    eqd_eqj = Astronomy_Rotation_EQD_EQJ(&time);
+    CHECK_INVERSE(eqj_eqd, eqd_eqj);
+
+    /* Round trip #2: EQJ <==> ECL. */
+    eqj_ecl = Astronomy_Rotation_EQJ_ECL();
+    ecl_eqj = Astronomy_Rotation_ECL_EQJ();
+    CHECK_INVERSE(eqj_ecl, ecl_eqj);
+
+    /* Round trip #3: EQJ <==> HOR. */
+    eqj_hor = Astronomy_Rotation_EQJ_HOR(&time, observer);
+    hor_eqj = Astronomy_Rotation_HOR_EQJ(&time, observer);
+    CHECK_INVERSE(eqj_hor, hor_eqj);
+
+    /* Round trip #4: EQD <==> HOR. */
+    eqd_hor = Astronomy_Rotation_EQD_HOR(&time, observer);
+    hor_eqd = Astronomy_Rotation_HOR_EQD(&time, observer);
+    CHECK_INVERSE(eqd_hor, hor_eqd);
+
+    /* Round trip #5: EQD <==> ECL. */
+    eqd_ecl = Astronomy_Rotation_EQD_ECL(&time);
+    ecl_eqd = Astronomy_Rotation_ECL_EQD(&time);
+    CHECK_INVERSE(eqd_ecl, ecl_eqd);
+
+    /* Round trip #6: HOR <==> ECL. */
+    hor_ecl = Astronomy_Rotation_HOR_ECL(&time, observer);
+    ecl_hor = Astronomy_Rotation_ECL_HOR(&time, observer);
+    CHECK_INVERSE(hor_ecl, ecl_hor);
+
+    /* Round trip #7: EQD <==> ECT. */
+    eqd_ect = Astronomy_Rotation_EQD_ECT(&time);
+    ect_eqd = Astronomy_Rotation_ECT_EQD(&time);
+    CHECK_INVERSE(eqd_ect, ect_eqd);
+
+    /* Round trip #8: EQJ <==> ECT. */
+    eqj_ect = Astronomy_Rotation_EQJ_ECT(&time);
+    ect_eqj = Astronomy_Rotation_ECT_EQJ(&time);
+    CHECK_INVERSE(eqj_ect, ect_eqj);
+
+    /*
+        Verify that combining different sequences of rotations result
+        in the expected combination.
+        For example, (EQJ ==> HOR ==> ECL) must be the same matrix as (EQJ ==> ECL).
+    */
+    CHECK_CYCLE(eqj_ecl, ecl_eqd, eqd_eqj);
+    CHECK_CYCLE(eqj_hor, hor_ecl, ecl_eqj);
+    CHECK_CYCLE(eqj_hor, hor_eqd, eqd_eqj);
+    CHECK_CYCLE(ecl_eqd, eqd_hor, hor_ecl);
+    CHECK_CYCLE(eqj_eqd, eqd_ect, ect_eqj);
+
+    FDEBUG("PASS\n");
+    error = 0;
+fail:
+    return error;
+}
+
+static int RotationTest(void)
+{
+    int error;
+    CHECK(Rotation_MatrixInverse());
+    CHECK(Rotation_MatrixMultiply());
+    CHECK(Rotation_Pivot());
+
+    /* Verify conversion of spherical coordinates to vector. */
+    CHECK(TestVectorFromAngles(0.0, 0.0, 1.0, 0.0, 0.0));
+    CHECK(TestVectorFromAngles(0.0, 90.0, 0.0, 1.0, 0.0));
+    CHECK(TestVectorFromAngles(0.0, 180.0, -1.0, 0.0, 0.0));
+    CHECK(TestVectorFromAngles(0.0, 270.0, 0.0, -1.0, 0.0));
+    CHECK(TestVectorFromAngles(+90.0, 0.0, 0.0, 0.0, 1.0));
+    CHECK(TestVectorFromAngles(-90.0, 0.0, 0.0, 0.0, -1.0));
+    CHECK(TestVectorFromAngles(-30.0, +60.0, 0.43301270189221946, 0.75, -0.5));
+
+    /* Verify conversion of vector to spherical coordinates. */
+    CHECK(TestAnglesFromVector(0.0, 0.0, 1.0, 0.0, 0.0));
+    CHECK(TestAnglesFromVector(0.0, 90.0, 0.0, 1.0, 0.0));
+    CHECK(TestAnglesFromVector(0.0, 180.0, -1.0, 0.0, 0.0));
+    CHECK(TestAnglesFromVector(0.0, 270.0, 0.0, -1.0, 0.0));
+    CHECK(TestAnglesFromVector(+90.0, 0.0, 0.0, 0.0, 1.0));
+    CHECK(TestAnglesFromVector(-90.0, 0.0, 0.0, 0.0, -1.0));
+    CHECK(TestAnglesFromVector(-30.0, +60.0, 0.43301270189221946, 0.75, -0.5));
+
+    /* Verify rotation of vectors */
+    CHECK(TestSpin(0.0, 0.0, 90.0, +1, +2, +3, -2, +1, +3));
+    CHECK(TestSpin(0.0, 0.0, 0.0, 1.0, 2.0, -3.0, 1.0, 2.0, -3.0));
+    CHECK(TestSpin(90.0, 0.0, 0.0, +1, +2, +3, +1, -3, +2));
+    CHECK(TestSpin(0.0, 90.0, 0.0, +1, +2, +3, +3, +2, -1));
+    CHECK(TestSpin(180.0, 180.0, 180.0, +1, +2, +3, +1, +2, +3));
+    CHECK(TestSpin(0.0, 0.0, -45.0, +1, 0, 0, +0.7071067811865476, -0.7071067811865476, 0));
+
+    CHECK(Test_EQJ_GAL_NOVAS("temp/galeqj.txt"));
+    CHECK(Test_EQJ_GAL_JPL("galactic/mars.txt"));
+
+    CHECK(Test_EQJ_EQD(BODY_MERCURY));
+    CHECK(Test_EQJ_EQD(BODY_VENUS));
+    CHECK(Test_EQJ_EQD(BODY_MARS));
+    CHECK(Test_EQJ_EQD(BODY_JUPITER));
+    CHECK(Test_EQJ_EQD(BODY_SATURN));
+
+    CHECK(Test_EQD_HOR(BODY_MERCURY));
+    CHECK(Test_EQD_HOR(BODY_VENUS));
+    CHECK(Test_EQD_HOR(BODY_MARS));
+    CHECK(Test_EQD_HOR(BODY_JUPITER));
+    CHECK(Test_EQD_HOR(BODY_SATURN));
+
+    CHECK(Test_EQD_ECT());
+
+    CHECK(Test_RotRoundTrip());
 
     FPASS();
 fail:
     return error;
 }
 
+static int VectorDiff(astro_vector_t a, astro_vector_t b, double *diff)
+{
+    double dx, dy, dz;
+
+    *diff = NAN;
+
+    if (a.status != ASTRO_SUCCESS)
+        FAILRET("C %s: ERROR - first vector has status %d\n", __func__, a.status);
+
+    if (b.status != ASTRO_SUCCESS)
+        FAILRET("C %s: ERROR - second vector has status %d\n", __func__, b.status);
+
+    dx = a.x - b.x;
+    dy = a.y - b.y;
+    dz = a.z - b.z;
+    *diff = V(sqrt(dx*dx + dy*dy + dz*dz));
+    return 0;
+}
+
 /*-----------------------------------------------------------------------------------------------------------*/
 
-static int PlotDeltaT(const char *outFileName)
+static int RefractionTest(void)
 {
-    int error = 1;
-    FILE *outfile = NULL;
-    int year;
-    double dt;
-    astro_time_t time;
-
-    outfile = fopen(outFileName, "wt");
-    if (outfile == NULL)
-        FAIL("ctest PlotDeltaT: Cannot open output file: %s\n", outFileName);
+    int error;
+    double alt, corrected, refr, inv_refr, check_alt, diff;
 
-    fprintf(outfile, "\"year\",\"delta_t\"\n");
-    for (year = 1500; year <= 2500; ++year)
+    for (alt = -90.1; alt <= +90.1; alt += 0.001)
     {
-        time = Astronomy_MakeTime(year, 1, 1, 0, 0, 0.0);
-        dt = (24.0 * 3600.0) * (time.tt - time.ut);
-        fprintf(outfile, "%d,%lf\n", year, dt);
+        refr = Astronomy_Refraction(REFRACTION_NORMAL, alt);
+        corrected = alt + refr;
+        inv_refr = Astronomy_InverseRefraction(REFRACTION_NORMAL, corrected);
+        check_alt = corrected + inv_refr;
+        diff = ABS(check_alt - alt);
+        if (diff > 2.0e-14)
+            FFAIL("EXCESSIVE diff: alt=%8.3lf, refr=%10.6lf, diff=%lg\n", alt, refr, diff);
     }
 
-    printf("ctest PlotDeltaT: Wrote file %s\n", outFileName);
-    error = 0;
+    FPASS();
 fail:
-    if (outfile != NULL) fclose(outfile);
     return error;
 }
 
 /*-----------------------------------------------------------------------------------------------------------*/
 
-static int TransitFile(astro_body_t body, const char *filename, double limit_minutes, double limit_sep)
+static int ConstellationTest(void)
 {
     int error = 1;
     FILE *infile = NULL;
+    const char *inFileName = "constellation/test_input.txt";
     char line[100];
-    int lnum;
-    astro_time_t time1, time2, timep;
-    astro_transit_t transit;
-    double separation;
-    double diff_start, diff_peak, diff_finish, diff_sep;
-    double max_minutes = 0.0, max_sep = 0.0;
-    const int START_YEAR = 1600;
+    double ra, dec;
+    char symbol[4];
+    int lnum, failcount, id;
+    astro_constellation_t constel;
 
-    infile = fopen(filename, "rt");
+    infile = fopen(inFileName, "rt");
     if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", filename);
-
-    transit = Astronomy_SearchTransit(body, Astronomy_MakeTime(START_YEAR, 1, 1, 0, 0, 0.0));
-    if (transit.status != ASTRO_SUCCESS)
-        FAIL("C TransitFile(%s): SearchTransit returned %d\n", filename, transit.status);
-
-    DEBUG("\n----------------------------------------------------------------\n\n");
-    FDEBUG("STARTING %s\n\n", filename);
+        FFAIL("Cannot open input file: %s\n", inFileName);
 
     lnum = 0;
-    while (ReadLine(line, sizeof(line), infile, filename, lnum))
+    failcount = 0;
+    while (ReadLine(line, sizeof(line), infile, inFileName, lnum))
     {
         ++lnum;
+        if (4 != sscanf(line, "%d %lf %lf %3s", &id, &ra, &dec, symbol) || 3 != strlen(symbol))
+            FFAIL("Invalid test data in %s line %d\n", inFileName, lnum);
 
-        /* 22:17 1881-11-08T00:57Z 03:38  3.8633 */
+        constel = Astronomy_Constellation(ra, dec);
+        if (constel.status != ASTRO_SUCCESS)
+            FFAIL("FAILED star %d with status %d: %s line %d\n", id, constel.status, inFileName, lnum);
 
-        if (strlen(line) < 37)
-            FAIL("C TransitFile(%s line %d): line is too short.\n", filename, lnum);
+        if (constel.symbol == NULL || constel.name == NULL)
+            FFAIL("UNEXPECTED NULL name/symbol: star %d, %s line %d\n", id, inFileName, lnum);
 
-        if (line[5] != ' ' || line[23] != ' ' || line[29] != ' ')
-            FAIL("C TransitFile(%s line %d): invalid data format.\n", filename, lnum);
+        if (strcmp(constel.symbol, symbol))
+        {
+            fprintf(stderr, "Star %6d: expected %s, found %s at B1875 RA=%10.6lf, DEC=%10.6lf\n", id, symbol, constel.symbol, constel.ra_1875, constel.dec_1875);
+            ++failcount;
+        }
+    }
 
-        if (1 != sscanf(line+30, "%lf", &separation))
-            FAIL("C TransitFile(%s line %d): unable to parse angular separation.\n", filename, lnum);
+    if (failcount > 0)
+        FFAIL("%d failures\n", failcount);
 
-        line[23] = '\0';
-        if (ParseDate(line+6, &timep))
-            FAIL("C TransitFile(%s line %d): invalid date/time '%s'\n", filename, lnum, line+6);
+    FPASSA("(verified %d)\n", lnum);
+fail:
+    if (infile != NULL) fclose(infile);
+    return error;
+}
 
-        /* Patch the start time and reparse. */
-        line[17] = line[0];
-        line[18] = line[1];
-        line[20] = line[3];
-        line[21] = line[4];
-        if (ParseDate(line+6, &time1))
-            FAIL("C TransitFile(%s line %d): failed to parse patched start time '%s'\n", filename, lnum, line+6);
+/*-----------------------------------------------------------------------------------------------------------*/
 
-        /* If the start time is after the peak time, it really starts on the previous day. */
-        if (time1.ut > timep.ut)
-            time1 = Astronomy_AddDays(time1, -1.0);
+static void PrintTime(astro_time_t time)
+{
+    astro_utc_t utc = Astronomy_UtcFromTime(time);
+    printf("%04d-%02d-%02dT%02d:%02d:%06.3lfZ", utc.year, utc.month, utc.day, utc.hour, utc.minute, utc.second);
+}
 
-        /* Patch the finish time and reparse. */
-        line[17] = line[24];
-        line[18] = line[25];
-        line[20] = line[27];
-        line[21] = line[28];
-        if (ParseDate(line+6, &time2))
-            FAIL("C TransitFile(%s line %d): failed to parse patched finish time '%s'\n", filename, lnum, line+6);
+static int LunarEclipseIssue78(void)
+{
+    int error;
+    astro_lunar_eclipse_t eclipse;
+    astro_time_t search_time   = Astronomy_MakeTime(2020, 12, 19, 0, 0, 0.0);
+    astro_time_t expected_peak = Astronomy_MakeTime(2021, 5, 26, 11, 18, 42);  /* https://www.timeanddate.com/eclipse/lunar/2021-may-26 */
+    double dt_seconds;
 
-        /* If the finish time is before the peak time, it really starts on the next day. */
-        if (time2.ut < timep.ut)
-            time2 = Astronomy_AddDays(time2, +1.0);
-
-        /* Measure result errors. */
-        diff_start  = (24.0 * 60.0) * (time1.ut - transit.start.ut );
-        diff_peak   = (24.0 * 60.0) * (timep.ut - transit.peak.ut  );
-        diff_finish = (24.0 * 60.0) * (time2.ut - transit.finish.ut);
-        diff_sep    = separation - transit.separation;
-
-        if (Verbose)
-        {
-            printf("Expected: ");
-            PrintTime(time1);
-            printf("    ");
-            PrintTime(timep);
-            printf("    ");
-            PrintTime(time2);
-            printf(" %10.4lf\n", separation);
-
-            printf("Found:    ");
-            PrintTime(transit.start);
-            printf("    ");
-            PrintTime(transit.peak);
-            printf("    ");
-            PrintTime(transit.finish);
-            printf(" %10.4lf\n", transit.separation);
-
-            printf("Diff: %24.3lf    %24.3lf    %24.3lf     %10.4lf\n\n", diff_start, diff_peak, diff_finish, diff_sep);
-        }
-
-        diff_start  = ABS(diff_start);
-        diff_peak   = ABS(diff_peak);
-        diff_finish = ABS(diff_finish);
-        if (diff_start  > max_minutes)  max_minutes = diff_start;
-        if (diff_peak   > max_minutes)  max_minutes = diff_peak;
-        if (diff_finish > max_minutes)  max_minutes = diff_finish;
-        if (max_minutes > limit_minutes)
-            FAIL("C TransitFile(%s line %d): EXCESSIVE TIME ERROR = %0.3lf minutes. (Run again with -v to debug.)\n", filename, lnum, max_minutes);
-
-        diff_sep = ABS(diff_sep);
-        if (diff_sep > max_sep)  max_sep = diff_sep;
-        if (max_sep > limit_sep)
-            FAIL("C TransitFile(%s line %d): EXCESSIVE SEPARATION ERROR = %0.4lf arcminutes. (Run again with -v to debug.)\n", filename, lnum, max_sep);
+    eclipse = Astronomy_SearchLunarEclipse(search_time);
+    CHECK_STATUS(eclipse);
 
-        /* Search for the next transit. */
-        transit = Astronomy_NextTransit(body, transit.finish);
-        if (transit.status != ASTRO_SUCCESS)
-            FAIL("C TransitFile(%s line %d): NextTransit returned %d\n", filename, lnum, transit.status);
-    }
+    dt_seconds = (24.0 * 3600.0) * ABS(eclipse.peak.tt - expected_peak.tt);
+    if (dt_seconds > 40.0)
+        FFAIL("Excessive prediction error = %lf seconds.\n", dt_seconds);
 
-    printf("C TransitFile(%-20s): PASS - verified %2d, max minutes = %6.3lf, max sep arcmin = %6.4lf\n", filename, lnum, max_minutes, max_sep);
-    error = 0;
+    if (eclipse.kind != ECLIPSE_TOTAL)
+        FFAIL("Expected total eclipse; found %d\n", eclipse.kind);
 
+    FPASS();
 fail:
-    if (infile != NULL) fclose(infile);
     return error;
 }
 
-static int Transit(void)
+static int LunarEclipseTest(void)
 {
-    int error;
-
-    CHECK(TransitFile(BODY_MERCURY, "eclipse/mercury.txt", 10.710, 0.2121));
-    CHECK(TransitFile(BODY_VENUS,   "eclipse/venus.txt",    9.109, 0.6772));
-fail:
-    return error;
-}
+    const char *filename = "eclipse/lunar_eclipse.txt";
+    const char *statsFileName = "eclipse/c_le_stats.csv";
+    FILE *infile = NULL;
+    FILE *outfile = NULL;
+    int lnum = 0;
+    int error = 1;
+    char line[100];
+    astro_time_t peak_time;
+    astro_lunar_eclipse_t eclipse;
+    double partial_minutes, total_minutes;
+    double diff_minutes, max_diff_minutes = 0.0, sum_diff_minutes = 0.0;
+    int diff_count = 0;
+    double diff_days;
+    int sd_valid = 0;
+    int frac_valid = 0;
+    int skip_count = 0;
+    const double diff_limit = 2.0;
+    extern int _CalcMoonCount;      /* incremented by Astronomy Engine every time expensive CalcMoon() is called */
 
-/*-----------------------------------------------------------------------------------------------------------*/
+    _CalcMoonCount = 0;
 
-static int DistancePlot(astro_body_t body, double ut1, double ut2, const char *filename)
-{
-    const int npoints = 100000;
-    int error = 1;
-    int i;
-    double ut;
-    astro_time_t time, j2000;
-    astro_func_result_t dist;
-    FILE *outfile = NULL;
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FFAIL("Cannot open input file: %s\n", filename);
 
-    outfile = fopen(filename, "wt");
+    outfile = fopen(statsFileName, "wt");
     if (outfile == NULL)
-        FFAIL("Cannot open output file: %s\n", filename);
+        FFAIL("Cannot open output stats file: %s\n", statsFileName);
 
-    j2000 = Astronomy_MakeTime(2000, 1, 1, 12, 0, 0.0);
+    eclipse = Astronomy_SearchLunarEclipse(Astronomy_MakeTime(1701, 1, 1, 0, 0, 0.0));
+    CHECK_STATUS(eclipse);
 
-    fprintf(outfile, "\"tt\",\"distance\"\n");
-    for (i=0; i < npoints; ++i)
+    fprintf(outfile, "\"utc\",\"center\",\"partial\",\"total\"\n");
+    while (ReadLine(line, sizeof(line), infile, filename, lnum))
     {
-        ut = ut1 + (((double)i)/((double)(npoints-1)) * (ut2 - ut1));
-        time = Astronomy_AddDays(j2000, ut);
-        dist = Astronomy_HelioDistance(body, time);
-        CHECK_STATUS(dist);
-        fprintf(outfile, "%0.16lf,%0.16lg\n", time.tt, dist.value);
-    }
+        ++lnum;
 
-    error = 0;
-fail:
-    if (outfile != NULL) fclose(outfile);
-    return error;
-}
+        /* Make sure numeric data are finite numbers. */
+        V(eclipse.obscuration);
+        V(eclipse.sd_partial);
+        V(eclipse.sd_penum);
+        V(eclipse.sd_total);
 
-/*-----------------------------------------------------------------------------------------------------------*/
+        /* scan test data */
 
-static int PlutoCheckDate(double ut, double arcmin_tolerance, double x, double y, double z)
-{
-    int error = 1;
-    astro_time_t time;
-    astro_vector_t vector;
-    double dx, dy, dz, diff, dist, arcmin;
+        /* 2021-05-26T11:19Z  94   9 */
+        if (strlen(line) < 17)
+            FAIL("C LunarEclipseTest(%s line %d): line is too short.\n", filename, lnum);
 
-    time = Astronomy_TimeFromDays(ut);
+        line[17] = '\0';
+        CHECK(ParseDate(line, &peak_time));
+        if (2 != sscanf(line+18, "%lf %lf", &partial_minutes, &total_minutes))
+            FAIL("C LunarEclipseTest(%s line %d): invalid data format.\n", filename, lnum);
 
-    DEBUG("C %s: ", __func__);
-    if (Verbose) PrintTime(time);
-    DEBUG(" = %0.6lf UT = %0.6lf TT\n", time.ut, time.tt);
+        /* Verify that the calculated eclipse semi-durations are consistent with the kind. */
+        /* Verify that obscuration values also make sense for the kind. */
 
-    vector = Astronomy_HelioVector(BODY_PLUTO, time);
-    if (vector.status != ASTRO_SUCCESS)
-        FFAIL("FAIL - Astronomy_HelioVector returned status = %d\n", vector.status);
+        switch (eclipse.kind)
+        {
+        case ECLIPSE_PENUMBRAL:
+            sd_valid = (eclipse.sd_penum > 0.0) && (eclipse.sd_partial == 0.0) && (eclipse.sd_total == 0.0);
+            frac_valid = (eclipse.obscuration == 0.0);
+            break;
 
-    dx = V(vector.x) - x;
-    dy = V(vector.y) - y;
-    dz = V(vector.z) - z;
-    diff = sqrt(dx*dx + dy*dy + dz*dz);
-    dist = (sqrt(x*x + y*y + z*z) - 1.0);       /* worst-case distance between Pluto and Earth */
-    arcmin = (diff / dist) * (180.0 * 60.0 / PI);
-    FDEBUG("calc pos = [%20.16lf, %20.16lf, %20.16lf]\n", vector.x, vector.y, vector.z);
-    FDEBUG("ref  pos = [%20.16lf, %20.16lf, %20.16lf]\n", x, y, z);
-    FDEBUG("del  pos = [%20.16lf, %20.16lf, %20.16lf]\n", vector.x - x, vector.y - y, vector.z - z);
-    FDEBUG("diff = %le AU, %0.3lf arcmin\n", diff, arcmin);
-    DEBUG("\n");
+        case ECLIPSE_PARTIAL:
+            sd_valid = (eclipse.sd_penum > 0.0) && (eclipse.sd_partial > 0.0) && (eclipse.sd_total == 0.0);
+            frac_valid = (eclipse.obscuration > 0.0) && (eclipse.obscuration < 1.0);
+            break;
 
-    if (V(arcmin) > arcmin_tolerance)
-        FFAIL("EXCESSIVE ERROR\n");
+        case ECLIPSE_TOTAL:
+            sd_valid = (eclipse.sd_penum > 0.0) && (eclipse.sd_partial > 0.0) && (eclipse.sd_total > 0.0);
+            frac_valid = (eclipse.obscuration == 1.0);
+            break;
 
-    error = 0;
-fail:
-    return error;
-}
+        default:
+            FAIL("C LunarEclipseTest(%s line %d): invalid eclipse kind %d.\n", filename, lnum, eclipse.kind);
+        }
 
+        if (!sd_valid)
+        {
+            FAIL("C LunarEclipseTest(%s line %d): invalid semiduration(s) for kind %d: penum=%lf, partial=%lf, total=%lf.\n",
+                filename, lnum, eclipse.kind, eclipse.sd_penum, eclipse.sd_partial, eclipse.sd_total);
+        }
 
-static int PlutoCheck(void)
-{
-    int error;
-    CHECK(PlutoCheckDate(  +18250.0, 0.089, +37.4377303523676090, -10.2466292454075898, -14.4773101310875809));
-    CHECK(PlutoCheckDate( -856493.0, 4.067, +23.4292113199166252, +42.1452685817740829,  +6.0580908436642940));
-    CHECK(PlutoCheckDate( +435633.0, 0.016, -27.3178902095231813, +18.5887022581070305, +14.0493896259306936));
-    CHECK(PlutoCheckDate(       0.0, 8.e-9,  -9.8753673425269000, -27.9789270580402771,  -5.7537127596369588));
-    CHECK(PlutoCheckDate( +800916.0, 2.286, -29.5266052645301365, +12.0554287322176474, +12.6878484911631091));
+        if (!frac_valid)
+        {
+            FAIL("C LunarEclipseTest(%s line %d): invalid obscuration = %0.16lf for kind %d\n",
+                filename, lnum, eclipse.obscuration, eclipse.kind);
+        }
 
-    FPASS();
-fail:
-    return error;
-}
+        /* check eclipse peak time */
 
-/*-----------------------------------------------------------------------------------------------------------*/
+        diff_days = eclipse.peak.ut - peak_time.ut;
+        /* tolerate missing penumbral eclipses - skip to next input line without calculating next eclipse. */
+        if (partial_minutes == 0.0 && diff_days > 20.0)
+        {
+            ++skip_count;
+            continue;
+        }
 
-static int GeoidTestCase(FILE *outfile, astro_time_t time, astro_observer_t observer, astro_equator_date_t equdate)
-{
-    int error;
-    astro_state_vector_t state;
-    astro_vector_t surface;
-    astro_vector_t geo_moon;
-    astro_equatorial_t topo_moon;
-    double dx, dy, dz, diff, lat_diff, lon_diff, h_diff;
-    astro_observer_t vobs;
+        fprintf(outfile, "\"%s\",%lf,%lf,%lf\n",
+            line,   /* was already truncated at offset [17] above, so now has only UTC */
+            diff_days * (24.0 * 60.0),
+            eclipse.sd_partial - partial_minutes,
+            eclipse.sd_total - total_minutes
+        );
 
-    topo_moon = Astronomy_Equator(BODY_MOON, &time, observer, equdate, NO_ABERRATION);
-    CHECK_STATUS(topo_moon);
+        diff_minutes = (24.0 * 60.0) * ABS(diff_days);
+        sum_diff_minutes += diff_minutes;
+        ++diff_count;
 
-    surface = Astronomy_ObserverVector(&time, observer, equdate);
-    CHECK_STATUS(surface);
+        if (diff_minutes > diff_limit)
+        {
+            printf("C LunarEclipseTest expected peak: ");
+            PrintTime(peak_time);
+            printf("\n");
+            printf("C LunarEclipseTest found    peak: ");
+            PrintTime(eclipse.peak);
+            printf("\n");
+            FAIL("C LunarEclipseTest(%s line %d): EXCESSIVE peak time error = %lf minutes (%lf days).\n", filename, lnum, diff_minutes, diff_days);
+        }
 
-    state = Astronomy_ObserverState(&time, observer, equdate);
-    CHECK_STATUS(state);
+        if (diff_minutes > max_diff_minutes)
+            max_diff_minutes = diff_minutes;
 
-    /* Verify state vector's position exactly matches the lone position vector. */
-    if (state.x != surface.x) FFAIL("state vector x = %0.16le, but position vector x = %0.16le\n", state.x, surface.x);
-    if (state.y != surface.y) FFAIL("state vector x = %0.16le, but position vector x = %0.16le\n", state.y, surface.y);
-    if (state.z != surface.z) FFAIL("state vector x = %0.16le, but position vector x = %0.16le\n", state.z, surface.z);
+        /* check partial eclipse duration */
 
-    if (outfile != NULL)
-    {
-        const double speedConvert = KM_PER_AU / 24.0;   /* converts AU/day into km/hour */
+        diff_minutes = ABS(partial_minutes - eclipse.sd_partial);
+        sum_diff_minutes += diff_minutes;
+        ++diff_count;
 
-        fprintf(
-            outfile,
-            "%d %22.12lf %6.1lf %7.1lf %7.1lf %12.6lf %12.6lf %12.6lf %12.6lf %12.6lf %12.6lf\n",
-            (int)equdate,
-            time.ut,
-            observer.latitude,
-            observer.longitude,
-            observer.height,
-            KM_PER_AU * state.x,
-            KM_PER_AU * state.y,
-            KM_PER_AU * state.z,
-            speedConvert * state.vx,
-            speedConvert * state.vy,
-            speedConvert * state.vz
-        );
-    }
+        if (diff_minutes > diff_limit)
+            FAIL("C LunarEclipseTest(%s line %d): EXCESSIVE partial eclipse semiduration error: %lf minutes\n", filename, lnum, diff_minutes);
 
-    geo_moon = Astronomy_GeoMoon(time);
-    CHECK_STATUS(geo_moon);
+        if (diff_minutes > max_diff_minutes)
+            max_diff_minutes = diff_minutes;
 
-    if (equdate == EQUATOR_OF_DATE)
-    {
-        /* Astronomy_GeoMoon() returns J2000 coordinates. Convert to equator-of-date coordinates. */
-        astro_rotation_t rot = Astronomy_Rotation_EQJ_EQD(&time);
-        CHECK_STATUS(rot);
-        geo_moon = Astronomy_RotateVector(rot, geo_moon);
-    }
+        /* check total eclipse duration */
 
-    dx = KM_PER_AU * V((geo_moon.x - surface.x) - topo_moon.vec.x);
-    dy = KM_PER_AU * V((geo_moon.y - surface.y) - topo_moon.vec.y);
-    dz = KM_PER_AU * V((geo_moon.z - surface.z) - topo_moon.vec.z);
-    diff = sqrt(dx*dx + dy*dy + dz*dz);
-    FDEBUG("equ=%d, tt=%14.5lf, lat=%5.1lf, lon=%6.1lf, ht=%6.1lf, surface=(%12.6lf, %12.6lf, %12.6lf), diff = %9.6lf km\n",
-        (int)equdate,
-        time.tt,
-        observer.latitude,
-        observer.longitude,
-        observer.height,
-        KM_PER_AU * surface.x,
-        KM_PER_AU * surface.y,
-        KM_PER_AU * surface.z,
-        diff);
+        diff_minutes = ABS(total_minutes - eclipse.sd_total);
+        sum_diff_minutes += diff_minutes;
+        ++diff_count;
 
-    /* Require 1 millimeter accuracy! (one millionth of a kilometer). */
-    if (diff > 1.0e-6)
-        FFAIL("EXCESSIVE POSITION ERROR.\n");
+        if (diff_minutes > diff_limit)
+            FAIL("C LunarEclipseTest(%s line %d): EXCESSIVE total eclipse semiduration error: %lf minutes\n", filename, lnum, diff_minutes);
 
-    /* Verify that we can convert the surface vector back to an observer. */
-    vobs = Astronomy_VectorObserver(&surface, equdate);
-    lat_diff = ABS(vobs.latitude - observer.latitude);
+        if (diff_minutes > max_diff_minutes)
+            max_diff_minutes = diff_minutes;
 
-    /* Longitude is meaningless at the poles, so don't bother checking it there. */
-    if (-89.99 <= observer.latitude && observer.latitude <= +89.99)
-    {
-        lon_diff = ABS(vobs.longitude - observer.longitude);
-        if (lon_diff > 180.0)
-            lon_diff = 360.0 - lon_diff;
-        lon_diff = ABS(lon_diff * cos(DEG2RAD * observer.latitude));
-        if (lon_diff > 1.0e-6)
-            FFAIL("EXCESSIVE longitude check error = %lf\n", lon_diff);
-    }
-    else
-    {
-        lon_diff = 0.0;
-    }
+        /* calculate for next iteration */
 
-    h_diff = ABS(vobs.height - observer.height);
-    FDEBUG("vobs=(lat=%lf, lon=%lf, height=%lf), lat_diff=%lg, lon_diff=%lg, h_diff=%lg\n",
-        vobs.latitude, vobs.longitude, vobs.height, lat_diff, lon_diff, h_diff);
+        eclipse = Astronomy_NextLunarEclipse(eclipse.peak);
+        if (eclipse.status != ASTRO_SUCCESS)
+            FAIL("C LunarEclipseTest(%s line %d): Astronomy_NextLunarEclipse returned status %d\n", filename, lnum, eclipse.status);
+    }
 
-    if (lat_diff > 1.0e-6)
-        FFAIL("EXCESSIVE latitude check error = %lf\n", lat_diff);
+    sum_diff_minutes /= diff_count;     /* convert to average error in minutes */
+    if (sum_diff_minutes > 0.274)
+        FFAIL("EXCESSIVE AVERAGE TIME ERROR: %lf\n", sum_diff_minutes);
 
-    if (h_diff > 0.001)
-        FFAIL("EXCESSIVE height check error = %lf\n", h_diff);
+    if (skip_count > 9)
+        FFAIL("Skipped too many penumbral eclipses: %d\n", skip_count);
 
-    error = 0;
+    FPASSA("(verified %d, skipped %d, %d CalcMoons, max_diff_minutes = %0.3lf, avg_diff_minutes = %0.3lf)\n", lnum, skip_count, _CalcMoonCount, max_diff_minutes, sum_diff_minutes);
 fail:
+    if (infile != NULL) fclose(infile);
+    if (outfile != NULL) fclose(outfile);
     return error;
 }
 
+/*-----------------------------------------------------------------------------------------------------------*/
 
-static int GeoidTest(void)
+static int LunarFractionCase(int year, int month, int day, double obscuration)
 {
     int error;
-    int tindex, oindex;
     astro_time_t time;
-    astro_vector_t vec;
-    astro_observer_t observer;
-    int lat, lon;
-    FILE *outfile = NULL;
-    const char *outFileName = "temp/c_geoid.txt";
+    astro_lunar_eclipse_t eclipse;
+    double dt, diff;
 
-    const astro_time_t time_list[] =
-    {
-        Astronomy_MakeTime(1066,  9, 27, 18,  0,  0.0),
-        Astronomy_MakeTime(1970, 12, 13, 15, 42,  0.0),
-        Astronomy_MakeTime(1970, 12, 13, 15, 43,  0.0),
-        Astronomy_MakeTime(2015,  3,  5,  2, 15, 45.0)
-    };
-    const int ntimes = sizeof(time_list) / sizeof(time_list[0]);
+    /* Search for the first lunar eclipse to occur after the given date. */
+    /* It should always happen within 24 hours of the given date. */
+    time = Astronomy_MakeTime(year, month, day, 0, 0, 0.0);
+    eclipse = Astronomy_SearchLunarEclipse(time);
+    CHECK_STATUS(eclipse);
 
-    const astro_observer_t observer_list[] =
-    {
-        Astronomy_MakeObserver( +1.5,   +2.7,    7.4),
-        Astronomy_MakeObserver(-53.7, +141.7, +100.0),
-        Astronomy_MakeObserver(+30.0,  -85.2,  -50.0),
-        Astronomy_MakeObserver(+90.0,  +45.0,  -50.0),
-        Astronomy_MakeObserver(-90.0, -180.0,    0.0)
-    };
-    const int nobs = sizeof(observer_list) / sizeof(observer_list[0]);
+    if (eclipse.kind != ECLIPSE_PARTIAL)
+        FAIL("C LunarFractionCase(%04d-%02d-%02d): expected partial eclipse, but found %d.\n", year, month, day, eclipse.kind);
 
-    /* Make sure Astronomy_ObserverVector() checks for invalid equdate parameter. */
-    time = time_list[0];
-    vec = Astronomy_ObserverVector(&time, observer_list[0], (astro_equator_date_t)42);
-    if (vec.status != ASTRO_INVALID_PARAMETER)
-        FFAIL("Expected ASTRO_INVALID_PARAMETER (%d) but found %d\n", (int)ASTRO_INVALID_PARAMETER, (int)vec.status);
-    FDEBUG("Astronomy_ObserverVector correctly detected invalid astro_equator_date_t parameter.\n");
+    dt = V(eclipse.peak.ut - time.ut);
+    if (dt < 0.0 || dt > 1.0)
+        FAIL("C LunarFractionCase(%04d-%02d-%02d): eclipse occurs %0.4lf days after predicted date.\n", year, month, day, dt);
 
-    /* Test a variety of times and locations, in both supported orientation systems. */
-    /* Also write reference data for comparing with other language implementations. */
-    outfile = fopen(outFileName, "wt");
-    if (outfile == NULL)
-        FFAIL("FAIL - cannot open output file: %s\n", outFileName);
+    diff = V(eclipse.obscuration - obscuration);
+    if (ABS(diff) > 0.00763)
+        FAIL("C LunarFractionCase(%04d-%02d-%02d) FAIL: obscuration error = %0.8lf, expected = %0.3lf, actual = %0.8lf\n", year, month, day, diff, obscuration, eclipse.obscuration);
+    DEBUG("C LunarFractionCase(%04d-%02d-%02d) fraction error = %0.8lf\n", year, month, day, diff);
 
-    for (oindex = 0; oindex < nobs; ++oindex)
-    {
-        for (tindex = 0; tindex < ntimes; ++tindex)
-        {
-            CHECK(GeoidTestCase(outfile, time_list[tindex], observer_list[oindex], EQUATOR_J2000));
-            CHECK(GeoidTestCase(outfile, time_list[tindex], observer_list[oindex], EQUATOR_OF_DATE));
-        }
-    }
+fail:
+    return error;
+}
 
-    /* More exhaustive tests for a single time value across many different geographic coordinates. */
-    time = Astronomy_MakeTime(2021, 6, 20, 15, 8, 0.0);
-    for (lat = -90; lat <= +90; lat += 1)
-    {
-        for (lon = -175; lon <= +180; lon += 5)
-        {
-            observer = Astronomy_MakeObserver(lat, lon, 0.0);
-            CHECK(GeoidTestCase(NULL, time, observer, EQUATOR_OF_DATE));
-        }
-    }
+
+static int LunarFractionTest(void)
+{
+    int error;
+
+    /* Verify calculation of the fraction of the Moon's disc covered by the Earth's umbra during a partial eclipse. */
+    /* Data for this is more tedious to gather, because Espenak data does not contain it. */
+    /* We already verify fraction=0.0 for penumbral eclipses and fraction=1.0 for total eclipses in LunarEclipseTest. */
+
+    CHECK(LunarFractionCase(2010,  6, 26, 0.506));  /* https://www.timeanddate.com/eclipse/lunar/2010-june-26 */
+    CHECK(LunarFractionCase(2012,  6,  4, 0.304));  /* https://www.timeanddate.com/eclipse/lunar/2012-june-4 */
+    CHECK(LunarFractionCase(2013,  4, 25, 0.003));  /* https://www.timeanddate.com/eclipse/lunar/2013-april-25 */
+    CHECK(LunarFractionCase(2017,  8,  7, 0.169));  /* https://www.timeanddate.com/eclipse/lunar/2017-august-7 */
+    CHECK(LunarFractionCase(2019,  7, 16, 0.654));  /* https://www.timeanddate.com/eclipse/lunar/2019-july-16 */
+    CHECK(LunarFractionCase(2021, 11, 19, 0.991));  /* https://www.timeanddate.com/eclipse/lunar/2021-november-19 */
+    CHECK(LunarFractionCase(2023, 10, 28, 0.060));  /* https://www.timeanddate.com/eclipse/lunar/2023-october-28 */
+    CHECK(LunarFractionCase(2024,  9, 18, 0.035));  /* https://www.timeanddate.com/eclipse/lunar/2024-september-18 */
+    CHECK(LunarFractionCase(2026,  8, 28, 0.962));  /* https://www.timeanddate.com/eclipse/lunar/2026-august-28 */
+    CHECK(LunarFractionCase(2028,  1, 12, 0.024));  /* https://www.timeanddate.com/eclipse/lunar/2028-january-12 */
+    CHECK(LunarFractionCase(2028,  7,  6, 0.325));  /* https://www.timeanddate.com/eclipse/lunar/2028-july-6 */
+    CHECK(LunarFractionCase(2030,  6, 15, 0.464));  /* https://www.timeanddate.com/eclipse/lunar/2030-june-15 */
 
     FPASS();
 fail:
-    if (outfile) fclose(outfile);
     return error;
 }
 
 /*-----------------------------------------------------------------------------------------------------------*/
 
-static void TrimWhiteSpace(char *line)
+static int GlobalSolarEclipseTest(void)
 {
-    int len = (int)strlen(line);
-    while (len > 0 && isspace(line[len-1]))
-        line[--len] = '\0';
-}
+    const int expected_count = 1180;
+    int error = 1;
+    FILE *infile = NULL;
+    const char *inFileName = "eclipse/solar_eclipse.txt";
+    int lnum;
+    char line[100];
+    char typeChar;
+    double deltaT, lat, lon;
+    astro_time_t peak;
+    astro_global_solar_eclipse_t eclipse;
+    astro_eclipse_kind_t expected_kind;
+    double diff_days, diff_minutes, max_minutes=0.0;
+    double diff_angle, max_angle=0.0;
+    int skip_count = 0;
+    extern int _CalcMoonCount;      /* incremented by Astronomy Engine every time expensive CalcMoon() is called */
 
+    _CalcMoonCount = 0;
 
-static int StringStartsWith(const char *text, const char *prefix)
-{
-    int i;
+    infile = fopen(inFileName, "rt");
+    if (infile == NULL)
+        FFAIL("Cannot open input file: %s\n", inFileName);
 
-    for (i = 0; prefix[i] != '\0'; ++i)
-        if (text[i] != prefix[i])
-            return 0;
+    eclipse = Astronomy_SearchGlobalSolarEclipse(Astronomy_MakeTime(1701, 1, 1, 0, 0, 0.0));
 
-    return 1;
-}
+    lnum = 0;
+    while (ReadLine(line, sizeof(line), infile, inFileName, lnum))
+    {
+        ++lnum;
 
+        if (eclipse.status != ASTRO_SUCCESS)
+            FAIL("C GlobalSolarEclipseTest(%s line %d): error %d searching for solar eclipse.\n", inFileName, lnum, eclipse.status);
 
-static astro_state_vector_t SelectJupiterMoon(const astro_jupiter_moons_t *jm, int mindex)
-{
-    switch (mindex)
-    {
-        case 0: return jm->io;
-        case 1: return jm->europa;
-        case 2: return jm->ganymede;
-        case 3: return jm->callisto;
-        default:
-            fprintf(stderr, "C FATAL(%s): Invalid mindex = %d\n", __func__, mindex);
-            exit(1);
-    }
-}
+        /* 1889-12-22T12:54:15Z   -6 T   -12.7   -12.8 */
+        if (strlen(line) < 20)
+            FAIL("C GlobalSolarEclipseTest(%s line %d): line is too short.\n", inFileName, lnum);
 
+        line[20] = '\0';        /* terminate the date/time string */
+        if (ParseDate(line, &peak))
+            FAIL("C GlobalSolarEclipseTest(%s line %d): invalid date/time format: '%s'\n", inFileName, lnum, line);
 
-static int JupiterMoons_CheckJpl(int mindex, double tt, const double pos[3], const double vel[3])
-{
-    int error;
-    astro_jupiter_moons_t jm;
-    astro_state_vector_t moon;
-    astro_time_t time;
-    double dx, dy, dz, mag, diff;
-    const double pos_tolerance = 9.0e-4;
-    const double vel_tolerance = 9.0e-4;
-
-    time = Astronomy_TerrestrialTime(tt);
-
-    jm = Astronomy_JupiterMoons(time);
-    CHECK_STATUS(jm.io);
-    CHECK_STATUS(jm.europa);
-    CHECK_STATUS(jm.ganymede);
-    CHECK_STATUS(jm.callisto);
-    moon = SelectJupiterMoon(&jm, mindex);
-
-    dx = V(pos[0] - moon.x);
-    dy = V(pos[1] - moon.y);
-    dz = V(pos[2] - moon.z);
-    mag = V(sqrt(pos[0]*pos[0] + pos[1]*pos[1] + pos[2]*pos[2]));
-    diff = V(sqrt(dx*dx + dy*dy + dz*dz) / mag);
-    if (diff > pos_tolerance)
-        FFAIL("(mindex=%d, tt=%0.1lf): excessive position error %le\n", mindex, tt, diff);
+        if (4 != sscanf(line+21, "%lf %c %lf %lf", &deltaT, &typeChar, &lat, &lon))
+            FAIL("C GlobalSolarEclipseTest(%s line %d): invalid data format.\n", inFileName, lnum);
 
-    dx = V(vel[0] - moon.vx);
-    dy = V(vel[1] - moon.vy);
-    dz = V(vel[2] - moon.vz);
-    mag = V(sqrt(vel[0]*vel[0] + vel[1]*vel[1] + vel[2]*vel[2]));
-    diff = V(sqrt(dx*dx + dy*dy + dz*dz) / mag);
-    if (diff > vel_tolerance)
-        FFAIL("(mindex=%d, tt=%0.1lf): excessive velocity error %le\n", mindex, tt, diff);
+        /*
+            The test data allows for "hybrid" eclipses, which means that some
+            observers see a total eclipse, others see an annular eclipse.
+            The global solar eclipse predictor determines the eclipse kind
+            for the peak observer only. Therefore, hybrid in the test data
+            matches a total eclipse from our predictor.
+        */
+        switch (typeChar)
+        {
+        case 'P':   expected_kind = ECLIPSE_PARTIAL;    break;
+        case 'A':   expected_kind = ECLIPSE_ANNULAR;    break;
+        case 'T':   expected_kind = ECLIPSE_TOTAL;      break;
+        case 'H':   expected_kind = ECLIPSE_TOTAL;      break;
+        default:
+            FAIL("C GlobalSolarEclipseTest(%s line %d): invalid eclipse kind in test data.\n", inFileName, lnum);
+        }
 
-    error = 0;
-fail:
-    return error;
-}
+        diff_days = V(eclipse.peak.ut - peak.ut);
 
+        /* Sometimes we find marginal eclipses that aren't listed in the test data. */
+        /* Ignore them if the distance between the Sun/Moon shadow axis and the Earth's center is large. */
+        while (diff_days < -25.0 && eclipse.distance > 9000.0)
+        {
+            ++skip_count;
+            eclipse = Astronomy_NextGlobalSolarEclipse(eclipse.peak);
+            CHECK_STATUS(eclipse);
+            diff_days = V(eclipse.peak.ut - peak.ut);
+        }
 
-static int JupiterMoonsTest(void)
-{
-    int error, mindex, check_mindex, lnum, found, part;
-    double tt = NAN, pos[3] = {NAN, NAN, NAN}, vel[3] = {NAN, NAN, NAN};
-    FILE *infile = NULL;
-    char filename[100];
-    char line[100];
-    const int expected_count = 5001;
-    int count;
+        /* Validate the eclipse prediction. */
+        diff_minutes = (24 * 60) * ABS(diff_days);
+        if (diff_minutes > 7.56)
+        {
+            printf("Expected: ");
+            PrintTime(peak);
+            printf("\nFound:    ");
+            PrintTime(eclipse.peak);
+            printf("\n");
+            FAIL("C GlobalSolarEclipseTest(%s line %d): EXCESSIVE TIME ERROR = %0.2lf minutes\n", inFileName, lnum, diff_minutes);
+        }
 
-    for (mindex = 0; mindex < 4; ++mindex)
-    {
-        snprintf(filename, sizeof(filename), "jupiter_moons/horizons/jm%d.txt", mindex);
-        infile = fopen(filename, "rt");
-        if (infile == NULL)
-            FFAIL("Cannot open input file: %s\n", filename);
+        if (diff_minutes > max_minutes)
+            max_minutes = diff_minutes;
 
-        FDEBUG("Comparing against %s\n", filename);
+        /* Validate the eclipse kind, but only when it is not a "glancing" eclipse. */
+        if ((V(eclipse.distance) < 6360) && (eclipse.kind != expected_kind))
+            FAIL("C GlobalSolarEclipseTest(%s line %d): WRONG ECLIPSE KIND: expected %d, found %d\n", inFileName, lnum, expected_kind, eclipse.kind);
 
-        lnum = 0;
-        found = 0;
-        part = -1;
-        count = 0;
-        while (ReadLine(line, sizeof(line), infile, filename, lnum))
+        if (eclipse.kind == ECLIPSE_TOTAL || eclipse.kind == ECLIPSE_ANNULAR)
         {
-            ++lnum;
-            TrimWhiteSpace(line);
-            if (!found)
-            {
-                if (!strcmp(line, "$$SOE"))
-                {
-                    found = 1;
-                    part = 0;
-                }
-                else if (StringStartsWith(line, "Revised:"))
-                {
-                    if (strlen(line) != 79)
-                        FAIL("C JupiterMoonsTest(%s line %d): unexpected line length.\n", filename, lnum);
-                    check_mindex = atoi(&line[76]) - 501;
-                    if (mindex != check_mindex)
-                        FAIL("C JupiterMoonsTest(%s line %d): moon index does not match: check=%d, mindex=%d.\n", filename, lnum, check_mindex, mindex);
-                }
-            }
-            else if (!strcmp(line, "$$EOE"))
+            /*
+                When the distance between the Moon's shadow ray and the Earth's center is beyond 6100 km,
+                it creates a glancing blow whose geographic coordinates are excessively sensitive to
+                slight changes in the ray. Therefore, it is unreasonable to count large errors there.
+            */
+            if (eclipse.distance < 6100.0)
             {
-                break;
+                diff_angle = AngleDiff(lat, lon, eclipse.latitude, eclipse.longitude);
+                if (diff_angle > 0.247)
+                    FAIL("C GlobalSolarEclipseTest(%s line %d): EXCESSIVE GEOGRAPHIC LOCATION ERROR = %0.6lf degrees\n", inFileName, lnum, diff_angle);
+                if (diff_angle > max_angle)
+                    max_angle = diff_angle;
             }
-            else
-            {
-                switch (part)
-                {
-                    case 0:
-                        /* 2446545.000000000 = A.D. 1986-Apr-24 12:00:00.0000 TDB */
-                        if (1 != sscanf(line, "%lf", &tt))
-                            FAIL("C JupiterMoonsTest(%s line %d): failed to read time stamp.\n", filename, lnum);
-                        tt -= JD_2000;    /* convert JD to J2000 TT */
-                        break;
+        }
 
-                    case 1:
-                        /* X = 1.134408131605554E-03 Y =-2.590904586750408E-03 Z =-7.490427225904720E-05 */
-                        if (3 != sscanf(line, " X =%lf Y =%lf Z =%lf", &pos[0], &pos[1], &pos[2]))
-                            FAIL("C JupiterMoonsTest(%s line %d): cannot parse position vector.\n", filename, lnum);
-                        break;
+        /* Verify that the obscuration value is consistent with the eclipse kind. */
+        switch (eclipse.kind)
+        {
+        case ECLIPSE_PARTIAL:
+            if (!isnan(eclipse.obscuration))
+                FAIL("C GlobalSolarEclipseTest(%s line %d): expected NAN obscuration for partial eclipse, but found %lf\n", inFileName, lnum, eclipse.obscuration);
+            break;
 
-                    case 2:
-                        /* VX= 9.148038778472862E-03 VY= 3.973823407182510E-03 VZ= 2.765660368640458E-04 */
-                        if (3 != sscanf(line, " VX=%lf VY=%lf VZ=%lf", &vel[0], &vel[1], &vel[2]))
-                            FAIL("C JupiterMoonsTest(%s line %d): cannot parse velocity vector.\n", filename, lnum);
-                        if (JupiterMoons_CheckJpl(mindex, tt, pos, vel))
-                            FAIL("C JupiterMoonsTest(%s line %d): FAILED VERIFICATION.\n", filename, lnum);
-                        ++count;
-                        break;
+        case ECLIPSE_ANNULAR:
+            if (!isfinite(eclipse.obscuration))
+                FAIL("C GlobalSolarEclipseTest(%s line %d): expected finite obscuration for annular eclipse.\n", inFileName, lnum);
+            if (eclipse.obscuration < 0.8 || eclipse.obscuration >= 1.0)
+                FAIL("C GlobalSolarEclipseTest(%s line %d): obscuration = %0.6lf is out of range for annular eclipse.\n", inFileName, lnum, eclipse.obscuration);
+            break;
 
-                    default:
-                        FAIL("C JupiterMoonsTest(%s line %d): unexpected part = %d.\n", filename, lnum, part);
-                }
-                part = (part + 1) % 3;
-            }
-        }
+        case ECLIPSE_TOTAL:
+            if (!isfinite(eclipse.obscuration))
+                FAIL("C GlobalSolarEclipseTest(%s line %d): expected finite obscuration for total eclipse.\n", inFileName, lnum);
+            if (eclipse.obscuration != 1.0)
+                FAIL("C GlobalSolarEclipseTest(%s line %d): obscuration = %0.6lf should have been 1.0 for total eclipse.\n", inFileName, lnum, eclipse.obscuration);
+            break;
 
-        fclose(infile);
-        infile = NULL;
+        default:
+            FAIL("C GlobalSolarEclipseTest(%s line %d): Unhandled eclipse kind %d for obscuration check.\n", inFileName, lnum, eclipse.kind);
+        }
 
-        if (count != expected_count)
-            FAIL("C JupiterMoonsTest(%s): expected %d test cases, found %d\n", filename, expected_count, count);
+        eclipse = Astronomy_NextGlobalSolarEclipse(eclipse.peak);
     }
 
-    FPASS();
+    if (lnum != expected_count)
+        FFAIL("WRONG LINE COUNT = %d, expected %d\n", lnum, expected_count);
+
+    if (skip_count > 2)
+        FFAIL("EXCESSIVE SKIP COUNT = %d\n", skip_count);
+
+    FPASSA("(%d verified, %d skipped, %d CalcMoons, max minutes = %0.3lf, max angle = %0.3lf)\n", lnum, skip_count, _CalcMoonCount, max_minutes, max_angle);
 fail:
     if (infile != NULL) fclose(infile);
     return error;
@@ -5405,125 +5769,147 @@ fail:
 
 /*-----------------------------------------------------------------------------------------------------------*/
 
-static int Issue103(void)
+static void VectorFromAngles(double v[3], double lat, double lon)
 {
-    /* https://github.com/cosinekitty/astronomy/issues/103 */
+    double coslat = cos(DEG2RAD * lat);
+    v[0] = cos(DEG2RAD * lon) * coslat;
+    v[1] = sin(DEG2RAD * lon) * coslat;
+    v[2] = sin(DEG2RAD * lat);
+}
 
-    astro_observer_t observer = Astronomy_MakeObserver(29.0, -81.0, 10.0);
-    double ut = -8.817548982869034808e+04;
-    astro_time_t time = Astronomy_TimeFromDays(ut);
-    astro_body_t body = BODY_VENUS;
-    astro_equatorial_t ofdate = Astronomy_Equator(body, &time, observer, EQUATOR_OF_DATE, ABERRATION);
-    astro_horizon_t hor;
 
-    printf("tt  = %23.16lf\n", time.tt);
-    printf("ra  = %23.16lf\n", ofdate.ra);
-    printf("dec = %23.16lf\n", ofdate.dec);
-    hor = Astronomy_Horizon(&time, observer, ofdate.ra, ofdate.dec, REFRACTION_NONE);
-    printf("az  = %23.16lf\n", hor.azimuth);
-    printf("alt = %23.16lf\n", hor.altitude);
+static double AngleDiff(double alat, double alon, double blat, double blon)
+{
+    double a[3];
+    double b[3];
+    double dot;
 
-    return 0;
+    /* Convert angles to vectors on a unit sphere. */
+    VectorFromAngles(a, alat, alon);
+    VectorFromAngles(b, blat, blon);
+
+    dot = V(a[0]*b[0] + a[1]*b[1] + a[2]*b[2]);
+    if (dot <= -1.0)
+        return 180.0;
+
+    if (dot >= +1.0)
+        return 0.0;
+
+    return V(RAD2DEG * acos(dot));
 }
 
 /*-----------------------------------------------------------------------------------------------------------*/
 
-static int AberrationTest(void)
+static int LocalSolarEclipseTest(void)
 {
-    int error, lnum, nscanned;
-    int found_begin = 0;
-    int found_end = 0;
-    int count = 0;
-    FILE *infile = NULL;
-    const char *filename = "equatorial/Mars_j2000_ofdate_aberration.txt";
-    char line[100];
-    double jd, jra, jdec, dra, ddec, xra, xdec;
-    astro_time_t time;
-    astro_rotation_t rot;
-    astro_spherical_t eqj_sphere, eqd_sphere;
-    astro_vector_t eqj_vec, eqd_vec;
-    double factor, diff_seconds, max_diff_seconds = 0.0;
-    astro_state_vector_t eqj_earth;
-    const double THRESHOLD_SECONDS = 0.453;
-
-    infile = fopen(filename, "rt");
-    if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", filename);
+    int error;
+    CHECK(LocalSolarEclipseTest1());
+    CHECK(LocalSolarEclipseTest2());
+fail:
+    return error;
+}
+
+static int LocalSolarEclipseTest1(void)
+{
+    /*
+        Re-use the test data for global solar eclipses, only feed the given coordinates
+        into the local solar eclipse predictor as the observer's location.
+        In each case, start the search 20 days before the expected eclipse.
+        Then verify that the peak time and eclipse type is correct in each case.
+    */
+
+    int error = 1;
+    FILE *infile = NULL;
+    const char *inFileName = "eclipse/solar_eclipse.txt";
+    int lnum;
+    char line[100];
+    char typeChar;
+    double deltaT;
+    astro_observer_t observer;
+    astro_time_t peak, search_start;
+    astro_local_solar_eclipse_t eclipse;
+    double diff_days, diff_minutes, max_minutes=0.0;
+    int skip_count = 0;
+    extern int _CalcMoonCount;      /* incremented by Astronomy Engine every time expensive CalcMoon() is called */
+
+    _CalcMoonCount = 0;
+
+    infile = fopen(inFileName, "rt");
+    if (infile == NULL)
+        FFAIL("Cannot open input file: %s\n", inFileName);
 
     lnum = 0;
-    while (!found_end && ReadLine(line, sizeof(line), infile, filename, lnum))
+    observer.height = 0.0;
+    while (ReadLine(line, sizeof(line), infile, inFileName, lnum))
     {
         ++lnum;
-        if (!found_begin)
-        {
-            if (strlen(line) >= 5 && !memcmp(line, "$$SOE", 5))
-                found_begin = 1;
-        }
-        else if (strlen(line) >= 5 && !memcmp(line, "$$EOE", 5))
-        {
-            found_end = 1;
-        }
-        else
-        {
-            /* 2459371.500000000 *   118.566080210  22.210647456 118.874086738  22.155784122 */
-            nscanned = sscanf(line+22, "%lf %lf %lf %lf", &jra, &jdec, &dra, &ddec);
-            if (nscanned != 4)
-                FAIL("C AberrationTest(%s line %d): invalid coordinates\n", filename, lnum);
 
-            nscanned = sscanf(line, "%lf", &jd);
-            if (nscanned != 1)
-                FAIL("C AberrationTest(%s line %d): invalid julian date\n", filename, lnum);
+        /* 1889-12-22T12:54:15Z   -6 T   -12.7   -12.8 */
+        if (strlen(line) < 20)
+            FAIL("C LocalSolarEclipseTest1(%s line %d): line is too short.\n", inFileName, lnum);
 
-            /* Convert julian day value to astro_time_t. */
-            time = Astronomy_TimeFromDays(jd - JD_2000);
+        line[20] = '\0';        /* terminate the date/time string */
+        if (ParseDate(line, &peak))
+            FAIL("C LocalSolarEclipseTest1(%s line %d): invalid date/time format: '%s'\n", inFileName, lnum, line);
 
-            /* Convert EQJ angular coordinates (jra, jdec) to an EQJ vector. */
-            eqj_sphere.status = ASTRO_SUCCESS;
-            eqj_sphere.lat = jdec;
-            eqj_sphere.lon = jra;       /* JPL Horizons RA is already in degrees, not hours. */
-            eqj_sphere.dist = C_AUDAY;  /* scale to the speed of light, to prepare for aberration correction. */
-            eqj_vec = Astronomy_VectorFromSphere(eqj_sphere, time);
-            CHECK_STATUS(eqj_vec);
+        if (4 != sscanf(line+21, "%lf %c %lf %lf", &deltaT, &typeChar, &observer.latitude, &observer.longitude))
+            FAIL("C LocalSolarEclipseTest1(%s line %d): invalid data format.\n", inFileName, lnum);
 
-            /* Aberration correction: calculate the Earth's barycentric velocity vector in EQJ coordinates. */
-            eqj_earth = Astronomy_BaryState(BODY_EARTH, time);
-            CHECK_STATUS(eqj_earth);
+        /* Start the search 20 days before we know the eclipse should peak. */
+        search_start = Astronomy_AddDays(peak, -20.0);
+        eclipse = Astronomy_SearchLocalSolarEclipse(search_start, observer);
+        if (eclipse.status != ASTRO_SUCCESS)
+            FAIL("C LocalSolarEclipseTest1(%s line %d): Astronomy_SearchLocalSolarEclipse returned %d\n", inFileName, lnum, eclipse.status);
 
-            /* Use non-relativistic approximation: add light vector to Earth velocity vector. */
-            /* This gives aberration-corrected apparent position of the star in EQJ. */
-            eqj_vec.x += eqj_earth.vx;
-            eqj_vec.y += eqj_earth.vy;
-            eqj_vec.z += eqj_earth.vz;
+        /* Validate the predicted eclipse peak time. */
+        diff_days = eclipse.peak.time.ut - peak.ut;
+        if (diff_days > 20.0)
+        {
+            ++skip_count;
+            continue;
+        }
 
-            /* Calculate the rotation matrix that converts J2000 coordinates to of-date coordinates. */
-            rot = Astronomy_Rotation_EQJ_EQD(&time);
-            CHECK_STATUS(rot);
+        diff_minutes = (24 * 60) * ABS(diff_days);
+        if (diff_minutes > 7.737)
+        {
+            printf("Expected: ");
+            PrintTime(peak);
+            printf("\nFound:    ");
+            PrintTime(eclipse.peak.time);
+            printf("  ut=%0.6lf, tt=%0.6lf\n", eclipse.peak.time.ut, eclipse.peak.time.tt);
+            FAIL("C LocalSolarEclipseTest1(%s line %d): EXCESSIVE TIME ERROR = %0.6lf minutes\n", inFileName, lnum, diff_minutes);
+        }
 
-            /* Use the rotation matrix to re-orient the EQJ vector to a EQD vector. */
-            eqd_vec = Astronomy_RotateVector(rot, eqj_vec);
-            CHECK_STATUS(eqd_vec);
+        if (diff_minutes > max_minutes)
+            max_minutes = diff_minutes;
 
-            /* Convert the EQD vector back to spherical angular coordinates. */
-            eqd_sphere = Astronomy_SphereFromVector(eqd_vec);
-            CHECK_STATUS(eqd_sphere);
+        /* Verify obscuration makes sense for this kind of eclipse. */
 
-            /* Calculate the differences in RA and DEC between expected and calculated values. */
-            factor = cos(V(eqd_sphere.lat * DEG2RAD));  /* RA errors are less important toward the poles */
-            xra = factor * ABS(eqd_sphere.lon - dra);
-            xdec = ABS(eqd_sphere.lat - ddec);
-            diff_seconds = V(3600.0 * sqrt(xra*xra + xdec*xdec));
-            DEBUG("C AberrationTest(%s line %d): xra=%0.6lf deg, xdec=%0.6lf deg, diff_seconds=%0.3lf.\n", filename, lnum, xra, xdec, diff_seconds);
-            if (diff_seconds > THRESHOLD_SECONDS)
-                FAIL("C AberrationTest(%s line %d): EXCESSIVE ANGULAR ERROR = %0.3lf seconds\n", filename, lnum, diff_seconds);
-            if (diff_seconds > max_diff_seconds)
-                max_diff_seconds = diff_seconds;
+        if (!isfinite(eclipse.obscuration))
+            FAIL("C LocalSolarEclipseTest1(%s line %d): obscuration is not finite\n", inFileName, lnum);
 
-            /* We have completed one more test case. */
-            ++count;
+        switch (eclipse.kind)
+        {
+        case ECLIPSE_ANNULAR:
+        case ECLIPSE_PARTIAL:
+            if (eclipse.obscuration <= 0.0 || eclipse.obscuration >= 1.0)
+                FAIL("C LocalSolarEclipseTest1(%s line %d): eclipse kind %d has invalid obscuration = %0.8lf\n", inFileName, lnum, eclipse.kind, eclipse.obscuration);
+            break;
+
+        case ECLIPSE_TOTAL:
+            if (eclipse.obscuration != 1.0)
+                FAIL("C LocalSolarEclipseTest1(%s line %d): total eclipse has invalid obscuration = %0.8lf\n", inFileName, lnum, eclipse.obscuration);
+            break;
+
+        default:
+            FAIL("C LocalSolarEclipseTest1(%s line %d): Invalid eclipse kind %d\n", inFileName, lnum, eclipse.kind);
         }
     }
 
-    printf("C AberrationTest(%s): PASS - Tested %d cases. max_diff_seconds = %0.3lf\n", filename, count, max_diff_seconds);
+    if (skip_count > 6)
+        FFAIL("EXCESSIVE SKIP COUNT %d\n", skip_count);
+
+    FPASSA("(%d verified, %d skipped, %d CalcMoons, max minutes = %0.3lf)\n", lnum, skip_count, _CalcMoonCount, max_minutes);
     error = 0;
 fail:
     if (infile != NULL) fclose(infile);
@@ -5532,93 +5918,65 @@ fail:
 
 /*-----------------------------------------------------------------------------------------------------------*/
 
-static double StateVectorDiff(int relative, const double vec[3], double x, double y, double z)
+static int ParseEvent(const char *str, int required, astro_time_t *time)
 {
-    double dx = V(vec[0] - x);
-    double dy = V(vec[1] - y);
-    double dz = V(vec[2] - z);
-    double diff_squared = dx*dx + dy*dy + dz*dz;
-    if (relative)
-        diff_squared /= (vec[0]*vec[0] + vec[1]*vec[1] + vec[2]*vec[2]);
-    return V(sqrt(diff_squared));
-}
-
-struct _verify_state_context_t;
-
-typedef astro_state_vector_t (* state_func_t) (struct _verify_state_context_t *, astro_body_t, astro_time_t);
+    if (required)
+        return ParseDate(str, time);
 
-typedef struct _verify_state_context_t
-{
-    state_func_t    func;
+    if (strcmp(str, "-"))
+    {
+        fprintf(stderr, "ParseEvent: Expected '-' but found '%s'\n", str);
+        return 1;
+    }
 
-    /* The following are used for Lagrange point testing only. */
-    astro_body_t    major;
-    int             point;      /* 1=L1, 2=L2, ..., 5=L5. */
+    time->ut = time->tt = NAN;
+    return 0;
 }
-verify_state_context_t;
 
-static double ArcCos(double x)
+
+static int IgnoreLine(char *line)
 {
-    if (x <= -1.0)
-        return 180.0;
+    int col, empty;
 
-    if (x >= +1.0)
-        return 0.0;
+    /* Treat '#' as a comment character. */
+    empty = 1;
+    for (col=0; line[col] != '\0' && line[col] != '#'; ++col)
+        if (!isspace(line[col]))
+            empty = 0;
 
-    return RAD2DEG * acos(x);
+    line[col] = '\0';
+    return empty;
 }
 
-static void PrintDiagnostic(double x, double y, double z, const double ref[3])
-{
-    double calc_mag, ref_mag, angle;
-
-    calc_mag = sqrt(x*x + y*y + z*z);
-    ref_mag = sqrt(ref[0]*ref[0] + ref[1]*ref[1] + ref[2]*ref[2]);
-    angle = 60.0 * ArcCos((x*ref[0] + y*ref[1] + z*ref[2])/(calc_mag * ref_mag));
-    fprintf(stderr, "CALCULATED x = %22.16le, y = %22.16le, z = %22.16le [mag = %22.16le]\n", x, y, z, calc_mag);
-    fprintf(stderr, "REFERENCE  x = %22.16le, y = %22.16le, z = %22.16le [mag = %22.16le]\n", ref[0], ref[1], ref[2], ref_mag);
-    fprintf(stderr, "ANGLE ERROR = %0.6lf arcmin, MAG ERROR = %0.6lf\n", angle, (calc_mag-ref_mag)/ref_mag);
-}
 
-static int VerifyState(
-    verify_state_context_t *context,
-    double *max_rdiff,
-    double *max_vdiff,
-    astro_body_t body,
-    const char *filename,
+static int CheckEvent(
+    const char *inFileName,
     int lnum,
-    astro_time_t time,
-    const double pos[3],
-    const double vel[3],
-    double r_thresh,
-    double v_thresh)
+    const char *name,
+    astro_time_t expected_time,
+    double expected_altitude,
+    astro_eclipse_event_t evt,
+    double *max_minutes,
+    double *max_degrees)
 {
-    int error;
-    astro_state_vector_t state;
-    double rdiff, vdiff;
+    int error = 1;
+    double diff_minutes, diff_alt;
 
-    state = context->func(context, body, time);
-    if (state.status != ASTRO_SUCCESS)
-        FAIL("C VerifyState(%s line %d): state function returned error %d\n", filename, lnum, state.status);
+    diff_minutes = (24 * 60) * ABS(expected_time.ut - evt.time.ut);
 
-    rdiff = StateVectorDiff((r_thresh > 0.0), pos, state.x, state.y, state.z);
-    if (rdiff > *max_rdiff)
-        *max_rdiff = rdiff;
+    if (diff_minutes > *max_minutes)
+        *max_minutes = diff_minutes;
 
-    vdiff = StateVectorDiff((v_thresh > 0.0), vel, state.vx, state.vy, state.vz);
-    if (vdiff > *max_vdiff)
-        *max_vdiff = vdiff;
+    if (diff_minutes > 1.0)
+        FAIL("CheckEvent(%s line %d): EXCESSIVE TIME ERROR: %0.3lf minutes\n", inFileName, lnum, diff_minutes);
 
-    if (rdiff > fabs(r_thresh))
+    /* Ignore discrepancies for negative altitudes, because of quirky and irrelevant differences in refraction models. */
+    if (expected_altitude >= 0.0)
     {
-        PrintDiagnostic(state.x, state.y, state.z, pos);
-        FAIL("C VerifyState(%s line %d): EXCESSIVE position error = %0.4le\n", filename, lnum, rdiff);
-    }
-
-    if (vdiff > fabs(v_thresh))
-    {
-        PrintDiagnostic(state.vx, state.vy, state.vz, vel);
-        FAIL("C VerifyState(%s line %d): EXCESSIVE velocity error = %0.4le\n", filename, lnum, vdiff);
+        diff_alt = ABS(expected_altitude - evt.altitude);
+        if (diff_alt > *max_degrees) *max_degrees = diff_alt;
+        if (diff_alt > 0.5)
+            FAIL("CheckEvent(%s line %d): EXCESSIVE ALTITUDE ERROR: %0.6lf degrees (expected = %0.6lf, calc = %0.6lf)\n", inFileName, lnum, diff_alt, expected_altitude, evt.altitude);
     }
 
     error = 0;
@@ -5626,98 +5984,93 @@ fail:
     return error;
 }
 
-static int VerifyStateBody(
-    verify_state_context_t *context,
-    astro_body_t body,
-    const char *filename,
-    double r_thresh,
-    double v_thresh)
+
+#define TIMESTRSIZE 31
+
+static int LocalSolarEclipseTest2(void)
 {
-    int error, lnum, nscanned;
-    int found_begin = 0;
-    int found_end = 0;
-    int count = 0;
-    int part = 0;
+    /*
+        Test ability to calculate local solar eclipse conditions away from
+        the peak position on the Earth.
+    */
+
+    int error = 1;
     FILE *infile = NULL;
-    char line[100];
-    astro_time_t time;
-    double jd, pos[3], vel[3];
-    double max_rdiff = 0.0, max_vdiff = 0.0;
+    const char *inFileName = "eclipse/local_solar_eclipse.txt";
+    int lnum, nscanned;
+    char line[300];
+    char p1str[TIMESTRSIZE], p2str[TIMESTRSIZE], t1str[TIMESTRSIZE], t2str[TIMESTRSIZE], peakstr[TIMESTRSIZE];
+    double p1alt, p2alt, t1alt, t2alt, peakalt;
+    astro_time_t p1, p2, t1, t2, peak, search_time;
+    char typeChar;
+    astro_observer_t observer;
+    double max_minutes=0.0, max_degrees=0.0;
+    int verify_count = 0;
+    astro_local_solar_eclipse_t eclipse;
+    astro_eclipse_kind_t expected_kind;
+    extern int _CalcMoonCount;      /* incremented by Astronomy Engine every time expensive CalcMoon() is called */
 
-    infile = fopen(filename, "rt");
+    _CalcMoonCount = 0;
+
+    infile = fopen(inFileName, "rt");
     if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", filename);
+        FFAIL("Cannot open input file: %s\n", inFileName);
 
     lnum = 0;
-    while (!found_end && ReadLine(line, sizeof(line), infile, filename, lnum))
+    observer.height = 0.0;
+    while (ReadLine(line, sizeof(line), infile, inFileName, lnum))
     {
         ++lnum;
-        if (!found_begin)
-        {
-            if (strlen(line) >= 5 && !memcmp(line, "$$SOE", 5))
-                found_begin = 1;
-        }
-        else
-        {
-            /*
-                Input comes in triplets of lines:
-
-                2444249.500000000 = A.D. 1980-Jan-11 00:00:00.0000 TDB
-                 X =-3.314860345089456E-01 Y = 8.463418210972562E-01 Z = 3.667227830514760E-01
-                 VX=-1.642704711077836E-02 VY=-5.494770742558920E-03 VZ=-2.383170237527642E-03
+        if (IgnoreLine(line)) continue;
 
-                Track which of these 3 cases we are in using the 'part' variable...
-            */
+        nscanned = sscanf(line, "%lf %lf %c %30s %lf %30s %lf %30s %lf %30s %lf %30s %lf",
+            &observer.latitude,   &observer.longitude,
+            &typeChar,
+            p1str,      &p1alt,
+            t1str,      &t1alt,
+            peakstr,    &peakalt,
+            t2str,      &t2alt,
+            p2str,      &p2alt);
 
-            switch (part)
-            {
-            case 0:
-                if (strlen(line) >= 5 && !memcmp(line, "$$EOE", 5))
-                {
-                    found_end = 1;
-                }
-                else
-                {
-                    nscanned = sscanf(line, "%lf", &jd);
-                    if (nscanned != 1)
-                        FAIL("C VerifyStateBody(%s line %d) ERROR reading Julian date.\n", filename, lnum);
-                    V(jd);
+        if (nscanned != 13)
+            FAIL("C LocalSolarEclipseTest2(%s line %d): Incorrect token count (scanned %d)\n", inFileName, lnum, nscanned);
 
-                    /* Convert julian TT day value to astro_time_t. */
-                    time = Astronomy_TerrestrialTime(jd - JD_2000);
-                }
-                break;
+        switch (typeChar)
+        {
+        case 'P': expected_kind = ECLIPSE_PARTIAL; break;
+        case 'A': expected_kind = ECLIPSE_ANNULAR; break;
+        case 'T': expected_kind = ECLIPSE_TOTAL;   break;
+        default:
+            FAIL("C LocalSolarEclipseTest2(%s line %d): invalid eclipse type '%c'\n", inFileName, lnum, typeChar);
+        }
 
-            case 1:
-                nscanned = sscanf(line, " X =%lf Y =%lf Z =%lf", &pos[0], &pos[1], &pos[2]);
-                if (nscanned != 3)
-                    FAIL("C VerifyStateBody(%s line %d) ERROR reading position vector.\n", filename, lnum);
-                V(pos[0]);
-                V(pos[1]);
-                V(pos[2]);
-                break;
+        CHECK(ParseEvent(p1str, 1, &p1));
+        CHECK(ParseEvent(p2str, 1, &p2));
+        CHECK(ParseEvent(peakstr, 1, &peak));
+        CHECK(ParseEvent(t1str, (typeChar != 'P'), &t1));
+        CHECK(ParseEvent(t2str, (typeChar != 'P'), &t2));
 
-            case 2:
-                nscanned = sscanf(line, " VX=%lf VY=%lf VZ=%lf", &vel[0], &vel[1], &vel[2]);
-                if (nscanned != 3)
-                    FAIL("C VerifyStateBody(%s line %d) ERROR reading velocity vector.\n", filename, lnum);
-                V(vel[0]);
-                V(vel[1]);
-                V(vel[2]);
-                CHECK(VerifyState(context, &max_rdiff, &max_vdiff, body, filename, lnum, time, pos, vel, r_thresh, v_thresh));
-                ++count;
-                break;
+        search_time = Astronomy_AddDays(p1, -20.0);
+        eclipse = Astronomy_SearchLocalSolarEclipse(search_time, observer);
+        if (eclipse.status != ASTRO_SUCCESS)
+            FAIL("C LocalSolarEclipseTest2(%s line %d): error %d searching for solar eclipse.\n", inFileName, lnum, eclipse.status);
 
-            default:
-                FFAIL("INTERNAL ERROR : part=%d\n", part);
-            }
+        if (eclipse.kind != expected_kind)
+            FAIL("C LocalSolarEclipseTest2(%s line %d): expected eclipse kind %d, found %d\n", inFileName, lnum, expected_kind, eclipse.kind);
 
-            part = (part + 1) % 3;
+        CHECK(CheckEvent(inFileName, lnum, "peak", peak, peakalt, eclipse.peak, &max_minutes, &max_degrees));
+        CHECK(CheckEvent(inFileName, lnum, "partial_begin", p1, p1alt, eclipse.partial_begin, &max_minutes, &max_degrees));
+        CHECK(CheckEvent(inFileName, lnum, "partial_end", p2, p2alt, eclipse.partial_end, &max_minutes, &max_degrees));
+        if (typeChar != 'P')
+        {
+            CHECK(CheckEvent(inFileName, lnum, "total_begin", t1, t1alt, eclipse.total_begin, &max_minutes, &max_degrees));
+            CHECK(CheckEvent(inFileName, lnum, "total_end", t2, t2alt, eclipse.total_end, &max_minutes, &max_degrees));
         }
+
+        ++verify_count;
     }
 
-    DEBUG("C VerifyStateBody(%-22s): PASS - Tested %d cases. max rdiff=%0.3le, vdiff=%0.3le\n", filename, count, max_rdiff, max_vdiff);
-    error = 0;
+    FPASSA("(%d verified, %d CalcMoons, max minutes = %0.3lf, max alt degrees = %0.3lf)\n", verify_count, _CalcMoonCount, max_minutes, max_degrees);
 fail:
     if (infile != NULL) fclose(infile);
     return error;
@@ -5725,900 +6078,2996 @@ fail:
 
 /*-----------------------------------------------------------------------------------------------------------*/
 
-/* Constants for use inside unit tests only; they doesn't make sense for public consumption. */
-#define BODY_GEOMOON    ((astro_body_t)(-100))
-#define BODY_GEO_EMB    ((astro_body_t)(-101))
-
-static astro_state_vector_t BaryState(verify_state_context_t *context, astro_body_t body, astro_time_t time)
+static int GlobalAnnularCase(int year, int month, int day, double obscuration)
 {
-    (void)context;
-
-    if (body == BODY_GEOMOON)
-        return Astronomy_GeoMoonState(time);
-
-    if (body == BODY_GEO_EMB)
-        return Astronomy_GeoEmbState(time);
+    int error;
+    astro_time_t time;
+    astro_global_solar_eclipse_t eclipse;
+    double dt, diff;
 
-    return Astronomy_BaryState(body, time);
-}
+    /* Search for the first solar eclipse that occurs after the given date. */
+    time = Astronomy_MakeTime(year, month, day, 0, 0, 0.0);
+    eclipse = Astronomy_SearchGlobalSolarEclipse(time);
+    CHECK_STATUS(eclipse);
 
-static int BaryStateTest(void)
-{
-    int error;  /* set as a side-effect of CHECK macro */
-    verify_state_context_t context;
+    /* Verify the eclipse is within 1 day after the search basis time. */
+    dt = V(eclipse.peak.ut - time.ut);
+    if (dt < 0.0 || dt > 1.0)
+        FAIL("C GlobalAnnularCase(%04d-%02d-%02d) FAIL: found eclipse %0.8lf days after search time.\n", year, month, day, dt);
 
-    memset(&context, 0, sizeof(context));
-    context.func = BaryState;
+    /* Verify we found an annular solar eclipse. */
+    if (eclipse.kind != ECLIPSE_ANNULAR)
+        FAIL("C GlobalAnnularCase(%04d-%02d-%02d) FAIL: expected annular eclipse, found %d.\n", year, month, day, eclipse.kind);
 
-    CHECK(VerifyStateBody(&context, BODY_SUN,     "barystate/Sun.txt",      -1.224e-05, -1.134e-07));
-    CHECK(VerifyStateBody(&context, BODY_MERCURY, "barystate/Mercury.txt",   1.672e-04,  2.698e-04));
-    CHECK(VerifyStateBody(&context, BODY_VENUS,   "barystate/Venus.txt",     4.123e-05,  4.308e-05));
-    CHECK(VerifyStateBody(&context, BODY_EARTH,   "barystate/Earth.txt",     2.296e-05,  6.359e-05));
-    CHECK(VerifyStateBody(&context, BODY_MARS,    "barystate/Mars.txt",      3.107e-05,  5.550e-05));
-    CHECK(VerifyStateBody(&context, BODY_JUPITER, "barystate/Jupiter.txt",   7.389e-05,  2.471e-04));
-    CHECK(VerifyStateBody(&context, BODY_SATURN,  "barystate/Saturn.txt",    1.067e-04,  3.220e-04));
-    CHECK(VerifyStateBody(&context, BODY_URANUS,  "barystate/Uranus.txt",    9.035e-05,  2.519e-04));
-    CHECK(VerifyStateBody(&context, BODY_NEPTUNE, "barystate/Neptune.txt",   9.838e-05,  4.446e-04));
-    CHECK(VerifyStateBody(&context, BODY_PLUTO,   "barystate/Pluto.txt",     4.259e-05,  7.827e-05));
-    CHECK(VerifyStateBody(&context, BODY_MOON,    "barystate/Moon.txt",      2.354e-05,  6.604e-05));
-    CHECK(VerifyStateBody(&context, BODY_EMB,     "barystate/EMB.txt",       2.353e-05,  6.511e-05));
-    CHECK(VerifyStateBody(&context, BODY_GEOMOON, "barystate/GeoMoon.txt",   4.086e-05,  5.347e-05));
-    CHECK(VerifyStateBody(&context, BODY_GEO_EMB, "barystate/GeoEMB.txt",    4.076e-05,  5.335e-05));
+    /* Check how accurately we calculated obscuration. */
+    diff = V(eclipse.obscuration - obscuration);
+    if (ABS(diff) > 0.0000904)
+        FAIL("C GlobalAnnularCase(%04d-%02d-%02d) FAIL: excessive obscuration error = %0.8lf. expected = %0.8lf, calculated = %0.8lf\n", year, month, day, diff, obscuration, eclipse.obscuration);
+    DEBUG("C GlobalAnnularCase(%04d-%02d-%02d) obscuration error = %0.8lf, expected = %0.8lf, calculated = %0.8lf\n", year, month, day, diff, obscuration, eclipse.obscuration);
 
-    FPASS();
 fail:
     return error;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
 
-static astro_state_vector_t HelioStateFunc(verify_state_context_t *context, astro_body_t body, astro_time_t time)
+static int LocalSolarCase(
+    int year,
+    int month,
+    int day,
+    double latitude,
+    double longitude,
+    astro_eclipse_kind_t kind,
+    double obscuration,
+    double tolerance)
 {
-    (void)context;
-    return Astronomy_HelioState(body, time);
-}
+    int error;
+    astro_time_t time;
+    astro_observer_t observer;
+    astro_local_solar_eclipse_t eclipse;
+    double dt, diff;
 
-static int HelioStateTest(void)
-{
-    int error;  /* set as a side-effect of CHECK macro */
-    verify_state_context_t context;
+    observer = Astronomy_MakeObserver(latitude, longitude, 0.0);
+    time = Astronomy_MakeTime(year, month, day, 0, 0, 0.0);
+    eclipse = Astronomy_SearchLocalSolarEclipse(time, observer);
+    CHECK_STATUS(eclipse);
 
-    memset(&context, 0, sizeof(context));
-    context.func = HelioStateFunc;
+    dt = V(eclipse.peak.time.ut - time.ut);
+    if (dt < 0.0 || dt > 1.0)
+        FAIL("C LocalSolarCase(%04d-%02d-%02d) FAIL: elapsed time = %0.6lf days\n", year, month, day, dt);
 
-    CHECK(VerifyStateBody(&context, BODY_SSB,     "heliostate/SSB.txt",     -1.209e-05, -1.125e-07));
-    CHECK(VerifyStateBody(&context, BODY_MERCURY, "heliostate/Mercury.txt",  1.481e-04,  2.756e-04));
-    CHECK(VerifyStateBody(&context, BODY_VENUS,   "heliostate/Venus.txt",    3.528e-05,  4.485e-05));
-    CHECK(VerifyStateBody(&context, BODY_EARTH,   "heliostate/Earth.txt",    1.476e-05,  6.105e-05));
-    CHECK(VerifyStateBody(&context, BODY_MARS,    "heliostate/Mars.txt",     3.154e-05,  5.603e-05));
-    CHECK(VerifyStateBody(&context, BODY_JUPITER, "heliostate/Jupiter.txt",  7.455e-05,  2.562e-04));
-    CHECK(VerifyStateBody(&context, BODY_SATURN,  "heliostate/Saturn.txt",   1.066e-04,  3.150e-04));
-    CHECK(VerifyStateBody(&context, BODY_URANUS,  "heliostate/Uranus.txt",   9.034e-05,  2.712e-04));
-    CHECK(VerifyStateBody(&context, BODY_NEPTUNE, "heliostate/Neptune.txt",  9.834e-05,  4.534e-04));
-    CHECK(VerifyStateBody(&context, BODY_PLUTO,   "heliostate/Pluto.txt",    4.271e-05,  1.198e-04));
-    CHECK(VerifyStateBody(&context, BODY_MOON,    "heliostate/Moon.txt",     1.477e-05,  6.195e-05));
-    CHECK(VerifyStateBody(&context, BODY_EMB,     "heliostate/EMB.txt",      1.476e-05,  6.106e-05));
+    if (eclipse.kind != kind)
+        FAIL("C LocalSolarCase(%04d-%02d-%02d) FAIL: expected kind %d, found %d\n", year, month, day, kind, eclipse.kind);
+
+    diff = V(eclipse.obscuration - obscuration);
+    if (ABS(diff) > tolerance)
+        FAIL("C LocalSolarCase(%04d-%02d-%02d) FAIL: obscuration diff = %11.8lf, expected = %11.8lf, calculated = %11.8lf\n", year, month, day, diff, obscuration, eclipse.obscuration);
+    DEBUG("C LocalSolarCase(%04d-%02d-%02d) obscuration diff = %11.8lf, expected = %11.8lf, calculated = %11.8lf\n", year, month, day, diff, obscuration, eclipse.obscuration);
 
-    FPASS();
 fail:
     return error;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
 
-static astro_state_vector_t LagrangeFunc(verify_state_context_t *context, astro_body_t minor_body, astro_time_t time)
-{
-    return Astronomy_LagrangePoint(
-        context->point,
-        time,
-        context->major,
-        minor_body
-    );
-}
-
-
-static int VerifyStateLagrange(
-    astro_body_t majorBody,
-    astro_body_t minorBody,
-    int point,
-    const char *filename,
-    double r_thresh,
-    double v_thresh)
+static int SolarFractionTest(void)
 {
-    verify_state_context_t context;
-    memset(&context, 0, sizeof(context));
-    context.func = LagrangeFunc;
-    context.major = majorBody;
-    context.point = point;
-    return VerifyStateBody(&context, minorBody, filename, r_thresh, v_thresh);
-}
+    int error;
 
+    /* Verify global solar eclipse obscurations for annular eclipses only. */
+    /* This is because they are the only nontrivial values for global solar eclipses. */
+    /* The trivial values are all validated exactly by GlobalSolarEclipseTest(). */
 
-static int VerifyEquilateral(
-    const char *kind,
-    astro_body_t major_body,
-    astro_body_t minor_body,
-    int point,
-    astro_time_t time,
-    double mx,
-    double my,
-    double mz,
-    double px,
-    double py,
-    double pz,
-    double *max_diff,
-    double *max_arcmin)
-{
-    int error = 0;
-    const double LENGTH_TOLERANCE = 1.0e-15;
-    const double ARCMIN_TOLERANCE = 3.0e-12;
-    double dx, dy, dz, dlength;
-    double mlength, plength, diff, dotprod;
-    double arcmin;
-    char tag[100];
+    CHECK(GlobalAnnularCase(2023, 10, 14, 0.90638));    /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2023Oct14Aprime.html */
+    CHECK(GlobalAnnularCase(2024, 10,  2, 0.86975));    /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2024Oct02Aprime.html */
+    CHECK(GlobalAnnularCase(2027,  2,  6, 0.86139));    /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2027Feb06Aprime.html */
+    CHECK(GlobalAnnularCase(2028,  1, 26, 0.84787));    /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2028Jan26Aprime.html */
+    CHECK(GlobalAnnularCase(2030,  6,  1, 0.89163));    /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2030Jun01Aprime.html */
 
-    snprintf(tag, sizeof(tag),
-        "C VerifyEquilateral(%s,%s,%s,L%d,tt=%0.3lf)",
-        kind,
-        Astronomy_BodyName(major_body),
-        Astronomy_BodyName(minor_body),
-        point,
-        time.tt
-    );
+    /* Verify obscuration values for specific locations on the Earth. */
+    /* Local solar eclipse calculations include obscuration for all types of eclipse, not just annular and total. */
+    CHECK(LocalSolarCase(2023, 10, 14,  11.3683,  -83.1017, ECLIPSE_ANNULAR, 0.90638, 0.000080));   /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2023Oct14Aprime.html */
+    CHECK(LocalSolarCase(2023, 10, 14,  25.78,    -80.22,   ECLIPSE_PARTIAL, 0.578,   0.000023));   /* https://aa.usno.navy.mil/calculated/eclipse/solar?eclipse=22023&lat=25.78&lon=-80.22&label=Miami%2C+FL&height=0&submit=Get+Data */
+    CHECK(LocalSolarCase(2023, 10, 14,  30.2666,  -97.7000, ECLIPSE_PARTIAL, 0.8867,  0.001016));   /* http://astro.ukho.gov.uk/eclipse/0332023/Austin_TX_United_States_2023Oct14.png */
+    CHECK(LocalSolarCase(2024,  4,  8,  25.2900, -104.1383, ECLIPSE_TOTAL,   1.0,     0.0));        /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2024Apr08Tprime.html */
+    CHECK(LocalSolarCase(2024,  4,  8,  37.76,   -122.44,   ECLIPSE_PARTIAL, 0.340,   0.000604));   /* https://aa.usno.navy.mil/calculated/eclipse/solar?eclipse=12024&lat=37.76&lon=-122.44&label=San+Francisco%2C+CA&height=0&submit=Get+Data */
+    CHECK(LocalSolarCase(2024, 10,  2, -21.9533, -114.5083, ECLIPSE_ANNULAR, 0.86975, 0.000061));   /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2024Oct02Aprime.html */
+    CHECK(LocalSolarCase(2024, 10,  2, -33.468,   -70.636,  ECLIPSE_PARTIAL, 0.436,   0.000980));   /* https://aa.usno.navy.mil/calculated/eclipse/solar?eclipse=22024&lat=-33.468&lon=-70.636&label=Santiago%2C+Chile&height=0&submit=Get+Data */
+    CHECK(LocalSolarCase(2030,  6,  1,  56.525,    80.0617, ECLIPSE_ANNULAR, 0.89163, 0.000067));   /* https://www.eclipsewise.com/solar/SEprime/2001-2100/SE2030Jun01Aprime.html */
+    CHECK(LocalSolarCase(2030,  6,  1,  40.388,    49.914,  ECLIPSE_PARTIAL, 0.67240, 0.000599));   /* http://xjubier.free.fr/en/site_pages/SolarEclipseCalc_Diagram.html */
+    CHECK(LocalSolarCase(2030,  6,  1,  40.3667,   49.8333, ECLIPSE_PARTIAL, 0.6736,  0.001464));   /* http://astro.ukho.gov.uk/eclipse/0132030/Baku_Azerbaijan_2030Jun01.png */
 
-    /* Verify minor body vector and Lagrange point vector are the same length. */
-    mlength = sqrt(mx*mx + my*my + mz*mz);
-    plength = sqrt(px*px + py*py + pz*pz);
-    diff = ABS((plength - mlength) / mlength);
-    if (diff > LENGTH_TOLERANCE)
-        FAIL("%s: FAIL mlength = %0.6le, plength = %0.6le, diff = %0.6le\n", tag, mlength, plength, diff);
-    if (diff > *max_diff)
-        *max_diff = diff;
+    FPASS();
+fail:
+    return error;
+}
 
-    /* Verify the third triangle leg (minor body to Lagrange point) is also the same length. */
-    dx = px - mx;
-    dy = py - my;
-    dz = pz - mz;
-    dlength = sqrt(dx*dx + dy*dy + dz*dz);
-    diff = ABS((dlength - mlength) / mlength);
-    if (diff > LENGTH_TOLERANCE)
-        FAIL("%s: FAIL mlength = %0.6le, dlength = %0.6le, diff = %0.6le\n", tag, mlength, dlength, diff);
-    if (diff > *max_diff)
-        *max_diff = diff;
+/*-----------------------------------------------------------------------------------------------------------*/
 
-    /* The 3 mutual angles should all be 60 degrees. */
-    dotprod = (mx*px + my*py + mz*pz) / (mlength * plength);
-    arcmin = ABS(60.0 * (60.0 - ArcCos(dotprod)));
-    if (arcmin > ARCMIN_TOLERANCE)
-        FAIL("%s: FAIL m/p angle error = %0.6le arcmin.\n", tag, arcmin);
-    if (arcmin > *max_arcmin)
-        *max_arcmin = arcmin;
+static int PlotDeltaT(const char *outFileName)
+{
+    int error = 1;
+    FILE *outfile = NULL;
+    int year;
+    double dt;
+    astro_time_t time;
 
-    dotprod = -(mx*dx + my*dy + mz*dz) / (mlength * dlength);       /* negate because pointing opposite dirs */
-    arcmin = ABS(60.0 * (60.0 - ArcCos(dotprod)));
-    if (arcmin > ARCMIN_TOLERANCE)
-        FAIL("%s: FAIL m/d angle error = %0.6le arcmin.\n", tag, arcmin);
-    if (arcmin > *max_arcmin)
-        *max_arcmin = arcmin;
+    outfile = fopen(outFileName, "wt");
+    if (outfile == NULL)
+        FAIL("ctest PlotDeltaT: Cannot open output file: %s\n", outFileName);
 
-    dotprod = (px*dx + py*dy + pz*dz) / (plength * dlength);       /* negate because pointing opposite dirs */
-    arcmin = ABS(60.0 * (60.0 - ArcCos(dotprod)));
-    if (arcmin > ARCMIN_TOLERANCE)
-        FAIL("%s: FAIL p/d angle error = %0.6le arcmin.\n", tag, arcmin);
-    if (arcmin > *max_arcmin)
-        *max_arcmin = arcmin;
+    fprintf(outfile, "\"year\",\"delta_t\"\n");
+    for (year = 1500; year <= 2500; ++year)
+    {
+        time = Astronomy_MakeTime(year, 1, 1, 0, 0, 0.0);
+        dt = (24.0 * 3600.0) * (time.tt - time.ut);
+        fprintf(outfile, "%d,%lf\n", year, dt);
+    }
 
+    printf("ctest PlotDeltaT: Wrote file %s\n", outFileName);
+    error = 0;
 fail:
-    if (error != 0) printf("%s: returning %d\n", tag, error);
+    if (outfile != NULL) fclose(outfile);
     return error;
 }
 
+/*-----------------------------------------------------------------------------------------------------------*/
 
-static int VerifyLagrangeTriangle(astro_body_t major_body, astro_body_t minor_body, int point)
+static int TransitFile(astro_body_t body, const char *filename, double limit_minutes, double limit_sep)
 {
-    int error, count;
-    char tag[100];
-    astro_state_vector_t major_state, minor_state, point_state;
-    double major_mass, minor_mass;
-    const double tt1 = 7335.5;      /* 2020-02-01T00:00Z */
-    const double tt2 = 7425.5;      /* 2020-05-01T00:00Z */
-    const double dt = 0.125;        /* 1/8 is exactly represented in binary */
-    astro_time_t time;
-    double max_pos_diff = 0.0, max_pos_arcmin = 0.0;
-    double max_vel_diff = 0.0, max_vel_arcmin = 0.0;
-
-    snprintf(tag, sizeof(tag),
-        "C VerifyLagrangeTriangle(%s,%s,L%d)",
-        Astronomy_BodyName(major_body),
-        Astronomy_BodyName(minor_body),
-        point
-    );
+    int error = 1;
+    FILE *infile = NULL;
+    char line[100];
+    int lnum;
+    astro_time_t time1, time2, timep;
+    astro_transit_t transit;
+    double separation;
+    double diff_start, diff_peak, diff_finish, diff_sep;
+    double max_minutes = 0.0, max_sep = 0.0;
+    const int START_YEAR = 1600;
 
-    if (point != 4 && point != 5)
-        FAIL("%s: Invalid Lagrange point %d\n", tag, point);
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FFAIL("Cannot open input file: %s\n", filename);
 
-    major_mass = Astronomy_MassProduct(major_body);
-    if (major_mass <= 0.0)
-        FAIL("%s: Invalid mass product for major body.\n", tag);
+    transit = Astronomy_SearchTransit(body, Astronomy_MakeTime(START_YEAR, 1, 1, 0, 0, 0.0));
+    if (transit.status != ASTRO_SUCCESS)
+        FAIL("C TransitFile(%s): SearchTransit returned %d\n", filename, transit.status);
 
-    minor_mass = Astronomy_MassProduct(minor_body);
-    if (minor_mass <= 0.0)
-        FAIL("%s: Invalid mass product for minor body.\n", tag);
+    DEBUG("\n----------------------------------------------------------------\n\n");
+    FDEBUG("STARTING %s\n\n", filename);
 
-    count = 0;
-    time = Astronomy_TerrestrialTime(tt1);
-    while (time.tt <= tt2)
+    lnum = 0;
+    while (ReadLine(line, sizeof(line), infile, filename, lnum))
     {
-        ++count;
+        ++lnum;
 
-        major_state = Astronomy_HelioState(major_body, time);
-        if (major_state.status != ASTRO_SUCCESS)
-            FAIL("%s: HelioState failed for major body.\n", tag);
+        /* 22:17 1881-11-08T00:57Z 03:38  3.8633 */
 
-        minor_state = Astronomy_HelioState(minor_body, time);
-        if (minor_state.status != ASTRO_SUCCESS)
-            FAIL("%s: HelioState failed for minor body.\n", tag);
+        if (strlen(line) < 37)
+            FAIL("C TransitFile(%s line %d): line is too short.\n", filename, lnum);
 
-        point_state = Astronomy_LagrangePointFast(point, major_state, major_mass, minor_state, minor_mass);
-        if (point_state.status != ASTRO_SUCCESS)
-            FAIL("%s: Astronomy_LagrangePoint returned status = %d\n", tag, point_state.status);
+        if (line[5] != ' ' || line[23] != ' ' || line[29] != ' ')
+            FAIL("C TransitFile(%s line %d): invalid data format.\n", filename, lnum);
 
-        /* Verify the (major, minor, L4/L5) triangle is equilateral, both in position and velocity. */
-        CHECK(VerifyEquilateral(
-            "position",
-            major_body,
-            minor_body,
-            point,
-            time,
-            minor_state.x - major_state.x,
-            minor_state.y - major_state.y,
-            minor_state.z - major_state.z,
-            point_state.x,
-            point_state.y,
-            point_state.z,
-            &max_pos_diff,
-            &max_pos_arcmin
-        ));
+        if (1 != sscanf(line+30, "%lf", &separation))
+            FAIL("C TransitFile(%s line %d): unable to parse angular separation.\n", filename, lnum);
 
-        CHECK(VerifyEquilateral(
-            "velocity",
-            major_body,
-            minor_body,
-            point,
-            time,
-            minor_state.vx - major_state.vx,
-            minor_state.vy - major_state.vy,
-            minor_state.vz - major_state.vz,
-            point_state.vx,
-            point_state.vy,
-            point_state.vz,
-            &max_vel_diff,
-            &max_vel_arcmin
-        ));
+        line[23] = '\0';
+        if (ParseDate(line+6, &timep))
+            FAIL("C TransitFile(%s line %d): invalid date/time '%s'\n", filename, lnum, line+6);
 
-        time = Astronomy_TerrestrialTime(time.tt + dt);
-    }
+        /* Patch the start time and reparse. */
+        line[17] = line[0];
+        line[18] = line[1];
+        line[20] = line[3];
+        line[21] = line[4];
+        if (ParseDate(line+6, &time1))
+            FAIL("C TransitFile(%s line %d): failed to parse patched start time '%s'\n", filename, lnum, line+6);
 
-    if (Verbose)
-    {
-        printf("%s: PASS (%d cases)\n", tag, count);
-        printf("    max_pos_diff = %0.3le, max_vel_diff = %0.3le\n", max_pos_diff, max_vel_diff);
-        printf("    max_pos_arcmin = %0.3le, max_vel_arcmin = %0.3le\n", max_pos_arcmin, max_vel_arcmin);
+        /* If the start time is after the peak time, it really starts on the previous day. */
+        if (time1.ut > timep.ut)
+            time1 = Astronomy_AddDays(time1, -1.0);
+
+        /* Patch the finish time and reparse. */
+        line[17] = line[24];
+        line[18] = line[25];
+        line[20] = line[27];
+        line[21] = line[28];
+        if (ParseDate(line+6, &time2))
+            FAIL("C TransitFile(%s line %d): failed to parse patched finish time '%s'\n", filename, lnum, line+6);
+
+        /* If the finish time is before the peak time, it really starts on the next day. */
+        if (time2.ut < timep.ut)
+            time2 = Astronomy_AddDays(time2, +1.0);
+
+        /* Measure result errors. */
+        diff_start  = (24.0 * 60.0) * (time1.ut - transit.start.ut );
+        diff_peak   = (24.0 * 60.0) * (timep.ut - transit.peak.ut  );
+        diff_finish = (24.0 * 60.0) * (time2.ut - transit.finish.ut);
+        diff_sep    = separation - transit.separation;
+
+        if (Verbose)
+        {
+            printf("Expected: ");
+            PrintTime(time1);
+            printf("    ");
+            PrintTime(timep);
+            printf("    ");
+            PrintTime(time2);
+            printf(" %10.4lf\n", separation);
+
+            printf("Found:    ");
+            PrintTime(transit.start);
+            printf("    ");
+            PrintTime(transit.peak);
+            printf("    ");
+            PrintTime(transit.finish);
+            printf(" %10.4lf\n", transit.separation);
+
+            printf("Diff: %24.3lf    %24.3lf    %24.3lf     %10.4lf\n\n", diff_start, diff_peak, diff_finish, diff_sep);
+        }
+
+        diff_start  = ABS(diff_start);
+        diff_peak   = ABS(diff_peak);
+        diff_finish = ABS(diff_finish);
+        if (diff_start  > max_minutes)  max_minutes = diff_start;
+        if (diff_peak   > max_minutes)  max_minutes = diff_peak;
+        if (diff_finish > max_minutes)  max_minutes = diff_finish;
+        if (max_minutes > limit_minutes)
+            FAIL("C TransitFile(%s line %d): EXCESSIVE TIME ERROR = %0.3lf minutes. (Run again with -v to debug.)\n", filename, lnum, max_minutes);
+
+        diff_sep = ABS(diff_sep);
+        if (diff_sep > max_sep)  max_sep = diff_sep;
+        if (max_sep > limit_sep)
+            FAIL("C TransitFile(%s line %d): EXCESSIVE SEPARATION ERROR = %0.4lf arcminutes. (Run again with -v to debug.)\n", filename, lnum, max_sep);
+
+        /* Search for the next transit. */
+        transit = Astronomy_NextTransit(body, transit.finish);
+        if (transit.status != ASTRO_SUCCESS)
+            FAIL("C TransitFile(%s line %d): NextTransit returned %d\n", filename, lnum, transit.status);
     }
+
+    printf("C TransitFile(%-20s): PASS - verified %2d, max minutes = %6.3lf, max sep arcmin = %6.4lf\n", filename, lnum, max_minutes, max_sep);
     error = 0;
+
 fail:
+    if (infile != NULL) fclose(infile);
     return error;
 }
 
-
-static int VerifyGeoMoon(const char *filename)
+static int Transit(void)
 {
-    verify_state_context_t context;
+    int error;
 
-    memset(&context, 0, sizeof(context));
-    context.func = BaryState;
-    return VerifyStateBody(&context, BODY_GEOMOON, filename, 3.777e-5, 5.047e-5);
+    CHECK(TransitFile(BODY_MERCURY, "eclipse/mercury.txt", 10.710, 0.2121));
+    CHECK(TransitFile(BODY_VENUS,   "eclipse/venus.txt",    9.109, 0.6772));
+fail:
+    return error;
 }
 
+/*-----------------------------------------------------------------------------------------------------------*/
 
-static double ErrorArcmin(
-    double ax, double ay, double az,
-    double bx, double by, double bz)
+static int DistancePlot(astro_body_t body, double ut1, double ut2, const char *filename)
 {
-    double dx = ax - bx;
-    double dy = ay - by;
-    double dz = az - bz;
-    double error = sqrt(dx*dx + dy*dy + dz*dz);
-    double mag = sqrt(ax*ax + ay*ay + az*az);
-    return (error / mag) * (RAD2DEG * 60.0);
-}
+    const int npoints = 100000;
+    int error = 1;
+    int i;
+    double ut;
+    astro_time_t time, j2000;
+    astro_func_result_t dist;
+    FILE *outfile = NULL;
 
+    outfile = fopen(filename, "wt");
+    if (outfile == NULL)
+        FFAIL("Cannot open output file: %s\n", filename);
 
-static int LagrangeJplGeoMoon(const char *mb_filename, const char *lp_filename, int point)
-{
-    int error, i;
-    double major_mass, minor_mass;
-    astro_state_vector_t major;
-    astro_state_vector_t m, p, q;
-    state_vector_batch_t mb = EmptyStateVectorBatch();
-    state_vector_batch_t lp = EmptyStateVectorBatch();
-    double arcmin;
-    double max_pos_arcmin = 0.0;
-    double max_vel_arcmin = 0.0;
+    j2000 = Astronomy_MakeTime(2000, 1, 1, 12, 0, 0.0);
 
-    /* The major body is the Earth, and we do everything geocentrically. */
-    major.x = major.y = major.z = 0.0;
-    major.vx = major.vy = major.vz = 0.0;
-    memset(&major.t, 0, sizeof(major.t));
-    major.status = ASTRO_SUCCESS;
+    fprintf(outfile, "\"tt\",\"distance\"\n");
+    for (i=0; i < npoints; ++i)
+    {
+        ut = ut1 + (((double)i)/((double)(npoints-1)) * (ut2 - ut1));
+        time = Astronomy_AddDays(j2000, ut);
+        dist = Astronomy_HelioDistance(body, time);
+        CHECK_STATUS(dist);
+        fprintf(outfile, "%0.16lf,%0.16lg\n", time.tt, dist.value);
+    }
 
-    major_mass = Astronomy_MassProduct(BODY_EARTH);
-    if (major_mass <= 0.0)
-        FAIL("LagrangeJplGeoMoon: cannot find Earth mass\n");
+    error = 0;
+fail:
+    if (outfile != NULL) fclose(outfile);
+    return error;
+}
 
-    minor_mass = Astronomy_MassProduct(BODY_MOON);
-    if (minor_mass <= 0.0)
-        FAIL("LagrangeJplGeoMoon: cannot find Moon mass\n");
+/*-----------------------------------------------------------------------------------------------------------*/
 
-    /* Use state vectors provided by JPL to calculate Lagrange points. */
-    /* Compare calculated Lagrange points against JPL Lagrange points. */
+static int PlutoCheckDate(double ut, double arcmin_tolerance, double x, double y, double z)
+{
+    int error = 1;
+    astro_time_t time;
+    astro_vector_t vector;
+    double dx, dy, dz, diff, dist, arcmin;
 
-    CHECK(LoadStateVectors(&mb, mb_filename));
-    CHECK(LoadStateVectors(&lp, lp_filename));
-    if (mb.length != lp.length)
-        FFAIL("%s has %d states, but %s has %d\n", mb_filename, mb.length, lp_filename, lp.length);
+    time = Astronomy_TimeFromDays(ut);
 
-    for (i = 0; i < mb.length; ++i)
-    {
-        m = mb.array[i];
-        p = lp.array[i];
-        if (m.t.tt != p.t.tt)
-            FAIL("C LagrangeJplGeoMoon(%s): mismatching time: %0.16lf != %0.16lf.\n", lp_filename, m.t.tt, p.t.tt);
+    DEBUG("C %s: ", __func__);
+    if (Verbose) PrintTime(time);
+    DEBUG(" = %0.6lf UT = %0.6lf TT\n", time.ut, time.tt);
 
-        major.t = m.t;
-        q = Astronomy_LagrangePointFast(point, major, major_mass, m, minor_mass);
-        if (q.status != ASTRO_SUCCESS)
-            FAIL("C LagrangeJplGeoMoon(%s): Astronomy_LagrangePoint returned status %d.\n", lp_filename, q.status);
+    vector = Astronomy_HelioVector(BODY_PLUTO, time);
+    if (vector.status != ASTRO_SUCCESS)
+        FFAIL("FAIL - Astronomy_HelioVector returned status = %d\n", vector.status);
 
-        arcmin = ErrorArcmin(p.x, p.y, p.z, q.x, q.y, q.z);
-        if (arcmin > max_pos_arcmin)
-            max_pos_arcmin = arcmin;
-        if (arcmin > 4.9e-5)
-            FAIL("C LagrangeJplGeoMoon(%s, %d): EXCESSIVE position error = %0.6lf arcmin.\n", lp_filename, i, arcmin);
+    dx = V(vector.x) - x;
+    dy = V(vector.y) - y;
+    dz = V(vector.z) - z;
+    diff = sqrt(dx*dx + dy*dy + dz*dz);
+    dist = (sqrt(x*x + y*y + z*z) - 1.0);       /* worst-case distance between Pluto and Earth */
+    arcmin = (diff / dist) * (180.0 * 60.0 / PI);
+    FDEBUG("calc pos = [%20.16lf, %20.16lf, %20.16lf]\n", vector.x, vector.y, vector.z);
+    FDEBUG("ref  pos = [%20.16lf, %20.16lf, %20.16lf]\n", x, y, z);
+    FDEBUG("del  pos = [%20.16lf, %20.16lf, %20.16lf]\n", vector.x - x, vector.y - y, vector.z - z);
+    FDEBUG("diff = %le AU, %0.3lf arcmin\n", diff, arcmin);
+    DEBUG("\n");
 
-        arcmin = ErrorArcmin(p.vx, p.vy, p.vz, q.vx, q.vy, q.vz);
-        if (arcmin > max_vel_arcmin)
-            max_vel_arcmin = arcmin;
-        if (arcmin > 5.45)      /* !!! REPORT TO JPL !!! */
-            FAIL("C LagrangeJplGeoMoon(%s, %d): EXCESSIVE velocity error = %0.6lf arcmin.\n", lp_filename, i, arcmin);
-    }
+    if (V(arcmin) > arcmin_tolerance)
+        FFAIL("EXCESSIVE ERROR\n");
 
-    DEBUG("C LagrangeJplGeoMoon(%s): PASS: %d cases, max pos arcmin = %0.16lf, max vel arcmin = %0.16lf\n", lp_filename, mb.length, max_pos_arcmin, max_vel_arcmin);
+    error = 0;
 fail:
-    FreeStateVectorBatch(&mb);
-    FreeStateVectorBatch(&lp);
     return error;
 }
 
 
-static int LagrangeTest(void)
+static int PlutoCheck(void)
 {
-    int error;  /* set as a side-effect of CHECK macro */
+    int error;
+    CHECK(PlutoCheckDate(  +18250.0, 0.089, +37.4377303523676090, -10.2466292454075898, -14.4773101310875809));
+    CHECK(PlutoCheckDate( -856493.0, 4.067, +23.4292113199166252, +42.1452685817740829,  +6.0580908436642940));
+    CHECK(PlutoCheckDate( +435633.0, 0.016, -27.3178902095231813, +18.5887022581070305, +14.0493896259306936));
+    CHECK(PlutoCheckDate(       0.0, 8.e-9,  -9.8753673425269000, -27.9789270580402771,  -5.7537127596369588));
+    CHECK(PlutoCheckDate( +800916.0, 2.286, -29.5266052645301365, +12.0554287322176474, +12.6878484911631091));
 
-    /* Before verifying against JPL values, do self-consistency checks for L4/L5. */
-    CHECK(VerifyLagrangeTriangle(BODY_EARTH, BODY_MOON, 4));
-    CHECK(VerifyLagrangeTriangle(BODY_EARTH, BODY_MOON, 5));
+    FPASS();
+fail:
+    return error;
+}
 
-    /* Make sure our geocentric moon calculations match JPL's. */
-    CHECK(VerifyGeoMoon("lagrange/geo_moon.txt"));
 
-    /* Try feeding JPL states into Astronomy_LagrangePoint(). */
-    CHECK(LagrangeJplGeoMoon("lagrange/geo_moon.txt", "lagrange/em_L4.txt", 4));
-    CHECK(LagrangeJplGeoMoon("lagrange/geo_moon.txt", "lagrange/em_L5.txt", 5));
+static int PlutoFarTest(void)
+{
+    int error, i, k;
+    astro_context_t *ctx[2] = { NULL, NULL };
+    astro_time_t time;
+    astro_vector_t a, b;
+    astro_state_vector_t state;
+    double diff;
+    static const double tt_list[] =
+    {
+        -730000.0 - 100.0, -730000.0 - 29200.0, -856493.0, -1500000.0, -2000000.5,
+        +730000.0 + 100.0, +730000.0 + 29200.0, +800916.0, +1500000.0, +2000000.5
+    };
+    const int count = (int)(sizeof(tt_list) / sizeof(tt_list[0]));
 
-    /* NOTE: JPL Horizons does not provide L3 calculations. */
+    for (k = 0; k < 2; ++k)
+        if (ASTRO_SUCCESS != Astronomy_ContextCreate(&ctx[k]))
+            FFAIL("Cannot create context %d\n", k);
 
-    CHECK(VerifyStateLagrange(BODY_SUN, BODY_EMB, 1, "lagrange/semb_L1.txt",   1.33e-5, 6.13e-5));
-    CHECK(VerifyStateLagrange(BODY_SUN, BODY_EMB, 2, "lagrange/semb_L2.txt",   1.33e-5, 6.13e-5));
-    CHECK(VerifyStateLagrange(BODY_SUN, BODY_EMB, 4, "lagrange/semb_L4.txt",   3.75e-5, 5.28e-5));
-    CHECK(VerifyStateLagrange(BODY_SUN, BODY_EMB, 5, "lagrange/semb_L5.txt",   3.75e-5, 5.28e-5));
+    /* The cached segments and anchors must not depend on the order of the queries. */
+    for (i = 0; i < count; ++i)
+    {
+        time = Astronomy_TerrestrialTime(tt_list[i]);
+        CHECK_VECTOR(a, Astronomy_HelioVectorCtx(ctx[0], BODY_PLUTO, time));
+        time = Astronomy_TerrestrialTime(tt_list[count-1-i]);
+        CHECK_VECTOR(b, Astronomy_HelioVectorCtx(ctx[1], BODY_PLUTO, time));
+    }
 
-    CHECK(VerifyStateLagrange(BODY_EARTH, BODY_MOON, 1, "lagrange/em_L1.txt",  3.79e-5, 5.06e-5));
-    CHECK(VerifyStateLagrange(BODY_EARTH, BODY_MOON, 2, "lagrange/em_L2.txt",  3.79e-5, 5.06e-5));
-    CHECK(VerifyStateLagrange(BODY_EARTH, BODY_MOON, 4, "lagrange/em_L4.txt",  3.79e-5, 1.59e-3));
-    CHECK(VerifyStateLagrange(BODY_EARTH, BODY_MOON, 5, "lagrange/em_L5.txt",  3.79e-5, 1.59e-3));
+    for (i = 0; i < count; ++i)
+    {
+        time = Astronomy_TerrestrialTime(tt_list[i]);
+        CHECK_VECTOR(a, Astronomy_HelioVectorCtx(ctx[0], BODY_PLUTO, time));
+        CHECK_VECTOR(b, Astronomy_HelioVectorCtx(ctx[1], BODY_PLUTO, time));
+        if (a.x != b.x || a.y != b.y || a.z != b.z)
+            FFAIL("Query order changed the result at tt=%0.1lf\n", tt_list[i]);
+
+        /* A context reset must reproduce exactly the same position. */
+        Astronomy_ContextReset(ctx[1]);
+        CHECK_VECTOR(b, Astronomy_HelioVectorCtx(ctx[1], BODY_PLUTO, time));
+        if (a.x != b.x || a.y != b.y || a.z != b.z)
+            FFAIL("Context reset changed the result at tt=%0.1lf\n", tt_list[i]);
+    }
+
+    /* Positions must be continuous across the boundaries between simulated segments. */
+    for (k = -40; k <= 40; ++k)
+    {
+        if (k >= 0 && k <= 50)
+            continue;
+        time = Astronomy_TerrestrialTime(-730000.0 + k*29200.0 - 1.0e-9);
+        CHECK_VECTOR(a, Astronomy_HelioVectorCtx(ctx[0], BODY_PLUTO, time));
+        time = Astronomy_TerrestrialTime(-730000.0 + k*29200.0 + 1.0e-9);
+        CHECK_VECTOR(b, Astronomy_HelioVectorCtx(ctx[0], BODY_PLUTO, time));
+        diff = V(sqrt((a.x-b.x)*(a.x-b.x) + (a.y-b.y)*(a.y-b.y) + (a.z-b.z)*(a.z-b.z)));
+        if (diff > 1.0e-10)
+            FFAIL("Discontinuity of %le AU at segment boundary %d\n", diff, k);
+    }
+
+    /* Times absurdly far from the present are rejected instead of crawling forever. */
+    state = Astronomy_BaryStateCtx(ctx[0], BODY_PLUTO, Astronomy_TerrestrialTime(1.0e+12));
+    if (state.status != ASTRO_BAD_TIME)
+        FFAIL("Expected ASTRO_BAD_TIME for a distant time, but found status %d\n", state.status);
 
     FPASS();
 fail:
+    Astronomy_ContextFree(ctx[0]);
+    Astronomy_ContextFree(ctx[1]);
     return error;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
 
-static int LoadStateVectors(
-    state_vector_batch_t *batch,
-    const char *filename)
+static int PlutoFileTest(void)
 {
-    int error, lnum, nscanned;
-    int found_begin = 0;
-    int found_end = 0;
-    int part = 0;
+    int error, i, k;
+    astro_status_t status;
+    astro_context_t *ctx[3] = { NULL, NULL, NULL };
+    astro_time_t time;
+    astro_vector_t a, b;
     FILE *infile = NULL;
-    char line[100];
-    double jd;
-    astro_state_vector_t state;
+    FILE *outfile = NULL;
+    char buffer[4096];
+    size_t nread;
+    const char *filename = "temp/c_pluto_segments.bin";
+    const char *badname = "temp/c_pluto_truncated.bin";
 
-    memset(&state, 0, sizeof(state));
+    for (k = 0; k < 3; ++k)
+        if (ASTRO_SUCCESS != Astronomy_ContextCreate(&ctx[k]))
+            FFAIL("Cannot create context %d\n", k);
 
-    infile = fopen(filename, "rt");
-    if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", filename);
+    status = Astronomy_ContextWarmPluto(ctx[0]);
+    if (status != ASTRO_SUCCESS)
+        FFAIL("Astronomy_ContextWarmPluto returned status %d\n", status);
 
-    lnum = 0;
-    while (!found_end && ReadLine(line, sizeof(line), infile, filename, lnum))
+    status = Astronomy_ContextSavePluto(ctx[1], filename);
+    if (status != ASTRO_SUCCESS)
+        FFAIL("Astronomy_ContextSavePluto returned status %d\n", status);
+
+    status = Astronomy_ContextLoadPluto(ctx[2], filename);
+    if (status != ASTRO_SUCCESS)
+        FFAIL("Astronomy_ContextLoadPluto returned status %d\n", status);
+
+    /* Warmed, loaded, and lazily calculated segments must all give exactly the same positions. */
+    for (i = 0; i < 200; ++i)
     {
-        ++lnum;
-        if (!found_begin)
+        time = Astronomy_TerrestrialTime(-730000.0 + 7300.0*i + 0.37);
+        CHECK_VECTOR(a, Astronomy_HelioVector(BODY_PLUTO, time));
+        for (k = 0; k < 3; ++k)
         {
-            if (strlen(line) >= 5 && !memcmp(line, "$$SOE", 5))
-                found_begin = 1;
+            CHECK_VECTOR(b, Astronomy_HelioVectorCtx(ctx[k], BODY_PLUTO, time));
+            if (a.x != b.x || a.y != b.y || a.z != b.z)
+                FFAIL("Context %d mismatch at tt=%0.2lf\n", k, time.tt);
         }
-        else
-        {
-            /*
-                Input comes in triplets of lines:
-
-                2444249.500000000 = A.D. 1980-Jan-11 00:00:00.0000 TDB
-                 X =-3.314860345089456E-01 Y = 8.463418210972562E-01 Z = 3.667227830514760E-01
-                 VX=-1.642704711077836E-02 VY=-5.494770742558920E-03 VZ=-2.383170237527642E-03
-
-                Track which of these 3 cases we are in using the 'part' variable...
-            */
-
-            switch (part)
-            {
-            case 0:
-                if (strlen(line) >= 5 && !memcmp(line, "$$EOE", 5))
-                {
-                    found_end = 1;
-                }
-                else
-                {
-                    nscanned = sscanf(line, "%lf", &jd);
-                    if (nscanned != 1)
-                        FAIL("C LoadStateVectors(%s line %d) ERROR reading Julian date.\n", filename, lnum);
-                    V(jd);
-
-                    /* Convert julian TT day value to astro_time_t. */
-                    state.t = Astronomy_TerrestrialTime(jd - JD_2000);
-                }
-                break;
-
-            case 1:
-                nscanned = sscanf(line, " X =%lf Y =%lf Z =%lf", &state.x, &state.y, &state.z);
-                if (nscanned != 3)
-                    FAIL("C LoadStateVectors(%s line %d) ERROR reading position vector.\n", filename, lnum);
-                V(state.x);
-                V(state.y);
-                V(state.z);
-                break;
-
-            case 2:
-                nscanned = sscanf(line, " VX=%lf VY=%lf VZ=%lf", &state.vx, &state.vy, &state.vz);
-                if (nscanned != 3)
-                    FAIL("C LoadStateVectors(%s line %d) ERROR reading velocity vector.\n", filename, lnum);
-                V(state.vx);
-                V(state.vy);
-                V(state.vz);
-                state.status = ASTRO_SUCCESS;
-                CHECK(AppendStateVector(batch, state));
-                break;
+    }
 
-            default:
-                FFAIL("INTERNAL ERROR : part=%d\n", part);
-            }
+    /* Loading a missing file must fail. */
+    status = Astronomy_ContextLoadPluto(ctx[0], "temp/this_file_does_not_exist.bin");
+    if (status != ASTRO_FILE_ERROR)
+        FFAIL("Expected ASTRO_FILE_ERROR for missing file, but found %d\n", status);
 
-            part = (part + 1) % 3;
-        }
-    }
+    /* Loading a truncated file must fail and leave the context usable. */
+    infile = fopen(filename, "rb");
+    if (infile == NULL)
+        FFAIL("Cannot open file: %s\n", filename);
+    outfile = fopen(badname, "wb");
+    if (outfile == NULL)
+        FFAIL("Cannot open file: %s\n", badname);
+    nread = fread(buffer, 1, sizeof(buffer), infile);
+    if (nread != sizeof(buffer) || nread != fwrite(buffer, 1, nread, outfile))
+        FFAIL("Cannot copy file %s to %s\n", filename, badname);
+    fclose(infile);
+    infile = NULL;
+    fclose(outfile);
+    outfile = NULL;
+
+    status = Astronomy_ContextLoadPluto(ctx[2], badname);
+    if (status != ASTRO_FILE_ERROR)
+        FFAIL("Expected ASTRO_FILE_ERROR for truncated file, but found %d\n", status);
+
+    CHECK_VECTOR(b, Astronomy_HelioVectorCtx(ctx[2], BODY_PLUTO, time));
+    if (a.x != b.x || a.y != b.y || a.z != b.z)
+        FFAIL("Failed load disturbed the context.\n");
+
+    /* Resetting a context releases the loaded file; segments are recalculated as needed. */
+    Astronomy_ContextReset(ctx[2]);
+    CHECK_VECTOR(b, Astronomy_HelioVectorCtx(ctx[2], BODY_PLUTO, time));
+    if (a.x != b.x || a.y != b.y || a.z != b.z)
+        FFAIL("Context reset changed the result.\n");
 
-    error = 0;
+    FPASS();
 fail:
     if (infile != NULL) fclose(infile);
+    if (outfile != NULL) fclose(outfile);
+    for (k = 0; k < 3; ++k)
+        Astronomy_ContextFree(ctx[k]);
     return error;
 }
 
+/*-----------------------------------------------------------------------------------------------------------*/
 
-static astro_vector_t CrossProduct(astro_vector_t a, astro_vector_t b)
+static int GeoidTestCase(FILE *outfile, astro_time_t time, astro_observer_t observer, astro_equator_date_t equdate)
 {
-    astro_vector_t c;
-
-    c.status = ASTRO_SUCCESS;
-    c.t = a.t;
-    c.x = a.y*b.z - a.z*b.y;
-    c.y = a.z*b.x - a.x*b.z;
-    c.z = a.x*b.y - a.y*b.x;
+    int error;
+    astro_state_vector_t state;
+    astro_vector_t surface;
+    astro_vector_t geo_moon;
+    astro_equatorial_t topo_moon;
+    double dx, dy, dz, diff, lat_diff, lon_diff, h_diff;
+    astro_observer_t vobs;
 
-    return c;
-}
+    topo_moon = Astronomy_Equator(BODY_MOON, &time, observer, equdate, NO_ABERRATION);
+    CHECK_STATUS(topo_moon);
 
+    surface = Astronomy_ObserverVector(&time, observer, equdate);
+    CHECK_STATUS(surface);
 
-static int LagrangeJplAnalyzeFiles(
-    const char *mb_filename,        /* filename containing minor body state vectors relative to major body */
-    const char *lp_filename,        /* filename containing Lagrange point state vectors relative to major body */
-    int point)                      /* Lagrange point 1..5 */
-{
-    int error, i;
-    state_vector_batch_t mb = EmptyStateVectorBatch();
-    state_vector_batch_t lp = EmptyStateVectorBatch();
-    double pos_mag_ratio, vel_mag_ratio, angle;
-    double pos_dev, vel_dev, angle_dev;
-    double dr, dv, da;
-    double m_mag, p_mag;
-    astro_state_vector_t m, p;
+    state = Astronomy_ObserverState(&time, observer, equdate);
+    CHECK_STATUS(state);
 
-    /*
-        [Don Cross - 2022-02-12]
-        I am trying to understand how JPL Horizons calculates L4 and L5.
-        So I generated data for heliocentric EMB state vectors
-        and geocentric Moon vectors. This should be enough to run statistics
-        on distance ratios, angles, and planes of alignment (normal vectors).
+    /* Verify state vector's position exactly matches the lone position vector. */
+    if (state.x != surface.x) FFAIL("state vector x = %0.16le, but position vector x = %0.16le\n", state.x, surface.x);
+    if (state.y != surface.y) FFAIL("state vector x = %0.16le, but position vector x = %0.16le\n", state.y, surface.y);
+    if (state.z != surface.z) FFAIL("state vector x = %0.16le, but position vector x = %0.16le\n", state.z, surface.z);
 
-        Quantities I would like to find means and standard deviations for:
-        1. Distance from the major and minor bodies.
-        2. Angle away from the vector from the major body toward the minor body.
-        3. (L4/L5 only) Normal vector to the plane that contains both L4/L5 vector and minor body vector.
-    */
+    if (outfile != NULL)
+    {
+        const double speedConvert = KM_PER_AU / 24.0;   /* converts AU/day into km/hour */
 
-    CHECK(LoadStateVectors(&mb, mb_filename));
-    CHECK(LoadStateVectors(&lp, lp_filename));
-    if (mb.length != lp.length)
-        FFAIL("%d state vectors in %s, but %d in %s\n", mb.length, mb_filename, lp.length, lp_filename);
+        fprintf(
+            outfile,
+            "%d %22.12lf %6.1lf %7.1lf %7.1lf %12.6lf %12.6lf %12.6lf %12.6lf %12.6lf %12.6lf\n",
+            (int)equdate,
+            time.ut,
+            observer.latitude,
+            observer.longitude,
+            observer.height,
+            KM_PER_AU * state.x,
+            KM_PER_AU * state.y,
+            KM_PER_AU * state.z,
+            speedConvert * state.vx,
+            speedConvert * state.vy,
+            speedConvert * state.vz
+        );
+    }
 
-    if (mb.length < 10)
-        FAIL("C LagrangeJplAnalyzeFiles(%s): %d state vectors is not enough for statistical analysis.\n", mb_filename, mb.length);
+    geo_moon = Astronomy_GeoMoon(time);
+    CHECK_STATUS(geo_moon);
 
-    /* Calculate mean values. */
-    angle = pos_mag_ratio = vel_mag_ratio = 0.0;
-    for (i = 0; i < mb.length; ++i)
+    if (equdate == EQUATOR_OF_DATE)
     {
-        m = mb.array[i];
-        p = lp.array[i];
+        /* Astronomy_GeoMoon() returns J2000 coordinates. Convert to equator-of-date coordinates. */
+        astro_rotation_t rot = Astronomy_Rotation_EQJ_EQD(&time);
+        CHECK_STATUS(rot);
+        geo_moon = Astronomy_RotateVector(rot, geo_moon);
+    }
 
-        /* Sanity check that the time offsets match between the two files. */
-        if (m.t.tt != p.t.tt)
-            FAIL("C LagrangeJplAnalyzeFiles(%d, %s): time mismatch", i, lp_filename);
+    dx = KM_PER_AU * V((geo_moon.x - surface.x) - topo_moon.vec.x);
+    dy = KM_PER_AU * V((geo_moon.y - surface.y) - topo_moon.vec.y);
+    dz = KM_PER_AU * V((geo_moon.z - surface.z) - topo_moon.vec.z);
+    diff = sqrt(dx*dx + dy*dy + dz*dz);
+    FDEBUG("equ=%d, tt=%14.5lf, lat=%5.1lf, lon=%6.1lf, ht=%6.1lf, surface=(%12.6lf, %12.6lf, %12.6lf), diff = %9.6lf km\n",
+        (int)equdate,
+        time.tt,
+        observer.latitude,
+        observer.longitude,
+        observer.height,
+        KM_PER_AU * surface.x,
+        KM_PER_AU * surface.y,
+        KM_PER_AU * surface.z,
+        diff);
 
-        m_mag = sqrt(m.x*m.x + m.y*m.y + m.z*m.z);
-        p_mag = sqrt(p.x*p.x + p.y*p.y + p.z*p.z);
-        pos_mag_ratio += p_mag/m_mag;
-        vel_mag_ratio += sqrt((p.vx*p.vx + p.vy*p.vy + p.vz*p.vz) / (m.vx*m.vx + m.vy*m.vy + m.vz*m.vz));
-        angle += ArcCos((m.x*p.x + m.y*p.y + m.z*p.z) / (m_mag * p_mag));
-    }
-    pos_mag_ratio /= mb.length;
-    vel_mag_ratio /= mb.length;
-    angle /= mb.length;
+    /* Require 1 millimeter accuracy! (one millionth of a kilometer). */
+    if (diff > 1.0e-6)
+        FFAIL("EXCESSIVE POSITION ERROR.\n");
 
-    /* Calculate standard deviations. */
-    pos_dev = vel_dev = angle_dev = 0.0;
-    for (i = 0; i < mb.length; ++i)
+    /* Verify that we can convert the surface vector back to an observer. */
+    vobs = Astronomy_VectorObserver(&surface, equdate);
+    lat_diff = ABS(vobs.latitude - observer.latitude);
+
+    /* Longitude is meaningless at the poles, so don't bother checking it there. */
+    if (-89.99 <= observer.latitude && observer.latitude <= +89.99)
     {
-        m = mb.array[i];
-        p = lp.array[i];
-        m_mag = sqrt(m.x*m.x + m.y*m.y + m.z*m.z);
-        p_mag = sqrt(p.x*p.x + p.y*p.y + p.z*p.z);
-        dr = pos_mag_ratio - p_mag/m_mag;
-        dv = vel_mag_ratio - sqrt((p.vx*p.vx + p.vy*p.vy + p.vz*p.vz) / (m.vx*m.vx + m.vy*m.vy + m.vz*m.vz));
-        da = angle - ArcCos((m.x*p.x + m.y*p.y + m.z*p.z) / (m_mag * p_mag));
-        pos_dev += (dr * dr);
-        vel_dev += (dv * dv);
-        angle_dev += (da * da);
+        lon_diff = ABS(vobs.longitude - observer.longitude);
+        if (lon_diff > 180.0)
+            lon_diff = 360.0 - lon_diff;
+        lon_diff = ABS(lon_diff * cos(DEG2RAD * observer.latitude));
+        if (lon_diff > 1.0e-6)
+            FFAIL("EXCESSIVE longitude check error = %lf\n", lon_diff);
     }
-    pos_dev = sqrt(pos_dev / mb.length);
-    vel_dev = sqrt(vel_dev / mb.length);
-    angle_dev = sqrt(angle_dev / mb.length);
-
-    printf("C LagrangeJplAnalyzeFiles(%s): %d samples\n", lp_filename, mb.length);
-    printf("    mag [mean = %0.8lf, dev = %0.8lf]; vel [mean = %0.8lf, dev = %0.8lf]\n",
-        pos_mag_ratio, pos_dev,
-        vel_mag_ratio, vel_dev);
-    printf("    angle [mean = %0.8lf, dev = %0.8lf]\n",
-        angle, angle_dev);
-
-    /* Special case for L4, L5: try to understand the instantaneous co-orbital plane. */
-    if (point == 4 || point == 5)
+    else
     {
-        double max_pole_diff = 0.0;
-        astro_angle_result_t pole_diff;
-        double v_mag;
-        astro_vector_t m_unit, p_unit, mp_norm;
-        astro_vector_t v_unit, mv_norm;
-        m_unit.status = p_unit.status = v_unit.status = ASTRO_SUCCESS;
+        lon_diff = 0.0;
+    }
 
-        for (i = 0; i < mb.length; ++i)
-        {
-            m = mb.array[i];
-            p = lp.array[i];
+    h_diff = ABS(vobs.height - observer.height);
+    FDEBUG("vobs=(lat=%lf, lon=%lf, height=%lf), lat_diff=%lg, lon_diff=%lg, h_diff=%lg\n",
+        vobs.latitude, vobs.longitude, vobs.height, lat_diff, lon_diff, h_diff);
 
-            m_mag = sqrt(m.x*m.x + m.y*m.y + m.z*m.z);
-            m_unit.x = m.x / m_mag;
-            m_unit.y = m.y / m_mag;
-            m_unit.z = m.z / m_mag;
-            m_unit.t = m.t;
+    if (lat_diff > 1.0e-6)
+        FFAIL("EXCESSIVE latitude check error = %lf\n", lat_diff);
 
-            p_mag = sqrt(p.x*p.x + p.y*p.y + p.z*p.z);
-            p_unit.x = p.x / p_mag;
-            p_unit.y = p.y / p_mag;
-            p_unit.z = p.z / p_mag;
-            p_unit.t = p.t;
+    if (h_diff > 0.001)
+        FFAIL("EXCESSIVE height check error = %lf\n", h_diff);
 
-            v_mag = sqrt(m.vx*m.vx + m.vy*m.vy + m.vz*m.vz);
-            v_unit.x = m.vx / v_mag;
-            v_unit.y = m.vy / v_mag;
-            v_unit.z = m.vz / v_mag;
-            v_unit.t = m.t;
+    error = 0;
+fail:
+    return error;
+}
 
-            if (point == 4)
-                mp_norm = CrossProduct(m_unit, p_unit);
-            else
-                mp_norm = CrossProduct(p_unit, m_unit);
 
-            mv_norm = CrossProduct(m_unit, v_unit);
-            pole_diff = Astronomy_AngleBetween(mp_norm, mv_norm);
-            CHECK_STATUS(pole_diff);
-            if (pole_diff.angle > max_pole_diff)
-                max_pole_diff = pole_diff.angle;
+static int GeoidTest(void)
+{
+    int error;
+    int tindex, oindex;
+    astro_time_t time;
+    astro_vector_t vec;
+    astro_observer_t observer;
+    int lat, lon;
+    FILE *outfile = NULL;
+    const char *outFileName = "temp/c_geoid.txt";
+
+    const astro_time_t time_list[] =
+    {
+        Astronomy_MakeTime(1066,  9, 27, 18,  0,  0.0),
+        Astronomy_MakeTime(1970, 12, 13, 15, 42,  0.0),
+        Astronomy_MakeTime(1970, 12, 13, 15, 43,  0.0),
+        Astronomy_MakeTime(2015,  3,  5,  2, 15, 45.0)
+    };
+    const int ntimes = sizeof(time_list) / sizeof(time_list[0]);
+
+    const astro_observer_t observer_list[] =
+    {
+        Astronomy_MakeObserver( +1.5,   +2.7,    7.4),
+        Astronomy_MakeObserver(-53.7, +141.7, +100.0),
+        Astronomy_MakeObserver(+30.0,  -85.2,  -50.0),
+        Astronomy_MakeObserver(+90.0,  +45.0,  -50.0),
+        Astronomy_MakeObserver(-90.0, -180.0,    0.0)
+    };
+    const int nobs = sizeof(observer_list) / sizeof(observer_list[0]);
+
+    /* Make sure Astronomy_ObserverVector() checks for invalid equdate parameter. */
+    time = time_list[0];
+    vec = Astronomy_ObserverVector(&time, observer_list[0], (astro_equator_date_t)42);
+    if (vec.status != ASTRO_INVALID_PARAMETER)
+        FFAIL("Expected ASTRO_INVALID_PARAMETER (%d) but found %d\n", (int)ASTRO_INVALID_PARAMETER, (int)vec.status);
+    FDEBUG("Astronomy_ObserverVector correctly detected invalid astro_equator_date_t parameter.\n");
+
+    /* Test a variety of times and locations, in both supported orientation systems. */
+    /* Also write reference data for comparing with other language implementations. */
+    outfile = fopen(outFileName, "wt");
+    if (outfile == NULL)
+        FFAIL("FAIL - cannot open output file: %s\n", outFileName);
+
+    for (oindex = 0; oindex < nobs; ++oindex)
+    {
+        for (tindex = 0; tindex < ntimes; ++tindex)
+        {
+            CHECK(GeoidTestCase(outfile, time_list[tindex], observer_list[oindex], EQUATOR_J2000));
+            CHECK(GeoidTestCase(outfile, time_list[tindex], observer_list[oindex], EQUATOR_OF_DATE));
         }
-        printf("    max L%d pole diff angle = %0.6lf degrees.\n", point, max_pole_diff);
     }
 
-    /* Special case for L4, L5: confirm velocity vector would leave distances as an equilateral triangle. */
-    /* cppcheck-suppress[duplicateCondition] */
-    if (point == 4 || point == 5)
+    /* More exhaustive tests for a single time value across many different geographic coordinates. */
+    time = Astronomy_MakeTime(2021, 6, 20, 15, 8, 0.0);
+    for (lat = -90; lat <= +90; lat += 1)
     {
-        double a, b, c;      /* distances before v*dt increment */
-        double dx, dy, dz;
-        double ratio;
-        double min_ratio_before = NAN, max_ratio_before = NAN;
-        double min_ratio_after  = NAN, max_ratio_after  = NAN;
-        const double dt = 1.0;
-
-        for (i = 0; i < mb.length; ++i)
+        for (lon = -175; lon <= +180; lon += 5)
         {
-            m = mb.array[i];
-            p = lp.array[i];
+            observer = Astronomy_MakeObserver(lat, lon, 0.0);
+            CHECK(GeoidTestCase(NULL, time, observer, EQUATOR_OF_DATE));
+        }
+    }
 
-            /* a = distance from major body to minor body */
-            a = sqrt(m.x*m.x + m.y*m.y + m.z*m.z);
+    FPASS();
+fail:
+    if (outfile) fclose(outfile);
+    return error;
+}
 
-            /* b = distance from major body to L4/L5 */
-            b = sqrt(p.x*p.x + p.y*p.y + p.z*p.z);
+/*-----------------------------------------------------------------------------------------------------------*/
 
-            /* c = distance from minor body to L4/L5 */
-            dx = p.x - m.x;
-            dy = p.y - m.y;
-            dz = p.z - m.z;
-            c = sqrt(dx*dx + dy*dy + dz*dz);
+static void TrimWhiteSpace(char *line)
+{
+    int len = (int)strlen(line);
+    while (len > 0 && isspace(line[len-1]))
+        line[--len] = '\0';
+}
 
-            ratio = b / a;
-            if (i == 0)
-            {
-                min_ratio_before = max_ratio_before = ratio;
-            }
-            else
-            {
-                if (ratio < min_ratio_before)
-                    min_ratio_before = ratio;
-                if (ratio > max_ratio_before)
-                    max_ratio_before = ratio;
-            }
 
-            ratio = c / a;
-            if (ratio < min_ratio_before)
-                min_ratio_before = ratio;
-            if (ratio > max_ratio_before)
-                max_ratio_before = ratio;
+static int StringStartsWith(const char *text, const char *prefix)
+{
+    int i;
 
-            ratio = c / b;
-            if (ratio < min_ratio_before)
-                min_ratio_before = ratio;
-            if (ratio > max_ratio_before)
-                max_ratio_before = ratio;
+    for (i = 0; prefix[i] != '\0'; ++i)
+        if (text[i] != prefix[i])
+            return 0;
 
-            /* simulate a small movement of the body over a time period dt */
-            dx = m.x + dt*m.vx;
-            dy = m.y + dt*m.vy;
-            dz = m.z + dt*m.vz;
-            a = sqrt(dx*dx + dy*dy + dz*dz);
+    return 1;
+}
 
-            /* simulate straight-line movement of Lagrange point over dt */
-            dx = p.x + dt*p.vx;
-            dy = p.y + dt*p.vy;
-            dz = p.z + dt*p.vz;
-            b = sqrt(dx*dx + dy*dy + dz*dz);
 
-            /* measure extrapolated distance between minor body and Lagrange point */
-            dx -= m.x + dt*m.vx;
-            dy -= m.y + dt*m.vy;
-            dz -= m.z + dt*m.vz;
-            c = sqrt(dx*dx + dy*dy + dz*dz);
+static astro_state_vector_t SelectJupiterMoon(const astro_jupiter_moons_t *jm, int mindex)
+{
+    switch (mindex)
+    {
+        case 0: return jm->io;
+        case 1: return jm->europa;
+        case 2: return jm->ganymede;
+        case 3: return jm->callisto;
+        default:
+            fprintf(stderr, "C FATAL(%s): Invalid mindex = %d\n", __func__, mindex);
+            exit(1);
+    }
+}
 
-            /* All 3 distances (a, b, c) should be the same. */
 
-            ratio = b / a;
-            if (i == 0)
-            {
-                min_ratio_after = max_ratio_after = ratio;
-            }
-            else
-            {
-                if (ratio < min_ratio_after)
-                    min_ratio_after = ratio;
-                if (ratio > max_ratio_after)
-                    max_ratio_after = ratio;
-            }
+static int JupiterMoons_CheckJpl(int mindex, double tt, const double pos[3], const double vel[3])
+{
+    int error;
+    astro_jupiter_moons_t jm;
+    astro_state_vector_t moon;
+    astro_time_t time;
+    double dx, dy, dz, mag, diff;
+    const double pos_tolerance = 9.0e-4;
+    const double vel_tolerance = 9.0e-4;
 
-            ratio = c / a;
-            if (ratio < min_ratio_after)
-                min_ratio_after = ratio;
-            if (ratio > max_ratio_after)
-                max_ratio_after = ratio;
+    time = Astronomy_TerrestrialTime(tt);
 
-            ratio = c / b;
-            if (ratio < min_ratio_after)
-                min_ratio_after = ratio;
-            if (ratio > max_ratio_after)
-                max_ratio_after = ratio;
+    jm = Astronomy_JupiterMoons(time);
+    CHECK_STATUS(jm.io);
+    CHECK_STATUS(jm.europa);
+    CHECK_STATUS(jm.ganymede);
+    CHECK_STATUS(jm.callisto);
+    moon = SelectJupiterMoon(&jm, mindex);
 
-            if (ABS(1.0 - min_ratio_after) > 1.0e-7)
-                FAIL("LagrangeJplAnalyzeFiles(%s): BAD min_ratio_after = %0.15lf\n", lp_filename, min_ratio_after);
+    dx = V(pos[0] - moon.x);
+    dy = V(pos[1] - moon.y);
+    dz = V(pos[2] - moon.z);
+    mag = V(sqrt(pos[0]*pos[0] + pos[1]*pos[1] + pos[2]*pos[2]));
+    diff = V(sqrt(dx*dx + dy*dy + dz*dz) / mag);
+    if (diff > pos_tolerance)
+        FFAIL("(mindex=%d, tt=%0.1lf): excessive position error %le\n", mindex, tt, diff);
 
-            if (ABS(1.0 - max_ratio_after) > 1.0e-7)
-                FAIL("LagrangeJplAnalyzeFiles(%s): BAD max_ratio_after = %0.15lf\n", lp_filename, max_ratio_after);
+    dx = V(vel[0] - moon.vx);
+    dy = V(vel[1] - moon.vy);
+    dz = V(vel[2] - moon.vz);
+    mag = V(sqrt(vel[0]*vel[0] + vel[1]*vel[1] + vel[2]*vel[2]));
+    diff = V(sqrt(dx*dx + dy*dy + dz*dz) / mag);
+    if (diff > vel_tolerance)
+        FFAIL("(mindex=%d, tt=%0.1lf): excessive velocity error %le\n", mindex, tt, diff);
+
+    error = 0;
+fail:
+    return error;
+}
+
+
+static int JupiterMoonsTest(void)
+{
+    int error, mindex, check_mindex, lnum, found, part;
+    double tt = NAN, pos[3] = {NAN, NAN, NAN}, vel[3] = {NAN, NAN, NAN};
+    FILE *infile = NULL;
+    char filename[100];
+    char line[100];
+    const int expected_count = 5001;
+    int count;
+
+    for (mindex = 0; mindex < 4; ++mindex)
+    {
+        snprintf(filename, sizeof(filename), "jupiter_moons/horizons/jm%d.txt", mindex);
+        infile = fopen(filename, "rt");
+        if (infile == NULL)
+            FFAIL("Cannot open input file: %s\n", filename);
+
+        FDEBUG("Comparing against %s\n", filename);
+
+        lnum = 0;
+        found = 0;
+        part = -1;
+        count = 0;
+        while (ReadLine(line, sizeof(line), infile, filename, lnum))
+        {
+            ++lnum;
+            TrimWhiteSpace(line);
+            if (!found)
+            {
+                if (!strcmp(line, "$$SOE"))
+                {
+                    found = 1;
+                    part = 0;
+                }
+                else if (StringStartsWith(line, "Revised:"))
+                {
+                    if (strlen(line) != 79)
+                        FAIL("C JupiterMoonsTest(%s line %d): unexpected line length.\n", filename, lnum);
+                    check_mindex = atoi(&line[76]) - 501;
+                    if (mindex != check_mindex)
+                        FAIL("C JupiterMoonsTest(%s line %d): moon index does not match: check=%d, mindex=%d.\n", filename, lnum, check_mindex, mindex);
+                }
+            }
+            else if (!strcmp(line, "$$EOE"))
+            {
+                break;
+            }
+            else
+            {
+                switch (part)
+                {
+                    case 0:
+                        /* 2446545.000000000 = A.D. 1986-Apr-24 12:00:00.0000 TDB */
+                        if (1 != sscanf(line, "%lf", &tt))
+                            FAIL("C JupiterMoonsTest(%s line %d): failed to read time stamp.\n", filename, lnum);
+                        tt -= JD_2000;    /* convert JD to J2000 TT */
+                        break;
+
+                    case 1:
+                        /* X = 1.134408131605554E-03 Y =-2.590904586750408E-03 Z =-7.490427225904720E-05 */
+                        if (3 != sscanf(line, " X =%lf Y =%lf Z =%lf", &pos[0], &pos[1], &pos[2]))
+                            FAIL("C JupiterMoonsTest(%s line %d): cannot parse position vector.\n", filename, lnum);
+                        break;
+
+                    case 2:
+                        /* VX= 9.148038778472862E-03 VY= 3.973823407182510E-03 VZ= 2.765660368640458E-04 */
+                        if (3 != sscanf(line, " VX=%lf VY=%lf VZ=%lf", &vel[0], &vel[1], &vel[2]))
+                            FAIL("C JupiterMoonsTest(%s line %d): cannot parse velocity vector.\n", filename, lnum);
+                        if (JupiterMoons_CheckJpl(mindex, tt, pos, vel))
+                            FAIL("C JupiterMoonsTest(%s line %d): FAILED VERIFICATION.\n", filename, lnum);
+                        ++count;
+                        break;
+
+                    default:
+                        FAIL("C JupiterMoonsTest(%s line %d): unexpected part = %d.\n", filename, lnum, part);
+                }
+                part = (part + 1) % 3;
+            }
+        }
+
+        fclose(infile);
+        infile = NULL;
+
+        if (count != expected_count)
+            FAIL("C JupiterMoonsTest(%s): expected %d test cases, found %d\n", filename, expected_count, count);
+    }
+
+    FPASS();
+fail:
+    if (infile != NULL) fclose(infile);
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static int Issue103(void)
+{
+    /* https://github.com/cosinekitty/astronomy/issues/103 */
+
+    astro_observer_t observer = Astronomy_MakeObserver(29.0, -81.0, 10.0);
+    double ut = -8.817548982869034808e+04;
+    astro_time_t time = Astronomy_TimeFromDays(ut);
+    astro_body_t body = BODY_VENUS;
+    astro_equatorial_t ofdate = Astronomy_Equator(body, &time, observer, EQUATOR_OF_DATE, ABERRATION);
+    astro_horizon_t hor;
+
+    printf("tt  = %23.16lf\n", time.tt);
+    printf("ra  = %23.16lf\n", ofdate.ra);
+    printf("dec = %23.16lf\n", ofdate.dec);
+    hor = Astronomy_Horizon(&time, observer, ofdate.ra, ofdate.dec, REFRACTION_NONE);
+    printf("az  = %23.16lf\n", hor.azimuth);
+    printf("alt = %23.16lf\n", hor.altitude);
+
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static int AberrationTest(void)
+{
+    int error, lnum, nscanned;
+    int found_begin = 0;
+    int found_end = 0;
+    int count = 0;
+    FILE *infile = NULL;
+    const char *filename = "equatorial/Mars_j2000_ofdate_aberration.txt";
+    char line[100];
+    double jd, jra, jdec, dra, ddec, xra, xdec;
+    astro_time_t time;
+    astro_rotation_t rot;
+    astro_spherical_t eqj_sphere, eqd_sphere;
+    astro_vector_t eqj_vec, eqd_vec;
+    double factor, diff_seconds, max_diff_seconds = 0.0;
+    astro_state_vector_t eqj_earth;
+    const double THRESHOLD_SECONDS = 0.453;
+
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FFAIL("Cannot open input file: %s\n", filename);
+
+    lnum = 0;
+    while (!found_end && ReadLine(line, sizeof(line), infile, filename, lnum))
+    {
+        ++lnum;
+        if (!found_begin)
+        {
+            if (strlen(line) >= 5 && !memcmp(line, "$$SOE", 5))
+                found_begin = 1;
+        }
+        else if (strlen(line) >= 5 && !memcmp(line, "$$EOE", 5))
+        {
+            found_end = 1;
+        }
+        else
+        {
+            /* 2459371.500000000 *   118.566080210  22.210647456 118.874086738  22.155784122 */
+            nscanned = sscanf(line+22, "%lf %lf %lf %lf", &jra, &jdec, &dra, &ddec);
+            if (nscanned != 4)
+                FAIL("C AberrationTest(%s line %d): invalid coordinates\n", filename, lnum);
+
+            nscanned = sscanf(line, "%lf", &jd);
+            if (nscanned != 1)
+                FAIL("C AberrationTest(%s line %d): invalid julian date\n", filename, lnum);
+
+            /* Convert julian day value to astro_time_t. */
+            time = Astronomy_TimeFromDays(jd - JD_2000);
+
+            /* Convert EQJ angular coordinates (jra, jdec) to an EQJ vector. */
+            eqj_sphere.status = ASTRO_SUCCESS;
+            eqj_sphere.lat = jdec;
+            eqj_sphere.lon = jra;       /* JPL Horizons RA is already in degrees, not hours. */
+            eqj_sphere.dist = C_AUDAY;  /* scale to the speed of light, to prepare for aberration correction. */
+            eqj_vec = Astronomy_VectorFromSphere(eqj_sphere, time);
+            CHECK_STATUS(eqj_vec);
+
+            /* Aberration correction: calculate the Earth's barycentric velocity vector in EQJ coordinates. */
+            eqj_earth = Astronomy_BaryState(BODY_EARTH, time);
+            CHECK_STATUS(eqj_earth);
+
+            /* Use non-relativistic approximation: add light vector to Earth velocity vector. */
+            /* This gives aberration-corrected apparent position of the star in EQJ. */
+            eqj_vec.x += eqj_earth.vx;
+            eqj_vec.y += eqj_earth.vy;
+            eqj_vec.z += eqj_earth.vz;
+
+            /* Calculate the rotation matrix that converts J2000 coordinates to of-date coordinates. */
+            rot = Astronomy_Rotation_EQJ_EQD(&time);
+            CHECK_STATUS(rot);
+
+            /* Use the rotation matrix to re-orient the EQJ vector to a EQD vector. */
+            eqd_vec = Astronomy_RotateVector(rot, eqj_vec);
+            CHECK_STATUS(eqd_vec);
+
+            /* Convert the EQD vector back to spherical angular coordinates. */
+            eqd_sphere = Astronomy_SphereFromVector(eqd_vec);
+            CHECK_STATUS(eqd_sphere);
+
+            /* Calculate the differences in RA and DEC between expected and calculated values. */
+            factor = cos(V(eqd_sphere.lat * DEG2RAD));  /* RA errors are less important toward the poles */
+            xra = factor * ABS(eqd_sphere.lon - dra);
+            xdec = ABS(eqd_sphere.lat - ddec);
+            diff_seconds = V(3600.0 * sqrt(xra*xra + xdec*xdec));
+            DEBUG("C AberrationTest(%s line %d): xra=%0.6lf deg, xdec=%0.6lf deg, diff_seconds=%0.3lf.\n", filename, lnum, xra, xdec, diff_seconds);
+            if (diff_seconds > THRESHOLD_SECONDS)
+                FAIL("C AberrationTest(%s line %d): EXCESSIVE ANGULAR ERROR = %0.3lf seconds\n", filename, lnum, diff_seconds);
+            if (diff_seconds > max_diff_seconds)
+                max_diff_seconds = diff_seconds;
+
+            /* We have completed one more test case. */
+            ++count;
+        }
+    }
+
+    printf("C AberrationTest(%s): PASS - Tested %d cases. max_diff_seconds = %0.3lf\n", filename, count, max_diff_seconds);
+    error = 0;
+fail:
+    if (infile != NULL) fclose(infile);
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static double StateVectorDiff(int relative, const double vec[3], double x, double y, double z)
+{
+    double dx = V(vec[0] - x);
+    double dy = V(vec[1] - y);
+    double dz = V(vec[2] - z);
+    double diff_squared = dx*dx + dy*dy + dz*dz;
+    if (relative)
+        diff_squared /= (vec[0]*vec[0] + vec[1]*vec[1] + vec[2]*vec[2]);
+    return V(sqrt(diff_squared));
+}
+
+struct _verify_state_context_t;
+
+typedef astro_state_vector_t (* state_func_t) (struct _verify_state_context_t *, astro_body_t, astro_time_t);
+
+typedef struct _verify_state_context_t
+{
+    state_func_t    func;
+
+    /* The following are used for Lagrange point testing only. */
+    astro_body_t    major;
+    int             point;      /* 1=L1, 2=L2, ..., 5=L5. */
+}
+verify_state_context_t;
+
+static double ArcCos(double x)
+{
+    if (x <= -1.0)
+        return 180.0;
+
+    if (x >= +1.0)
+        return 0.0;
+
+    return RAD2DEG * acos(x);
+}
+
+static void PrintDiagnostic(double x, double y, double z, const double ref[3])
+{
+    double calc_mag, ref_mag, angle;
+
+    calc_mag = sqrt(x*x + y*y + z*z);
+    ref_mag = sqrt(ref[0]*ref[0] + ref[1]*ref[1] + ref[2]*ref[2]);
+    angle = 60.0 * ArcCos((x*ref[0] + y*ref[1] + z*ref[2])/(calc_mag * ref_mag));
+    fprintf(stderr, "CALCULATED x = %22.16le, y = %22.16le, z = %22.16le [mag = %22.16le]\n", x, y, z, calc_mag);
+    fprintf(stderr, "REFERENCE  x = %22.16le, y = %22.16le, z = %22.16le [mag = %22.16le]\n", ref[0], ref[1], ref[2], ref_mag);
+    fprintf(stderr, "ANGLE ERROR = %0.6lf arcmin, MAG ERROR = %0.6lf\n", angle, (calc_mag-ref_mag)/ref_mag);
+}
+
+static int VerifyState(
+    verify_state_context_t *context,
+    double *max_rdiff,
+    double *max_vdiff,
+    astro_body_t body,
+    const char *filename,
+    int lnum,
+    astro_time_t time,
+    const double pos[3],
+    const double vel[3],
+    double r_thresh,
+    double v_thresh)
+{
+    int error;
+    astro_state_vector_t state;
+    double rdiff, vdiff;
+
+    state = context->func(context, body, time);
+    if (state.status != ASTRO_SUCCESS)
+        FAIL("C VerifyState(%s line %d): state function returned error %d\n", filename, lnum, state.status);
+
+    rdiff = StateVectorDiff((r_thresh > 0.0), pos, state.x, state.y, state.z);
+    if (rdiff > *max_rdiff)
+        *max_rdiff = rdiff;
+
+    vdiff = StateVectorDiff((v_thresh > 0.0), vel, state.vx, state.vy, state.vz);
+    if (vdiff > *max_vdiff)
+        *max_vdiff = vdiff;
+
+    if (rdiff > fabs(r_thresh))
+    {
+        PrintDiagnostic(state.x, state.y, state.z, pos);
+        FAIL("C VerifyState(%s line %d): EXCESSIVE position error = %0.4le\n", filename, lnum, rdiff);
+    }
+
+    if (vdiff > fabs(v_thresh))
+    {
+        PrintDiagnostic(state.vx, state.vy, state.vz, vel);
+        FAIL("C VerifyState(%s line %d): EXCESSIVE velocity error = %0.4le\n", filename, lnum, vdiff);
+    }
+
+    error = 0;
+fail:
+    return error;
+}
+
+static int VerifyStateBody(
+    verify_state_context_t *context,
+    astro_body_t body,
+    const char *filename,
+    double r_thresh,
+    double v_thresh)
+{
+    int error, lnum, nscanned;
+    int found_begin = 0;
+    int found_end = 0;
+    int count = 0;
+    int part = 0;
+    FILE *infile = NULL;
+    char line[100];
+    astro_time_t time;
+    double jd, pos[3], vel[3];
+    double max_rdiff = 0.0, max_vdiff = 0.0;
+
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FFAIL("Cannot open input file: %s\n", filename);
+
+    lnum = 0;
+    while (!found_end && ReadLine(line, sizeof(line), infile, filename, lnum))
+    {
+        ++lnum;
+        if (!found_begin)
+        {
+            if (strlen(line) >= 5 && !memcmp(line, "$$SOE", 5))
+                found_begin = 1;
+        }
+        else
+        {
+            /*
+                Input comes in triplets of lines:
+
+                2444249.500000000 = A.D. 1980-Jan-11 00:00:00.0000 TDB
+                 X =-3.314860345089456E-01 Y = 8.463418210972562E-01 Z = 3.667227830514760E-01
+                 VX=-1.642704711077836E-02 VY=-5.494770742558920E-03 VZ=-2.383170237527642E-03
+
+                Track which of these 3 cases we are in using the 'part' variable...
+            */
+
+            switch (part)
+            {
+            case 0:
+                if (strlen(line) >= 5 && !memcmp(line, "$$EOE", 5))
+                {
+                    found_end = 1;
+                }
+                else
+                {
+                    nscanned = sscanf(line, "%lf", &jd);
+                    if (nscanned != 1)
+                        FAIL("C VerifyStateBody(%s line %d) ERROR reading Julian date.\n", filename, lnum);
+                    V(jd);
+
+                    /* Convert julian TT day value to astro_time_t. */
+                    time = Astronomy_TerrestrialTime(jd - JD_2000);
+                }
+                break;
+
+            case 1:
+                nscanned = sscanf(line, " X =%lf Y =%lf Z =%lf", &pos[0], &pos[1], &pos[2]);
+                if (nscanned != 3)
+                    FAIL("C VerifyStateBody(%s line %d) ERROR reading position vector.\n", filename, lnum);
+                V(pos[0]);
+                V(pos[1]);
+                V(pos[2]);
+                break;
+
+            case 2:
+                nscanned = sscanf(line, " VX=%lf VY=%lf VZ=%lf", &vel[0], &vel[1], &vel[2]);
+                if (nscanned != 3)
+                    FAIL("C VerifyStateBody(%s line %d) ERROR reading velocity vector.\n", filename, lnum);
+                V(vel[0]);
+                V(vel[1]);
+                V(vel[2]);
+                CHECK(VerifyState(context, &max_rdiff, &max_vdiff, body, filename, lnum, time, pos, vel, r_thresh, v_thresh));
+                ++count;
+                break;
+
+            default:
+                FFAIL("INTERNAL ERROR : part=%d\n", part);
+            }
+
+            part = (part + 1) % 3;
+        }
+    }
+
+    DEBUG("C VerifyStateBody(%-22s): PASS - Tested %d cases. max rdiff=%0.3le, vdiff=%0.3le\n", filename, count, max_rdiff, max_vdiff);
+    error = 0;
+fail:
+    if (infile != NULL) fclose(infile);
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+/* Constants for use inside unit tests only; they doesn't make sense for public consumption. */
+#define BODY_GEOMOON    ((astro_body_t)(-100))
+#define BODY_GEO_EMB    ((astro_body_t)(-101))
+
+static astro_state_vector_t BaryState(verify_state_context_t *context, astro_body_t body, astro_time_t time)
+{
+    (void)context;
+
+    if (body == BODY_GEOMOON)
+        return Astronomy_GeoMoonState(time);
+
+    if (body == BODY_GEO_EMB)
+        return Astronomy_GeoEmbState(time);
+
+    return Astronomy_BaryState(body, time);
+}
+
+static int BaryStateTest(void)
+{
+    int error;  /* set as a side-effect of CHECK macro */
+    verify_state_context_t context;
+
+    memset(&context, 0, sizeof(context));
+    context.func = BaryState;
+
+    CHECK(VerifyStateBody(&context, BODY_SUN,     "barystate/Sun.txt",      -1.224e-05, -1.134e-07));
+    CHECK(VerifyStateBody(&context, BODY_MERCURY, "barystate/Mercury.txt",   1.672e-04,  2.698e-04));
+    CHECK(VerifyStateBody(&context, BODY_VENUS,   "barystate/Venus.txt",     4.123e-05,  4.308e-05));
+    CHECK(VerifyStateBody(&context, BODY_EARTH,   "barystate/Earth.txt",     2.296e-05,  6.359e-05));
+    CHECK(VerifyStateBody(&context, BODY_MARS,    "barystate/Mars.txt",      3.107e-05,  5.550e-05));
+    CHECK(VerifyStateBody(&context, BODY_JUPITER, "barystate/Jupiter.txt",   7.389e-05,  2.471e-04));
+    CHECK(VerifyStateBody(&context, BODY_SATURN,  "barystate/Saturn.txt",    1.067e-04,  3.220e-04));
+    CHECK(VerifyStateBody(&context, BODY_URANUS,  "barystate/Uranus.txt",    9.035e-05,  2.519e-04));
+    CHECK(VerifyStateBody(&context, BODY_NEPTUNE, "barystate/Neptune.txt",   9.838e-05,  4.446e-04));
+    CHECK(VerifyStateBody(&context, BODY_PLUTO,   "barystate/Pluto.txt",     4.259e-05,  7.827e-05));
+    CHECK(VerifyStateBody(&context, BODY_MOON,    "barystate/Moon.txt",      2.354e-05,  6.604e-05));
+    CHECK(VerifyStateBody(&context, BODY_EMB,     "barystate/EMB.txt",       2.353e-05,  6.511e-05));
+    CHECK(VerifyStateBody(&context, BODY_GEOMOON, "barystate/GeoMoon.txt",   4.086e-05,  5.347e-05));
+    CHECK(VerifyStateBody(&context, BODY_GEO_EMB, "barystate/GeoEMB.txt",    4.076e-05,  5.335e-05));
+
+    FPASS();
+fail:
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static astro_state_vector_t HelioStateFunc(verify_state_context_t *context, astro_body_t body, astro_time_t time)
+{
+    (void)context;
+    return Astronomy_HelioState(body, time);
+}
+
+static int HelioStateTest(void)
+{
+    int error;  /* set as a side-effect of CHECK macro */
+    verify_state_context_t context;
+
+    memset(&context, 0, sizeof(context));
+    context.func = HelioStateFunc;
+
+    CHECK(VerifyStateBody(&context, BODY_SSB,     "heliostate/SSB.txt",     -1.209e-05, -1.125e-07));
+    CHECK(VerifyStateBody(&context, BODY_MERCURY, "heliostate/Mercury.txt",  1.481e-04,  2.756e-04));
+    CHECK(VerifyStateBody(&context, BODY_VENUS,   "heliostate/Venus.txt",    3.528e-05,  4.485e-05));
+    CHECK(VerifyStateBody(&context, BODY_EARTH,   "heliostate/Earth.txt",    1.476e-05,  6.105e-05));
+    CHECK(VerifyStateBody(&context, BODY_MARS,    "heliostate/Mars.txt",     3.154e-05,  5.603e-05));
+    CHECK(VerifyStateBody(&context, BODY_JUPITER, "heliostate/Jupiter.txt",  7.455e-05,  2.562e-04));
+    CHECK(VerifyStateBody(&context, BODY_SATURN,  "heliostate/Saturn.txt",   1.066e-04,  3.150e-04));
+    CHECK(VerifyStateBody(&context, BODY_URANUS,  "heliostate/Uranus.txt",   9.034e-05,  2.712e-04));
+    CHECK(VerifyStateBody(&context, BODY_NEPTUNE, "heliostate/Neptune.txt",  9.834e-05,  4.534e-04));
+    CHECK(VerifyStateBody(&context, BODY_PLUTO,   "heliostate/Pluto.txt",    4.271e-05,  1.198e-04));
+    CHECK(VerifyStateBody(&context, BODY_MOON,    "heliostate/Moon.txt",     1.477e-05,  6.195e-05));
+    CHECK(VerifyStateBody(&context, BODY_EMB,     "heliostate/EMB.txt",      1.476e-05,  6.106e-05));
+
+    FPASS();
+fail:
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static int BatchTest(void)
+{
+    int error, a;
+    size_t i, b;
+    astro_aberration_t aberration;
+    astro_status_t status;
+    astro_vector_t vec;
+    astro_state_vector_t state;
+    astro_time_t times[50];
+    double xyz[3*50];
+    double state_out[6*50];
+    const size_t n = sizeof(times) / sizeof(times[0]);
+    const astro_body_t body_list[] =
+    {
+        BODY_SUN, BODY_MOON, BODY_MERCURY, BODY_VENUS, BODY_EARTH, BODY_MARS,
+        BODY_JUPITER, BODY_SATURN, BODY_URANUS, BODY_NEPTUNE, BODY_PLUTO, BODY_EMB
+    };
+    const size_t nbodies = sizeof(body_list) / sizeof(body_list[0]);
+
+    for (i = 0; i < n; ++i)
+        times[i] = Astronomy_MakeTime(1950 + (int)i*3, 1 + (int)(i % 12), 7, 13, 28, 11.0);
+
+    /* The batch functions must return exactly the same values as the corresponding single-time functions. */
+    for (b = 0; b < nbodies; ++b)
+    {
+        status = Astronomy_HelioVectorBatch(body_list[b], times, n, xyz);
+        if (status != ASTRO_SUCCESS)
+            FFAIL("HelioVectorBatch(%s) returned status %d\n", Astronomy_BodyName(body_list[b]), status);
+
+        for (i = 0; i < n; ++i)
+        {
+            CHECK_VECTOR(vec, Astronomy_HelioVector(body_list[b], times[i]));
+            if (vec.x != xyz[i] || vec.y != xyz[n+i] || vec.z != xyz[2*n+i])
+                FFAIL("HelioVectorBatch(%s) mismatch at index %d\n", Astronomy_BodyName(body_list[b]), (int)i);
+        }
+
+        for (a = 0; a < 2 && body_list[b] != BODY_EMB; ++a)
+        {
+            aberration = a ? ABERRATION : NO_ABERRATION;
+            status = Astronomy_GeoVectorBatch(body_list[b], times, n, aberration, xyz);
+            if (status != ASTRO_SUCCESS)
+                FFAIL("GeoVectorBatch(%s, %d) returned status %d\n", Astronomy_BodyName(body_list[b]), a, status);
+
+            for (i = 0; i < n; ++i)
+            {
+                CHECK_VECTOR(vec, Astronomy_GeoVector(body_list[b], times[i], aberration));
+                if (vec.x != xyz[i] || vec.y != xyz[n+i] || vec.z != xyz[2*n+i])
+                    FFAIL("GeoVectorBatch(%s, %d) mismatch at index %d\n", Astronomy_BodyName(body_list[b]), a, (int)i);
+            }
+        }
+
+        status = Astronomy_BaryStateBatch(body_list[b], times, n, state_out);
+        if (status != ASTRO_SUCCESS)
+            FFAIL("BaryStateBatch(%s) returned status %d\n", Astronomy_BodyName(body_list[b]), status);
+
+        for (i = 0; i < n; ++i)
+        {
+            state = Astronomy_BaryState(body_list[b], times[i]);
+            CHECK_STATUS(state);
+            if (state.x  != state_out[i]     || state.y  != state_out[n+i]   || state.z  != state_out[2*n+i] ||
+                state.vx != state_out[3*n+i] || state.vy != state_out[4*n+i] || state.vz != state_out[5*n+i])
+                FFAIL("BaryStateBatch(%s) mismatch at index %d\n", Astronomy_BodyName(body_list[b]), (int)i);
+        }
+    }
+
+    /* Verify that errors are reported for the whole batch. */
+    status = Astronomy_HelioVectorBatch(BODY_INVALID, times, n, xyz);
+    if (status != ASTRO_INVALID_BODY)
+        FFAIL("Expected ASTRO_INVALID_BODY for invalid body, but found %d\n", status);
+
+    status = Astronomy_BaryStateBatch(BODY_EARTH, NULL, n, state_out);
+    if (status != ASTRO_INVALID_PARAMETER)
+        FFAIL("Expected ASTRO_INVALID_PARAMETER for NULL times, but found %d\n", status);
+
+    /* An empty batch is trivially successful, even with NULL arrays. */
+    status = Astronomy_GeoVectorBatch(BODY_MARS, NULL, 0, NO_ABERRATION, NULL);
+    if (status != ASTRO_SUCCESS)
+        FFAIL("Expected ASTRO_SUCCESS for empty batch, but found %d\n", status);
+
+    FPASS();
+fail:
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static double DeltaT_Zero(double ut)
+{
+    (void)ut;
+    return 0.0;
+}
+
+
+static int ContextTest(void)
+{
+    int error, i;
+    astro_status_t status;
+    astro_context_t *ctx = NULL;
+    astro_time_t time, ctx_time;
+    astro_vector_t a, b;
+    astro_state_vector_t sa, sb;
+    astro_constellation_t ca, cb;
+
+    status = Astronomy_ContextCreate(&ctx);
+    if (status != ASTRO_SUCCESS)
+        FFAIL("Astronomy_ContextCreate returned status %d\n", status);
+
+    /* A separate context must produce exactly the same results as the default context. */
+    for (i = 0; i < 20; ++i)
+    {
+        time = Astronomy_MakeTime(1700 + 37*i, 1 + (i % 12), 15, 6, 0, 0.0);
+        ctx_time = Astronomy_MakeTimeCtx(ctx, 1700 + 37*i, 1 + (i % 12), 15, 6, 0, 0.0);
+        if (time.ut != ctx_time.ut || time.tt != ctx_time.tt)
+            FFAIL("MakeTimeCtx mismatch at i=%d\n", i);
+
+        CHECK_VECTOR(a, Astronomy_HelioVector(BODY_PLUTO, time));
+        CHECK_VECTOR(b, Astronomy_HelioVectorCtx(ctx, BODY_PLUTO, time));
+        if (a.x != b.x || a.y != b.y || a.z != b.z)
+            FFAIL("HelioVectorCtx(Pluto) mismatch at i=%d\n", i);
+
+        CHECK_VECTOR(a, Astronomy_GeoVector(BODY_PLUTO, time, ABERRATION));
+        CHECK_VECTOR(b, Astronomy_GeoVectorCtx(ctx, BODY_PLUTO, time, ABERRATION));
+        if (a.x != b.x || a.y != b.y || a.z != b.z)
+            FFAIL("GeoVectorCtx(Pluto) mismatch at i=%d\n", i);
+
+        sa = Astronomy_BaryState(BODY_PLUTO, time);
+        CHECK_STATUS(sa);
+        sb = Astronomy_BaryStateCtx(ctx, BODY_PLUTO, time);
+        CHECK_STATUS(sb);
+        if (sa.x != sb.x || sa.y != sb.y || sa.z != sb.z || sa.vx != sb.vx || sa.vy != sb.vy || sa.vz != sb.vz)
+            FFAIL("BaryStateCtx(Pluto) mismatch at i=%d\n", i);
+
+        ca = Astronomy_Constellation(1.2*i, 8.5*i - 80.0);
+        CHECK_STATUS(ca);
+        cb = Astronomy_ConstellationCtx(ctx, 1.2*i, 8.5*i - 80.0);
+        CHECK_STATUS(cb);
+        if (strcmp(ca.symbol, cb.symbol) || ca.ra_1875 != cb.ra_1875 || ca.dec_1875 != cb.dec_1875)
+            FFAIL("ConstellationCtx mismatch at i=%d\n", i);
+    }
+
+    /* Resetting the default context must not disturb the separate context. */
+    CHECK_VECTOR(a, Astronomy_HelioVectorCtx(ctx, BODY_PLUTO, time));
+    Astronomy_Reset();
+    CHECK_VECTOR(b, Astronomy_HelioVectorCtx(ctx, BODY_PLUTO, time));
+    if (a.x != b.x || a.y != b.y || a.z != b.z)
+        FFAIL("HelioVectorCtx(Pluto) changed after Astronomy_Reset.\n");
+
+    /* Changing the Delta T model of a context must not affect the default context. */
+    Astronomy_ContextSetDeltaTFunction(ctx, DeltaT_Zero);
+    time = Astronomy_MakeTime(1900, 1, 1, 0, 0, 0.0);
+    ctx_time = Astronomy_MakeTimeCtx(ctx, 1900, 1, 1, 0, 0, 0.0);
+    if (ctx_time.tt != ctx_time.ut)
+        FFAIL("Context Delta T model was not used: ut=%0.12lf, tt=%0.12lf\n", ctx_time.ut, ctx_time.tt);
+    if (time.tt == time.ut)
+        FFAIL("Default Delta T model was changed by the context.\n");
+
+    ctx_time = Astronomy_AddDaysCtx(ctx, ctx_time, 1.5);
+    if (ctx_time.tt != ctx_time.ut)
+        FFAIL("AddDaysCtx did not use the context Delta T model.\n");
+
+    ctx_time = Astronomy_TerrestrialTimeCtx(ctx, 123.456);
+    if (ctx_time.ut != 123.456)
+        FFAIL("TerrestrialTimeCtx did not use the context Delta T model.\n");
+
+    FPASS();
+fail:
+    Astronomy_ContextFree(ctx);
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static astro_state_vector_t LagrangeFunc(verify_state_context_t *context, astro_body_t minor_body, astro_time_t time)
+{
+    return Astronomy_LagrangePoint(
+        context->point,
+        time,
+        context->major,
+        minor_body
+    );
+}
+
+
+static int VerifyStateLagrange(
+    astro_body_t majorBody,
+    astro_body_t minorBody,
+    int point,
+    const char *filename,
+    double r_thresh,
+    double v_thresh)
+{
+    verify_state_context_t context;
+    memset(&context, 0, sizeof(context));
+    context.func = LagrangeFunc;
+    context.major = majorBody;
+    context.point = point;
+    return VerifyStateBody(&context, minorBody, filename, r_thresh, v_thresh);
+}
+
+
+static int VerifyEquilateral(
+    const char *kind,
+    astro_body_t major_body,
+    astro_body_t minor_body,
+    int point,
+    astro_time_t time,
+    double mx,
+    double my,
+    double mz,
+    double px,
+    double py,
+    double pz,
+    double *max_diff,
+    double *max_arcmin)
+{
+    int error = 0;
+    const double LENGTH_TOLERANCE = 1.0e-15;
+    const double ARCMIN_TOLERANCE = 3.0e-12;
+    double dx, dy, dz, dlength;
+    double mlength, plength, diff, dotprod;
+    double arcmin;
+    char tag[100];
+
+    snprintf(tag, sizeof(tag),
+        "C VerifyEquilateral(%s,%s,%s,L%d,tt=%0.3lf)",
+        kind,
+        Astronomy_BodyName(major_body),
+        Astronomy_BodyName(minor_body),
+        point,
+        time.tt
+    );
+
+    /* Verify minor body vector and Lagrange point vector are the same length. */
+    mlength = sqrt(mx*mx + my*my + mz*mz);
+    plength = sqrt(px*px + py*py + pz*pz);
+    diff = ABS((plength - mlength) / mlength);
+    if (diff > LENGTH_TOLERANCE)
+        FAIL("%s: FAIL mlength = %0.6le, plength = %0.6le, diff = %0.6le\n", tag, mlength, plength, diff);
+    if (diff > *max_diff)
+        *max_diff = diff;
+
+    /* Verify the third triangle leg (minor body to Lagrange point) is also the same length. */
+    dx = px - mx;
+    dy = py - my;
+    dz = pz - mz;
+    dlength = sqrt(dx*dx + dy*dy + dz*dz);
+    diff = ABS((dlength - mlength) / mlength);
+    if (diff > LENGTH_TOLERANCE)
+        FAIL("%s: FAIL mlength = %0.6le, dlength = %0.6le, diff = %0.6le\n", tag, mlength, dlength, diff);
+    if (diff > *max_diff)
+        *max_diff = diff;
+
+    /* The 3 mutual angles should all be 60 degrees. */
+    dotprod = (mx*px + my*py + mz*pz) / (mlength * plength);
+    arcmin = ABS(60.0 * (60.0 - ArcCos(dotprod)));
+    if (arcmin > ARCMIN_TOLERANCE)
+        FAIL("%s: FAIL m/p angle error = %0.6le arcmin.\n", tag, arcmin);
+    if (arcmin > *max_arcmin)
+        *max_arcmin = arcmin;
+
+    dotprod = -(mx*dx + my*dy + mz*dz) / (mlength * dlength);       /* negate because pointing opposite dirs */
+    arcmin = ABS(60.0 * (60.0 - ArcCos(dotprod)));
+    if (arcmin > ARCMIN_TOLERANCE)
+        FAIL("%s: FAIL m/d angle error = %0.6le arcmin.\n", tag, arcmin);
+    if (arcmin > *max_arcmin)
+        *max_arcmin = arcmin;
+
+    dotprod = (px*dx + py*dy + pz*dz) / (plength * dlength);       /* negate because pointing opposite dirs */
+    arcmin = ABS(60.0 * (60.0 - ArcCos(dotprod)));
+    if (arcmin > ARCMIN_TOLERANCE)
+        FAIL("%s: FAIL p/d angle error = %0.6le arcmin.\n", tag, arcmin);
+    if (arcmin > *max_arcmin)
+        *max_arcmin = arcmin;
+
+fail:
+    if (error != 0) printf("%s: returning %d\n", tag, error);
+    return error;
+}
+
+
+static int VerifyLagrangeTriangle(astro_body_t major_body, astro_body_t minor_body, int point)
+{
+    int error, count;
+    char tag[100];
+    astro_state_vector_t major_state, minor_state, point_state;
+    double major_mass, minor_mass;
+    const double tt1 = 7335.5;      /* 2020-02-01T00:00Z */
+    const double tt2 = 7425.5;      /* 2020-05-01T00:00Z */
+    const double dt = 0.125;        /* 1/8 is exactly represented in binary */
+    astro_time_t time;
+    double max_pos_diff = 0.0, max_pos_arcmin = 0.0;
+    double max_vel_diff = 0.0, max_vel_arcmin = 0.0;
+
+    snprintf(tag, sizeof(tag),
+        "C VerifyLagrangeTriangle(%s,%s,L%d)",
+        Astronomy_BodyName(major_body),
+        Astronomy_BodyName(minor_body),
+        point
+    );
+
+    if (point != 4 && point != 5)
+        FAIL("%s: Invalid Lagrange point %d\n", tag, point);
+
+    major_mass = Astronomy_MassProduct(major_body);
+    if (major_mass <= 0.0)
+        FAIL("%s: Invalid mass product for major body.\n", tag);
+
+    minor_mass = Astronomy_MassProduct(minor_body);
+    if (minor_mass <= 0.0)
+        FAIL("%s: Invalid mass product for minor body.\n", tag);
+
+    count = 0;
+    time = Astronomy_TerrestrialTime(tt1);
+    while (time.tt <= tt2)
+    {
+        ++count;
+
+        major_state = Astronomy_HelioState(major_body, time);
+        if (major_state.status != ASTRO_SUCCESS)
+            FAIL("%s: HelioState failed for major body.\n", tag);
+
+        minor_state = Astronomy_HelioState(minor_body, time);
+        if (minor_state.status != ASTRO_SUCCESS)
+            FAIL("%s: HelioState failed for minor body.\n", tag);
+
+        point_state = Astronomy_LagrangePointFast(point, major_state, major_mass, minor_state, minor_mass);
+        if (point_state.status != ASTRO_SUCCESS)
+            FAIL("%s: Astronomy_LagrangePoint returned status = %d\n", tag, point_state.status);
+
+        /* Verify the (major, minor, L4/L5) triangle is equilateral, both in position and velocity. */
+        CHECK(VerifyEquilateral(
+            "position",
+            major_body,
+            minor_body,
+            point,
+            time,
+            minor_state.x - major_state.x,
+            minor_state.y - major_state.y,
+            minor_state.z - major_state.z,
+            point_state.x,
+            point_state.y,
+            point_state.z,
+            &max_pos_diff,
+            &max_pos_arcmin
+        ));
+
+        CHECK(VerifyEquilateral(
+            "velocity",
+            major_body,
+            minor_body,
+            point,
+            time,
+            minor_state.vx - major_state.vx,
+            minor_state.vy - major_state.vy,
+            minor_state.vz - major_state.vz,
+            point_state.vx,
+            point_state.vy,
+            point_state.vz,
+            &max_vel_diff,
+            &max_vel_arcmin
+        ));
+
+        time = Astronomy_TerrestrialTime(time.tt + dt);
+    }
+
+    if (Verbose)
+    {
+        printf("%s: PASS (%d cases)\n", tag, count);
+        printf("    max_pos_diff = %0.3le, max_vel_diff = %0.3le\n", max_pos_diff, max_vel_diff);
+        printf("    max_pos_arcmin = %0.3le, max_vel_arcmin = %0.3le\n", max_pos_arcmin, max_vel_arcmin);
+    }
+    error = 0;
+fail:
+    return error;
+}
+
+
+static int VerifyGeoMoon(const char *filename)
+{
+    verify_state_context_t context;
+
+    memset(&context, 0, sizeof(context));
+    context.func = BaryState;
+    return VerifyStateBody(&context, BODY_GEOMOON, filename, 3.777e-5, 5.047e-5);
+}
+
+
+static double ErrorArcmin(
+    double ax, double ay, double az,
+    double bx, double by, double bz)
+{
+    double dx = ax - bx;
+    double dy = ay - by;
+    double dz = az - bz;
+    double error = sqrt(dx*dx + dy*dy + dz*dz);
+    double mag = sqrt(ax*ax + ay*ay + az*az);
+    return (error / mag) * (RAD2DEG * 60.0);
+}
+
+
+static int LagrangeJplGeoMoon(const char *mb_filename, const char *lp_filename, int point)
+{
+    int error, i;
+    double major_mass, minor_mass;
+    astro_state_vector_t major;
+    astro_state_vector_t m, p, q;
+    state_vector_batch_t mb = EmptyStateVectorBatch();
+    state_vector_batch_t lp = EmptyStateVectorBatch();
+    double arcmin;
+    double max_pos_arcmin = 0.0;
+    double max_vel_arcmin = 0.0;
+
+    /* The major body is the Earth, and we do everything geocentrically. */
+    major.x = major.y = major.z = 0.0;
+    major.vx = major.vy = major.vz = 0.0;
+    memset(&major.t, 0, sizeof(major.t));
+    major.status = ASTRO_SUCCESS;
+
+    major_mass = Astronomy_MassProduct(BODY_EARTH);
+    if (major_mass <= 0.0)
+        FAIL("LagrangeJplGeoMoon: cannot find Earth mass\n");
+
+    minor_mass = Astronomy_MassProduct(BODY_MOON);
+    if (minor_mass <= 0.0)
+        FAIL("LagrangeJplGeoMoon: cannot find Moon mass\n");
+
+    /* Use state vectors provided by JPL to calculate Lagrange points. */
+    /* Compare calculated Lagrange points against JPL Lagrange points. */
+
+    CHECK(LoadStateVectors(&mb, mb_filename));
+    CHECK(LoadStateVectors(&lp, lp_filename));
+    if (mb.length != lp.length)
+        FFAIL("%s has %d states, but %s has %d\n", mb_filename, mb.length, lp_filename, lp.length);
+
+    for (i = 0; i < mb.length; ++i)
+    {
+        m = mb.array[i];
+        p = lp.array[i];
+        if (m.t.tt != p.t.tt)
+            FAIL("C LagrangeJplGeoMoon(%s): mismatching time: %0.16lf != %0.16lf.\n", lp_filename, m.t.tt, p.t.tt);
+
+        major.t = m.t;
+        q = Astronomy_LagrangePointFast(point, major, major_mass, m, minor_mass);
+        if (q.status != ASTRO_SUCCESS)
+            FAIL("C LagrangeJplGeoMoon(%s): Astronomy_LagrangePoint returned status %d.\n", lp_filename, q.status);
+
+        arcmin = ErrorArcmin(p.x, p.y, p.z, q.x, q.y, q.z);
+        if (arcmin > max_pos_arcmin)
+            max_pos_arcmin = arcmin;
+        if (arcmin > 4.9e-5)
+            FAIL("C LagrangeJplGeoMoon(%s, %d): EXCESSIVE position error = %0.6lf arcmin.\n", lp_filename, i, arcmin);
+
+        arcmin = ErrorArcmin(p.vx, p.vy, p.vz, q.vx, q.vy, q.vz);
+        if (arcmin > max_vel_arcmin)
+            max_vel_arcmin = arcmin;
+        if (arcmin > 5.45)      /* !!! REPORT TO JPL !!! */
+            FAIL("C LagrangeJplGeoMoon(%s, %d): EXCESSIVE velocity error = %0.6lf arcmin.\n", lp_filename, i, arcmin);
+    }
+
+    DEBUG("C LagrangeJplGeoMoon(%s): PASS: %d cases, max pos arcmin = %0.16lf, max vel arcmin = %0.16lf\n", lp_filename, mb.length, max_pos_arcmin, max_vel_arcmin);
+fail:
+    FreeStateVectorBatch(&mb);
+    FreeStateVectorBatch(&lp);
+    return error;
+}
+
+
+static int LagrangeTest(void)
+{
+    int error;  /* set as a side-effect of CHECK macro */
+
+    /* Before verifying against JPL values, do self-consistency checks for L4/L5. */
+    CHECK(VerifyLagrangeTriangle(BODY_EARTH, BODY_MOON, 4));
+    CHECK(VerifyLagrangeTriangle(BODY_EARTH, BODY_MOON, 5));
+
+    /* Make sure our geocentric moon calculations match JPL's. */
+    CHECK(VerifyGeoMoon("lagrange/geo_moon.txt"));
+
+    /* Try feeding JPL states into Astronomy_LagrangePoint(). */
+    CHECK(LagrangeJplGeoMoon("lagrange/geo_moon.txt", "lagrange/em_L4.txt", 4));
+    CHECK(LagrangeJplGeoMoon("lagrange/geo_moon.txt", "lagrange/em_L5.txt", 5));
+
+    /* NOTE: JPL Horizons does not provide L3 calculations. */
+
+    CHECK(VerifyStateLagrange(BODY_SUN, BODY_EMB, 1, "lagrange/semb_L1.txt",   1.33e-5, 6.13e-5));
+    CHECK(VerifyStateLagrange(BODY_SUN, BODY_EMB, 2, "lagrange/semb_L2.txt",   1.33e-5, 6.13e-5));
+    CHECK(VerifyStateLagrange(BODY_SUN, BODY_EMB, 4, "lagrange/semb_L4.txt",   3.75e-5, 5.28e-5));
+    CHECK(VerifyStateLagrange(BODY_SUN, BODY_EMB, 5, "lagrange/semb_L5.txt",   3.75e-5, 5.28e-5));
+
+    CHECK(VerifyStateLagrange(BODY_EARTH, BODY_MOON, 1, "lagrange/em_L1.txt",  3.79e-5, 5.06e-5));
+    CHECK(VerifyStateLagrange(BODY_EARTH, BODY_MOON, 2, "lagrange/em_L2.txt",  3.79e-5, 5.06e-5));
+    CHECK(VerifyStateLagrange(BODY_EARTH, BODY_MOON, 4, "lagrange/em_L4.txt",  3.79e-5, 1.59e-3));
+    CHECK(VerifyStateLagrange(BODY_EARTH, BODY_MOON, 5, "lagrange/em_L5.txt",  3.79e-5, 1.59e-3));
+
+    FPASS();
+fail:
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static int LoadStateVectors(
+    state_vector_batch_t *batch,
+    const char *filename)
+{
+    int error, lnum, nscanned;
+    int found_begin = 0;
+    int found_end = 0;
+    int part = 0;
+    FILE *infile = NULL;
+    char line[100];
+    double jd;
+    astro_state_vector_t state;
+
+    memset(&state, 0, sizeof(state));
+
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FFAIL("Cannot open input file: %s\n", filename);
+
+    lnum = 0;
+    while (!found_end && ReadLine(line, sizeof(line), infile, filename, lnum))
+    {
+        ++lnum;
+        if (!found_begin)
+        {
+            if (strlen(line) >= 5 && !memcmp(line, "$$SOE", 5))
+                found_begin = 1;
+        }
+        else
+        {
+            /*
+                Input comes in triplets of lines:
+
+                2444249.500000000 = A.D. 1980-Jan-11 00:00:00.0000 TDB
+                 X =-3.314860345089456E-01 Y = 8.463418210972562E-01 Z = 3.667227830514760E-01
+                 VX=-1.642704711077836E-02 VY=-5.494770742558920E-03 VZ=-2.383170237527642E-03
+
+                Track which of these 3 cases we are in using the 'part' variable...
+            */
+
+            switch (part)
+            {
+            case 0:
+                if (strlen(line) >= 5 && !memcmp(line, "$$EOE", 5))
+                {
+                    found_end = 1;
+                }
+                else
+                {
+                    nscanned = sscanf(line, "%lf", &jd);
+                    if (nscanned != 1)
+                        FAIL("C LoadStateVectors(%s line %d) ERROR reading Julian date.\n", filename, lnum);
+                    V(jd);
+
+                    /* Convert julian TT day value to astro_time_t. */
+                    state.t = Astronomy_TerrestrialTime(jd - JD_2000);
+                }
+                break;
+
+            case 1:
+                nscanned = sscanf(line, " X =%lf Y =%lf Z =%lf", &state.x, &state.y, &state.z);
+                if (nscanned != 3)
+                    FAIL("C LoadStateVectors(%s line %d) ERROR reading position vector.\n", filename, lnum);
+                V(state.x);
+                V(state.y);
+                V(state.z);
+                break;
+
+            case 2:
+                nscanned = sscanf(line, " VX=%lf VY=%lf VZ=%lf", &state.vx, &state.vy, &state.vz);
+                if (nscanned != 3)
+                    FAIL("C LoadStateVectors(%s line %d) ERROR reading velocity vector.\n", filename, lnum);
+                V(state.vx);
+                V(state.vy);
+                V(state.vz);
+                state.status = ASTRO_SUCCESS;
+                CHECK(AppendStateVector(batch, state));
+                break;
+
+            default:
+                FFAIL("INTERNAL ERROR : part=%d\n", part);
+            }
+
+            part = (part + 1) % 3;
+        }
+    }
+
+    error = 0;
+fail:
+    if (infile != NULL) fclose(infile);
+    return error;
+}
+
+
+static astro_vector_t CrossProduct(astro_vector_t a, astro_vector_t b)
+{
+    astro_vector_t c;
+
+    c.status = ASTRO_SUCCESS;
+    c.t = a.t;
+    c.x = a.y*b.z - a.z*b.y;
+    c.y = a.z*b.x - a.x*b.z;
+    c.z = a.x*b.y - a.y*b.x;
+
+    return c;
+}
+
+
+static int LagrangeJplAnalyzeFiles(
+    const char *mb_filename,        /* filename containing minor body state vectors relative to major body */
+    const char *lp_filename,        /* filename containing Lagrange point state vectors relative to major body */
+    int point)                      /* Lagrange point 1..5 */
+{
+    int error, i;
+    state_vector_batch_t mb = EmptyStateVectorBatch();
+    state_vector_batch_t lp = EmptyStateVectorBatch();
+    double pos_mag_ratio, vel_mag_ratio, angle;
+    double pos_dev, vel_dev, angle_dev;
+    double dr, dv, da;
+    double m_mag, p_mag;
+    astro_state_vector_t m, p;
+
+    /*
+        [Don Cross - 2022-02-12]
+        I am trying to understand how JPL Horizons calculates L4 and L5.
+        So I generated data for heliocentric EMB state vectors
+        and geocentric Moon vectors. This should be enough to run statistics
+        on distance ratios, angles, and planes of alignment (normal vectors).
+
+        Quantities I would like to find means and standard deviations for:
+        1. Distance from the major and minor bodies.
+        2. Angle away from the vector from the major body toward the minor body.
+        3. (L4/L5 only) Normal vector to the plane that contains both L4/L5 vector and minor body vector.
+    */
+
+    CHECK(LoadStateVectors(&mb, mb_filename));
+    CHECK(LoadStateVectors(&lp, lp_filename));
+    if (mb.length != lp.length)
+        FFAIL("%d state vectors in %s, but %d in %s\n", mb.length, mb_filename, lp.length, lp_filename);
+
+    if (mb.length < 10)
+        FAIL("C LagrangeJplAnalyzeFiles(%s): %d state vectors is not enough for statistical analysis.\n", mb_filename, mb.length);
+
+    /* Calculate mean values. */
+    angle = pos_mag_ratio = vel_mag_ratio = 0.0;
+    for (i = 0; i < mb.length; ++i)
+    {
+        m = mb.array[i];
+        p = lp.array[i];
+
+        /* Sanity check that the time offsets match between the two files. */
+        if (m.t.tt != p.t.tt)
+            FAIL("C LagrangeJplAnalyzeFiles(%d, %s): time mismatch", i, lp_filename);
+
+        m_mag = sqrt(m.x*m.x + m.y*m.y + m.z*m.z);
+        p_mag = sqrt(p.x*p.x + p.y*p.y + p.z*p.z);
+        pos_mag_ratio += p_mag/m_mag;
+        vel_mag_ratio += sqrt((p.vx*p.vx + p.vy*p.vy + p.vz*p.vz) / (m.vx*m.vx + m.vy*m.vy + m.vz*m.vz));
+        angle += ArcCos((m.x*p.x + m.y*p.y + m.z*p.z) / (m_mag * p_mag));
+    }
+    pos_mag_ratio /= mb.length;
+    vel_mag_ratio /= mb.length;
+    angle /= mb.length;
+
+    /* Calculate standard deviations. */
+    pos_dev = vel_dev = angle_dev = 0.0;
+    for (i = 0; i < mb.length; ++i)
+    {
+        m = mb.array[i];
+        p = lp.array[i];
+        m_mag = sqrt(m.x*m.x + m.y*m.y + m.z*m.z);
+        p_mag = sqrt(p.x*p.x + p.y*p.y + p.z*p.z);
+        dr = pos_mag_ratio - p_mag/m_mag;
+        dv = vel_mag_ratio - sqrt((p.vx*p.vx + p.vy*p.vy + p.vz*p.vz) / (m.vx*m.vx + m.vy*m.vy + m.vz*m.vz));
+        da = angle - ArcCos((m.x*p.x + m.y*p.y + m.z*p.z) / (m_mag * p_mag));
+        pos_dev += (dr * dr);
+        vel_dev += (dv * dv);
+        angle_dev += (da * da);
+    }
+    pos_dev = sqrt(pos_dev / mb.length);
+    vel_dev = sqrt(vel_dev / mb.length);
+    angle_dev = sqrt(angle_dev / mb.length);
+
+    printf("C LagrangeJplAnalyzeFiles(%s): %d samples\n", lp_filename, mb.length);
+    printf("    mag [mean = %0.8lf, dev = %0.8lf]; vel [mean = %0.8lf, dev = %0.8lf]\n",
+        pos_mag_ratio, pos_dev,
+        vel_mag_ratio, vel_dev);
+    printf("    angle [mean = %0.8lf, dev = %0.8lf]\n",
+        angle, angle_dev);
+
+    /* Special case for L4, L5: try to understand the instantaneous co-orbital plane. */
+    if (point == 4 || point == 5)
+    {
+        double max_pole_diff = 0.0;
+        astro_angle_result_t pole_diff;
+        double v_mag;
+        astro_vector_t m_unit, p_unit, mp_norm;
+        astro_vector_t v_unit, mv_norm;
+        m_unit.status = p_unit.status = v_unit.status = ASTRO_SUCCESS;
+
+        for (i = 0; i < mb.length; ++i)
+        {
+            m = mb.array[i];
+            p = lp.array[i];
+
+            m_mag = sqrt(m.x*m.x + m.y*m.y + m.z*m.z);
+            m_unit.x = m.x / m_mag;
+            m_unit.y = m.y / m_mag;
+            m_unit.z = m.z / m_mag;
+            m_unit.t = m.t;
+
+            p_mag = sqrt(p.x*p.x + p.y*p.y + p.z*p.z);
+            p_unit.x = p.x / p_mag;
+            p_unit.y = p.y / p_mag;
+            p_unit.z = p.z / p_mag;
+            p_unit.t = p.t;
+
+            v_mag = sqrt(m.vx*m.vx + m.vy*m.vy + m.vz*m.vz);
+            v_unit.x = m.vx / v_mag;
+            v_unit.y = m.vy / v_mag;
+            v_unit.z = m.vz / v_mag;
+            v_unit.t = m.t;
+
+            if (point == 4)
+                mp_norm = CrossProduct(m_unit, p_unit);
+            else
+                mp_norm = CrossProduct(p_unit, m_unit);
+
+            mv_norm = CrossProduct(m_unit, v_unit);
+            pole_diff = Astronomy_AngleBetween(mp_norm, mv_norm);
+            CHECK_STATUS(pole_diff);
+            if (pole_diff.angle > max_pole_diff)
+                max_pole_diff = pole_diff.angle;
+        }
+        printf("    max L%d pole diff angle = %0.6lf degrees.\n", point, max_pole_diff);
+    }
+
+    /* Special case for L4, L5: confirm velocity vector would leave distances as an equilateral triangle. */
+    /* cppcheck-suppress[duplicateCondition] */
+    if (point == 4 || point == 5)
+    {
+        double a, b, c;      /* distances before v*dt increment */
+        double dx, dy, dz;
+        double ratio;
+        double min_ratio_before = NAN, max_ratio_before = NAN;
+        double min_ratio_after  = NAN, max_ratio_after  = NAN;
+        const double dt = 1.0;
+
+        for (i = 0; i < mb.length; ++i)
+        {
+            m = mb.array[i];
+            p = lp.array[i];
+
+            /* a = distance from major body to minor body */
+            a = sqrt(m.x*m.x + m.y*m.y + m.z*m.z);
+
+            /* b = distance from major body to L4/L5 */
+            b = sqrt(p.x*p.x + p.y*p.y + p.z*p.z);
+
+            /* c = distance from minor body to L4/L5 */
+            dx = p.x - m.x;
+            dy = p.y - m.y;
+            dz = p.z - m.z;
+            c = sqrt(dx*dx + dy*dy + dz*dz);
+
+            ratio = b / a;
+            if (i == 0)
+            {
+                min_ratio_before = max_ratio_before = ratio;
+            }
+            else
+            {
+                if (ratio < min_ratio_before)
+                    min_ratio_before = ratio;
+                if (ratio > max_ratio_before)
+                    max_ratio_before = ratio;
+            }
+
+            ratio = c / a;
+            if (ratio < min_ratio_before)
+                min_ratio_before = ratio;
+            if (ratio > max_ratio_before)
+                max_ratio_before = ratio;
+
+            ratio = c / b;
+            if (ratio < min_ratio_before)
+                min_ratio_before = ratio;
+            if (ratio > max_ratio_before)
+                max_ratio_before = ratio;
+
+            /* simulate a small movement of the body over a time period dt */
+            dx = m.x + dt*m.vx;
+            dy = m.y + dt*m.vy;
+            dz = m.z + dt*m.vz;
+            a = sqrt(dx*dx + dy*dy + dz*dz);
+
+            /* simulate straight-line movement of Lagrange point over dt */
+            dx = p.x + dt*p.vx;
+            dy = p.y + dt*p.vy;
+            dz = p.z + dt*p.vz;
+            b = sqrt(dx*dx + dy*dy + dz*dz);
+
+            /* measure extrapolated distance between minor body and Lagrange point */
+            dx -= m.x + dt*m.vx;
+            dy -= m.y + dt*m.vy;
+            dz -= m.z + dt*m.vz;
+            c = sqrt(dx*dx + dy*dy + dz*dz);
+
+            /* All 3 distances (a, b, c) should be the same. */
+
+            ratio = b / a;
+            if (i == 0)
+            {
+                min_ratio_after = max_ratio_after = ratio;
+            }
+            else
+            {
+                if (ratio < min_ratio_after)
+                    min_ratio_after = ratio;
+                if (ratio > max_ratio_after)
+                    max_ratio_after = ratio;
+            }
+
+            ratio = c / a;
+            if (ratio < min_ratio_after)
+                min_ratio_after = ratio;
+            if (ratio > max_ratio_after)
+                max_ratio_after = ratio;
+
+            ratio = c / b;
+            if (ratio < min_ratio_after)
+                min_ratio_after = ratio;
+            if (ratio > max_ratio_after)
+                max_ratio_after = ratio;
+
+            if (ABS(1.0 - min_ratio_after) > 1.0e-7)
+                FAIL("LagrangeJplAnalyzeFiles(%s): BAD min_ratio_after = %0.15lf\n", lp_filename, min_ratio_after);
+
+            if (ABS(1.0 - max_ratio_after) > 1.0e-7)
+                FAIL("LagrangeJplAnalyzeFiles(%s): BAD max_ratio_after = %0.15lf\n", lp_filename, max_ratio_after);
+        }
+
+        printf("    length ratios before: min = %0.15lf, max = %0.15lf\n", min_ratio_before, max_ratio_before);
+        printf("    length ratios after : min = %0.15lf, max = %0.15lf\n", min_ratio_after,  max_ratio_after );
+    }
+
+    /* Special case for L4/L5: confirm velocity vectors are 60 degrees apart. */
+    /* cppcheck-suppress[duplicateCondition] */
+    if (point == 4 || point == 5)
+    {
+        double speed, arcmin_error;
+        double mx, my, mz;
+        double px, py, pz;
+        double min_angle = NAN;
+        double max_angle = NAN;
+
+        for (i = 0; i < mb.length; ++i)
+        {
+            m = mb.array[i];
+            p = lp.array[i];
+
+            /* Calculate unit vector in direction of the minor body's velocity. */
+            speed = sqrt(m.vx*m.vx + m.vy*m.vy + m.vz*m.vz);
+            mx = m.vx / speed;
+            my = m.vy / speed;
+            mz = m.vz / speed;
+
+            /* Calculate unit vector in the direction of the Lagrange point's velocity. */
+            speed = sqrt(p.vx*p.vx + p.vy*p.vy + p.vz*p.vz);
+            px = p.vx / speed;
+            py = p.vy / speed;
+            pz = p.vz / speed;
+
+            /* The dot product should always be very close to 0.5 (an angle of 60 degrees). */
+            angle = ArcCos(px*mx + py*my + pz*mz);
+            arcmin_error = 60.0 * ABS(angle - 60.0);
+            if (arcmin_error > 0.0026)
+                FAIL("C LagrangeJplAnalyzeFiles(%d, %s): velocity angle is out of bounds: %0.16lf (error = %0.4le arcmin)\n", i, lp_filename, angle, arcmin_error);
+
+            if (i == 0)
+            {
+                min_angle = max_angle = angle;
+            }
+            else
+            {
+                if (angle < min_angle)
+                    min_angle = angle;
+                if (angle > max_angle)
+                    max_angle = angle;
+            }
+        }
+
+        printf("    speed angles: min_angle = %0.15lf, max_angle = %0.15lf, spread = %0.4le\n", min_angle, max_angle, max_angle - min_angle);
+    }
+
+fail:
+    FreeStateVectorBatch(&mb);
+    FreeStateVectorBatch(&lp);
+    return error;
+}
+
+
+static int LagrangeJplAnalysis(void)
+{
+    int error;
+
+    CHECK(LagrangeJplAnalyzeFiles("lagrange/helio_emb.txt", "lagrange/semb_L1.txt", 1));
+    CHECK(LagrangeJplAnalyzeFiles("lagrange/helio_emb.txt", "lagrange/semb_L2.txt", 2));
+    CHECK(LagrangeJplAnalyzeFiles("lagrange/helio_emb.txt", "lagrange/semb_L4.txt", 4));
+    CHECK(LagrangeJplAnalyzeFiles("lagrange/helio_emb.txt", "lagrange/semb_L5.txt", 5));
+
+    CHECK(LagrangeJplAnalyzeFiles("lagrange/geo_moon.txt", "lagrange/em_L1.txt", 1));
+    CHECK(LagrangeJplAnalyzeFiles("lagrange/geo_moon.txt", "lagrange/em_L2.txt", 2));
+    CHECK(LagrangeJplAnalyzeFiles("lagrange/geo_moon.txt", "lagrange/em_L4.txt", 4));
+    CHECK(LagrangeJplAnalyzeFiles("lagrange/geo_moon.txt", "lagrange/em_L5.txt", 5));
+fail:
+    return error;
+}
+
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static astro_state_vector_t TopoStateFunc(verify_state_context_t *context, astro_body_t body, astro_time_t time)
+{
+    astro_observer_t        observer;
+    astro_state_vector_t    observer_state, state;
+
+    (void)context;
+
+    observer.latitude = 30.0;
+    observer.longitude = -80.0;
+    observer.height = 1000.0;
+
+    observer_state = Astronomy_ObserverState(&time, observer, EQUATOR_J2000);
+    if (observer_state.status != ASTRO_SUCCESS)
+    {
+        fprintf(stderr, "C TopoStateFunc: Astronomy_ObserverState returned error %d\n", observer_state.status);
+        return observer_state;
+    }
+
+    if (body == BODY_GEO_EMB)
+    {
+        state = Astronomy_GeoEmbState(time);
+    }
+    else if (body == BODY_EARTH)
+    {
+        state.status = ASTRO_SUCCESS;
+        state.t = time;
+        state.x = state.y = state.z = 0.0;
+        state.vx = state.vy = state.vz = 0.0;
+    }
+    else
+    {
+        fprintf(stderr, "C TopoStateFunc: Unsupported body %d\n", body);
+        memset(&state, 0, sizeof(state));
+        state.status = ASTRO_INVALID_BODY;
+        return state;
+    }
+
+    if (state.status != ASTRO_SUCCESS)
+    {
+        fprintf(stderr, "C TopoStateFunc: body %d resulted in error %d\n", body, state.status);
+        return state;
+    }
+
+    state.x  -= observer_state.x;
+    state.y  -= observer_state.y;
+    state.z  -= observer_state.z;
+    state.vx -= observer_state.vx;
+    state.vy -= observer_state.vy;
+    state.vz -= observer_state.vz;
+
+    return state;
+}
+
+static int TopoStateTest(void)
+{
+    int error;  /* set as a side-effect of CHECK macro */
+    verify_state_context_t context;
+
+    memset(&context, 0, sizeof(context));
+    context.func = TopoStateFunc;
+    CHECK(VerifyStateBody(&context, BODY_EARTH,   "topostate/Earth_N30_W80_1000m.txt",  2.108e-04, 2.430e-04));
+    CHECK(VerifyStateBody(&context, BODY_GEO_EMB, "topostate/EMB_N30_W80_1000m.txt",    7.197e-04, 2.497e-04));
+
+    FPASS();
+fail:
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static int Twilight(void)
+{
+    int error, lnum, nscanned, i;
+    char line[200];
+    char search_text[20];
+    char token[6][20];
+    astro_time_t search_time;
+    astro_time_t expected_time[6];
+    astro_search_result_t calc[6];
+    FILE *infile;
+    astro_observer_t observer;
+    double diff, max_diff = 0.0;
+    const double tolerance_seconds = 60.0;
+    const char *filename = "riseset/twilight.txt";
+
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FFAIL("Cannot open input file: %s\n", filename);
+
+    lnum = 0;
+    observer.height = 0.0;
+    while (ReadLine(line, sizeof(line), infile, filename, lnum))
+    {
+        ++lnum;
+
+        nscanned = sscanf(line, "%lf %lf %17s %17s %17s %17s %17s %17s %17s",
+            &observer.latitude,
+            &observer.longitude,
+            search_text,
+            token[0], token[1], token[2], token[3], token[4], token[5]);
+
+        if (nscanned != 9)
+            FAIL("C Twilight(%s line %d): expected 9 tokens but found %d\n", filename, lnum, nscanned);
+
+        if (ParseDate(search_text, &search_time))
+            FAIL("C Twilight(%s line %d): BAD SEARCH TIME FORMAT.", filename, lnum);
+
+        for (i = 0; i < 6; ++i)
+            if (ParseDate(token[i], &expected_time[i]))
+                FAIL("C Twilight(%s line %d): BAD EXPECTED TIME [%d] FORMAT.\n", filename, lnum, i);
+
+        search_time = expected_time[0];
+        calc[0] = Astronomy_SearchAltitude(BODY_SUN, observer, DIRECTION_RISE, search_time, 1.0, -18.0);   // astronomical dawn
+        calc[1] = Astronomy_SearchAltitude(BODY_SUN, observer, DIRECTION_RISE, search_time, 1.0, -12.0);   // nautical dawn
+        calc[2] = Astronomy_SearchAltitude(BODY_SUN, observer, DIRECTION_RISE, search_time, 1.0,  -6.0);   // civil dawn
+        calc[3] = Astronomy_SearchAltitude(BODY_SUN, observer, DIRECTION_SET,  search_time, 1.0,  -6.0);   // civil dusk
+        calc[4] = Astronomy_SearchAltitude(BODY_SUN, observer, DIRECTION_SET,  search_time, 1.0, -12.0);   // nautical dusk
+        calc[5] = Astronomy_SearchAltitude(BODY_SUN, observer, DIRECTION_SET,  search_time, 1.0, -18.0);   // astronomical dusk
+
+        for (i = 0; i < 6; ++i)
+        {
+            if (calc[i].status != ASTRO_SUCCESS)
+                FAIL("C Twilight(%s line %d): error %d in search[%d]\n", filename, lnum, calc[i].status, i);
+
+            diff = 86400.0 * ABS(calc[i].time.ut - expected_time[i].ut);
+            if (diff > tolerance_seconds)
+                FAIL("C TwilightTest(%s line %d): EXCESSIVE ERROR = %0.3lf seconds for test %d.\n", filename, lnum, diff, i);
+
+            if (diff > max_diff)
+                max_diff = diff;
+        }
+    }
+
+    FPASSA("(%d test cases, max error = %0.3lf seconds)\n", lnum, max_diff);
+fail:
+    if (infile != NULL) fclose(infile);
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static int AltitudeGrazeTest(void)
+{
+    /*
+        Search for a target altitude just below a body's highest point,
+        so that the body rises through it for only a few seconds around culmination.
+        The altitude search first scans an interpolated model of the body's position,
+        whose small errors can hide such a brief event; it must then fall back to the full model.
+    */
+    int error, d, k;
+    astro_observer_t observer;
+    astro_time_t time, peak_time;
+    astro_hour_angle_t culm;
+    astro_equatorial_t equ;
+    astro_horizon_t hor;
+    astro_search_result_t search;
+    double peak, diff, max_diff = 0.0;
+    static const int days[] = { 0, 10, 11, 29 };
+
+    for (d = 0; d < (int)(sizeof(days) / sizeof(days[0])); ++d)
+    {
+        observer = Astronomy_MakeObserver(40.0 + days[d]%7, -70.0 + days[d], 0.0);
+        time = Astronomy_AddDays(Astronomy_MakeTime(2023, 1, 1, 0, 0, 0.0), 9.1 * days[d]);
+        culm = Astronomy_SearchHourAngle(BODY_MERCURY, observer, 0.0, time);
+        CHECK_STATUS(culm);
+
+        /* Find the highest geometric altitude to the nearest second. */
+        peak = -90.0;
+        peak_time = culm.time;
+        for (k = -30; k <= +30; ++k)
+        {
+            time = Astronomy_AddDays(culm.time, (double)k / SECONDS_PER_DAY);
+            equ = Astronomy_Equator(BODY_MERCURY, &time, observer, EQUATOR_OF_DATE, ABERRATION);
+            CHECK_STATUS(equ);
+            hor = Astronomy_Horizon(&time, observer, equ.ra, equ.dec, REFRACTION_NONE);
+            if (hor.altitude > peak)
+            {
+                peak = hor.altitude;
+                peak_time = time;
+            }
+        }
+
+        search = Astronomy_SearchAltitude(BODY_MERCURY, observer, DIRECTION_RISE, Astronomy_AddDays(culm.time, -0.3), 0.6, peak - 3.0e-6);
+        if (search.status != ASTRO_SUCCESS)
+            FFAIL("Day %d: altitude search returned status %d\n", days[d], search.status);
+
+        diff = SECONDS_PER_DAY * ABS(search.time.ut - peak_time.ut);
+        if (diff > max_diff)
+            max_diff = diff;
+        if (diff > 30.0)
+            FFAIL("Day %d: EXCESSIVE time from culmination = %0.3lf seconds\n", days[d], diff);
+    }
+
+    FPASSA("(max time from culmination = %0.3lf seconds)\n", max_diff);
+fail:
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static int Libration(const char *filename, int *ndata, double *var_lon, double *var_lat)
+{
+    int error;
+    FILE *infile;
+    int lnum, count, nscanned;
+    char line[200];
+    int day, month, year, hour, minute;
+    char mtext[4];
+    double phase, age, diam, dist, ra, dec, slon, slat, elon, elat, axisa;
+    astro_time_t time;
+    astro_libration_t lib;
+    double diff_elon, diff_elat, diff_distance, diff_diam;
+    double max_diff_elon = 0.0, max_diff_elat = 0.0, max_diff_distance = 0.0, max_diff_diam = 0.0;
+    double max_eclip_lon = -900.0;
+
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FFAIL("cannot open input file: %s\n", filename);
+
+    lnum = 0;
+    count = 0;
+    while (ReadLine(line, sizeof(line), infile, filename, lnum))
+    {
+        ++lnum;
+        if (lnum == 1)
+        {
+            if (strcmp(line, "   Date       Time    Phase    Age    Diam    Dist     RA        Dec      Slon      Slat     Elon     Elat   AxisA\n"))
+                FAIL("C Libration(%s line %d): unexpected header line\n", filename, lnum);
+        }
+        else
+        {
+            /* 01 Jan 2020 00:00 UT  29.95   5.783  1774.5  403898  23.2609  -10.0824   114.557   -0.045   0.773    6.360  336.353 */
+            nscanned = sscanf(line,
+                "%d %3s %d %d:%d UT %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf",
+                &day, mtext, &year, &hour, &minute,
+                &phase, &age, &diam, &dist, &ra, &dec, &slon, &slat, &elon, &elat, &axisa);
+
+            if (nscanned != 16)
+                FAIL("C Libration(%s line %d): expected 16 tokens, found %d\n", filename, lnum, nscanned);
+
+            /* Calculate the astronomy time value for this calendar date/time. */
+            if (ParseMonthName(mtext, &month))
+                FAIL("Libration(%s line %d): invalid month symbol '%s'\n", filename, lnum, mtext);
+
+            time = Astronomy_MakeTime(year, month, day, hour, minute, 0.0);
+            lib = Astronomy_Libration(time);
+
+            diff_elon = 60.0 * ABS(lib.elon - elon);
+            if (diff_elon > max_diff_elon)
+                max_diff_elon = diff_elon;
+
+            diff_elat = 60.0 * ABS(lib.elat - elat);
+            if (diff_elat > max_diff_elat)
+                max_diff_elat = diff_elat;
+
+            diff_distance = ABS(lib.dist_km - dist);
+            if (diff_distance > max_diff_distance)
+                max_diff_distance = diff_distance;
+
+            diff_diam = ABS(lib.diam_deg - diam/3600.0);
+            if (diff_diam > max_diff_diam)
+                max_diff_diam = diff_diam;
+
+            if (lib.mlon > max_eclip_lon)
+                max_eclip_lon = lib.mlon;
+
+            if (diff_elon > 0.1304)
+                FAIL("C Libration(%s line %d): EXCESSIVE diff_elon = %0.4lf arcmin\n", filename, lnum, diff_elon);
+
+            if (diff_elat > 1.6476)
+                FAIL("C Libration(%s line %d): EXCESSIVE diff_elat = %0.4lf arcmin\n", filename, lnum, diff_elat);
+
+            if (diff_distance > 54.377)
+                FAIL("C Libration(%s line %d): EXCESSIVE diff_distance = %0.3lf km\n", filename, lnum, diff_distance);
+
+            if (diff_diam > 0.00009)
+                FAIL("C Libration(%s line %d): EXCESSIVE diff_diam = %0.3le degrees\n", filename, lnum, diff_diam);
+
+            /* Update sum-of-squared-errors. */
+            *var_lon += diff_elon * diff_elon;
+            *var_lat += diff_elat * diff_elat;
+
+            ++count;
+        }
+    }
+
+    if (max_eclip_lon < 359.0 || max_eclip_lon > 360.0)
+        FAIL("C Libration(%s): INVALID max ecliptic longitude %0.3lf degrees.\n", filename, max_eclip_lon);
+
+    printf("C Libration(%s): PASS (%d test cases, max_diff_elon = %0.4lf arcmin, max_diff_elat = %0.4lf arcmin, max_diff_distance = %0.3lf km, max_diff_diam = %0.12lf deg)\n",
+        filename, count, max_diff_elon, max_diff_elat, max_diff_distance, max_diff_diam);
+
+    *ndata += count;
+    error = 0;
+fail:
+    if (infile != NULL) fclose(infile);
+    return error;
+}
+
+static int LibrationTest(void)
+{
+    int error;
+    int ndata = 0;
+    double var_lat = 0.0;
+    double var_lon = 0.0;
+    double dev_lat, dev_lon;
+
+    CHECK(Libration("libration/mooninfo_2020.txt", &ndata, &var_lon, &var_lat));
+    CHECK(Libration("libration/mooninfo_2021.txt", &ndata, &var_lon, &var_lat));
+    CHECK(Libration("libration/mooninfo_2022.txt", &ndata, &var_lon, &var_lat));
+
+    dev_lon = sqrt(var_lon / ndata);
+    dev_lat = sqrt(var_lat / ndata);
+    printf("C LibrationTest PASS: %d data points, dev_lon = %0.4lf arcmin, dev_lat = %0.4lf arcmin\n", ndata, dev_lon, dev_lat);
+fail:
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static int DE405_Check(void)
+{
+    int error, lnum, nscanned;
+    const char *filename = "barystate/de405_state.txt";
+    FILE *infile;
+    double jd;
+    astro_time_t time;
+    char line[200];
+    char name[10];
+    double pos[3], vel[3];
+    astro_body_t body;
+    astro_state_vector_t state;
+    double dx, dy, dz, dr, dv;
+    double scale;
+
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FFAIL("cannot open input file: %s\n", filename);
+
+    lnum = 0;
+    while (ReadLine(line, sizeof(line), infile, filename, 0))
+    {
+        ++lnum;
+        if (line[0] == '*')
+            break;
+
+        if (lnum == 1)
+        {
+            if (1 != sscanf(line, "%lf", &jd))
+                FAIL("DE405_Check(%s line %d): cannot scan Julian Date\n", filename, lnum);
+            time = Astronomy_TerrestrialTime(jd - JD_2000);
+            Astronomy_FormatTime(time, TIME_FORMAT_MILLI, line, sizeof(line));
+            FDEBUG("time = %s\n", line);
+        }
+        else
+        {
+            nscanned = sscanf(line, "%7[A-Za-z] %lf %lf %lf %lf %lf %lf", name, &pos[0], &pos[1], &pos[2], &vel[0], &vel[1], &vel[2]);
+            if (nscanned != 7)
+                FAIL("C DE405_Check(%s line %d): expected 7 tokens, found %d\n", filename, lnum, nscanned);
+            body = Astronomy_BodyCode(name);
+            if (body == BODY_INVALID)
+                FAIL("C DE405_Check(%s line %d): unrecognized body name '%s'\n", filename, lnum, name);
+
+            switch (body)
+            {
+            case BODY_MOON:
+                /* geocentric Moon */
+                state = Astronomy_GeoMoonState(time);
+                scale = sqrt(pos[0]*pos[0] + pos[1]*pos[1] + pos[2]*pos[2]);
+                break;
+
+            case BODY_SUN:
+                /* barycentric Sun */
+                state = Astronomy_BaryState(body, time);
+                scale = 1.0;
+                break;
+
+            default:
+                /* heliocentric planet */
+                state = Astronomy_HelioState(body, time);
+                scale = sqrt(pos[0]*pos[0] + pos[1]*pos[1] + pos[2]*pos[2]);
+                break;
+            }
+
+            if (state.status != ASTRO_SUCCESS)
+                FAIL("C DE405_Check(%s line %d): status = %d\n", filename, lnum, state.status);
+
+            dx = pos[0] - state.x;
+            dy = pos[1] - state.y;
+            dz = pos[2] - state.z;
+            dr = V(sqrt(dx*dx + dy*dy + dz*dz) / scale);
+
+            dx = vel[0] - state.vx;
+            dy = vel[1] - state.vy;
+            dz = vel[2] - state.vz;
+            dv = V(sqrt(dx*dx + dy*dy + dz*dz));
+
+            FDEBUG("%-10s dr=%0.4le dv=%0.4le\n", name, dr, dv);
+            if (dr > 8.7e-5)
+                FLNFAIL("EXCESSIVE POSITION ERROR\n");
+
+            if (dv > 7.3e-6)
+                FLNFAIL("EXCESSIVE VELOCITY ERROR\n");
+        }
+    }
+
+    FPASS();
+fail:
+    if (infile != NULL) fclose(infile);
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static int AxisTestBody(astro_body_t body, const char *filename, double arcmin_tolerance)
+{
+    int error, lnum, nscanned, found_data, count;
+    astro_axis_t axis;
+    astro_time_t time;
+    astro_spherical_t sphere;
+    astro_vector_t north;
+    astro_angle_result_t diff;
+    double jd, ra, dec, arcmin, max_arcmin;
+    FILE *infile;
+    char line[100];
+
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FAIL("AxisTestBody: cannot open input file: %s\n", filename);
+
+    count = 0;
+    lnum = 0;
+    found_data = 0;
+    max_arcmin = 0.0;
+    while (ReadLine(line, sizeof(line), infile, filename, lnum))
+    {
+        ++lnum;
+        if (!found_data)
+        {
+            if (0 == memcmp(line, "$$SOE", 5))
+                found_data = 1;
+        }
+        else
+        {
+            if (0 == memcmp(line, "$$EOE", 5))
+                break;
+
+            /* [ 1979-Jun-13 00:00 2444037.500000000     181.44164   89.88493] */
+            if (strlen(line) < 61)
+                FAIL("C AxisTestBody(%s line %d): line is too short\n", filename, lnum);
+
+            nscanned = sscanf(&line[19], "%lf %lf %lf", &jd, &ra, &dec);
+            if (nscanned != 3)
+                FAIL("C AxisTestBody(%s line %d): could not scan data.\n", filename, lnum);
+
+            time = Astronomy_TimeFromDays(jd - JD_2000);
+            axis = Astronomy_RotationAxis(body, &time);
+            if (axis.status != ASTRO_SUCCESS)
+                FAIL("C AxisTestBody(%s line %d): Astronomy_Axis returned error %d\n", filename, lnum, axis.status);
+
+            /* Convert the reference angles to a reference north pole vector. */
+            sphere.status = ASTRO_SUCCESS;
+            sphere.dist = 1.0;
+            sphere.lat = dec;
+            sphere.lon = ra;    /* tricky: RA is in degrees, not sidereal hours */
+            north = Astronomy_VectorFromSphere(sphere, time);
+            if (north.status != ASTRO_SUCCESS)
+                FAIL("C AxisTestBody(%s line %d): VectorFromSphere error %d\n", filename, lnum, north.status);
+
+            /* Find angle between two versions of the north pole. Use that as the measure of error. */
+            diff = Astronomy_AngleBetween(north, axis.north);
+            if (diff.status != ASTRO_SUCCESS)
+                FAIL("C AxisTestBody(%s line %d): AngleBetween error %d\n", filename, lnum, diff.status);
+
+            arcmin = diff.angle * 60.0;     /* convert error degrees to arcminutes */
+            if (arcmin > max_arcmin)
+                max_arcmin = arcmin;
+
+            ++count;
+        }
+    }
+
+    DEBUG("C AxisTestBody(%s): %d test cases, max arcmin error = %0.6lf.\n", filename, count, max_arcmin);
+    if (max_arcmin > arcmin_tolerance)
+        FAIL("C AxisTestBody(%s): EXCESSIVE ERROR = %lf arcmin\n", filename, max_arcmin);
+    error = 0;
+fail:
+    if (infile != NULL) fclose(infile);
+    return error;
+}
+
+static int AxisTest(void)
+{
+    int error;
+    CHECK(AxisTestBody(BODY_SUN,      "axis/Sun.txt",       0.0));
+    CHECK(AxisTestBody(BODY_MERCURY,  "axis/Mercury.txt",   0.074340));
+    CHECK(AxisTestBody(BODY_VENUS,    "axis/Venus.txt",     0.0));
+    CHECK(AxisTestBody(BODY_EARTH,    "axis/Earth.txt",     0.002032));
+    CHECK(AxisTestBody(BODY_MOON,     "axis/Moon.txt",      0.264845));
+    CHECK(AxisTestBody(BODY_MARS,     "axis/Mars.txt",      0.075323));
+    CHECK(AxisTestBody(BODY_JUPITER,  "axis/Jupiter.txt",   0.000324));
+    CHECK(AxisTestBody(BODY_SATURN,   "axis/Saturn.txt",    0.000304));
+    CHECK(AxisTestBody(BODY_URANUS,   "axis/Uranus.txt",    0.0));
+    CHECK(AxisTestBody(BODY_NEPTUNE,  "axis/Neptune.txt",   0.000462));
+    CHECK(AxisTestBody(BODY_PLUTO,    "axis/Pluto.txt",     0.0));
+    FPASS();
+fail:
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static int MapPerformanceTest(void)
+{
+    int error;
+    int count;
+    astro_observer_t observer;
+    astro_time_t time;
+    astro_vector_t ovec;
+    astro_rotation_t rot;
+
+    time = Astronomy_MakeTime(2022, 1, 22, 12, 30, 0.0);
+
+    count = 0;
+    observer.height = 0.0;
+    for (observer.longitude = -180.0; observer.longitude < +180.0; observer.longitude += 0.01)
+    {
+        for (observer.latitude = -85.0; observer.latitude <= +85.0; observer.latitude += 0.01)
+        {
+            ovec = Astronomy_ObserverVector(&time, observer, EQUATOR_OF_DATE);
+            CHECK_STATUS(ovec);
+            rot = Astronomy_Rotation_EQD_HOR(&time, observer);
+            CHECK_STATUS(rot);
+            ++count;
         }
-
-        printf("    length ratios before: min = %0.15lf, max = %0.15lf\n", min_ratio_before, max_ratio_before);
-        printf("    length ratios after : min = %0.15lf, max = %0.15lf\n", min_ratio_after,  max_ratio_after );
     }
 
-    /* Special case for L4/L5: confirm velocity vectors are 60 degrees apart. */
-    /* cppcheck-suppress[duplicateCondition] */
-    if (point == 4 || point == 5)
-    {
-        double speed, arcmin_error;
-        double mx, my, mz;
-        double px, py, pz;
-        double min_angle = NAN;
-        double max_angle = NAN;
+    /*
+        612,017,000 geographic locations.
 
-        for (i = 0; i < mb.length; ++i)
-        {
-            m = mb.array[i];
-            p = lp.array[i];
+        Before sidereal time optimization:
+        Trial #1: 236.420 seconds.
+        Trial #2: 235.906 seconds.
+        Trial #3: 238.809 seconds.
 
-            /* Calculate unit vector in direction of the minor body's velocity. */
-            speed = sqrt(m.vx*m.vx + m.vy*m.vy + m.vz*m.vz);
-            mx = m.vx / speed;
-            my = m.vy / speed;
-            mz = m.vz / speed;
+        After sidereal time optimization:
+        Trial #1: 103.452 seconds.
+        Trial #2: 104.249 seconds.
+        Trial #3: 103.657 seconds.
 
-            /* Calculate unit vector in the direction of the Lagrange point's velocity. */
-            speed = sqrt(p.vx*p.vx + p.vy*p.vy + p.vz*p.vz);
-            px = p.vx / speed;
-            py = p.vy / speed;
-            pz = p.vz / speed;
+        Mean performance improvement ratio = 2.284.
+    */
 
-            /* The dot product should always be very close to 0.5 (an angle of 60 degrees). */
-            angle = ArcCos(px*mx + py*my + pz*mz);
-            arcmin_error = 60.0 * ABS(angle - 60.0);
-            if (arcmin_error > 0.0026)
-                FAIL("C LagrangeJplAnalyzeFiles(%d, %s): velocity angle is out of bounds: %0.16lf (error = %0.4le arcmin)\n", i, lp_filename, angle, arcmin_error);
+    printf("MapPerformanceTest: PASS (%d geographic locations)\n", count);
+    error = 0;
+fail:
+    return error;
+}
 
-            if (i == 0)
-            {
-                min_angle = max_angle = angle;
-            }
-            else
-            {
-                if (angle < min_angle)
-                    min_angle = angle;
-                if (angle > max_angle)
-                    max_angle = angle;
-            }
-        }
+/*-----------------------------------------------------------------------------------------------------------*/
 
-        printf("    speed angles: min_angle = %0.15lf, max_angle = %0.15lf, spread = %0.4le\n", min_angle, max_angle, max_angle - min_angle);
-    }
+static int GeoMoonPerformance(void)
+{
+    /* Call EclipticGeoMoon for many different times to measure its speed. */
 
+    int error = 1;
+    int count = 0;
+    astro_time_t time = Astronomy_MakeTime(1800, 1, 1, 0, 0, 0.0);
+    astro_time_t stopTime = Astronomy_MakeTime(2200, 1, 1, 0, 0, 0.0);
+    while (time.ut <= stopTime.ut)
+    {
+        astro_spherical_t sphere = Astronomy_EclipticGeoMoon(time);
+        if (sphere.status != ASTRO_SUCCESS)
+            FAIL("GeoMoonPerformance: EclipticGeoMoon returned error %d.\n", sphere.status);
+        time = Astronomy_AddDays(time, 0.01);
+        ++count;
+    }
+    printf("GeoMoonPerformance: PASS (called %d times)\n", count);
+    error = 0;
 fail:
-    FreeStateVectorBatch(&mb);
-    FreeStateVectorBatch(&lp);
     return error;
 }
 
 
-static int LagrangeJplAnalysis(void)
+static int MoonCachePerformance(void)
 {
+    /* Same as GeoMoonPerformance, but with the lunar cache enabled in the default context. */
+
     int error;
+    astro_status_t status;
 
-    CHECK(LagrangeJplAnalyzeFiles("lagrange/helio_emb.txt", "lagrange/semb_L1.txt", 1));
-    CHECK(LagrangeJplAnalyzeFiles("lagrange/helio_emb.txt", "lagrange/semb_L2.txt", 2));
-    CHECK(LagrangeJplAnalyzeFiles("lagrange/helio_emb.txt", "lagrange/semb_L4.txt", 4));
-    CHECK(LagrangeJplAnalyzeFiles("lagrange/helio_emb.txt", "lagrange/semb_L5.txt", 5));
+    status = Astronomy_ContextSetMoonCache(NULL, 4096);
+    if (status != ASTRO_SUCCESS)
+        FAIL("MoonCachePerformance: Astronomy_ContextSetMoonCache returned %d\n", status);
 
-    CHECK(LagrangeJplAnalyzeFiles("lagrange/geo_moon.txt", "lagrange/em_L1.txt", 1));
-    CHECK(LagrangeJplAnalyzeFiles("lagrange/geo_moon.txt", "lagrange/em_L2.txt", 2));
-    CHECK(LagrangeJplAnalyzeFiles("lagrange/geo_moon.txt", "lagrange/em_L4.txt", 4));
-    CHECK(LagrangeJplAnalyzeFiles("lagrange/geo_moon.txt", "lagrange/em_L5.txt", 5));
+    error = GeoMoonPerformance();
 fail:
+    Astronomy_ContextSetMoonCache(NULL, 0);
     return error;
 }
 
 
 /*-----------------------------------------------------------------------------------------------------------*/
 
-static astro_state_vector_t TopoStateFunc(verify_state_context_t *context, astro_body_t body, astro_time_t time)
+static int NutationPerformance(void)
 {
-    astro_observer_t        observer;
-    astro_state_vector_t    observer_state, state;
+    /* Call SiderealTime for many different times to gauge speed of iau2000b nutation model. */
 
-    (void)context;
+    int count = 0;
+    astro_time_t time = Astronomy_MakeTime(1800, 1, 1, 0, 0, 0.0);
+    astro_time_t stopTime = Astronomy_MakeTime(2200, 1, 1, 0, 0, 0.0);
+    while (time.ut <= stopTime.ut)
+    {
+        Astronomy_SiderealTime(&time);
+        time = Astronomy_AddDays(time, 0.01);
+        ++count;
+    }
+    printf("NutationPerformance: PASS (called %d times)\n", count);
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+
+static int MoonNodes(void)
+{
+    const char *filename = "moon_nodes/moon_nodes.txt";
+    int error;
+    int lnum, nscanned;
+    char kind, prev_kind;
+    astro_time_t time;
+    double ra, dec;
+    FILE *infile;
+    char line[100];
+    char date[20];
+    astro_spherical_t ecl;
+    astro_vector_t vec_eqj, vec_eqd, vec_test;
+    double diff_lat, max_lat = 0.0;
+    double max_node_lat = 0.0;
+    double diff_angle, max_angle = 0.0;
+    double diff_minutes, max_minutes = 0.0;
+    double dt, min_dt = 1.0e+99, max_dt = 0.0;
+    astro_rotation_t rot;
+    astro_spherical_t sphere;
+    astro_angle_result_t result;
+    astro_node_event_t node;
+
+    memset(&node, 0, sizeof(node));
+    node.status = ASTRO_NOT_INITIALIZED;
+
+    infile = fopen(filename, "rt");
+    if (infile == NULL)
+        FAIL("MoonNodes: Cannot open input file: %s\n", filename);
+
+    lnum = 0;
+    prev_kind = '?';
+    while (ReadLine(line, sizeof(line), infile, filename, lnum))
+    {
+        ++lnum;
+
+        /* Parse the line from the test data file. */
+        /* A 2001-01-09T13:53Z    7.1233   22.5350 */
+        /* D 2001-01-22T22:22Z   19.1250  -21.4683 */
+
+        if (strlen(line) < 40)
+            FAIL("C MoonNodes(%s line %d): line is too short\n", filename, lnum);
+
+        nscanned = sscanf(line, "%c %17s %lf %lf", &kind, date, &ra, &dec);
+        if (nscanned != 4)
+            FAIL("C MoonNodes(%s line %d): syntax error\n", filename, lnum);
+
+        if (kind != 'A' && kind != 'D')
+            FAIL("C MoonNodes(%s line %d): invalid kind character.\n", filename, lnum);
+
+        if (kind == prev_kind)
+            FAIL("C MoonNodes(%s line %d): duplicate ascending/descending kind.\n", filename, lnum);
+
+        if (ParseDate(date, &time))
+            FAIL("C MoonNodes(%s line %d): invalid date/time.\n", filename, lnum);
+
+        if (!isfinite(ra) || ra < 0.0 || ra > 24.0)
+            FAIL("C MoonNodes(%s line %d): invalid right ascension.\n", filename, lnum);
+
+        if (!isfinite(dec) || dec < -90.0 || dec > +90.0)
+            FAIL("C MoonNodes(%s line %d): invalid declination.\n", filename, lnum);
+
+        /* Convert RA/DEC to a vector. */
+        sphere.status = ASTRO_SUCCESS;
+        sphere.lat = dec;
+        sphere.lon = 15.0 * ra;
+        sphere.dist = 1.0;
+        vec_test = Astronomy_VectorFromSphere(sphere, time);
+        CHECK_STATUS(vec_test);
+
+        /* Calculate the Moon's ecliptic angles. Verify latitude is very close to zero. */
+        ecl = Astronomy_EclipticGeoMoon(time);
+        CHECK_STATUS(ecl);
+        diff_lat = 60.0 * ABS(ecl.lat);  /* calculate arcminute latitude error */
+        V(ecl.lon);
+        V(ecl.dist);
+
+        if (diff_lat > max_lat)
+            max_lat = diff_lat;
+
+        /* Calculate EQD coordinates. Verify against input file. */
+        vec_eqj = Astronomy_GeoMoon(time);
+        CHECK_STATUS(vec_eqj);
+
+        rot = Astronomy_Rotation_EQJ_EQD(&time);
+        CHECK_STATUS(rot);
+        vec_eqd = Astronomy_RotateVector(rot, vec_eqj);
+        CHECK_STATUS(vec_eqd);
+
+        /* Measure the error angle between the correct vector and the calculated vector. */
+        result = Astronomy_AngleBetween(vec_test, vec_eqd);
+        CHECK_STATUS(result);
+        diff_angle = 60.0 * ABS(result.angle);
+        if (diff_angle > max_angle)
+            max_angle = diff_angle;
+        if (diff_angle > 1.54)
+            FAIL("C MoonNodes(%s line %d): EXCESSIVE equatorial error = %0.3lf arcmin\n", filename, lnum, diff_angle);
+
+        /* Test the Astronomy Engine moon node searcher. */
+        if (lnum == 1)
+        {
+            /* The very first time, so search for the first node in the series. */
+            /* Back up a few days to make sure we really are finding it ourselves. */
+            astro_time_t earlier = Astronomy_AddDays(time, -6.5472);    /* pick a weird amount of time */
+            node = Astronomy_SearchMoonNode(earlier);
+        }
+        else
+        {
+            double prev_tt = node.time.tt;
+
+            /* Use the previous node to find the next node. */
+            node = Astronomy_NextMoonNode(node);
+
+            /* Find the range of time intervals between consecutive nodes. */
+            dt = node.time.tt - prev_tt;
+            if (dt < min_dt)
+                min_dt = dt;
+            if (dt > max_dt)
+                max_dt = dt;
+        }
+
+        if (node.status != ASTRO_SUCCESS)
+            FAIL("C MoonNodes(%s line %d): error %d returned by node search\n", filename, lnum, node.status);
+
+        /* Verify the ecliptic latitude is very close to zero at the alleged node. */
+        ecl = Astronomy_EclipticGeoMoon(node.time);
+        CHECK_STATUS(ecl);
+        diff_lat = 60.0 * ABS(ecl.lat);
+        if (diff_lat > 8.06e-4)
+            FAIL("C MoonNodes(%s line %d): found node has excessive latitude = %0.4le arcmin\n", filename, lnum, diff_lat);
+        if (diff_lat > max_node_lat)
+            max_node_lat = diff_lat;
+
+        /* Verify the time agrees with Espenak's time to within a few minutes. */
+        diff_minutes = (24.0 * 60.0) * ABS(node.time.tt - time.tt);
+        if (diff_minutes > max_minutes)
+            max_minutes = diff_minutes;
 
-    observer.latitude = 30.0;
-    observer.longitude = -80.0;
-    observer.height = 1000.0;
+        /* Verify the kind of node matches what Espenak says (ascending or descending). */
+        if (kind == 'A' && node.kind != ASCENDING_NODE)
+            FAIL("C MoonNodes(%s line %d): did not find ascending node as expected.\n", filename, lnum);
 
-    observer_state = Astronomy_ObserverState(&time, observer, EQUATOR_J2000);
-    if (observer_state.status != ASTRO_SUCCESS)
-    {
-        fprintf(stderr, "C TopoStateFunc: Astronomy_ObserverState returned error %d\n", observer_state.status);
-        return observer_state;
-    }
+        if (kind == 'D' && node.kind != DESCENDING_NODE)
+            FAIL("C MoonNodes(%s line %d): did not find descending node as expected.\n", filename, lnum);
 
-    if (body == BODY_GEO_EMB)
-    {
-        state = Astronomy_GeoEmbState(time);
-    }
-    else if (body == BODY_EARTH)
-    {
-        state.status = ASTRO_SUCCESS;
-        state.t = time;
-        state.x = state.y = state.z = 0.0;
-        state.vx = state.vy = state.vz = 0.0;
-    }
-    else
-    {
-        fprintf(stderr, "C TopoStateFunc: Unsupported body %d\n", body);
-        memset(&state, 0, sizeof(state));
-        state.status = ASTRO_INVALID_BODY;
-        return state;
+        /* Prepare for the next iteration. */
+        prev_kind = kind;
     }
 
-    if (state.status != ASTRO_SUCCESS)
-    {
-        fprintf(stderr, "C TopoStateFunc: body %d resulted in error %d\n", body, state.status);
-        return state;
-    }
+    if (max_lat > 0.183)
+        FFAIL("EXCESSIVE ecliptic latitude error = %0.3lf arcmin\n", max_lat);
 
-    state.x  -= observer_state.x;
-    state.y  -= observer_state.y;
-    state.z  -= observer_state.z;
-    state.vx -= observer_state.vx;
-    state.vy -= observer_state.vy;
-    state.vz -= observer_state.vz;
+    if (max_minutes > 3.681)
+        FFAIL("EXCESSIVE time prediction error = %0.3lf minutes\n", max_minutes);
 
-    return state;
+    FDEBUG("min_dt = %0.3lf days, max_dt = %0.3lf days.\n", min_dt, max_dt);
+    FPASSA("(%d nodes, max lat error = %0.3lf arcmin, max equ error = %0.3lf arcmin, max time error = %0.3lf minutes, max node lat = %0.3le arcmin)\n", lnum, max_lat, max_angle, max_minutes, max_node_lat);
+fail:
+    if (infile != NULL) fclose(infile);
+    return error;
 }
 
-static int TopoStateTest(void)
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static int SiderealTimeTest(void)
 {
-    int error;  /* set as a side-effect of CHECK macro */
-    verify_state_context_t context;
+    int error;
+    astro_time_t time;
+    double gast, diff;
+    const double correct = 9.3983699280076483;
 
-    memset(&context, 0, sizeof(context));
-    context.func = TopoStateFunc;
-    CHECK(VerifyStateBody(&context, BODY_EARTH,   "topostate/Earth_N30_W80_1000m.txt",  2.108e-04, 2.430e-04));
-    CHECK(VerifyStateBody(&context, BODY_GEO_EMB, "topostate/EMB_N30_W80_1000m.txt",    7.197e-04, 2.497e-04));
+    time = Astronomy_MakeTime(2022, 3, 15, 21, 50, 0.0);
+    gast = Astronomy_SiderealTime(&time);
+    diff = ABS(gast - correct);
+    printf("C %s: gast=%0.15f, correct=%0.15lf, diff=%0.3le hours.\n", __func__, gast, correct, diff);
+    if (diff > 1.0e-15)
+        FFAIL("EXCESSIVE ERROR\n");
 
     FPASS();
 fail:
@@ -6627,870 +9076,1277 @@ fail:
 
 /*-----------------------------------------------------------------------------------------------------------*/
 
-static int Twilight(void)
+static double ArcminPosError(astro_state_vector_t correct, astro_state_vector_t calc)
 {
-    int error, lnum, nscanned, i;
-    char line[200];
-    char search_text[20];
-    char token[6][20];
-    astro_time_t search_time;
-    astro_time_t expected_time[6];
-    astro_search_result_t calc[6];
-    FILE *infile;
-    astro_observer_t observer;
-    double diff, max_diff = 0.0;
-    const double tolerance_seconds = 60.0;
-    const char *filename = "riseset/twilight.txt";
-
-    infile = fopen(filename, "rt");
-    if (infile == NULL)
-        FFAIL("Cannot open input file: %s\n", filename);
-
-    lnum = 0;
-    observer.height = 0.0;
-    while (ReadLine(line, sizeof(line), infile, filename, lnum))
-    {
-        ++lnum;
-
-        nscanned = sscanf(line, "%lf %lf %17s %17s %17s %17s %17s %17s %17s",
-            &observer.latitude,
-            &observer.longitude,
-            search_text,
-            token[0], token[1], token[2], token[3], token[4], token[5]);
-
-        if (nscanned != 9)
-            FAIL("C Twilight(%s line %d): expected 9 tokens but found %d\n", filename, lnum, nscanned);
-
-        if (ParseDate(search_text, &search_time))
-            FAIL("C Twilight(%s line %d): BAD SEARCH TIME FORMAT.", filename, lnum);
-
-        for (i = 0; i < 6; ++i)
-            if (ParseDate(token[i], &expected_time[i]))
-                FAIL("C Twilight(%s line %d): BAD EXPECTED TIME [%d] FORMAT.\n", filename, lnum, i);
-
-        search_time = expected_time[0];
-        calc[0] = Astronomy_SearchAltitude(BODY_SUN, observer, DIRECTION_RISE, search_time, 1.0, -18.0);   // astronomical dawn
-        calc[1] = Astronomy_SearchAltitude(BODY_SUN, observer, DIRECTION_RISE, search_time, 1.0, -12.0);   // nautical dawn
-        calc[2] = Astronomy_SearchAltitude(BODY_SUN, observer, DIRECTION_RISE, search_time, 1.0,  -6.0);   // civil dawn
-        calc[3] = Astronomy_SearchAltitude(BODY_SUN, observer, DIRECTION_SET,  search_time, 1.0,  -6.0);   // civil dusk
-        calc[4] = Astronomy_SearchAltitude(BODY_SUN, observer, DIRECTION_SET,  search_time, 1.0, -12.0);   // nautical dusk
-        calc[5] = Astronomy_SearchAltitude(BODY_SUN, observer, DIRECTION_SET,  search_time, 1.0, -18.0);   // astronomical dusk
-
-        for (i = 0; i < 6; ++i)
-        {
-            if (calc[i].status != ASTRO_SUCCESS)
-                FAIL("C Twilight(%s line %d): error %d in search[%d]\n", filename, lnum, calc[i].status, i);
+    double dx = V(calc.x - correct.x);
+    double dy = V(calc.y - correct.y);
+    double dz = V(calc.z - correct.z);
+    double diff_squared = dx*dx + dy*dy + dz*dz;
+    double mag_squared = correct.x*correct.x + correct.y*correct.y + correct.z*correct.z;
+    double radians = V(sqrt(diff_squared / mag_squared));
+    double arcmin = (RAD2DEG * 60.0) * radians;
+    return arcmin;
+}
 
-            diff = 86400.0 * ABS(calc[i].time.ut - expected_time[i].ut);
-            if (diff > tolerance_seconds)
-                FAIL("C TwilightTest(%s line %d): EXCESSIVE ERROR = %0.3lf seconds for test %d.\n", filename, lnum, diff, i);
+static double ArcminVelError(astro_state_vector_t correct, astro_state_vector_t calc)
+{
+    double dx = V(calc.vx - correct.vx);
+    double dy = V(calc.vy - correct.vy);
+    double dz = V(calc.vz - correct.vz);
+    double diff_squared = dx*dx + dy*dy + dz*dz;
+    double mag_squared = correct.vx*correct.vx + correct.vy*correct.vy + correct.vz*correct.vz;
+    double radians = V(sqrt(diff_squared / mag_squared));
+    double arcmin = (RAD2DEG * 60.0) * radians;
+    return arcmin;
+}
 
-            if (diff > max_diff)
-                max_diff = diff;
-        }
-    }
 
-    FPASSA("(%d test cases, max error = %0.3lf seconds)\n", lnum, max_diff);
-fail:
-    if (infile != NULL) fclose(infile);
-    return error;
+static double SSB_ArcminPosError(astro_state_vector_t correct, astro_state_vector_t calc)
+{
+    /* Scale the SSB based on 1 AU, not on its absolute magnitude, which can become very close to zero. */
+    double dx = V(calc.x - correct.x);
+    double dy = V(calc.y - correct.y);
+    double dz = V(calc.z - correct.z);
+    double diff_squared = dx*dx + dy*dy + dz*dz;
+    double radians = V(sqrt(diff_squared));
+    double arcmin = (RAD2DEG * 60.0) * radians;
+    return arcmin;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
 
-static int Libration(const char *filename, int *ndata, double *var_lon, double *var_lat)
+static int GravSimFile(
+    const char *filename,
+    astro_body_t originBody,
+    int nsteps,
+    double *r_score,
+    double *v_score,
+    double r_thresh,
+    double v_thresh)
 {
     int error;
-    FILE *infile;
-    int lnum, count, nscanned;
-    char line[200];
-    int day, month, year, hour, minute;
-    char mtext[4];
-    double phase, age, diam, dist, ra, dec, slon, slat, elon, elat, axisa;
-    astro_time_t time;
-    astro_libration_t lib;
-    double diff_elon, diff_elat, diff_distance, diff_diam;
-    double max_diff_elon = 0.0, max_diff_elat = 0.0, max_diff_distance = 0.0, max_diff_diam = 0.0;
-    double max_eclip_lon = -900.0;
-
-    infile = fopen(filename, "rt");
-    if (infile == NULL)
-        FFAIL("cannot open input file: %s\n", filename);
-
-    lnum = 0;
-    count = 0;
-    while (ReadLine(line, sizeof(line), infile, filename, lnum))
-    {
-        ++lnum;
-        if (lnum == 1)
-        {
-            if (strcmp(line, "   Date       Time    Phase    Age    Diam    Dist     RA        Dec      Slon      Slat     Elon     Elat   AxisA\n"))
-                FAIL("C Libration(%s line %d): unexpected header line\n", filename, lnum);
-        }
-        else
-        {
-            /* 01 Jan 2020 00:00 UT  29.95   5.783  1774.5  403898  23.2609  -10.0824   114.557   -0.045   0.773    6.360  336.353 */
-            nscanned = sscanf(line,
-                "%d %3s %d %d:%d UT %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lf",
-                &day, mtext, &year, &hour, &minute,
-                &phase, &age, &diam, &dist, &ra, &dec, &slon, &slat, &elon, &elat, &axisa);
+    int i, k;
+    double rdiff, vdiff, tdiff;
+    double max_rdiff = 0.0, max_vdiff = 0.0;
+    astro_grav_sim_t *sim = NULL;
+    astro_state_vector_t state;
+    astro_status_t status;
+    state_vector_batch_t batch = EmptyStateVectorBatch();
+    astro_time_t time, checkTime;
+    astro_body_t checkOrigin;
 
-            if (nscanned != 16)
-                FAIL("C Libration(%s line %d): expected 16 tokens, found %d\n", filename, lnum, nscanned);
+    if (nsteps < 1)
+        FAIL("C GravSimFile(%s): invalid nsteps=%d\n", filename, nsteps);
 
-            /* Calculate the astronomy time value for this calendar date/time. */
-            if (ParseMonthName(mtext, &month))
-                FAIL("Libration(%s line %d): invalid month symbol '%s'\n", filename, lnum, mtext);
+    CHECK(LoadStateVectors(&batch, filename));
 
-            time = Astronomy_MakeTime(year, month, day, hour, minute, 0.0);
-            lib = Astronomy_Libration(time);
+    if (batch.length <= 0)
+        FAIL("C GravSimFile(%s): batch.length = %d is invalid.\n", filename, batch.length);
 
-            diff_elon = 60.0 * ABS(lib.elon - elon);
-            if (diff_elon > max_diff_elon)
-                max_diff_elon = diff_elon;
+    /* Use the state vector and time in the batch to initialize the gravity simulator. */
+    state = batch.array[0];
 
-            diff_elat = 60.0 * ABS(lib.elat - elat);
-            if (diff_elat > max_diff_elat)
-                max_diff_elat = diff_elat;
+    status = Astronomy_GravSimInit(&sim, originBody, state.t, 1, &state);
+    if (status != ASTRO_SUCCESS)
+        FAIL("C GravSimFile(%s): Astronomy_GravSimInit returned error %d\n", filename, status);
 
-            diff_distance = ABS(lib.dist_km - dist);
-            if (diff_distance > max_diff_distance)
-                max_diff_distance = diff_distance;
+    i = Astronomy_GravSimNumBodies(sim);
+    if (i != 1)
+        FAIL("C GravSimFile(%s): expected 1 body, found %d\n", filename, i);
 
-            diff_diam = ABS(lib.diam_deg - diam/3600.0);
-            if (diff_diam > max_diff_diam)
-                max_diff_diam = diff_diam;
+    checkOrigin = Astronomy_GravSimOrigin(sim);
+    if (checkOrigin != originBody)
+        FAIL("C GravSimFile(%s): expected body %d, found %d\n", filename, originBody, checkOrigin);
 
-            if (lib.mlon > max_eclip_lon)
-                max_eclip_lon = lib.mlon;
+    time = state.t;
+    for (i = 1; i < batch.length; ++i)
+    {
+        /* Split each entry of the input batch into `nsteps` simulation steps. */
+        double tt1 = batch.array[i-1].t.tt;
+        double tt2 = batch.array[i].t.tt;
+        double dt = (tt2 - tt1) / nsteps;
+        for (k = 1; k <= nsteps; ++k)
+        {
+            time = Astronomy_TerrestrialTime(tt1 + k*dt);
+            status = Astronomy_GravSimUpdate(sim, time, 1, &state);
+            if (status != ASTRO_SUCCESS)
+                FAIL("C GravSimFile(%s : i=%d): Astronomy_GravSimInit returned error %d\n", filename, i, status);
 
-            if (diff_elon > 0.1304)
-                FAIL("C Libration(%s line %d): EXCESSIVE diff_elon = %0.4lf arcmin\n", filename, lnum, diff_elon);
+            checkTime = Astronomy_GravSimTime(sim);
+            if (checkTime.tt != time.tt)
+                FAIL("C GravSimFile(%s): Expected tt=%0.16lf, found tt=%0.16lf", filename, time.tt, checkTime.tt);
+        }
 
-            if (diff_elat > 1.6476)
-                FAIL("C Libration(%s line %d): EXCESSIVE diff_elat = %0.4lf arcmin\n", filename, lnum, diff_elat);
+        tdiff = SECONDS_PER_DAY * ABS(time.tt - batch.array[i].t.tt);
+        if (tdiff > 1.0e-15)
+            FAIL("C GravSimFile(%s): terrestrial time error = %0.16lf seconds.\n", filename, tdiff);
 
-            if (diff_distance > 54.377)
-                FAIL("C Libration(%s line %d): EXCESSIVE diff_distance = %0.3lf km\n", filename, lnum, diff_distance);
+        /* Compare the simulated state with the reference state. */
+        rdiff = ArcminPosError(batch.array[i], state);
+        if (rdiff > max_rdiff)
+            max_rdiff = rdiff;
 
-            if (diff_diam > 0.00009)
-                FAIL("C Libration(%s line %d): EXCESSIVE diff_diam = %0.3le degrees\n", filename, lnum, diff_diam);
+        if (rdiff > r_thresh)
+            FAIL("C GravSimFile(%s : i=%d): EXCESSIVE position error = %0.4lf arcmin\n", filename, i, rdiff);
 
-            /* Update sum-of-squared-errors. */
-            *var_lon += diff_elon * diff_elon;
-            *var_lat += diff_elat * diff_elat;
+        vdiff = ArcminVelError(batch.array[i], state);
+        if (vdiff > max_vdiff)
+            max_vdiff = vdiff;
 
-            ++count;
-        }
+        if (vdiff > v_thresh)
+            FAIL("C GravSimFile(%s : i=%d): EXCESSIVE velocity error = %0.4lf arcmin\n", filename, i, vdiff);
     }
 
-    if (max_eclip_lon < 359.0 || max_eclip_lon > 360.0)
-        FAIL("C Libration(%s): INVALID max ecliptic longitude %0.3lf degrees.\n", filename, max_eclip_lon);
+    if (max_rdiff > *r_score)
+        *r_score = max_rdiff;
 
-    printf("C Libration(%s): PASS (%d test cases, max_diff_elon = %0.4lf arcmin, max_diff_elat = %0.4lf arcmin, max_diff_distance = %0.3lf km, max_diff_diam = %0.12lf deg)\n",
-        filename, count, max_diff_elon, max_diff_elat, max_diff_distance, max_diff_diam);
+    if (max_vdiff > *v_score)
+        *v_score = max_vdiff;
 
-    *ndata += count;
+    DEBUG("C GravSimFile(%-22s): PASS (count = %d, pos error = %7.4lf arcmin, vel error = %7.4lf arcmin)\n", filename, batch.length, max_rdiff, max_vdiff);
     error = 0;
 fail:
-    if (infile != NULL) fclose(infile);
+    Astronomy_GravSimFree(sim);
+    FreeStateVectorBatch(&batch);
     return error;
 }
 
-static int LibrationTest(void)
+
+static int GravSimEmpty(
+    const char *filename,
+    astro_body_t origin,
+    astro_body_t body,
+    double limit_rdiff,
+    double limit_vdiff)
 {
     int error;
-    int ndata = 0;
-    double var_lat = 0.0;
-    double var_lon = 0.0;
-    double dev_lat, dev_lon;
-
-    CHECK(Libration("libration/mooninfo_2020.txt", &ndata, &var_lon, &var_lat));
-    CHECK(Libration("libration/mooninfo_2021.txt", &ndata, &var_lon, &var_lat));
-    CHECK(Libration("libration/mooninfo_2022.txt", &ndata, &var_lon, &var_lat));
+    int i;
+    astro_body_t checkOrigin;
+    astro_status_t status;
+    astro_grav_sim_t *sim = NULL;
+    state_vector_batch_t batch = EmptyStateVectorBatch();
+    astro_state_vector_t calc;
+    double rdiff, vdiff;
+    double max_rdiff = 0.0;
+    double max_vdiff = 0.0;
 
-    dev_lon = sqrt(var_lon / ndata);
-    dev_lat = sqrt(var_lat / ndata);
-    printf("C LibrationTest PASS: %d data points, dev_lon = %0.4lf arcmin, dev_lat = %0.4lf arcmin\n", ndata, dev_lon, dev_lat);
-fail:
-    return error;
-}
+    CHECK(LoadStateVectors(&batch, filename));
+    if (batch.length < 1)
+        FAIL("C GravSimEmpty(%s): invalid number of entries = %d\n", filename, batch.length);
 
-/*-----------------------------------------------------------------------------------------------------------*/
+    /* Verify that we can create an empty simulator, and that we can calculate the SSB from it. */
+    status = Astronomy_GravSimInit(&sim, origin, batch.array[0].t, 0, NULL);
+    if (status != ASTRO_SUCCESS)
+        FAIL("C GravSimEmpty(%s): Astronomy_GravSimInit returned %d\n", filename, status);
 
-static int DE405_Check(void)
-{
-    int error, lnum, nscanned;
-    const char *filename = "barystate/de405_state.txt";
-    FILE *infile;
-    double jd;
-    astro_time_t time;
-    char line[200];
-    char name[10];
-    double pos[3], vel[3];
-    astro_body_t body;
-    astro_state_vector_t state;
-    double dx, dy, dz, dr, dv;
-    double scale;
+    i = Astronomy_GravSimNumBodies(sim);
+    if (i != 0)
+        FAIL("C GravSimEmpty(%s): expected 0 bodies, found %d\n", filename, i);
 
-    infile = fopen(filename, "rt");
-    if (infile == NULL)
-        FFAIL("cannot open input file: %s\n", filename);
+    checkOrigin = Astronomy_GravSimOrigin(sim);
+    if (checkOrigin != origin)
+        FAIL("C GravSimEmpty(%s): expected body %d, found %d\n", filename, origin, checkOrigin);
 
-    lnum = 0;
-    while (ReadLine(line, sizeof(line), infile, filename, 0))
+    for (i = 0; i < batch.length; ++i)
     {
-        ++lnum;
-        if (line[0] == '*')
-            break;
-
-        if (lnum == 1)
-        {
-            if (1 != sscanf(line, "%lf", &jd))
-                FAIL("DE405_Check(%s line %d): cannot scan Julian Date\n", filename, lnum);
-            time = Astronomy_TerrestrialTime(jd - JD_2000);
-            Astronomy_FormatTime(time, TIME_FORMAT_MILLI, line, sizeof(line));
-            FDEBUG("time = %s\n", line);
-        }
-        else
-        {
-            nscanned = sscanf(line, "%7[A-Za-z] %lf %lf %lf %lf %lf %lf", name, &pos[0], &pos[1], &pos[2], &vel[0], &vel[1], &vel[2]);
-            if (nscanned != 7)
-                FAIL("C DE405_Check(%s line %d): expected 7 tokens, found %d\n", filename, lnum, nscanned);
-            body = Astronomy_BodyCode(name);
-            if (body == BODY_INVALID)
-                FAIL("C DE405_Check(%s line %d): unrecognized body name '%s'\n", filename, lnum, name);
-
-            switch (body)
-            {
-            case BODY_MOON:
-                /* geocentric Moon */
-                state = Astronomy_GeoMoonState(time);
-                scale = sqrt(pos[0]*pos[0] + pos[1]*pos[1] + pos[2]*pos[2]);
-                break;
-
-            case BODY_SUN:
-                /* barycentric Sun */
-                state = Astronomy_BaryState(body, time);
-                scale = 1.0;
-                break;
+        status = Astronomy_GravSimUpdate(sim, batch.array[i].t, 0, NULL);
+        if (status != ASTRO_SUCCESS)
+            FAIL("C GravSimEmpty(%s): i=%d, Astronomy_GravSimUpdate returned %d\n", filename, i, status);
 
-            default:
-                /* heliocentric planet */
-                state = Astronomy_HelioState(body, time);
-                scale = sqrt(pos[0]*pos[0] + pos[1]*pos[1] + pos[2]*pos[2]);
-                break;
-            }
+        calc = Astronomy_GravSimBodyState(sim, body);
+        CHECK_STATUS(calc);
 
-            if (state.status != ASTRO_SUCCESS)
-                FAIL("C DE405_Check(%s line %d): status = %d\n", filename, lnum, state.status);
+        if (origin==BODY_SSB && body==BODY_SUN)
+            rdiff = SSB_ArcminPosError(batch.array[i], calc);
+        else
+            rdiff = ArcminPosError(batch.array[i], calc);
 
-            dx = pos[0] - state.x;
-            dy = pos[1] - state.y;
-            dz = pos[2] - state.z;
-            dr = V(sqrt(dx*dx + dy*dy + dz*dz) / scale);
+        if (rdiff > limit_rdiff)
+            FAIL("C GravSimEmpty(%s): excessive position error = %0.6lf arcmin\n", filename, rdiff);
 
-            dx = vel[0] - state.vx;
-            dy = vel[1] - state.vy;
-            dz = vel[2] - state.vz;
-            dv = V(sqrt(dx*dx + dy*dy + dz*dz));
+        if (rdiff > max_rdiff)
+            max_rdiff = rdiff;
 
-            FDEBUG("%-10s dr=%0.4le dv=%0.4le\n", name, dr, dv);
-            if (dr > 8.7e-5)
-                FLNFAIL("EXCESSIVE POSITION ERROR\n");
+        vdiff = ArcminVelError(batch.array[i], calc);
+        if (vdiff > max_vdiff)
+            max_vdiff = vdiff;
 
-            if (dv > 7.3e-6)
-                FLNFAIL("EXCESSIVE VELOCITY ERROR\n");
-        }
+        if (vdiff > limit_vdiff)
+            FAIL("C GravSimEmpty(%s): excessive velocity error = %0.6lf arcmin\n", filename, vdiff);
     }
 
-    FPASS();
+    DEBUG("C GravSimEmpty(%-22s): PASS - %d cases, pos error = %0.4lf arcmin, vel error = %0.4lf arcmin\n", filename, batch.length, max_rdiff, max_vdiff);
+    error = 0;
 fail:
-    if (infile != NULL) fclose(infile);
+    Astronomy_GravSimFree(sim);
     return error;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
 
-static int AxisTestBody(astro_body_t body, const char *filename, double arcmin_tolerance)
+static int GravSimAdaptiveFile(
+    const char *filename,
+    astro_body_t originBody,
+    double tolerance,
+    double r_thresh,
+    double v_thresh)
 {
-    int error, lnum, nscanned, found_data, count;
-    astro_axis_t axis;
-    astro_time_t time;
-    astro_spherical_t sphere;
-    astro_vector_t north;
-    astro_angle_result_t diff;
-    double jd, ra, dec, arcmin, max_arcmin;
-    FILE *infile;
-    char line[100];
+    int error, i, fixed_evaluations;
+    double rdiff, vdiff, max_rdiff = 0.0, max_vdiff = 0.0;
+    astro_grav_sim_t *sim = NULL;
+    astro_state_vector_t state;
+    astro_status_t status;
+    astro_gravsim_stats_t stats;
+    state_vector_batch_t batch = EmptyStateVectorBatch();
+    const int nsteps = 20;  /* the number of fixed steps per entry that GravitySimulatorTest uses */
 
-    infile = fopen(filename, "rt");
-    if (infile == NULL)
-        FAIL("AxisTestBody: cannot open input file: %s\n", filename);
+    CHECK(LoadStateVectors(&batch, filename));
+    if (batch.length < 2)
+        FAIL("C GravSimAdaptiveFile(%s): batch.length = %d is invalid.\n", filename, batch.length);
 
-    count = 0;
-    lnum = 0;
-    found_data = 0;
-    max_arcmin = 0.0;
-    while (ReadLine(line, sizeof(line), infile, filename, lnum))
+    state = batch.array[0];
+    status = Astronomy_GravSimInit(&sim, originBody, state.t, 1, &state);
+    if (status != ASTRO_SUCCESS)
+        FAIL("C GravSimAdaptiveFile(%s): Astronomy_GravSimInit returned error %d\n", filename, status);
+
+    status = Astronomy_GravSimSetIntegrator(sim, GRAVSIM_DORMAND_PRINCE, tolerance);
+    if (status != ASTRO_SUCCESS)
+        FAIL("C GravSimAdaptiveFile(%s): Astronomy_GravSimSetIntegrator returned error %d\n", filename, status);
+
+    /* Let the integrator choose its own steps between the reference states. */
+    for (i = 1; i < batch.length; ++i)
     {
-        ++lnum;
-        if (!found_data)
-        {
-            if (0 == memcmp(line, "$$SOE", 5))
-                found_data = 1;
-        }
-        else
-        {
-            if (0 == memcmp(line, "$$EOE", 5))
-                break;
+        status = Astronomy_GravSimUpdate(sim, batch.array[i].t, 1, &state);
+        if (status != ASTRO_SUCCESS)
+            FAIL("C GravSimAdaptiveFile(%s : i=%d): Astronomy_GravSimUpdate returned error %d\n", filename, i, status);
 
-            /* [ 1979-Jun-13 00:00 2444037.500000000     181.44164   89.88493] */
-            if (strlen(line) < 61)
-                FAIL("C AxisTestBody(%s line %d): line is too short\n", filename, lnum);
+        if (state.t.tt != batch.array[i].t.tt)
+            FAIL("C GravSimAdaptiveFile(%s : i=%d): expected tt=%0.16lf, found tt=%0.16lf\n", filename, i, batch.array[i].t.tt, state.t.tt);
+
+        rdiff = ArcminPosError(batch.array[i], state);
+        if (rdiff > max_rdiff)
+            max_rdiff = rdiff;
 
-            nscanned = sscanf(&line[19], "%lf %lf %lf", &jd, &ra, &dec);
-            if (nscanned != 3)
-                FAIL("C AxisTestBody(%s line %d): could not scan data.\n", filename, lnum);
+        vdiff = ArcminVelError(batch.array[i], state);
+        if (vdiff > max_vdiff)
+            max_vdiff = vdiff;
+    }
 
-            time = Astronomy_TimeFromDays(jd - JD_2000);
-            axis = Astronomy_RotationAxis(body, &time);
-            if (axis.status != ASTRO_SUCCESS)
-                FAIL("C AxisTestBody(%s line %d): Astronomy_Axis returned error %d\n", filename, lnum, axis.status);
+    if (max_rdiff > r_thresh)
+        FAIL("C GravSimAdaptiveFile(%s): EXCESSIVE position error = %0.4lf arcmin\n", filename, max_rdiff);
 
-            /* Convert the reference angles to a reference north pole vector. */
-            sphere.status = ASTRO_SUCCESS;
-            sphere.dist = 1.0;
-            sphere.lat = dec;
-            sphere.lon = ra;    /* tricky: RA is in degrees, not sidereal hours */
-            north = Astronomy_VectorFromSphere(sphere, time);
-            if (north.status != ASTRO_SUCCESS)
-                FAIL("C AxisTestBody(%s line %d): VectorFromSphere error %d\n", filename, lnum, north.status);
+    if (max_vdiff > v_thresh)
+        FAIL("C GravSimAdaptiveFile(%s): EXCESSIVE velocity error = %0.4lf arcmin\n", filename, max_vdiff);
 
-            /* Find angle between two versions of the north pole. Use that as the measure of error. */
-            diff = Astronomy_AngleBetween(north, axis.north);
-            if (diff.status != ASTRO_SUCCESS)
-                FAIL("C AxisTestBody(%s line %d): AngleBetween error %d\n", filename, lnum, diff.status);
+    stats = Astronomy_GravSimStats(sim);
+    if (stats.steps < 1 || stats.evaluations != 5*(stats.steps + stats.rejected))
+        FAIL("C GravSimAdaptiveFile(%s): inconsistent statistics: steps=%d, rejected=%d, evaluations=%d\n", filename, stats.steps, stats.rejected, stats.evaluations);
 
-            arcmin = diff.angle * 60.0;     /* convert error degrees to arcminutes */
-            if (arcmin > max_arcmin)
-                max_arcmin = arcmin;
+    if (!(stats.max_error <= tolerance) || stats.last_error > stats.max_error)
+        FAIL("C GravSimAdaptiveFile(%s): invalid error estimates: max=%lg, last=%lg, tolerance=%lg\n", filename, stats.max_error, stats.last_error, tolerance);
 
-            ++count;
-        }
-    }
+    /* The reference states are close together, so the savings are modest here. GravSimAdaptiveLong checks the real savings. */
+    fixed_evaluations = nsteps * (batch.length - 1);
+    if (stats.evaluations >= fixed_evaluations)
+        FAIL("C GravSimAdaptiveFile(%s): too many evaluations: %d, versus %d for fixed steps.\n", filename, stats.evaluations, fixed_evaluations);
 
-    DEBUG("C AxisTestBody(%s): %d test cases, max arcmin error = %0.6lf.\n", filename, count, max_arcmin);
-    if (max_arcmin > arcmin_tolerance)
-        FAIL("C AxisTestBody(%s): EXCESSIVE ERROR = %lf arcmin\n", filename, max_arcmin);
+    DEBUG("C GravSimAdaptiveFile(%-20s): PASS (pos error = %7.4lf arcmin, vel error = %7.4lf arcmin, steps = %d, rejected = %d, evaluations = %d vs %d, max est. error = %0.2le)\n",
+        filename, max_rdiff, max_vdiff, stats.steps, stats.rejected, stats.evaluations, fixed_evaluations, stats.max_error);
     error = 0;
 fail:
-    if (infile != NULL) fclose(infile);
-    return error;
-}
-
-static int AxisTest(void)
-{
-    int error;
-    CHECK(AxisTestBody(BODY_SUN,      "axis/Sun.txt",       0.0));
-    CHECK(AxisTestBody(BODY_MERCURY,  "axis/Mercury.txt",   0.074340));
-    CHECK(AxisTestBody(BODY_VENUS,    "axis/Venus.txt",     0.0));
-    CHECK(AxisTestBody(BODY_EARTH,    "axis/Earth.txt",     0.002032));
-    CHECK(AxisTestBody(BODY_MOON,     "axis/Moon.txt",      0.264845));
-    CHECK(AxisTestBody(BODY_MARS,     "axis/Mars.txt",      0.075323));
-    CHECK(AxisTestBody(BODY_JUPITER,  "axis/Jupiter.txt",   0.000324));
-    CHECK(AxisTestBody(BODY_SATURN,   "axis/Saturn.txt",    0.000304));
-    CHECK(AxisTestBody(BODY_URANUS,   "axis/Uranus.txt",    0.0));
-    CHECK(AxisTestBody(BODY_NEPTUNE,  "axis/Neptune.txt",   0.000462));
-    CHECK(AxisTestBody(BODY_PLUTO,    "axis/Pluto.txt",     0.0));
-    FPASS();
-fail:
+    Astronomy_GravSimFree(sim);
+    FreeStateVectorBatch(&batch);
     return error;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
 
-static int MapPerformanceTest(void)
+static int GravSimAdaptiveLong(const char *filename, double tolerance)
 {
-    int error;
-    int count;
-    astro_observer_t observer;
+    /*
+        Propagate an asteroid across the whole time span of a reference file in a single update,
+        and compare the integrator errors, not the model errors, of the fixed-step and adaptive integrators.
+        The reference trajectory comes from the adaptive integrator with a very small tolerance.
+    */
+    int error, k, nsteps;
+    astro_grav_sim_t *sim = NULL;
+    astro_state_vector_t init, correct, fixed, adaptive;
     astro_time_t time;
-    astro_vector_t ovec;
-    astro_rotation_t rot;
+    astro_gravsim_stats_t fixed_stats, adaptive_stats;
+    state_vector_batch_t batch = EmptyStateVectorBatch();
+    double fixed_error, adaptive_error;
+    const double dt = 0.25;         /* fixed step size [days] */
 
-    time = Astronomy_MakeTime(2022, 1, 22, 12, 30, 0.0);
+    CHECK(LoadStateVectors(&batch, filename));
+    if (batch.length < 2)
+        FAIL("C GravSimAdaptiveLong(%s): batch.length = %d is invalid.\n", filename, batch.length);
 
-    count = 0;
-    observer.height = 0.0;
-    for (observer.longitude = -180.0; observer.longitude < +180.0; observer.longitude += 0.01)
-    {
-        for (observer.latitude = -85.0; observer.latitude <= +85.0; observer.latitude += 0.01)
-        {
-            ovec = Astronomy_ObserverVector(&time, observer, EQUATOR_OF_DATE);
-            CHECK_STATUS(ovec);
-            rot = Astronomy_Rotation_EQD_HOR(&time, observer);
-            CHECK_STATUS(rot);
-            ++count;
-        }
-    }
+    init = batch.array[0];
+    time = batch.array[batch.length-1].t;
+    nsteps = (int)((time.tt - init.t.tt) / dt);
 
-    /*
-        612,017,000 geographic locations.
+    CHECK_CODE(Astronomy_GravSimInit(&sim, BODY_SSB, init.t, 1, &init));
+    CHECK_CODE(Astronomy_GravSimSetIntegrator(sim, GRAVSIM_DORMAND_PRINCE, 1.0e-14));
+    CHECK_CODE(Astronomy_GravSimUpdate(sim, time, 1, &correct));
+    Astronomy_GravSimFree(sim);
+    sim = NULL;
 
-        Before sidereal time optimization:
-        Trial #1: 236.420 seconds.
-        Trial #2: 235.906 seconds.
-        Trial #3: 238.809 seconds.
+    CHECK_CODE(Astronomy_GravSimInit(&sim, BODY_SSB, init.t, 1, &init));
+    for (k = 1; k <= nsteps; ++k)
+        CHECK_CODE(Astronomy_GravSimUpdate(sim, (k < nsteps) ? Astronomy_AddDays(init.t, k*dt) : time, 1, &fixed));
+    fixed_stats = Astronomy_GravSimStats(sim);
+    Astronomy_GravSimFree(sim);
+    sim = NULL;
 
-        After sidereal time optimization:
-        Trial #1: 103.452 seconds.
-        Trial #2: 104.249 seconds.
-        Trial #3: 103.657 seconds.
+    CHECK_CODE(Astronomy_GravSimInit(&sim, BODY_SSB, init.t, 1, &init));
+    CHECK_CODE(Astronomy_GravSimSetIntegrator(sim, GRAVSIM_DORMAND_PRINCE, tolerance));
+    CHECK_CODE(Astronomy_GravSimUpdate(sim, time, 1, &adaptive));
+    adaptive_stats = Astronomy_GravSimStats(sim);
 
-        Mean performance improvement ratio = 2.284.
-    */
+    fixed_error = ArcminPosError(correct, fixed);
+    adaptive_error = ArcminPosError(correct, adaptive);
+
+    DEBUG("C GravSimAdaptiveLong(%s): fixed error = %0.3le arcmin with %d evaluations; adaptive error = %0.3le arcmin with %d evaluations in %d steps.\n",
+        filename, fixed_error, fixed_stats.evaluations, adaptive_error, adaptive_stats.evaluations, adaptive_stats.steps);
+
+    if (fixed_stats.steps != nsteps || fixed_stats.evaluations != nsteps || fixed_stats.max_error != 0.0)
+        FAIL("C GravSimAdaptiveLong(%s): unexpected fixed-step statistics: steps=%d, evaluations=%d\n", filename, fixed_stats.steps, fixed_stats.evaluations);
+
+    if (adaptive_error > fixed_error)
+        FAIL("C GravSimAdaptiveLong(%s): adaptive integrator is less accurate than fixed steps.\n", filename);
+
+    if (10 * adaptive_stats.evaluations > fixed_stats.evaluations)
+        FAIL("C GravSimAdaptiveLong(%s): adaptive integrator did not save an order of magnitude of evaluations.\n", filename);
+
+    /* Swapping must undo the whole adaptive update, however many steps it took. */
+    Astronomy_GravSimSwap(sim);
+    CHECK_CODE(Astronomy_GravSimUpdate(sim, init.t, 1, &adaptive));
+    if (adaptive.x != init.x || adaptive.y != init.y || adaptive.z != init.z || adaptive.vx != init.vx || adaptive.vy != init.vy || adaptive.vz != init.vz)
+        FAIL("C GravSimAdaptiveLong(%s): swap did not restore the initial state.\n", filename);
 
-    printf("MapPerformanceTest: PASS (%d geographic locations)\n", count);
     error = 0;
 fail:
+    Astronomy_GravSimFree(sim);
+    FreeStateVectorBatch(&batch);
     return error;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
 
-static int GeoMoonPerformance(void)
+static int GravSimSameStates(const char *tag, int nbodies, const astro_state_vector_t a[], const astro_state_vector_t b[])
 {
-    /* Call EclipticGeoMoon for many different times to measure its speed. */
+    int error, i;
+
+    for (i = 0; i < nbodies; ++i)
+        if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].z != b[i].z || a[i].vx != b[i].vx || a[i].vy != b[i].vy || a[i].vz != b[i].vz || a[i].t.tt != b[i].t.tt)
+            FFAIL("%s: state %d does not match.\n", tag, i);
 
-    int error = 1;
-    int count = 0;
-    astro_time_t time = Astronomy_MakeTime(1800, 1, 1, 0, 0, 0.0);
-    astro_time_t stopTime = Astronomy_MakeTime(2200, 1, 1, 0, 0, 0.0);
-    while (time.ut <= stopTime.ut)
-    {
-        astro_spherical_t sphere = Astronomy_EclipticGeoMoon(time);
-        if (sphere.status != ASTRO_SUCCESS)
-            FAIL("GeoMoonPerformance: EclipticGeoMoon returned error %d.\n", sphere.status);
-        time = Astronomy_AddDays(time, 0.01);
-        ++count;
-    }
-    printf("GeoMoonPerformance: PASS (called %d times)\n", count);
     error = 0;
 fail:
     return error;
 }
 
 
-/*-----------------------------------------------------------------------------------------------------------*/
-
-static int NutationPerformance(void)
+static int GravSimAdaptiveNoConverge(const char *filename)
 {
-    /* Call SiderealTime for many different times to gauge speed of iau2000b nutation model. */
+    /*
+        An adaptive update that cannot meet its tolerance must leave both endpoints unchanged.
+        Run the check twice: once examining the current endpoint, and once
+        swapping back to the previous endpoint.
+    */
+    int error, pass;
+    astro_status_t status;
+    astro_grav_sim_t *sim = NULL;
+    astro_state_vector_t init, state, check;
+    state_vector_batch_t batch = EmptyStateVectorBatch();
 
-    int count = 0;
-    astro_time_t time = Astronomy_MakeTime(1800, 1, 1, 0, 0, 0.0);
-    astro_time_t stopTime = Astronomy_MakeTime(2200, 1, 1, 0, 0, 0.0);
-    while (time.ut <= stopTime.ut)
+    CHECK(LoadStateVectors(&batch, filename));
+    if (batch.length < 3)
+        FAIL("C GravSimAdaptiveNoConverge(%s): batch.length = %d is invalid.\n", filename, batch.length);
+
+    init = batch.array[0];
+    for (pass = 0; pass < 2; ++pass)
     {
-        Astronomy_SiderealTime(&time);
-        time = Astronomy_AddDays(time, 0.01);
-        ++count;
+        CHECK_CODE(Astronomy_GravSimInit(&sim, BODY_SSB, init.t, 1, &init));
+        CHECK_CODE(Astronomy_GravSimSetIntegrator(sim, GRAVSIM_DORMAND_PRINCE, 1.0e-10));
+        CHECK_CODE(Astronomy_GravSimUpdate(sim, batch.array[1].t, 1, &state));
+
+        /* No step can be small enough to meet an absurdly small tolerance. */
+        CHECK_CODE(Astronomy_GravSimSetIntegrator(sim, GRAVSIM_DORMAND_PRINCE, 1.0e-300));
+        status = Astronomy_GravSimUpdate(sim, batch.array[2].t, 1, &check);
+        if (status != ASTRO_NO_CONVERGE)
+            FAIL("C GravSimAdaptiveNoConverge(%s): expected ASTRO_NO_CONVERGE, but found status %d\n", filename, status);
+
+        if (pass == 0)
+        {
+            CHECK_CODE(Astronomy_GravSimUpdate(sim, batch.array[1].t, 1, &check));
+            CHECK(GravSimSameStates("current", 1, &check, &state));
+        }
+        else
+        {
+            Astronomy_GravSimSwap(sim);
+            CHECK_CODE(Astronomy_GravSimUpdate(sim, init.t, 1, &check));
+            CHECK(GravSimSameStates("previous", 1, &check, &init));
+        }
+
+        Astronomy_GravSimFree(sim);
+        sim = NULL;
     }
-    printf("NutationPerformance: PASS (called %d times)\n", count);
-    return 0;
-}
 
-/*-----------------------------------------------------------------------------------------------------------*/
+    error = 0;
+fail:
+    Astronomy_GravSimFree(sim);
+    FreeStateVectorBatch(&batch);
+    return error;
+}
 
 
-static int MoonNodes(void)
+static int GravSimAdaptiveTest(void)
 {
-    const char *filename = "moon_nodes/moon_nodes.txt";
     int error;
-    int lnum, nscanned;
-    char kind, prev_kind;
-    astro_time_t time;
-    double ra, dec;
-    FILE *infile;
-    char line[100];
-    char date[20];
-    astro_spherical_t ecl;
-    astro_vector_t vec_eqj, vec_eqd, vec_test;
-    double diff_lat, max_lat = 0.0;
-    double max_node_lat = 0.0;
-    double diff_angle, max_angle = 0.0;
-    double diff_minutes, max_minutes = 0.0;
-    double dt, min_dt = 1.0e+99, max_dt = 0.0;
-    astro_rotation_t rot;
-    astro_spherical_t sphere;
-    astro_angle_result_t result;
-    astro_node_event_t node;
+    astro_grav_sim_t *sim = NULL;
+    astro_gravsim_stats_t stats;
+    astro_time_t time = Astronomy_MakeTime(2000, 1, 1, 0, 0, 0.0);
+
+    CHECK_CODE(Astronomy_GravSimInit(&sim, BODY_SUN, time, 0, NULL));
+    if (ASTRO_INVALID_PARAMETER != Astronomy_GravSimSetIntegrator(sim, GRAVSIM_DORMAND_PRINCE, 0.0))
+        FAIL("C GravSimAdaptiveTest: zero tolerance should have been rejected.\n");
+    if (ASTRO_INVALID_PARAMETER != Astronomy_GravSimSetIntegrator(sim, GRAVSIM_DORMAND_PRINCE, NAN))
+        FAIL("C GravSimAdaptiveTest: NAN tolerance should have been rejected.\n");
+    if (ASTRO_INVALID_PARAMETER != Astronomy_GravSimSetIntegrator(sim, (astro_gravsim_integrator_t)99, 1.0e-12))
+        FAIL("C GravSimAdaptiveTest: invalid integrator should have been rejected.\n");
+    Astronomy_GravSimFree(sim);
+    sim = NULL;
 
-    memset(&node, 0, sizeof(node));
-    node.status = ASTRO_NOT_INITIALIZED;
+    stats = Astronomy_GravSimStats(NULL);
+    if (stats.steps != 0 || stats.rejected != 0 || stats.evaluations != 0 || stats.step_days != 0.0 || stats.last_error != 0.0 || stats.max_error != 0.0)
+        FAIL("C GravSimAdaptiveTest: expected zero statistics for a NULL simulation.\n");
 
-    infile = fopen(filename, "rt");
-    if (infile == NULL)
-        FAIL("MoonNodes: Cannot open input file: %s\n", filename);
+    CHECK(GravSimAdaptiveFile("barystate/Ceres.txt",    BODY_SSB,   1.0e-10, 0.66, 0.64));
+    CHECK(GravSimAdaptiveFile("barystate/Pallas.txt",   BODY_SSB,   1.0e-10, 0.48, 0.39));
+    CHECK(GravSimAdaptiveFile("barystate/Vesta.txt",    BODY_SSB,   1.0e-10, 0.57, 0.51));
+    CHECK(GravSimAdaptiveFile("barystate/Juno.txt",     BODY_SSB,   1.0e-10, 0.71, 0.56));
+    CHECK(GravSimAdaptiveFile("barystate/Bennu.txt",    BODY_SSB,   1.0e-09, 2.26, 1.89));
+    CHECK(GravSimAdaptiveFile("barystate/Halley.txt",   BODY_SSB,   1.0e-10, 0.039, 0.068));
+    CHECK(GravSimAdaptiveFile("heliostate/Ceres.txt",   BODY_SUN,   1.0e-10, 0.036, 0.035));
+    CHECK(GravSimAdaptiveFile("geostate/Ceres.txt",     BODY_EARTH, 1.0e-10, 6.58, 6.48));
 
-    lnum = 0;
-    prev_kind = '?';
-    while (ReadLine(line, sizeof(line), infile, filename, lnum))
+    CHECK(GravSimAdaptiveLong("barystate/Ceres.txt", 1.0e-8));
+    CHECK(GravSimAdaptiveLong("barystate/Halley.txt", 1.0e-6));
+    CHECK(GravSimAdaptiveNoConverge("barystate/Ceres.txt"));
+
+    FPASS();
+fail:
+    Astronomy_GravSimFree(sim);
+    return error;
+}
+
+
+static int GravSimCheckpointInit(astro_grav_sim_t **sim, astro_body_t origin, astro_time_t time, int nbodies)
+{
+    int error, i;
+    astro_state_vector_t init[3], shift;
+    const astro_body_t source[3] = { BODY_MARS, BODY_JUPITER, BODY_VENUS };
+
+    /* Start small bodies near the orbits of some planets, but not exactly on them. */
+    for (i = 0; i < nbodies; ++i)
     {
-        ++lnum;
+        init[i] = Astronomy_HelioState(source[i], time);
+        CHECK_STATUS(init[i]);
+        init[i].x *= 1.1;
+        init[i].y *= 0.95;
+        init[i].vz += 0.001;
+    }
 
-        /* Parse the line from the test data file. */
-        /* A 2001-01-09T13:53Z    7.1233   22.5350 */
-        /* D 2001-01-22T22:22Z   19.1250  -21.4683 */
+    /* Express the states relative to `origin`. */
+    shift = Astronomy_HelioState(origin, time);
+    CHECK_STATUS(shift);
+    for (i = 0; i < nbodies; ++i)
+    {
+        init[i].x -= shift.x;   init[i].vx -= shift.vx;
+        init[i].y -= shift.y;   init[i].vy -= shift.vy;
+        init[i].z -= shift.z;   init[i].vz -= shift.vz;
+    }
 
-        if (strlen(line) < 40)
-            FAIL("C MoonNodes(%s line %d): line is too short\n", filename, lnum);
+    CHECK_CODE(Astronomy_GravSimInit(sim, origin, time, nbodies, init));
+    error = 0;
+fail:
+    return error;
+}
 
-        nscanned = sscanf(line, "%c %17s %lf %lf", &kind, date, &ra, &dec);
-        if (nscanned != 4)
-            FAIL("C MoonNodes(%s line %d): syntax error\n", filename, lnum);
 
-        if (kind != 'A' && kind != 'D')
-            FAIL("C MoonNodes(%s line %d): invalid kind character.\n", filename, lnum);
+static int GravSimLoadBytes(const char *filename, const char *data, size_t size, astro_status_t expected)
+{
+    int error;
+    astro_status_t status;
+    astro_grav_sim_t *sim = NULL;
+    FILE *outfile;
 
-        if (kind == prev_kind)
-            FAIL("C MoonNodes(%s line %d): duplicate ascending/descending kind.\n", filename, lnum);
+    outfile = fopen(filename, "wb");
+    if (outfile == NULL)
+        FFAIL("Cannot open %s\n", filename);
+    if (size != fwrite(data, 1, size, outfile))
+    {
+        fclose(outfile);
+        FFAIL("Cannot write %s\n", filename);
+    }
+    fclose(outfile);
 
-        if (ParseDate(date, &time))
-            FAIL("C MoonNodes(%s line %d): invalid date/time.\n", filename, lnum);
+    status = Astronomy_GravSimLoad(&sim, filename);
+    if (status != expected || (status != ASTRO_SUCCESS && sim != NULL))
+        FFAIL("size=%d: expected status %d, but found %d.\n", (int)size, (int)expected, (int)status);
 
-        if (!isfinite(ra) || ra < 0.0 || ra > 24.0)
-            FAIL("C MoonNodes(%s line %d): invalid right ascension.\n", filename, lnum);
+    error = 0;
+fail:
+    Astronomy_GravSimFree(sim);
+    return error;
+}
 
-        if (!isfinite(dec) || dec < -90.0 || dec > +90.0)
-            FAIL("C MoonNodes(%s line %d): invalid declination.\n", filename, lnum);
 
-        /* Convert RA/DEC to a vector. */
-        sphere.status = ASTRO_SUCCESS;
-        sphere.lat = dec;
-        sphere.lon = 15.0 * ra;
-        sphere.dist = 1.0;
-        vec_test = Astronomy_VectorFromSphere(sphere, time);
-        CHECK_STATUS(vec_test);
+static int GravSimCheckpointTest(void)
+{
+    int error, step, k, nbodies;
+    astro_grav_sim_t *sim = NULL;
+    astro_grav_sim_t *resumed = NULL;
+    astro_state_vector_t a[3], b[3];
+    astro_gravsim_stats_t sa, sb;
+    astro_time_t time;
+    FILE *infile = NULL;
+    char buffer[4096];
+    size_t size;
+    int32_t field;
+    const char *filename = "temp/c_gravsim_checkpoint.bin";
+    const char *truncated = "temp/c_gravsim_truncated.bin";
+    const astro_time_t start = Astronomy_MakeTime(2020, 1, 1, 0, 0, 0.0);
+
+    if (ASTRO_FILE_ERROR != Astronomy_GravSimLoad(&resumed, "this/file/does/not/exist.bin"))
+        FFAIL("Loading a missing file should have failed.\n");
+
+    /* Try both integrators, a geocentric and a barycentric simulation, and a simulation with no small bodies. */
+    for (k = 0; k < 3; ++k)
+    {
+        nbodies = (k == 2) ? 0 : 3;
+        CHECK(GravSimCheckpointInit(&sim, (k == 0) ? BODY_EARTH : BODY_SSB, start, nbodies));
+        if (k == 0)
+            CHECK_CODE(Astronomy_GravSimSetIntegrator(sim, GRAVSIM_DORMAND_PRINCE, 1.0e-10));
 
-        /* Calculate the Moon's ecliptic angles. Verify latitude is very close to zero. */
-        ecl = Astronomy_EclipticGeoMoon(time);
-        CHECK_STATUS(ecl);
-        diff_lat = 60.0 * ABS(ecl.lat);  /* calculate arcminute latitude error */
-        V(ecl.lon);
-        V(ecl.dist);
+        time = start;
+        for (step = 0; step < 10; ++step)
+        {
+            time = Astronomy_AddDays(time, 30.0);
+            CHECK_CODE(Astronomy_GravSimUpdate(sim, time, nbodies, a));
+        }
 
-        if (diff_lat > max_lat)
-            max_lat = diff_lat;
+        CHECK_CODE(Astronomy_GravSimSave(sim, filename));
+        CHECK_CODE(Astronomy_GravSimLoad(&resumed, filename));
 
-        /* Calculate EQD coordinates. Verify against input file. */
-        vec_eqj = Astronomy_GeoMoon(time);
-        CHECK_STATUS(vec_eqj);
+        if (Astronomy_GravSimNumBodies(resumed) != nbodies || Astronomy_GravSimOrigin(resumed) != Astronomy_GravSimOrigin(sim))
+            FFAIL("k=%d: resumed simulation has the wrong bodies or origin.\n", k);
 
-        rot = Astronomy_Rotation_EQJ_EQD(&time);
-        CHECK_STATUS(rot);
-        vec_eqd = Astronomy_RotateVector(rot, vec_eqj);
-        CHECK_STATUS(vec_eqd);
+        if (Astronomy_GravSimTime(resumed).tt != time.tt || Astronomy_GravSimTime(resumed).ut != time.ut)
+            FFAIL("k=%d: resumed simulation has the wrong time.\n", k);
 
-        /* Measure the error angle between the correct vector and the calculated vector. */
-        result = Astronomy_AngleBetween(vec_test, vec_eqd);
-        CHECK_STATUS(result);
-        diff_angle = 60.0 * ABS(result.angle);
-        if (diff_angle > max_angle)
-            max_angle = diff_angle;
-        if (diff_angle > 1.54)
-            FAIL("C MoonNodes(%s line %d): EXCESSIVE equatorial error = %0.3lf arcmin\n", filename, lnum, diff_angle);
+        sa = Astronomy_GravSimStats(sim);
+        sb = Astronomy_GravSimStats(resumed);
+        if (sa.steps != sb.steps || sa.rejected != sb.rejected || sa.evaluations != sb.evaluations || sa.max_error != sb.max_error || sa.step_days != sb.step_days)
+            FFAIL("k=%d: resumed simulation has different statistics.\n", k);
 
-        /* Test the Astronomy Engine moon node searcher. */
-        if (lnum == 1)
+        /* Undoing the last step must work the same way in both simulations. */
+        Astronomy_GravSimSwap(sim);
+        Astronomy_GravSimSwap(resumed);
+        CHECK_CODE(Astronomy_GravSimUpdate(sim, Astronomy_GravSimTime(sim), nbodies, a));
+        CHECK_CODE(Astronomy_GravSimUpdate(resumed, Astronomy_GravSimTime(resumed), nbodies, b));
+        CHECK(GravSimSameStates("swapped", nbodies, a, b));
+
+        /* Both simulations must continue identically, without the resumed one recalculating anything first. */
+        for (step = 0; step < 10; ++step)
         {
-            /* The very first time, so search for the first node in the series. */
-            /* Back up a few days to make sure we really are finding it ourselves. */
-            astro_time_t earlier = Astronomy_AddDays(time, -6.5472);    /* pick a weird amount of time */
-            node = Astronomy_SearchMoonNode(earlier);
+            time = Astronomy_AddDays(time, 30.0);
+            CHECK_CODE(Astronomy_GravSimUpdate(sim, time, nbodies, a));
+            CHECK_CODE(Astronomy_GravSimUpdate(resumed, time, nbodies, b));
+            CHECK(GravSimSameStates("resumed", nbodies, a, b));
         }
-        else
-        {
-            double prev_tt = node.time.tt;
 
-            /* Use the previous node to find the next node. */
-            node = Astronomy_NextMoonNode(node);
+        a[0] = Astronomy_GravSimBodyState(sim, BODY_MARS);
+        b[0] = Astronomy_GravSimBodyState(resumed, BODY_MARS);
+        CHECK(GravSimSameStates("planet", 1, a, b));
 
-            /* Find the range of time intervals between consecutive nodes. */
-            dt = node.time.tt - prev_tt;
-            if (dt < min_dt)
-                min_dt = dt;
-            if (dt > max_dt)
-                max_dt = dt;
-        }
+        Astronomy_GravSimFree(sim);
+        sim = NULL;
+        Astronomy_GravSimFree(resumed);
+        resumed = NULL;
+    }
 
-        if (node.status != ASTRO_SUCCESS)
-            FAIL("C MoonNodes(%s line %d): error %d returned by node search\n", filename, lnum, node.status);
+    /* Truncated and corrupted checkpoint files must be rejected. */
+    infile = fopen(filename, "rb");
+    if (infile == NULL)
+        FFAIL("Cannot open %s\n", filename);
+    size = fread(buffer, 1, sizeof(buffer), infile);
+    fclose(infile);
+    infile = NULL;
+    if (size < 256 || size == sizeof(buffer))
+        FFAIL("%s has an unexpected size %d.\n", filename, (int)size);
+
+    CHECK(GravSimLoadBytes(truncated, buffer, 256, ASTRO_FILE_ERROR));     /* truncated data */
+    CHECK(GravSimLoadBytes(truncated, buffer, 20, ASTRO_FILE_ERROR));      /* truncated header */
+
+    /* The header is an 8-byte signature followed by 32-bit integers: version, byte order, time size, state size, stats size, ... */
+    buffer[3] ^= 0x20;      /* signature */
+    CHECK(GravSimLoadBytes(truncated, buffer, size, ASTRO_FILE_ERROR));
+    buffer[3] ^= 0x20;
+
+    memcpy(&field, buffer + 8, sizeof(field));
+    field += 1;             /* version */
+    memcpy(buffer + 8, &field, sizeof(field));
+    CHECK(GravSimLoadBytes(truncated, buffer, size, ASTRO_INVALID_PARAMETER));
+    field -= 1;
+    memcpy(buffer + 8, &field, sizeof(field));
+
+    memcpy(&field, buffer + 24, sizeof(field));
+    field += 8;             /* stats size */
+    memcpy(buffer + 24, &field, sizeof(field));
+    CHECK(GravSimLoadBytes(truncated, buffer, size, ASTRO_INVALID_PARAMETER));
+    field -= 8;
+    memcpy(buffer + 24, &field, sizeof(field));
+
+    /* Undoing the damage must make the file valid again. */
+    CHECK(GravSimLoadBytes(truncated, buffer, size, ASTRO_SUCCESS));
 
-        /* Verify the ecliptic latitude is very close to zero at the alleged node. */
-        ecl = Astronomy_EclipticGeoMoon(node.time);
-        CHECK_STATUS(ecl);
-        diff_lat = 60.0 * ABS(ecl.lat);
-        if (diff_lat > 8.06e-4)
-            FAIL("C MoonNodes(%s line %d): found node has excessive latitude = %0.4le arcmin\n", filename, lnum, diff_lat);
-        if (diff_lat > max_node_lat)
-            max_node_lat = diff_lat;
+    FPASS();
+fail:
+    if (infile != NULL) fclose(infile);
+    Astronomy_GravSimFree(sim);
+    Astronomy_GravSimFree(resumed);
+    return error;
+}
 
-        /* Verify the time agrees with Espenak's time to within a few minutes. */
-        diff_minutes = (24.0 * 60.0) * ABS(node.time.tt - time.tt);
-        if (diff_minutes > max_minutes)
-            max_minutes = diff_minutes;
 
-        /* Verify the kind of node matches what Espenak says (ascending or descending). */
-        if (kind == 'A' && node.kind != ASCENDING_NODE)
-            FAIL("C MoonNodes(%s line %d): did not find ascending node as expected.\n", filename, lnum);
+static int GravSimStreamTest(void)
+{
+    int error, i, k;
+    astro_grav_sim_t *sim = NULL;
+    astro_grav_sim_t *streamed = NULL;
+    astro_state_vector_t state[3];
+    astro_time_t times[40];
+    double xyz[3 * 40 * 3];
+    double filed[3 * 40 * 3];
+    FILE *infile = NULL;
+    const int nbodies = 3;
+    const int ntimes = 40;
+    const char *filename = "temp/c_gravsim_stream.bin";
+    const astro_time_t start = Astronomy_MakeTime(2020, 1, 1, 0, 0, 0.0);
 
-        if (kind == 'D' && node.kind != DESCENDING_NODE)
-            FAIL("C MoonNodes(%s line %d): did not find descending node as expected.\n", filename, lnum);
+    for (k = 0; k < ntimes; ++k)
+        times[k] = Astronomy_AddDays(start, 5.0 * (k + 1));
 
-        /* Prepare for the next iteration. */
-        prev_kind = kind;
+    /* The streamed positions must exactly match those returned by Astronomy_GravSimUpdate. */
+    CHECK(GravSimCheckpointInit(&sim, BODY_EARTH, start, nbodies));
+    CHECK(GravSimCheckpointInit(&streamed, BODY_EARTH, start, nbodies));
+    CHECK_CODE(Astronomy_GravSimStream(streamed, times, (size_t)ntimes, xyz));
+
+    for (k = 0; k < ntimes; ++k)
+    {
+        CHECK_CODE(Astronomy_GravSimUpdate(sim, times[k], nbodies, state));
+        for (i = 0; i < nbodies; ++i)
+            if (xyz[3*(k*nbodies + i) + 0] != state[i].x || xyz[3*(k*nbodies + i) + 1] != state[i].y || xyz[3*(k*nbodies + i) + 2] != state[i].z)
+                FFAIL("Streamed position for body %d at step %d does not match.\n", i, k);
     }
 
-    if (max_lat > 0.183)
-        FFAIL("EXCESSIVE ecliptic latitude error = %0.3lf arcmin\n", max_lat);
+    if (Astronomy_GravSimTime(streamed).tt != times[ntimes-1].tt)
+        FFAIL("Streamed simulation ended at the wrong time.\n");
 
-    if (max_minutes > 3.681)
-        FFAIL("EXCESSIVE time prediction error = %0.3lf minutes\n", max_minutes);
+    Astronomy_GravSimFree(streamed);
+    streamed = NULL;
 
-    FDEBUG("min_dt = %0.3lf days, max_dt = %0.3lf days.\n", min_dt, max_dt);
-    FPASSA("(%d nodes, max lat error = %0.3lf arcmin, max equ error = %0.3lf arcmin, max time error = %0.3lf minutes, max node lat = %0.3le arcmin)\n", lnum, max_lat, max_angle, max_minutes, max_node_lat);
+    /* Appending in two calls must produce the same positions, in the same order, in the file. */
+    remove(filename);
+    CHECK(GravSimCheckpointInit(&streamed, BODY_EARTH, start, nbodies));
+    CHECK_CODE(Astronomy_GravSimStreamFile(streamed, times, (size_t)(ntimes/2), filename));
+    CHECK_CODE(Astronomy_GravSimStreamFile(streamed, times + ntimes/2, (size_t)(ntimes - ntimes/2), filename));
+
+    infile = fopen(filename, "rb");
+    if (infile == NULL)
+        FFAIL("Cannot open %s\n", filename);
+    if (sizeof(filed)/sizeof(double) != fread(filed, sizeof(double), sizeof(filed)/sizeof(double), infile) || fgetc(infile) != EOF)
+        FFAIL("File %s has the wrong size.\n", filename);
+    if (memcmp(xyz, filed, sizeof(xyz)))
+        FFAIL("File %s does not match the streamed positions.\n", filename);
+
+    if (ASTRO_INVALID_PARAMETER != Astronomy_GravSimStream(streamed, times, 1, NULL))
+        FFAIL("A NULL output buffer should have been rejected.\n");
+
+    FPASS();
 fail:
     if (infile != NULL) fclose(infile);
+    Astronomy_GravSimFree(sim);
+    Astronomy_GravSimFree(streamed);
     return error;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
 
-static int SiderealTimeTest(void)
+static astro_status_t MajorCacheSimulate(astro_context_t *ctx, astro_state_vector_t init, int nsteps, astro_state_vector_t *final)
 {
-    int error;
+    /* Simulates one small body in 2-day steps and returns its final state. */
+    astro_status_t status;
+    astro_grav_sim_t *sim = NULL;
+    int step;
+
+    status = Astronomy_GravSimInitCtx(ctx, &sim, BODY_SUN, init.t, 1, &init);
+    for (step = 1; status == ASTRO_SUCCESS && step <= nsteps; ++step)
+        status = Astronomy_GravSimUpdate(sim, Astronomy_AddDays(init.t, 2.0 * step), 1, final);
+
+    Astronomy_GravSimFree(sim);
+    return status;
+}
+
+
+static int MajorBodyCacheTest(void)
+{
+    int error, i, k, b, step;
+    astro_context_t *ctx[2] = { NULL, NULL };
+    astro_grav_sim_t *plain = NULL;
+    astro_grav_sim_t *cached[2] = { NULL, NULL };
+    astro_state_vector_t init, expected, actual;
+    astro_state_vector_t shared_init[2], shared_expected[2], shared_actual[2];
+    astro_status_t shared_status[2];
     astro_time_t time;
-    double gast, diff;
-    const double correct = 9.3983699280076483;
+    const astro_time_t start = Astronomy_MakeTime(2000, 1, 1, 0, 0, 0.0);
+    const int nbatches = 3;
+    const int nsteps = 200;
+    const double pluto_years[] = { -300.0, 1000.0, 2000.0, 4300.0 };
+    const int npluto = (int)(sizeof(pluto_years) / sizeof(pluto_years[0]));
 
-    time = Astronomy_MakeTime(2022, 3, 15, 21, 50, 0.0);
-    gast = Astronomy_SiderealTime(&time);
-    diff = ABS(gast - correct);
-    printf("C %s: gast=%0.15f, correct=%0.15lf, diff=%0.3le hours.\n", __func__, gast, correct, diff);
-    if (diff > 1.0e-15)
-        FFAIL("EXCESSIVE ERROR\n");
+    for (k = 0; k < 2; ++k)
+        if (ASTRO_SUCCESS != Astronomy_ContextCreate(&ctx[k]))
+            FFAIL("Cannot create context %d\n", k);
+
+    if (ASTRO_INVALID_PARAMETER != Astronomy_ContextSetMajorBodyCache(ctx[0], -1))
+        FFAIL("Negative cache size should have been rejected.\n");
+
+    /* A large cache and a single-slot cache must both give results identical to no cache at all. */
+    CHECK_CODE(Astronomy_ContextSetMajorBodyCache(ctx[0], 1000));
+    CHECK_CODE(Astronomy_ContextSetMajorBodyCache(ctx[1], 1));
+
+    /* Simulate batches one after another through the same times, so that later batches reuse the cached planets. */
+    for (b = 0; b < nbatches; ++b)
+    {
+        init = Astronomy_HelioState(BODY_MARS, start);
+        CHECK_STATUS(init);
+        init.x *= 1.2 + 0.3*b;
+        init.y *= 1.2 + 0.3*b;
+        init.z *= 1.2 + 0.3*b;
+
+        CHECK_CODE(Astronomy_GravSimInit(&plain, BODY_SUN, start, 1, &init));
+        for (k = 0; k < 2; ++k)
+            CHECK_CODE(Astronomy_GravSimInitCtx(ctx[k], &cached[k], BODY_SUN, start, 1, &init));
+
+        for (step = 1; step <= nsteps; ++step)
+        {
+            time = Astronomy_AddDays(start, 2.0 * step);
+            CHECK_CODE(Astronomy_GravSimUpdate(plain, time, 1, &expected));
+            for (k = 0; k < 2; ++k)
+            {
+                CHECK_CODE(Astronomy_GravSimUpdate(cached[k], time, 1, &actual));
+                if (actual.x != expected.x || actual.y != expected.y || actual.z != expected.z || actual.vx != expected.vx || actual.vy != expected.vy || actual.vz != expected.vz)
+                    FFAIL("Cached simulation %d differs in batch %d at step %d\n", k, b, step);
+            }
+        }
+
+        expected = Astronomy_GravSimBodyState(plain, BODY_JUPITER);
+        CHECK_STATUS(expected);
+        for (k = 0; k < 2; ++k)
+        {
+            actual = Astronomy_GravSimBodyState(cached[k], BODY_JUPITER);
+            CHECK_STATUS(actual);
+            if (actual.x != expected.x || actual.y != expected.y || actual.z != expected.z || actual.vx != expected.vx || actual.vy != expected.vy || actual.vz != expected.vz)
+                FFAIL("Cached simulation %d has a different Jupiter state in batch %d\n", k, b);
+            Astronomy_GravSimFree(cached[k]);
+            cached[k] = NULL;
+        }
+        Astronomy_GravSimFree(plain);
+        plain = NULL;
+    }
+
+    /* Pluto's orbit, inside and outside its state table, and the barycenter must not change either. */
+    for (i = 0; i < npluto; ++i)
+    {
+        time = Astronomy_TerrestrialTime((pluto_years[i] - 2000.0) * 365.25);
+        for (k = 0; k < 2; ++k)
+        {
+            expected = Astronomy_BaryState(BODY_PLUTO, time);
+            CHECK_STATUS(expected);
+            actual = Astronomy_BaryStateCtx(ctx[k], BODY_PLUTO, time);
+            CHECK_STATUS(actual);
+            if (actual.x != expected.x || actual.y != expected.y || actual.z != expected.z || actual.vx != expected.vx || actual.vy != expected.vy || actual.vz != expected.vz)
+                FFAIL("Cached context %d has a different Pluto state in year %0.0lf\n", k, pluto_years[i]);
+
+            expected = Astronomy_HelioState(BODY_SSB, time);
+            CHECK_STATUS(expected);
+            actual = Astronomy_HelioStateCtx(ctx[k], BODY_SSB, time);
+            CHECK_STATUS(actual);
+            if (actual.x != expected.x || actual.y != expected.y || actual.z != expected.z || actual.vx != expected.vx || actual.vy != expected.vy || actual.vz != expected.vz)
+                FFAIL("Cached context %d has a different barycenter in year %0.0lf\n", k, pluto_years[i]);
+        }
+    }
+
+    /*
+        Two simulations that step through the same times share the cache of the default context.
+        When OpenMP is enabled, they run at the same time on different threads,
+        reading and writing the same slots. The small cache forces slots to be replaced.
+    */
+    for (k = 0; k < 2; ++k)
+    {
+        shared_init[k] = Astronomy_HelioState(BODY_MARS, start);
+        CHECK_STATUS(shared_init[k]);
+        shared_init[k].x *= 1.1 + 0.4*k;
+        shared_init[k].y *= 1.1 + 0.4*k;
+        shared_init[k].z *= 1.1 + 0.4*k;
+        CHECK_CODE(MajorCacheSimulate(ctx[1], shared_init[k], nsteps, &shared_expected[k]));
+    }
+
+    CHECK_CODE(Astronomy_ContextSetMajorBodyCache(NULL, 64));
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static, 1) num_threads(2)
+#endif
+    for (k = 0; k < 2; ++k)
+        shared_status[k] = MajorCacheSimulate(NULL, shared_init[k], nsteps, &shared_actual[k]);
+    CHECK_CODE(Astronomy_ContextSetMajorBodyCache(NULL, 0));
+
+    for (k = 0; k < 2; ++k)
+    {
+        CHECK_CODE(shared_status[k]);
+        CHECK(GravSimSameStates("shared cache", 1, &shared_actual[k], &shared_expected[k]));
+    }
 
     FPASS();
 fail:
+    Astronomy_ContextSetMajorBodyCache(NULL, 0);
+    Astronomy_GravSimFree(plain);
+    Astronomy_GravSimFree(cached[0]);
+    Astronomy_GravSimFree(cached[1]);
+    Astronomy_ContextFree(ctx[0]);
+    Astronomy_ContextFree(ctx[1]);
     return error;
 }
 
-/*-----------------------------------------------------------------------------------------------------------*/
 
-static double ArcminPosError(astro_state_vector_t correct, astro_state_vector_t calc)
+static astro_kepler_elements_t KeplerElements(double tt, double q, double e, double incl, double node, double peri)
 {
-    double dx = V(calc.x - correct.x);
-    double dy = V(calc.y - correct.y);
-    double dz = V(calc.z - correct.z);
-    double diff_squared = dx*dx + dy*dy + dz*dz;
-    double mag_squared = correct.x*correct.x + correct.y*correct.y + correct.z*correct.z;
-    double radians = V(sqrt(diff_squared / mag_squared));
-    double arcmin = (RAD2DEG * 60.0) * radians;
-    return arcmin;
+    astro_kepler_elements_t elements;
+    elements.perihelion = Astronomy_TerrestrialTime(tt);
+    elements.q = q;
+    elements.e = e;
+    elements.incl = incl;
+    elements.node = node;
+    elements.peri = peri;
+    return elements;
 }
 
-static double ArcminVelError(astro_state_vector_t correct, astro_state_vector_t calc)
+
+static int KeplerConics(void)
 {
-    double dx = V(calc.vx - correct.vx);
-    double dy = V(calc.vy - correct.vy);
-    double dz = V(calc.vz - correct.vz);
-    double diff_squared = dx*dx + dy*dy + dz*dz;
-    double mag_squared = correct.vx*correct.vx + correct.vy*correct.vy + correct.vz*correct.vz;
-    double radians = V(sqrt(diff_squared / mag_squared));
-    double arcmin = (RAD2DEG * 60.0) * radians;
-    return arcmin;
+    int error, i, j, k;
+    astro_kepler_elements_t fitted;
+    astro_state_vector_t state, before, after, check;
+    astro_time_t time, later;
+    double gm, r, v2, energy, expected, h[3], hlen, diff, vscale;
+    double max_energy = 0.0, max_angmom = 0.0, max_deriv = 0.0, max_trip = 0.0;
+    const double dt = 1.0e-3;
+
+    /* Cover all three conic sections, including nearly circular, nearly parabolic, and retrograde orbits. */
+    const astro_kepler_elements_t orbits[] =
+    {
+        KeplerElements(100.0,  1.00, 0.0,      0.0,   0.0,   0.0),
+        KeplerElements(-50.0,  2.50, 0.1,     10.6,  80.3,  73.8),
+        KeplerElements(300.0,  0.59, 0.967,  162.2,  58.4, 111.3),
+        KeplerElements(  0.0,  0.30, 0.99999, 45.0, 200.0, 300.0),
+        KeplerElements(  0.0,  0.80, 1.0,     95.0,  30.0, 150.0),
+        KeplerElements( 20.0,  1.36, 1.2,    122.7,  24.6, 241.8),
+        KeplerElements(-10.0,  0.26, 4.0,     33.0, 300.0,  10.0)
+    };
+    const int norbits = (int)(sizeof(orbits) / sizeof(orbits[0]));
+    const double offsets[] = { 0.0, -3000.0, -400.0, -10.0, 0.5, 30.0, 2000.0 };
+    const int noffsets = (int)(sizeof(offsets) / sizeof(offsets[0]));
+
+    gm = Astronomy_MassProduct(BODY_SUN);
+
+    for (i = 0; i < norbits; ++i)
+    {
+        for (k = 0; k < noffsets; ++k)
+        {
+            time = Astronomy_TerrestrialTime(orbits[i].perihelion.tt + offsets[k]);
+            state = Astronomy_KeplerState(&orbits[i], time);
+            CHECK_STATUS(state);
+
+            r = sqrt(state.x*state.x + state.y*state.y + state.z*state.z);
+            v2 = state.vx*state.vx + state.vy*state.vy + state.vz*state.vz;
+
+            if (offsets[k] == 0.0 && fabs(r - orbits[i].q) > 1.0e-14)
+                FFAIL("Orbit %d: distance at perihelion = %0.16lf, expected %0.16lf\n", i, r, orbits[i].q);
+
+            /* The energy and angular momentum per unit mass are fixed by q and e. */
+            energy = v2/2.0 - gm/r;
+            expected = gm * (orbits[i].e - 1.0) / (2.0 * orbits[i].q);
+            diff = fabs(energy - expected) / (gm / orbits[i].q);
+            if (diff > max_energy)
+                max_energy = diff;
+
+            h[0] = state.y*state.vz - state.z*state.vy;
+            h[1] = state.z*state.vx - state.x*state.vz;
+            h[2] = state.x*state.vy - state.y*state.vx;
+            hlen = sqrt(h[0]*h[0] + h[1]*h[1] + h[2]*h[2]);
+            diff = fabs(hlen / sqrt(gm * orbits[i].q * (1.0 + orbits[i].e)) - 1.0);
+            if (diff > max_angmom)
+                max_angmom = diff;
+
+            /* The velocity must be the derivative of the position. */
+            before = Astronomy_KeplerState(&orbits[i], Astronomy_AddDays(time, -dt));
+            after  = Astronomy_KeplerState(&orbits[i], Astronomy_AddDays(time, +dt));
+            CHECK_STATUS(before);
+            CHECK_STATUS(after);
+            vscale = sqrt(v2);
+            diff = sqrt(
+                pow((after.x - before.x)/(2.0*dt) - state.vx, 2.0) +
+                pow((after.y - before.y)/(2.0*dt) - state.vy, 2.0) +
+                pow((after.z - before.z)/(2.0*dt) - state.vz, 2.0)
+            ) / vscale;
+            if (diff > max_deriv)
+                max_deriv = diff;
+
+            /* Converting the state back to elements must give the same orbit. */
+            CHECK_CODE(Astronomy_KeplerElementsFromState(&state, &fitted));
+            if (fabs(fitted.q - orbits[i].q) > 1.0e-12 * orbits[i].q || fabs(fitted.e - orbits[i].e) > 1.0e-12)
+                FFAIL("Orbit %d, offset %lg: fitted q=%0.16lf, e=%0.16lf\n", i, offsets[k], fitted.q, fitted.e);
+
+            for (j = 0; j < 3; ++j)
+            {
+                later = Astronomy_AddDays(time, 50.0 * j);
+                state = Astronomy_KeplerState(&orbits[i], later);
+                check = Astronomy_KeplerState(&fitted, later);
+                CHECK_STATUS(state);
+                CHECK_STATUS(check);
+                diff = sqrt(pow(check.x - state.x, 2.0) + pow(check.y - state.y, 2.0) + pow(check.z - state.z, 2.0));
+                diff /= sqrt(state.x*state.x + state.y*state.y + state.z*state.z);
+                if (diff > max_trip)
+                    max_trip = diff;
+            }
+        }
+    }
+
+    FDEBUG("max energy error = %0.3le, angular momentum error = %0.3le, derivative error = %0.3le, round trip error = %0.3le\n", max_energy, max_angmom, max_deriv, max_trip);
+
+    if (max_energy > 1.0e-13 || max_angmom > 1.0e-13)
+        FFAIL("EXCESSIVE conservation error: energy = %0.3le, angular momentum = %0.3le\n", max_energy, max_angmom);
+
+    if (max_deriv > 1.0e-6)
+        FFAIL("EXCESSIVE velocity error = %0.3le\n", max_deriv);
+
+    if (max_trip > 1.0e-9)
+        FFAIL("EXCESSIVE round trip error = %0.3le\n", max_trip);
+
+    FPASS();
+fail:
+    return error;
 }
 
 
-static double SSB_ArcminPosError(astro_state_vector_t correct, astro_state_vector_t calc)
+static int KeplerBatch(void)
 {
-    /* Scale the SSB based on 1 AU, not on its absolute magnitude, which can become very close to zero. */
-    double dx = V(calc.x - correct.x);
-    double dy = V(calc.y - correct.y);
-    double dz = V(calc.z - correct.z);
-    double diff_squared = dx*dx + dy*dy + dz*dz;
-    double radians = V(sqrt(diff_squared));
-    double arcmin = (RAD2DEG * 60.0) * radians;
-    return arcmin;
+    int error, i, k, d;
+    astro_kepler_elements_t elements[11];
+    astro_time_t times[5];
+    astro_state_vector_t state;
+    double pv[6 * 11 * 5];
+    double expected[6];
+    const int nbodies = 11;
+    const int ntimes = 5;
+
+    /* Mix the conic types within each batch, and leave a partial batch at the end. */
+    for (i = 0; i < nbodies; ++i)
+        elements[i] = KeplerElements(10.0*i, 0.4 + 0.3*i, (i % 5 == 3) ? 1.0 : 0.25*(i % 7), 7.0*i, 33.0*i, 71.0*i);
+
+    for (k = 0; k < ntimes; ++k)
+        times[k] = Astronomy_TerrestrialTime(-500.0 + 250.0*k);
+
+    CHECK_CODE(Astronomy_KeplerStateBatch(elements, (size_t)nbodies, times, (size_t)ntimes, pv));
+
+    for (k = 0; k < ntimes; ++k)
+    {
+        for (i = 0; i < nbodies; ++i)
+        {
+            state = Astronomy_KeplerState(&elements[i], times[k]);
+            CHECK_STATUS(state);
+            expected[0] = state.x;
+            expected[1] = state.y;
+            expected[2] = state.z;
+            expected[3] = state.vx;
+            expected[4] = state.vy;
+            expected[5] = state.vz;
+            for (d = 0; d < 6; ++d)
+                if (pv[6*(k*nbodies + i) + d] != expected[d])
+                    FFAIL("Batch state of body %d at time %d, component %d = %0.17lg, expected %0.17lg\n", i, k, d, pv[6*(k*nbodies + i) + d], expected[d]);
+        }
+    }
+
+    if (ASTRO_INVALID_PARAMETER != Astronomy_KeplerStateBatch(elements, (size_t)nbodies, times, (size_t)ntimes, NULL))
+        FFAIL("A NULL output buffer should have been rejected.\n");
+
+    elements[6].q = 0.0;
+    if (ASTRO_INVALID_PARAMETER != Astronomy_KeplerStateBatch(elements, (size_t)nbodies, times, (size_t)ntimes, pv))
+        FFAIL("A zero perihelion distance should have been rejected.\n");
+
+    elements[6].q = 1.0;
+    elements[6].e = -0.1;
+    state = Astronomy_KeplerState(&elements[6], times[0]);
+    if (state.status != ASTRO_INVALID_PARAMETER)
+        FFAIL("A negative eccentricity should have been rejected.\n");
+
+    FPASS();
+fail:
+    return error;
 }
 
 
-static int GravSimFile(
-    const char *filename,
-    astro_body_t originBody,
-    int nsteps,
-    double *r_score,
-    double *v_score,
-    double r_thresh,
-    double v_thresh)
+static int KeplerJpl(const char *filename, astro_kepler_elements_t elements, astro_state_vector_t epoch_state, double days, double arcmin_thresh)
 {
-    int error;
-    int i, k;
-    double rdiff, vdiff, tdiff;
-    double max_rdiff = 0.0, max_vdiff = 0.0;
-    astro_grav_sim_t *sim = NULL;
+    int error, i, count;
+    astro_kepler_elements_t fitted;
     astro_state_vector_t state;
-    astro_status_t status;
+    double diff, max_diff = 0.0;
     state_vector_batch_t batch = EmptyStateVectorBatch();
-    astro_time_t time, checkTime;
-    astro_body_t checkOrigin;
 
-    if (nsteps < 1)
-        FAIL("C GravSimFile(%s): invalid nsteps=%d\n", filename, nsteps);
+    /*
+        The JPL elements and the equivalent state vector must agree with each other.
+        They differ by a few hundredths of an arcsecond, because JPL uses the IAU 1976 obliquity
+        and the ICRF instead of the IAU 2006 obliquity and EQJ.
+    */
+    state = Astronomy_KeplerState(&elements, epoch_state.t);
+    CHECK_STATUS(state);
+    diff = ArcminPosError(epoch_state, state);
+    if (diff > 1.0e-3)
+        FFAIL("%s: EXCESSIVE position error at epoch = %0.3le arcmin\n", filename, diff);
 
-    CHECK(LoadStateVectors(&batch, filename));
+    diff = ArcminVelError(epoch_state, state);
+    if (diff > 1.0e-3)
+        FFAIL("%s: EXCESSIVE velocity error at epoch = %0.3le arcmin\n", filename, diff);
 
-    if (batch.length <= 0)
-        FAIL("C GravSimFile(%s): batch.length = %d is invalid.\n", filename, batch.length);
+    CHECK_CODE(Astronomy_KeplerElementsFromState(&epoch_state, &fitted));
+    if (fabs(fitted.q - elements.q) > 1.0e-8 || fabs(fitted.e - elements.e) > 1.0e-8 || fabs(fitted.perihelion.tt - elements.perihelion.tt) > 1.0e-4)
+        FFAIL("%s: fitted q=%0.10lf, e=%0.10lf, tp=%0.6lf\n", filename, fitted.q, fitted.e, fitted.perihelion.tt);
 
-    /* Use the state vector and time in the batch to initialize the gravity simulator. */
-    state = batch.array[0];
+    if (fabs(fitted.incl - elements.incl) > 1.0e-4 || fabs(fitted.node - elements.node) > 1.0e-4 || fabs(fitted.peri - elements.peri) > 1.0e-3)
+        FFAIL("%s: fitted incl=%0.8lf, node=%0.8lf, peri=%0.8lf\n", filename, fitted.incl, fitted.node, fitted.peri);
 
-    status = Astronomy_GravSimInit(&sim, originBody, state.t, 1, &state);
-    if (status != ASTRO_SUCCESS)
-        FAIL("C GravSimFile(%s): Astronomy_GravSimInit returned error %d\n", filename, status);
+    /* Without the planets' perturbations, an orbit fitted to the first state drifts slowly away from JPL's. */
+    CHECK(LoadStateVectors(&batch, filename));
+    if (batch.length < 1)
+        FFAIL("%s: no state vectors found.\n", filename);
+    CHECK_CODE(Astronomy_KeplerElementsFromState(&batch.array[0], &fitted));
+    count = 0;
+    for (i = 0; i < batch.length; ++i)
+    {
+        if (batch.array[i].t.tt - batch.array[0].t.tt > days)
+            break;
+        state = Astronomy_KeplerState(&fitted, batch.array[i].t);
+        CHECK_STATUS(state);
+        diff = ArcminPosError(batch.array[i], state);
+        if (diff > max_diff)
+            max_diff = diff;
+        ++count;
+    }
 
-    i = Astronomy_GravSimNumBodies(sim);
-    if (i != 1)
-        FAIL("C GravSimFile(%s): expected 1 body, found %d\n", filename, i);
+    if (count < 2)
+        FFAIL("%s: only %d states are within %lg days of the first state.\n", filename, count, days);
 
-    checkOrigin = Astronomy_GravSimOrigin(sim);
-    if (checkOrigin != originBody)
-        FAIL("C GravSimFile(%s): expected body %d, found %d\n", filename, originBody, checkOrigin);
+    FDEBUG("%-22s max error over %3.0lf days = %0.4lf arcmin\n", filename, days, max_diff);
+    if (max_diff > arcmin_thresh)
+        FFAIL("%s: EXCESSIVE position error = %0.4lf arcmin\n", filename, max_diff);
 
-    time = state.t;
-    for (i = 1; i < batch.length; ++i)
-    {
-        /* Split each entry of the input batch into `nsteps` simulation steps. */
-        double tt1 = batch.array[i-1].t.tt;
-        double tt2 = batch.array[i].t.tt;
-        double dt = (tt2 - tt1) / nsteps;
-        for (k = 1; k <= nsteps; ++k)
-        {
-            time = Astronomy_TerrestrialTime(tt1 + k*dt);
-            status = Astronomy_GravSimUpdate(sim, time, 1, &state);
-            if (status != ASTRO_SUCCESS)
-                FAIL("C GravSimFile(%s : i=%d): Astronomy_GravSimInit returned error %d\n", filename, i, status);
+    error = 0;
+fail:
+    FreeStateVectorBatch(&batch);
+    return error;
+}
 
-            checkTime = Astronomy_GravSimTime(sim);
-            if (checkTime.tt != time.tt)
-                FAIL("C GravSimFile(%s): Expected tt=%0.16lf, found tt=%0.16lf", filename, time.tt, checkTime.tt);
-        }
 
-        tdiff = SECONDS_PER_DAY * ABS(time.tt - batch.array[i].t.tt);
-        if (tdiff > 1.0e-15)
-            FAIL("C GravSimFile(%s): terrestrial time error = %0.16lf seconds.\n", filename, tdiff);
+static astro_state_vector_t JplState(double jd, double x, double y, double z, double vx, double vy, double vz)
+{
+    astro_state_vector_t state;
+    state.t = Astronomy_TerrestrialTime(jd - 2451545.0);
+    state.x = x;
+    state.y = y;
+    state.z = z;
+    state.vx = vx;
+    state.vy = vy;
+    state.vz = vz;
+    state.status = ASTRO_SUCCESS;
+    return state;
+}
 
-        /* Compare the simulated state with the reference state. */
-        rdiff = ArcminPosError(batch.array[i], state);
-        if (rdiff > max_rdiff)
-            max_rdiff = rdiff;
 
-        if (rdiff > r_thresh)
-            FAIL("C GravSimFile(%s : i=%d): EXCESSIVE position error = %0.4lf arcmin\n", filename, i, rdiff);
+static double KeplerArcsecDiff(astro_vector_t a, astro_vector_t b)
+{
+    /* Unlike Astronomy_AngleBetween, this resolves angles far below a milliarcsecond. */
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    double dz = b.z - a.z;
+    return (RAD2DEG * 3600.0) * sqrt((dx*dx + dy*dy + dz*dz) / (a.x*a.x + a.y*a.y + a.z*a.z));
+}
 
-        vdiff = ArcminVelError(batch.array[i], state);
-        if (vdiff > max_vdiff)
-            max_vdiff = vdiff;
 
-        if (vdiff > v_thresh)
-            FAIL("C GravSimFile(%s : i=%d): EXCESSIVE velocity error = %0.4lf arcmin\n", filename, i, vdiff);
-    }
+static int KeplerObserve(void)
+{
+    int error, k;
+    astro_kepler_elements_t elements;
+    astro_state_vector_t mars;
+    astro_vector_t expected, actual;
+    astro_equatorial_t equ_expected, equ_actual;
+    astro_time_t time;
+    astro_observer_t observer = Astronomy_MakeObserver(-35.0, 149.0, 600.0);
+    double diff, max_vec = 0.0, max_equ = 0.0;
+    const astro_time_t start = Astronomy_MakeTime(2024, 3, 1, 0, 0, 0.0);
 
-    if (max_rdiff > *r_score)
-        *r_score = max_rdiff;
+    /*
+        Fit elements to Mars at each time. Within the few minutes of light travel time,
+        the Keplerian orbit matches the planet's ephemeris, so the apparent positions
+        must match those of the planet itself, for both aberration settings.
+    */
+    for (k = 0; k < 40; ++k)
+    {
+        time = Astronomy_AddDays(start, 17.3 * k);
+        mars = Astronomy_HelioState(BODY_MARS, time);
+        CHECK_STATUS(mars);
+        CHECK_CODE(Astronomy_KeplerElementsFromState(&mars, &elements));
+
+        CHECK_VECTOR(expected, Astronomy_GeoVector(BODY_MARS, time, (k & 1) ? ABERRATION : NO_ABERRATION));
+        CHECK_VECTOR(actual, Astronomy_KeplerGeoVector(&elements, time, (k & 1) ? ABERRATION : NO_ABERRATION));
+        if (actual.t.tt != time.tt)
+            FFAIL("Geocentric vector has time %0.16lf, expected %0.16lf\n", actual.t.tt, time.tt);
+        diff = KeplerArcsecDiff(expected, actual);
+        if (diff > max_vec)
+            max_vec = diff;
+
+        CHECK_EQU(equ_expected, Astronomy_Equator(BODY_MARS, &time, observer, EQUATOR_OF_DATE, ABERRATION));
+        CHECK_EQU(equ_actual, Astronomy_KeplerEquator(&elements, &time, observer, EQUATOR_OF_DATE, ABERRATION));
+        diff = KeplerArcsecDiff(equ_expected.vec, equ_actual.vec);
+        if (diff > max_equ)
+            max_equ = diff;
+    }
 
-    if (max_vdiff > *v_score)
-        *v_score = max_vdiff;
+    FDEBUG("max geocentric error = %0.3le arcsec, max topocentric error = %0.3le arcsec\n", max_vec, max_equ);
+    if (max_vec > 1.0e-5 || max_equ > 1.0e-5)
+        FFAIL("EXCESSIVE error: geocentric = %0.3le arcsec, topocentric = %0.3le arcsec\n", max_vec, max_equ);
 
-    DEBUG("C GravSimFile(%-22s): PASS (count = %d, pos error = %7.4lf arcmin, vel error = %7.4lf arcmin)\n", filename, batch.length, max_rdiff, max_vdiff);
-    error = 0;
+    FPASS();
 fail:
-    Astronomy_GravSimFree(sim);
-    FreeStateVectorBatch(&batch);
     return error;
 }
 
 
-static int GravSimEmpty(
-    const char *filename,
-    astro_body_t origin,
-    astro_body_t body,
-    double limit_rdiff,
-    double limit_vdiff)
+static int KeplerTest(void)
 {
     int error;
-    int i;
-    astro_body_t checkOrigin;
-    astro_status_t status;
-    astro_grav_sim_t *sim = NULL;
-    state_vector_batch_t batch = EmptyStateVectorBatch();
-    astro_state_vector_t calc;
-    double rdiff, vdiff;
-    double max_rdiff = 0.0;
-    double max_vdiff = 0.0;
 
-    CHECK(LoadStateVectors(&batch, filename));
-    if (batch.length < 1)
-        FAIL("C GravSimEmpty(%s): invalid number of entries = %d\n", filename, batch.length);
+    CHECK(KeplerConics());
+    CHECK(KeplerBatch());
 
-    /* Verify that we can create an empty simulator, and that we can calculate the SSB from it. */
-    status = Astronomy_GravSimInit(&sim, origin, batch.array[0].t, 0, NULL);
-    if (status != ASTRO_SUCCESS)
-        FAIL("C GravSimEmpty(%s): Astronomy_GravSimInit returned %d\n", filename, status);
+    /* Elements and equivalent states are copied from the headers of the JPL Horizons files. */
+    CHECK(KeplerJpl("heliostate/Ceres.txt",
+        KeplerElements(2458240.1791309435 - 2451545.0, 2.556401146697176, .07687465013145245, 10.59127767086216, 80.3011901917491, 73.80896808746482),
+        JplState(2458849.5, 1.007608869613381E+00, -2.390064275223502E+00, -1.332124522752402E+00, 9.201724467227128E-03, 3.370381135398406E-03, -2.850337057661093E-04),
+        60.0, 0.08));
 
-    i = Astronomy_GravSimNumBodies(sim);
-    if (i != 0)
-        FAIL("C GravSimEmpty(%s): expected 0 bodies, found %d\n", filename, i);
+    CHECK(KeplerJpl("heliostate/Pallas.txt",
+        KeplerElements(2449888.234262689 - 2451545.0, 2.123204751285651, .2338123415749628, 34.80769754202284, 173.2983467771782, 309.6979606055149),
+        JplState(2449976.5, -1.970054913847300E+00, 9.344601720792679E-01, -5.069228381032120E-02, -6.556101132986031E-03, -1.072367279805506E-02, 2.566511942726757E-03),
+        60.0, 0.04));
 
-    checkOrigin = Astronomy_GravSimOrigin(sim);
-    if (checkOrigin != origin)
-        FAIL("C GravSimEmpty(%s): expected body %d, found %d\n", filename, origin, checkOrigin);
+    CHECK(KeplerJpl("heliostate/Juno.txt",
+        KeplerElements(2450481.1378782284 - 2451545.0, 1.984915105184622, .2570266021515117, 12.95828368662786, 170.2683121482084, 247.642323108671),
+        JplState(2449869.5, -3.151048548510591E-01, -3.173577172418717E+00, -5.852720172022363E-01, 8.454822466857106E-03, 4.699363636941995E-04, -2.378733303526027E-04),
+        60.0, 0.01));
 
-    for (i = 0; i < batch.length; ++i)
+    CHECK(KeplerObserve());
+
+    FPASS();
+fail:
+    return error;
+}
+
+
+static int GravSimSwarm(void)
+{
+    int error, i, k, step;
+    astro_grav_sim_t *swarm = NULL;
+    astro_grav_sim_t *single = NULL;
+    astro_state_vector_t *init = NULL;
+    astro_state_vector_t *state = NULL;
+    astro_state_vector_t one;
+    astro_status_t status;
+    astro_time_t time;
+    double radius, angle, speed;
+    const int nbodies = 1001;   /* odd, and more than one chunk of bodies */
+    const int nsteps = 20;
+    const int stride = 100;     /* check every 100th body individually, including the last one */
+
+    init  = (astro_state_vector_t *) calloc(nbodies, sizeof(astro_state_vector_t));
+    state = (astro_state_vector_t *) calloc(nbodies, sizeof(astro_state_vector_t));
+    if (init == NULL || state == NULL)
+        FFAIL("Out of memory.\n");
+
+    /* Spread the bodies across the asteroid belt in slightly inclined circular orbits. */
+    time = Astronomy_MakeTime(2000, 1, 1, 0, 0, 0.0);
+    for (i = 0; i < nbodies; ++i)
     {
-        status = Astronomy_GravSimUpdate(sim, batch.array[i].t, 0, NULL);
-        if (status != ASTRO_SUCCESS)
-            FAIL("C GravSimEmpty(%s): i=%d, Astronomy_GravSimUpdate returned %d\n", filename, i, status);
+        radius = 2.0 + (1.5 * i) / nbodies;
+        angle = 0.37 * i;
+        speed = 0.01720209895 / sqrt(radius);
+        init[i].status = ASTRO_SUCCESS;
+        init[i].t  = time;
+        init[i].x  = radius * cos(angle);
+        init[i].y  = radius * sin(angle);
+        init[i].z  = 0.05 * sin(1.3 * i);
+        init[i].vx = -speed * sin(angle);
+        init[i].vy = +speed * cos(angle);
+        init[i].vz = 0.0;
+    }
 
-        calc = Astronomy_GravSimBodyState(sim, body);
-        CHECK_STATUS(calc);
+    status = Astronomy_GravSimInit(&swarm, BODY_SUN, time, nbodies, init);
+    if (status != ASTRO_SUCCESS)
+        FFAIL("Astronomy_GravSimInit returned %d for the swarm.\n", status);
 
-        if (origin==BODY_SSB && body==BODY_SUN)
-            rdiff = SSB_ArcminPosError(batch.array[i], calc);
-        else
-            rdiff = ArcminPosError(batch.array[i], calc);
+    for (step = 1; step <= nsteps; ++step)
+    {
+        status = Astronomy_GravSimUpdate(swarm, Astronomy_AddDays(time, 2.0 * step), nbodies, state);
+        if (status != ASTRO_SUCCESS)
+            FFAIL("Astronomy_GravSimUpdate returned %d for the swarm.\n", status);
+    }
 
-        if (rdiff > limit_rdiff)
-            FAIL("C GravSimEmpty(%s): excessive position error = %0.6lf arcmin\n", filename, rdiff);
+    /* Each body must follow exactly the same trajectory when simulated by itself. */
+    for (i = 0; i < nbodies; i += stride)
+    {
+        status = Astronomy_GravSimInit(&single, BODY_SUN, time, 1, &init[i]);
+        if (status != ASTRO_SUCCESS)
+            FFAIL("Astronomy_GravSimInit returned %d for body %d.\n", status, i);
 
-        if (rdiff > max_rdiff)
-            max_rdiff = rdiff;
+        for (k = 1; k <= nsteps; ++k)
+        {
+            status = Astronomy_GravSimUpdate(single, Astronomy_AddDays(time, 2.0 * k), 1, &one);
+            if (status != ASTRO_SUCCESS)
+                FFAIL("Astronomy_GravSimUpdate returned %d for body %d.\n", status, i);
+        }
 
-        vdiff = ArcminVelError(batch.array[i], calc);
-        if (vdiff > max_vdiff)
-            max_vdiff = vdiff;
+        if (one.x != state[i].x || one.y != state[i].y || one.z != state[i].z ||
+            one.vx != state[i].vx || one.vy != state[i].vy || one.vz != state[i].vz)
+            FFAIL("Body %d differs between the swarm and the single-body simulation: dx=%lg, dvx=%lg\n", i, one.x - state[i].x, one.vx - state[i].vx);
 
-        if (vdiff > limit_vdiff)
-            FAIL("C GravSimEmpty(%s): excessive velocity error = %0.6lf arcmin\n", filename, vdiff);
+        Astronomy_GravSimFree(single);
+        single = NULL;
     }
 
-    DEBUG("C GravSimEmpty(%-22s): PASS - %d cases, pos error = %0.4lf arcmin, vel error = %0.4lf arcmin\n", filename, batch.length, max_rdiff, max_vdiff);
+    DEBUG("C GravSimSwarm: PASS - %d bodies match their single-body simulations.\n", nbodies);
     error = 0;
 fail:
-    Astronomy_GravSimFree(sim);
+    Astronomy_GravSimFree(swarm);
+    Astronomy_GravSimFree(single);
+    free(init);
+    free(state);
     return error;
 }
 
@@ -7540,6 +10396,8 @@ static int GravitySimulatorTest(void)
     CHECK(GravSimFile("geostate/Vesta.txt",     BODY_EARTH, nsteps, &rscore, &vscore, 3.2980, 3.8863));
     CHECK(GravSimFile("geostate/Juno.txt",      BODY_EARTH, nsteps, &rscore, &vscore, 6.0962, 7.7147));
 
+    CHECK(GravSimSwarm());
+
     FPASSA("(pos score = %0.4lf arcmin, vel score = %0.4lf arcmin)\n", rscore, vscore);
 fail:
     return error;
@@ -7547,6 +10405,290 @@ fail:
 
 /*-----------------------------------------------------------------------------------------------------------*/
 
+static int ChebEphemTest(const char *filename)
+{
+    int error, i, b;
+    astro_status_t status;
+    astro_time_t time;
+    astro_state_vector_t vsop, cheb;
+    astro_vector_t pos;
+    astro_context_t *ctx = NULL;
+    double dr, dv, max_dr = 0.0, max_dv = 0.0;
+    const int ntimes = 1000;
+    const astro_body_t body_list[] =
+    {
+        BODY_MERCURY, BODY_VENUS, BODY_EARTH, BODY_MARS,
+        BODY_JUPITER, BODY_SATURN, BODY_URANUS, BODY_NEPTUNE
+    };
+    const int nbodies = (int)(sizeof(body_list) / sizeof(body_list[0]));
+
+    /* Loading a file that doesn't exist must fail without disturbing anything. */
+    status = Astronomy_LoadChebyshevEphemeris("this/file/does/not/exist.ceb");
+    if (status != ASTRO_FILE_ERROR)
+        FFAIL("Expected ASTRO_FILE_ERROR for missing file, but found status %d\n", status);
+
+    for (b = 0; b < nbodies; ++b)
+    {
+        for (i = 0; i < ntimes; ++i)
+        {
+            /* Sample times from 1900 through 2099, which is inside the file's coverage. */
+            time = Astronomy_TerrestrialTime(-36524.0 + (73048.0 * i) / (ntimes - 1));
+
+            vsop = Astronomy_HelioState(body_list[b], time);
+            CHECK_STATUS(vsop);
+
+            status = Astronomy_LoadChebyshevEphemeris(filename);
+            if (status != ASTRO_SUCCESS)
+                FFAIL("Error %d loading Chebyshev ephemeris file: %s\n", status, filename);
+
+            cheb = Astronomy_HelioState(body_list[b], time);
+            CHECK_STATUS(cheb);
+            pos = Astronomy_HelioVector(body_list[b], time);
+            CHECK_STATUS(pos);
+            Astronomy_UnloadChebyshevEphemeris();
+
+            if (pos.x != cheb.x || pos.y != cheb.y || pos.z != cheb.z)
+                FFAIL("HelioVector and HelioState disagree for %s at tt=%0.6lf\n", Astronomy_BodyName(body_list[b]), time.tt);
+
+            dr = ArcminPosError(vsop, cheb);
+            dv = ArcminVelError(vsop, cheb);
+            if (dr > max_dr) max_dr = dr;
+            if (dv > max_dv) max_dv = dv;
+        }
+    }
+
+    if (max_dr > 1.0e-6)
+        FFAIL("EXCESSIVE position error = %0.3le arcmin\n", max_dr);
+
+    if (max_dv > 1.0e-4)
+        FFAIL("EXCESSIVE velocity error = %0.3le arcmin\n", max_dv);
+
+    /* Times outside the file's coverage must fall back to VSOP87 exactly. */
+    time = Astronomy_MakeTime(1800, 1, 1, 0, 0, 0.0);
+    vsop = Astronomy_HelioState(BODY_MARS, time);
+    CHECK_STATUS(vsop);
+    CHECK(Astronomy_LoadChebyshevEphemeris(filename));
+    cheb = Astronomy_HelioState(BODY_MARS, time);
+    CHECK_STATUS(cheb);
+    Astronomy_UnloadChebyshevEphemeris();
+    if (vsop.x != cheb.x || vsop.y != cheb.y || vsop.z != cheb.z || vsop.vx != cheb.vx || vsop.vy != cheb.vy || vsop.vz != cheb.vz)
+        FFAIL("Did not fall back to VSOP87 outside the file's coverage.\n");
+
+    /* Major body states cached before loading or unloading the ephemeris must not be reused afterward. */
+    CHECK_CODE(Astronomy_ContextCreate(&ctx));
+    CHECK_CODE(Astronomy_ContextSetMajorBodyCache(ctx, 16));
+    time = Astronomy_MakeTime(2000, 1, 1, 0, 0, 0.0);
+    for (i = 0; i < 3; ++i)
+    {
+        if (i == 1)
+            CHECK_CODE(Astronomy_LoadChebyshevEphemeris(filename));
+        else if (i == 2)
+            Astronomy_UnloadChebyshevEphemeris();
+        vsop = Astronomy_HelioState(BODY_SSB, time);
+        CHECK_STATUS(vsop);
+        cheb = Astronomy_HelioStateCtx(ctx, BODY_SSB, time);
+        CHECK_STATUS(cheb);
+        if (vsop.x != cheb.x || vsop.y != cheb.y || vsop.z != cheb.z || vsop.vx != cheb.vx || vsop.vy != cheb.vy || vsop.vz != cheb.vz)
+            FFAIL("Major body cache returned a stale barycenter at i=%d\n", i);
+    }
+
+    FPASSA("(max pos error = %0.3le arcmin, max vel error = %0.3le arcmin)\n", max_dr, max_dv);
+fail:
+    Astronomy_UnloadChebyshevEphemeris();
+    Astronomy_ContextFree(ctx);
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
+static double EclipseDiff(double a, double b, double *max_diff)
+{
+    double diff;
+
+    if (isnan(a) && isnan(b))
+        diff = 0.0;
+    else if (isnan(a) || isnan(b))
+        diff = 1.0e+99;
+    else
+        diff = V(fabs(a - b));
+
+    if (diff > *max_diff)
+        *max_diff = diff;
+
+    return diff;
+}
+
+
+static int EclipseCatalogTest(const char *filename)
+{
+    int error, i, lunar_count = 0, solar_count = 0;
+    astro_status_t status;
+    astro_time_t time;
+    astro_lunar_eclipse_t lsearch, lcat;
+    astro_global_solar_eclipse_t ssearch, scat;
+    double dt = 0.0, dsd = 0.0, dobs = 0.0, dpos = 0.0, ddist = 0.0;
+    const int ntimes = 2000;
+
+    /* Loading a file that doesn't exist must fail without disturbing anything. */
+    status = Astronomy_LoadEclipseCatalog("this/file/does/not/exist.ecl");
+    if (status != ASTRO_FILE_ERROR)
+        FFAIL("Expected ASTRO_FILE_ERROR for missing file, but found status %d\n", status);
+
+    for (i = 0; i < ntimes; ++i)
+    {
+        /* Sample start times from the year -1500 through the year 3500, which extends past the file's coverage. */
+        time = Astronomy_TimeFromDays(-1278416.3 + (1826211.0 * i) / (ntimes - 1));
+
+        lsearch = Astronomy_SearchLunarEclipse(time);
+        CHECK_STATUS(lsearch);
+        ssearch = Astronomy_SearchGlobalSolarEclipse(time);
+        CHECK_STATUS(ssearch);
+
+        status = Astronomy_LoadEclipseCatalog(filename);
+        if (status != ASTRO_SUCCESS)
+            FFAIL("Error %d loading eclipse catalog file: %s\n", status, filename);
+
+        /* A catalog lookup does not evaluate any search functions. */
+        Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+        lcat = Astronomy_SearchLunarEclipse(time);
+        lunar_count += (Astronomy_ContextSearchStats(NULL).evaluations == 0);
+
+        Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+        scat = Astronomy_SearchGlobalSolarEclipse(time);
+        solar_count += (Astronomy_ContextSearchStats(NULL).evaluations == 0);
+
+        Astronomy_UnloadEclipseCatalog();
+        CHECK_STATUS(lcat);
+        CHECK_STATUS(scat);
+
+        /*
+            The searches converge to slightly different values depending on where they start,
+            so the catalog agrees with a search only to within the search tolerances.
+        */
+        if (lcat.kind != lsearch.kind || EclipseDiff(lcat.peak.ut, lsearch.peak.ut, &dt) > 1.0/SECONDS_PER_DAY)
+            FFAIL("Lunar eclipse mismatch for start ut=%0.6lf: catalog peak=%0.6lf, search peak=%0.6lf\n", time.ut, lcat.peak.ut, lsearch.peak.ut);
+
+        if (scat.kind != ssearch.kind || EclipseDiff(scat.peak.ut, ssearch.peak.ut, &dt) > 1.0/SECONDS_PER_DAY)
+            FFAIL("Solar eclipse mismatch for start ut=%0.6lf: catalog peak=%0.6lf, search peak=%0.6lf\n", time.ut, scat.peak.ut, ssearch.peak.ut);
+
+        EclipseDiff(lcat.obscuration, lsearch.obscuration, &dobs);
+        EclipseDiff(lcat.sd_penum, lsearch.sd_penum, &dsd);
+        EclipseDiff(lcat.sd_partial, lsearch.sd_partial, &dsd);
+        EclipseDiff(lcat.sd_total, lsearch.sd_total, &dsd);
+        EclipseDiff(scat.obscuration, ssearch.obscuration, &dobs);
+        EclipseDiff(scat.distance, ssearch.distance, &ddist);
+        EclipseDiff(scat.latitude, ssearch.latitude, &dpos);
+        EclipseDiff(scat.longitude, ssearch.longitude, &dpos);
+    }
+
+    DEBUG("C EclipseCatalogTest: %d of %d lunar and %d of %d solar searches used the catalog.\n", lunar_count, ntimes, solar_count, ntimes);
+    DEBUG("C EclipseCatalogTest: max diffs: peak = %0.3lf sec, sd = %0.3le min, obscuration = %0.3le, distance = %0.3le km, lat/lon = %0.3le deg\n",
+        dt * SECONDS_PER_DAY, dsd, dobs, ddist, dpos);
+
+    /* Start times after the year 3000 and near eclipse peaks must fall back to searching; the rest must be lookups. */
+    if (lunar_count < ntimes*3/4 || solar_count < ntimes*3/4 || lunar_count == ntimes || solar_count == ntimes)
+        FFAIL("Unexpected number of catalog lookups.\n");
+
+    if (dsd > 0.01 || dobs > 1.0e-4 || ddist > 1.0 || dpos > 0.01)
+        FFAIL("EXCESSIVE difference between catalog and search.\n");
+
+    FPASS();
+fail:
+    Astronomy_UnloadEclipseCatalog();
+    Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+    return error;
+}
+
+static int CalendarTableTest(const char *filename)
+{
+    int error, i, year, quarter_count = 0, season_count = 0;
+    astro_status_t status;
+    astro_time_t time;
+    astro_moon_quarter_t msearch, mtable;
+    astro_seasons_t ssearch, stable;
+    double diff, max_diff = 0.0;
+    int search_evals = 0, table_evals = 0;
+    const int ntimes = 2000;
+
+    status = Astronomy_LoadCalendarTable("this/file/does/not/exist.cal");
+    if (status != ASTRO_FILE_ERROR)
+        FFAIL("Expected ASTRO_FILE_ERROR for missing file, but found status %d\n", status);
+
+    for (i = 0; i < ntimes; ++i)
+    {
+        /* Sample start times from the year 1500 through the year 2500, which extends past the table's coverage. */
+        time = Astronomy_TimeFromDays(-182621.5 + (365242.0 * i) / (ntimes - 1));
+
+        Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+        msearch = Astronomy_SearchMoonQuarter(time);
+        CHECK_STATUS(msearch);
+        search_evals += Astronomy_ContextSearchStats(NULL).evaluations;
+
+        status = Astronomy_LoadCalendarTable(filename);
+        if (status != ASTRO_SUCCESS)
+            FFAIL("Error %d loading calendar table file: %s\n", status, filename);
+
+        /* A table lookup only needs the two evaluations that refine it. */
+        Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+        mtable = Astronomy_SearchMoonQuarter(time);
+        table_evals += Astronomy_ContextSearchStats(NULL).evaluations;
+        quarter_count += (Astronomy_ContextSearchStats(NULL).evaluations == 2);
+
+        Astronomy_UnloadCalendarTable();
+        CHECK_STATUS(mtable);
+
+        diff = V(SECONDS_PER_DAY * fabs(mtable.time.ut - msearch.time.ut));
+        if (diff > max_diff)
+            max_diff = diff;
+
+        if (mtable.quarter != msearch.quarter || diff > 0.2)
+            FFAIL("Moon quarter mismatch for start ut=%0.6lf: table quarter=%d time=%0.6lf, search quarter=%d time=%0.6lf\n",
+                time.ut, mtable.quarter, mtable.time.ut, msearch.quarter, msearch.time.ut);
+    }
+
+    for (year = 1550; year < 2450; year += 3)
+    {
+        ssearch = Astronomy_Seasons(year);
+        CHECK_STATUS(ssearch);
+
+        status = Astronomy_LoadCalendarTable(filename);
+        if (status != ASTRO_SUCCESS)
+            FFAIL("Error %d loading calendar table file: %s\n", status, filename);
+
+        Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+        stable = Astronomy_Seasons(year);
+        season_count += (Astronomy_ContextSearchStats(NULL).evaluations == 8);
+
+        Astronomy_UnloadCalendarTable();
+        CHECK_STATUS(stable);
+
+        diff = V(SECONDS_PER_DAY * fabs(stable.mar_equinox.ut  - ssearch.mar_equinox.ut));
+        diff = fmax(diff, V(SECONDS_PER_DAY * fabs(stable.jun_solstice.ut - ssearch.jun_solstice.ut)));
+        diff = fmax(diff, V(SECONDS_PER_DAY * fabs(stable.sep_equinox.ut  - ssearch.sep_equinox.ut)));
+        diff = fmax(diff, V(SECONDS_PER_DAY * fabs(stable.dec_solstice.ut - ssearch.dec_solstice.ut)));
+        if (diff > max_diff)
+            max_diff = diff;
+
+        if (diff > 0.2)
+            FFAIL("Seasons mismatch for year %d: diff = %0.3lf seconds\n", year, diff);
+    }
+
+    DEBUG("C CalendarTableTest: %d of %d moon quarters and %d seasons used the table; max diff = %0.4lf sec.\n", quarter_count, ntimes, season_count, max_diff);
+    DEBUG("C CalendarTableTest: average evaluations per moon quarter: search = %0.2lf, table = %0.2lf\n", (double)search_evals / ntimes, (double)table_evals / ntimes);
+
+    /* Start times and years outside 1600..2399 must fall back to searching; the rest must be lookups. */
+    if (quarter_count < ntimes*3/4 || quarter_count == ntimes || season_count != 267)
+        FFAIL("Unexpected number of table lookups.\n");
+
+    FPASS();
+fail:
+    Astronomy_UnloadCalendarTable();
+    Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+    return error;
+}
+
+/*-----------------------------------------------------------------------------------------------------------*/
+
 static int CheckDecemberSolstice(int year, const char *expected)
 {
     int error = 1;
@@ -7657,6 +10799,111 @@ fail:
     return error;
 }
 
+typedef struct
+{
+    astro_observer_t observer;
+    double target_altitude;
+}
+star_altitude_context_t;
+
+static astro_func_result_t StarAltitudeDiff(void *context, astro_time_t time)
+{
+    astro_func_result_t result;
+    astro_equatorial_t equ;
+    astro_horizon_t hor;
+    const star_altitude_context_t *p = (const star_altitude_context_t *)context;
+
+    equ = Astronomy_Equator(BODY_STAR1, &time, p->observer, EQUATOR_OF_DATE, ABERRATION);
+    if (equ.status != ASTRO_SUCCESS)
+    {
+        result.status = equ.status;
+        result.value = NAN;
+        return result;
+    }
+    hor = Astronomy_Horizon(&time, p->observer, equ.ra, equ.dec, REFRACTION_NONE);
+    result.value = hor.altitude - p->target_altitude;
+    result.status = ASTRO_SUCCESS;
+    return result;
+}
+
+static int StarAltitudeTest(void)
+{
+    int error, a, d, s, k, dir, i, n, count = 0, calls = 0;
+    astro_status_t status;
+    astro_search_result_t search;
+    astro_root_t roots[8];
+    star_altitude_context_t context;
+    astro_time_t start;
+    double expected, diff, max_diff = 0.0;
+    static const double latitudes[] = { -70.0, -35.0, 0.0, +25.77, +51.5, +78.0 };
+    static const double declinations[] = { -80.0, -40.0, -5.0, +20.0, +60.0, +85.0 };
+    static const double targets[] = { -34.0/60.0, +30.0 };
+
+    /* Compare the star fast path against a brute force search of the star's altitude. */
+    Astronomy_ContextSetSearchBudget(NULL, 0, 0.0);
+    for (a = 0; a < 6; ++a)
+    {
+        context.observer = Astronomy_MakeObserver(latitudes[a], -80.0 + 31.0*a, 0.0);
+        for (d = 0; d < 6; ++d)
+        {
+            status = Astronomy_DefineStar(BODY_STAR1, 3.7*d + 0.4, declinations[d], 500.0);
+            if (status != ASTRO_SUCCESS)
+                FFAIL("Astronomy_DefineStar returned status %d\n", status);
+
+            for (s = 0; s < 2; ++s)
+            {
+                context.target_altitude = targets[s];
+                for (k = 0; k < 3; ++k)
+                {
+                    start = Astronomy_MakeTime(2022, 3 + 4*k, 1, 5*k, 0, 0.0);
+                    status = Astronomy_SearchAll(StarAltitudeDiff, &context, start, Astronomy_AddDays(start, 1.0), 361.0, 0.01, roots, 8, &n);
+                    if (status != ASTRO_SUCCESS)
+                        FFAIL("Astronomy_SearchAll returned status %d\n", status);
+
+                    for (dir = -1; dir <= +1; dir += 2)
+                    {
+                        calls -= Astronomy_ContextSearchStats(NULL).evaluations;
+                        search = Astronomy_SearchAltitude(BODY_STAR1, context.observer, (astro_direction_t)dir, start, 1.0, targets[s]);
+                        calls += Astronomy_ContextSearchStats(NULL).evaluations;
+                        ++count;
+
+                        expected = NAN;
+                        for (i = 0; i < n; ++i)
+                        {
+                            if (roots[i].direction == dir)
+                            {
+                                expected = roots[i].time.ut;
+                                break;
+                            }
+                        }
+
+                        if (isnan(expected))
+                        {
+                            if (search.status != ASTRO_SEARCH_FAILURE)
+                                FFAIL("lat=%0.2lf dec=%0.2lf alt=%0.4lf dir=%d: expected no event, but found status %d\n", latitudes[a], declinations[d], targets[s], dir, search.status);
+                        }
+                        else
+                        {
+                            CHECK_STATUS(search);
+                            diff = V(SECONDS_PER_DAY * fabs(search.time.ut - expected));
+                            if (diff > max_diff)
+                                max_diff = diff;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    DEBUG("C StarAltitudeTest: %d searches, %d evaluations, max_diff = %0.3lf seconds\n", count, calls, max_diff);
+    if (max_diff > 0.1)
+        FFAIL("EXCESSIVE time error = %0.3lf seconds\n", max_diff);
+
+    FPASS();
+fail:
+    return error;
+}
+
 /*-----------------------------------------------------------------------------------------------------------*/
 
 static int HourAngleCase(int year, int month, int day, double latitude, double longitude, double hourAngle, double *maxdiff)
@@ -0,0 +1,184 @@
+/*
+    eclipsecat.c  -  Don Cross <cosinekitty@gmail.com>
+
+    Finds every lunar eclipse and global solar eclipse in a range of years
+    using the Astronomy Engine search functions, and writes them to a binary
+    catalog file that the C version of Astronomy Engine can load using
+    Astronomy_LoadEclipseCatalog().
+
+    Usage:  eclipsecat outfile [year_begin year_end]
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "astronomy.h"
+
+#define CHECK(x)    do{if(0 != (error = (x))) goto fail;}while(0)
+#define FAIL(...)   do{fprintf(stderr, __VA_ARGS__); error = 1; goto fail;}while(0)
+
+/* These structures must exactly match eclipse_record_t and eclipse_catalog_header_t in astronomy.c. */
+typedef struct
+{
+    double  peak_ut;
+    double  peak_tt;
+    int32_t kind;
+    int32_t reserved;
+    double  obscuration;
+    double  value[3];
+}
+record_t;
+
+typedef struct
+{
+    char    signature[8];
+    int32_t byte_order;
+    int32_t record_size;
+    double  ut_begin;
+    double  ut_end;
+    int64_t lunar_offset;
+    int64_t lunar_count;
+    int64_t solar_offset;
+    int64_t solar_count;
+}
+file_header_t;
+
+
+static int WriteRecord(FILE *outfile, const record_t *record)
+{
+    if (1 != fwrite(record, sizeof(record_t), 1, outfile))
+    {
+        fprintf(stderr, "eclipsecat: Error writing eclipse record.\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+static int WriteLunarEclipses(FILE *outfile, double ut_begin, double ut_end, int64_t *count)
+{
+    int error;
+    astro_lunar_eclipse_t eclipse;
+    record_t record;
+
+    *count = 0;
+    memset(&record, 0, sizeof(record));
+    eclipse = Astronomy_SearchLunarEclipse(Astronomy_TimeFromDays(ut_begin));
+    while (eclipse.status == ASTRO_SUCCESS && eclipse.peak.ut <= ut_end)
+    {
+        record.peak_ut = eclipse.peak.ut;
+        record.peak_tt = eclipse.peak.tt;
+        record.kind = (int32_t)eclipse.kind;
+        record.obscuration = eclipse.obscuration;
+        record.value[0] = eclipse.sd_penum;
+        record.value[1] = eclipse.sd_partial;
+        record.value[2] = eclipse.sd_total;
+        CHECK(WriteRecord(outfile, &record));
+        ++(*count);
+        eclipse = Astronomy_NextLunarEclipse(eclipse.peak);
+    }
+
+    if (eclipse.status != ASTRO_SUCCESS)
+        FAIL("eclipsecat: Lunar eclipse search returned status %d\n", eclipse.status);
+
+    error = 0;
+fail:
+    return error;
+}
+
+
+static int WriteSolarEclipses(FILE *outfile, double ut_begin, double ut_end, int64_t *count)
+{
+    int error;
+    astro_global_solar_eclipse_t eclipse;
+    record_t record;
+
+    *count = 0;
+    memset(&record, 0, sizeof(record));
+    eclipse = Astronomy_SearchGlobalSolarEclipse(Astronomy_TimeFromDays(ut_begin));
+    while (eclipse.status == ASTRO_SUCCESS && eclipse.peak.ut <= ut_end)
+    {
+        record.peak_ut = eclipse.peak.ut;
+        record.peak_tt = eclipse.peak.tt;
+        record.kind = (int32_t)eclipse.kind;
+        record.obscuration = eclipse.obscuration;
+        record.value[0] = eclipse.distance;
+        record.value[1] = eclipse.latitude;
+        record.value[2] = eclipse.longitude;
+        CHECK(WriteRecord(outfile, &record));
+        ++(*count);
+        eclipse = Astronomy_NextGlobalSolarEclipse(eclipse.peak);
+    }
+
+    if (eclipse.status != ASTRO_SUCCESS)
+        FAIL("eclipsecat: Solar eclipse search returned status %d\n", eclipse.status);
+
+    error = 0;
+fail:
+    return error;
+}
+
+
+static int WriteCatalog(const char *filename, int year1, int year2)
+{
+    int error;
+    FILE *outfile = NULL;
+    file_header_t header;
+
+    if (year2 <= year1)
+        FAIL("eclipsecat: Invalid year range %d..%d\n", year1, year2);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.signature, "AEECL001", sizeof(header.signature));
+    header.byte_order = 0x01020304;
+    header.record_size = (int32_t)sizeof(record_t);
+    header.ut_begin = Astronomy_MakeTime(year1, 1, 1, 0, 0, 0.0).ut;
+    header.ut_end = Astronomy_MakeTime(year2, 1, 1, 0, 0, 0.0).ut;
+
+    outfile = fopen(filename, "wb");
+    if (outfile == NULL)
+        FAIL("eclipsecat: Cannot open output file: %s\n", filename);
+
+    /* Write a placeholder header, then the records, then go back and fill in the header. */
+    if (1 != fwrite(&header, sizeof(header), 1, outfile))
+        FAIL("eclipsecat: Error writing header to file: %s\n", filename);
+
+    header.lunar_offset = (int64_t)sizeof(header);
+    CHECK(WriteLunarEclipses(outfile, header.ut_begin, header.ut_end, &header.lunar_count));
+
+    header.solar_offset = header.lunar_offset + header.lunar_count * (int64_t)sizeof(record_t);
+    CHECK(WriteSolarEclipses(outfile, header.ut_begin, header.ut_end, &header.solar_count));
+
+    if (fseek(outfile, 0, SEEK_SET) || 1 != fwrite(&header, sizeof(header), 1, outfile))
+        FAIL("eclipsecat: Error writing header to file: %s\n", filename);
+
+    printf("eclipsecat: Wrote %0.0lf lunar and %0.0lf solar eclipses for years %d..%d to file %s\n",
+        (double)header.lunar_count, (double)header.solar_count, year1, year2 - 1, filename);
+
+    error = 0;
+fail:
+    if (outfile != NULL)
+    {
+        if (fclose(outfile) && !error)
+        {
+            fprintf(stderr, "eclipsecat: Error closing file: %s\n", filename);
+            error = 1;
+        }
+    }
+    return error;
+}
+
+
+int main(int argc, const char *argv[])
+{
+    if (argc == 2)
+        return WriteCatalog(argv[1], -1999, 3001);
+
+    if (argc == 4)
+        return WriteCatalog(argv[1], atoi(argv[2]), atoi(argv[3]));
+
+    fprintf(stderr, "USAGE: eclipsecat outfile [year_begin year_end]\n");
+    return 1;
+}
@@ -262,7 +262,9 @@ typedef enum
     ASTRO_FAIL_APSIS,               /**< Special-case logic for finding Neptune/Pluto apsis failed. */
     ASTRO_BUFFER_TOO_SMALL,         /**< A provided buffer's size is too small to receive the requested data. */
     ASTRO_OUT_OF_MEMORY,            /**< An attempt to allocate memory failed. */
-    ASTRO_INCONSISTENT_TIMES        /**< The provided initial state vectors did not have matching times. */
+    ASTRO_INCONSISTENT_TIMES,       /**< The provided initial state vectors did not have matching times. */
+    ASTRO_FILE_ERROR,               /**< A file could not be read, or its contents were not valid. */
+    ASTRO_BUDGET_EXCEEDED           /**< A search stopped because it reached the limit set by #Astronomy_ContextSetSearchBudget. */
 }
 astro_status_t;
 
@@ -561,6 +563,41 @@ typedef struct
 }
 astro_search_result_t;
 
+/**
+ * @brief A time at which a function crosses zero, as found by #Astronomy_SearchAll.
+ */
+typedef struct
+{
+    astro_time_t    time;       /**< The time at which the function crosses zero. */
+    int             direction;  /**< +1 if the function ascends through zero, or -1 if it descends through zero. */
+}
+astro_root_t;
+
+/**
+ * @brief The result of a search by #Astronomy_SearchDeriv.
+ */
+typedef struct
+{
+    astro_status_t  status;         /**< `ASTRO_SUCCESS` if this struct is valid; otherwise an error code. */
+    astro_time_t    time;           /**< The time at which a searched-for event occurs. */
+    int             evaluations;    /**< The number of times the search called the callback function, whether or not it succeeded. */
+}
+astro_deriv_search_result_t;
+
+/**
+ * @brief Statistics about the work done by searches.
+ *
+ * Returned by #Astronomy_ContextSearchStats.
+ */
+typedef struct
+{
+    int evaluations;    /**< The number of times searches evaluated the functions they were solving. */
+    int iterations;     /**< The number of times searches narrowed the time interval around a root. */
+    int quad_hits;      /**< The number of times quadratic interpolation narrowed the interval or finished a search. */
+    int quad_misses;    /**< The number of times quadratic interpolation failed, so the interval was bisected instead. */
+}
+astro_search_stats_t;
+
 /**
  * @brief
  *      The dates and times of changes of season for a given calendar year.
@@ -628,6 +665,31 @@ astro_func_result_t;
  */
 typedef astro_func_result_t (* astro_search_func_t) (void *context, astro_time_t time);
 
+/**
+ * @brief A real value and its rate of change, returned by a function whose ascending root is to be found.
+ *
+ * When calling #Astronomy_SearchDeriv, the caller must pass in a callback function
+ * compatible with the function-pointer type #astro_deriv_func_t.
+ * That callback function returns both the value of the function and its derivative
+ * with respect to time, which allows the search to converge in fewer calls.
+ * As with #astro_func_result_t, the callback reports any failure in `status`.
+ */
+typedef struct
+{
+    astro_status_t status;      /**< `ASTRO_SUCCESS` if this struct is valid; otherwise an error code. */
+    double value;               /**< The value returned by a function whose ascending root is to be found. */
+    double slope;               /**< The rate of change of `value` per day. */
+}
+astro_deriv_result_t;
+
+/**
+ * @brief A pointer to a function that is to be passed as a callback to #Astronomy_SearchDeriv.
+ *
+ * This is the same as #astro_search_func_t, except that the function also returns
+ * its derivative with respect to time, in units per day.
+ */
+typedef astro_deriv_result_t (* astro_deriv_func_t) (void *context, astro_time_t time);
+
 /**
  * @brief A pointer to a function that calculates Delta T.
  *
@@ -687,6 +749,34 @@ typedef struct
 }
 astro_hour_angle_t;
 
+/**
+ * @brief The columns of the table calculated by #Astronomy_Almanac.
+ *
+ * Rise and set times are for the top of the body's disc touching the horizon,
+ * corrected for atmospheric refraction, as with #Astronomy_SearchRiseSet.
+ * Culmination is when the body crosses the observer's meridian at its highest point,
+ * as with #Astronomy_SearchHourAngleEx with an hour angle of 0.
+ * Dawn and dusk are when the center of the Sun crosses 6, 12, or 18 degrees below the horizon,
+ * without refraction, as with #Astronomy_SearchAltitude.
+ */
+typedef enum
+{
+    ALMANAC_SUNRISE,                /**< The top of the Sun rises above the horizon. */
+    ALMANAC_SUNSET,                 /**< The top of the Sun sets below the horizon. */
+    ALMANAC_SUN_CULMINATION,        /**< The Sun crosses the meridian at its highest point (solar noon). */
+    ALMANAC_CIVIL_DAWN,             /**< The Sun ascends through 6 degrees below the horizon. */
+    ALMANAC_CIVIL_DUSK,             /**< The Sun descends through 6 degrees below the horizon. */
+    ALMANAC_NAUTICAL_DAWN,          /**< The Sun ascends through 12 degrees below the horizon. */
+    ALMANAC_NAUTICAL_DUSK,          /**< The Sun descends through 12 degrees below the horizon. */
+    ALMANAC_ASTRONOMICAL_DAWN,      /**< The Sun ascends through 18 degrees below the horizon. */
+    ALMANAC_ASTRONOMICAL_DUSK,      /**< The Sun descends through 18 degrees below the horizon. */
+    ALMANAC_MOONRISE,               /**< The top of the Moon rises above the horizon. */
+    ALMANAC_MOONSET,                /**< The top of the Moon sets below the horizon. */
+    ALMANAC_MOON_CULMINATION,       /**< The Moon crosses the meridian at its highest point. */
+    ALMANAC_NUM_COLUMNS             /**< The number of columns in the almanac table. */
+}
+astro_almanac_column_t;
+
 /**
  * @brief Information about the brightness and illuminated shape of a celestial body.
  *
@@ -1120,6 +1210,28 @@ typedef struct
 astro_jupiter_moons_t;
 
 
+/**
+ * @brief Osculating orbital elements of a body in a Keplerian orbit around the Sun.
+ *
+ * The elements describe elliptic, parabolic, and hyperbolic orbits alike,
+ * using the perihelion distance instead of the semi-major axis, and the time of
+ * perihelion passage instead of the mean anomaly at an epoch.
+ * The angles are referred to the J2000 mean ecliptic and equinox,
+ * as in the orbital elements published by the Minor Planet Center and JPL.
+ * See #Astronomy_KeplerState and #Astronomy_KeplerElementsFromState.
+ */
+typedef struct
+{
+    astro_time_t    perihelion;     /**< The time of perihelion passage. */
+    double          q;              /**< The perihelion distance in AU. Must be positive. */
+    double          e;              /**< The eccentricity: less than 1 for an ellipse, 1 for a parabola, greater than 1 for a hyperbola. */
+    double          incl;           /**< The inclination of the orbit to the ecliptic, in degrees. */
+    double          node;           /**< The ecliptic longitude of the ascending node, in degrees. */
+    double          peri;           /**< The argument of perihelion, measured from the ascending node, in degrees. */
+}
+astro_kepler_elements_t;
+
+
 /**
  * @brief  Indicates whether a crossing through the ecliptic plane is ascending or descending.
  */
@@ -1145,6 +1257,34 @@ typedef struct
 }
 astro_node_event_t;
 
+/**
+ * @brief The state of an iterator that finds a series of consecutive events.
+ *
+ * The `Next` functions such as #Astronomy_NextMoonQuarter find each event by a general
+ * search that starts over from the previous event. An event iterator finds the same events,
+ * but it remembers the times of recent events and how fast the search function was changing
+ * at each of them. It uses that information to predict each new event closely,
+ * so that finding it takes only a few function evaluations.
+ *
+ * Initialize an iterator by calling #Astronomy_SearchMoonQuarterIter, #Astronomy_SearchLunarApsisIter,
+ * #Astronomy_SearchPlanetApsisIter, or #Astronomy_SearchMoonNodeIter.
+ * Then pass it to the matching function #Astronomy_NextMoonQuarterIter, #Astronomy_NextLunarApsisIter,
+ * #Astronomy_NextPlanetApsisIter, or #Astronomy_NextMoonNodeIter as many times as desired.
+ * The iterator does not own any dynamic memory.
+ * The fields are for internal use and should not be modified by the caller.
+ */
+typedef struct
+{
+    int             series;     /**< The type of event series the iterator follows. */
+    astro_body_t    body;       /**< The body whose events are found. */
+    int             count;      /**< The number of events found so far. */
+    int             kind;       /**< The kind of the most recent event: a quarter, an #astro_apsis_kind_t, or an #astro_node_kind_t. */
+    astro_time_t    time;       /**< The time of the most recent event. */
+    double          tt[8];      /**< The terrestrial times of the most recent events, oldest first. */
+    double          slope[4];   /**< The rate of change of the search function at the most recent event of each kind, or 0 if unknown. */
+}
+astro_event_iterator_t;
+
 
 /**
  * @brief A data type used for managing simulation of the gravitational forces on a small body.
@@ -1155,10 +1295,67 @@ astro_node_event_t;
  */
 typedef struct astro_grav_sim_s astro_grav_sim_t;
 
+/**
+ * @brief Selects the numeric integrator used by a gravity simulation.
+ *
+ * See #Astronomy_GravSimSetIntegrator.
+ */
+typedef enum
+{
+    GRAVSIM_MEAN_ACCELERATION,  /**< The default second-order integrator: one step per update, using the mean of the accelerations at both ends of the step. */
+    GRAVSIM_DORMAND_PRINCE      /**< A fifth-order Runge-Kutta integrator that chooses its own step sizes to keep the estimated error within a tolerance. */
+}
+astro_gravsim_integrator_t;
+
+/**
+ * @brief Statistics about the work done by a gravity simulation.
+ *
+ * Returned by #Astronomy_GravSimStats.
+ */
+typedef struct
+{
+    int     steps;          /**< The number of integration steps accepted by #Astronomy_GravSimUpdate. */
+    int     rejected;       /**< The number of steps whose estimated error was too large, so they were retried with a smaller step size. */
+    int     evaluations;    /**< The number of times #Astronomy_GravSimUpdate calculated the positions of the Sun and planets. */
+    double  max_error;      /**< The largest estimated error of any accepted step, relative to the body's distance from the Solar System Barycenter. Always 0 for `GRAVSIM_MEAN_ACCELERATION`. */
+    double  last_error;     /**< The estimated error of the most recently accepted step, in the same units as `max_error`. */
+    double  step_days;      /**< The size of the next step the adaptive integrator will try, in days, or 0 if not yet known. */
+}
+astro_gravsim_stats_t;
+
+
+/**
+ * @brief A context that holds cached data and settings for reentrant calculations.
+ *
+ * This is an opaque data type that owns the lazily-calculated data
+ * used by Astronomy Engine (such as Pluto's orbit) and the Delta T model.
+ * Create one with #Astronomy_ContextCreate for each thread that needs to
+ * calculate independently of other threads, and pass it to the functions
+ * whose names end in `Ctx`. Passing NULL to those functions selects the
+ * default context, which is what the functions without `Ctx` use.
+ */
+typedef struct astro_context_s astro_context_t;
+
 
 /*---------- functions ----------*/
 
 void Astronomy_Reset(void);
+astro_status_t Astronomy_ContextCreate(astro_context_t **ctxOut);
+void Astronomy_ContextReset(astro_context_t *ctx);
+void Astronomy_ContextFree(astro_context_t *ctx);
+void Astronomy_ContextSetDeltaTFunction(astro_context_t *ctx, astro_deltat_func func);
+astro_status_t Astronomy_ContextWarmPluto(astro_context_t *ctx);
+astro_status_t Astronomy_ContextSavePluto(astro_context_t *ctx, const char *filename);
+astro_status_t Astronomy_ContextLoadPluto(astro_context_t *ctx, const char *filename);
+astro_status_t Astronomy_ContextSetMoonCache(astro_context_t *ctx, int max_segments);
+astro_status_t Astronomy_ContextSetOrientationCache(astro_context_t *ctx, int max_segments);
+astro_status_t Astronomy_ContextSetMajorBodyCache(astro_context_t *ctx, int max_entries);
+astro_status_t Astronomy_LoadChebyshevEphemeris(const char *filename);
+void Astronomy_UnloadChebyshevEphemeris(void);
+astro_status_t Astronomy_LoadEclipseCatalog(const char *filename);
+void Astronomy_UnloadEclipseCatalog(void);
+astro_status_t Astronomy_LoadCalendarTable(const char *filename);
+void Astronomy_UnloadCalendarTable(void);
 double Astronomy_VectorLength(astro_vector_t vector);
 astro_angle_result_t Astronomy_AngleBetween(astro_vector_t a, astro_vector_t b);
 const char *Astronomy_BodyName(astro_body_t body);
@@ -1168,23 +1365,39 @@ astro_observer_t Astronomy_MakeObserver(double latitude, double longitude, doubl
 astro_time_t Astronomy_CurrentTime(void);
 #endif
 astro_time_t Astronomy_MakeTime(int year, int month, int day, int hour, int minute, double second);
+astro_time_t Astronomy_MakeTimeCtx(astro_context_t *ctx, int year, int month, int day, int hour, int minute, double second);
 astro_time_t Astronomy_TimeFromUtc(astro_utc_t utc);
 astro_utc_t  Astronomy_UtcFromTime(astro_time_t time);
 astro_status_t Astronomy_FormatTime(astro_time_t time, astro_time_format_t format, char *text, size_t size);
 astro_time_t Astronomy_TimeFromDays(double ut);
+astro_time_t Astronomy_TimeFromDaysCtx(astro_context_t *ctx, double ut);
 astro_time_t Astronomy_TerrestrialTime(double tt);
+astro_time_t Astronomy_TerrestrialTimeCtx(astro_context_t *ctx, double tt);
 astro_time_t Astronomy_AddDays(astro_time_t time, double days);
+astro_time_t Astronomy_AddDaysCtx(astro_context_t *ctx, astro_time_t time, double days);
 double Astronomy_SiderealTime(astro_time_t *time);
+double Astronomy_SiderealTimeCtx(astro_context_t *ctx, astro_time_t *time);
 astro_func_result_t Astronomy_HelioDistance(astro_body_t body, astro_time_t time);
 astro_vector_t Astronomy_HelioVector(astro_body_t body, astro_time_t time);
+astro_vector_t Astronomy_HelioVectorCtx(astro_context_t *ctx, astro_body_t body, astro_time_t time);
+astro_status_t Astronomy_HelioVectorBatch(astro_body_t body, const astro_time_t *times, size_t n, double *xyz_out);
 astro_vector_t Astronomy_GeoVector(astro_body_t body, astro_time_t time, astro_aberration_t aberration);
+astro_vector_t Astronomy_GeoVectorCtx(astro_context_t *ctx, astro_body_t body, astro_time_t time, astro_aberration_t aberration);
+astro_status_t Astronomy_GeoVectorBatch(astro_body_t body, const astro_time_t *times, size_t n, astro_aberration_t aberration, double *xyz_out);
 astro_vector_t Astronomy_GeoMoon(astro_time_t time);
+astro_vector_t Astronomy_GeoMoonCtx(astro_context_t *ctx, astro_time_t time);
+astro_status_t Astronomy_GeoMoonBatch(const astro_time_t *times, size_t n, double *xyz_out);
 astro_spherical_t Astronomy_EclipticGeoMoon(astro_time_t time);
+astro_spherical_t Astronomy_EclipticGeoMoonCtx(astro_context_t *ctx, astro_time_t time);
 astro_state_vector_t Astronomy_GeoMoonState(astro_time_t time);
+astro_state_vector_t Astronomy_GeoMoonStateCtx(astro_context_t *ctx, astro_time_t time);
 astro_state_vector_t Astronomy_GeoEmbState(astro_time_t time);
 astro_libration_t Astronomy_Libration(astro_time_t time);
 astro_state_vector_t Astronomy_BaryState(astro_body_t body, astro_time_t time);
+astro_state_vector_t Astronomy_BaryStateCtx(astro_context_t *ctx, astro_body_t body, astro_time_t time);
+astro_status_t Astronomy_BaryStateBatch(astro_body_t body, const astro_time_t *times, size_t n, double *state_out);
 astro_state_vector_t Astronomy_HelioState(astro_body_t body, astro_time_t time);
+astro_state_vector_t Astronomy_HelioStateCtx(astro_context_t *ctx, astro_body_t body, astro_time_t time);
 
 double Astronomy_MassProduct(astro_body_t body);
 double Astronomy_PlanetOrbitalPeriod(astro_body_t body);
@@ -1214,6 +1427,15 @@ astro_equatorial_t Astronomy_Equator(
     astro_aberration_t aberration
 );
 
+astro_equatorial_t Astronomy_EquatorCtx(
+    astro_context_t *ctx,
+    astro_body_t body,
+    astro_time_t *time,
+    astro_observer_t observer,
+    astro_equator_date_t equdate,
+    astro_aberration_t aberration
+);
+
 astro_vector_t Astronomy_ObserverVector(
     astro_time_t *time,
     astro_observer_t observer,
@@ -1241,6 +1463,19 @@ astro_horizon_t Astronomy_Horizon(
     double dec,
     astro_refraction_t refraction);
 
+astro_status_t Astronomy_HorizonGrid(
+    astro_body_t body,
+    astro_time_t *time,
+    const double *latitudes,
+    size_t nlat,
+    const double *longitudes,
+    size_t nlon,
+    double height,
+    astro_aberration_t aberration,
+    astro_refraction_t refraction,
+    double *altitude,
+    double *azimuth);
+
 astro_angle_result_t Astronomy_AngleFromSun(astro_body_t body, astro_time_t time);
 astro_elongation_t Astronomy_Elongation(astro_body_t body, astro_time_t time);
 astro_elongation_t Astronomy_SearchMaxElongation(astro_body_t body, astro_time_t startTime);
@@ -1252,10 +1487,13 @@ astro_angle_result_t Astronomy_PairLongitude(astro_body_t body1, astro_body_t bo
 /** @endcond */
 
 astro_search_result_t Astronomy_SearchRelativeLongitude(astro_body_t body, double targetRelLon, astro_time_t startTime);
+astro_search_result_t Astronomy_SearchRelativeLongitudeCtx(astro_context_t *ctx, astro_body_t body, double targetRelLon, astro_time_t startTime);
 astro_angle_result_t Astronomy_MoonPhase(astro_time_t time);
 astro_search_result_t Astronomy_SearchMoonPhase(double targetLon, astro_time_t startTime, double limitDays);
 astro_moon_quarter_t Astronomy_SearchMoonQuarter(astro_time_t startTime);
 astro_moon_quarter_t Astronomy_NextMoonQuarter(astro_moon_quarter_t mq);
+astro_moon_quarter_t Astronomy_SearchMoonQuarterIter(astro_event_iterator_t *iter, astro_time_t startTime);
+astro_moon_quarter_t Astronomy_NextMoonQuarterIter(astro_event_iterator_t *iter);
 astro_lunar_eclipse_t Astronomy_SearchLunarEclipse(astro_time_t startTime);
 astro_lunar_eclipse_t Astronomy_NextLunarEclipse(astro_time_t prevEclipseTime);
 astro_global_solar_eclipse_t Astronomy_SearchGlobalSolarEclipse(astro_time_t startTime);
@@ -1266,6 +1504,11 @@ astro_transit_t Astronomy_SearchTransit(astro_body_t body, astro_time_t startTim
 astro_transit_t Astronomy_NextTransit(astro_body_t body, astro_time_t prevTransitTime);
 astro_node_event_t Astronomy_SearchMoonNode(astro_time_t startTime);
 astro_node_event_t Astronomy_NextMoonNode(astro_node_event_t prevNode);
+astro_node_event_t Astronomy_SearchMoonNodeIter(astro_event_iterator_t *iter, astro_time_t startTime);
+astro_node_event_t Astronomy_NextMoonNodeIter(astro_event_iterator_t *iter);
+
+astro_status_t Astronomy_ContextSetSearchBudget(astro_context_t *ctx, int max_evaluations, double max_seconds);
+astro_search_stats_t Astronomy_ContextSearchStats(astro_context_t *ctx);
 
 astro_search_result_t Astronomy_Search(
     astro_search_func_t func,
@@ -1274,6 +1517,52 @@ astro_search_result_t Astronomy_Search(
     astro_time_t t2,
     double dt_tolerance_seconds);
 
+astro_status_t Astronomy_SearchAll(
+    astro_search_func_t func,
+    void *context,
+    astro_time_t t1,
+    astro_time_t t2,
+    double max_slope,
+    double dt_tolerance_seconds,
+    astro_root_t *roots,
+    int max_roots,
+    int *num_roots);
+
+astro_search_result_t Astronomy_SearchCtx(
+    astro_context_t *ctx,
+    astro_search_func_t func,
+    void *context,
+    astro_time_t t1,
+    astro_time_t t2,
+    double dt_tolerance_seconds);
+
+astro_status_t Astronomy_SearchAllCtx(
+    astro_context_t *ctx,
+    astro_search_func_t func,
+    void *context,
+    astro_time_t t1,
+    astro_time_t t2,
+    double max_slope,
+    double dt_tolerance_seconds,
+    astro_root_t *roots,
+    int max_roots,
+    int *num_roots);
+
+astro_deriv_search_result_t Astronomy_SearchDeriv(
+    astro_deriv_func_t func,
+    void *context,
+    astro_time_t t1,
+    astro_time_t t2,
+    double dt_tolerance_seconds);
+
+astro_deriv_search_result_t Astronomy_SearchDerivCtx(
+    astro_context_t *ctx,
+    astro_deriv_func_t func,
+    void *context,
+    astro_time_t t1,
+    astro_time_t t2,
+    double dt_tolerance_seconds);
+
 astro_search_result_t Astronomy_SearchSunLongitude(
     double targetLon,
     astro_time_t startTime,
@@ -1286,6 +1575,14 @@ astro_hour_angle_t Astronomy_SearchHourAngleEx(
     astro_time_t startTime,
     int direction);
 
+astro_hour_angle_t Astronomy_SearchHourAngleExCtx(
+    astro_context_t *ctx,
+    astro_body_t body,
+    astro_observer_t observer,
+    double hourAngle,
+    astro_time_t startTime,
+    int direction);
+
 astro_func_result_t Astronomy_HourAngle(
     astro_body_t body,
     astro_time_t *time,
@@ -1310,6 +1607,15 @@ astro_search_result_t Astronomy_SearchRiseSetEx(
     double limitDays,
     double metersAboveGround);
 
+astro_search_result_t Astronomy_SearchRiseSetExCtx(
+    astro_context_t *ctx,
+    astro_body_t body,
+    astro_observer_t observer,
+    astro_direction_t direction,
+    astro_time_t startTime,
+    double limitDays,
+    double metersAboveGround);
+
 astro_search_result_t Astronomy_SearchAltitude(
     astro_body_t body,
     astro_observer_t observer,
@@ -1318,6 +1624,22 @@ astro_search_result_t Astronomy_SearchAltitude(
     double limitDays,
     double altitude);
 
+astro_search_result_t Astronomy_SearchAltitudeCtx(
+    astro_context_t *ctx,
+    astro_body_t body,
+    astro_observer_t observer,
+    astro_direction_t direction,
+    astro_time_t startTime,
+    double limitDays,
+    double altitude);
+
+astro_status_t Astronomy_Almanac(
+    const astro_observer_t *observers,
+    int num_observers,
+    astro_time_t start_time,
+    int num_days,
+    float *table);
+
 astro_atmosphere_t Astronomy_Atmosphere(double elevationMeters);
 
 astro_axis_t Astronomy_RotationAxis(astro_body_t body, astro_time_t *time);
@@ -1329,6 +1651,14 @@ astro_apsis_t Astronomy_SearchLunarApsis(astro_time_t startTime);
 astro_apsis_t Astronomy_NextLunarApsis(astro_apsis_t apsis);
 astro_apsis_t Astronomy_SearchPlanetApsis(astro_body_t body, astro_time_t startTime);
 astro_apsis_t Astronomy_NextPlanetApsis(astro_body_t body, astro_apsis_t apsis);
+astro_apsis_t Astronomy_SearchLunarApsisCtx(astro_context_t *ctx, astro_time_t startTime);
+astro_apsis_t Astronomy_NextLunarApsisCtx(astro_context_t *ctx, astro_apsis_t apsis);
+astro_apsis_t Astronomy_SearchPlanetApsisCtx(astro_context_t *ctx, astro_body_t body, astro_time_t startTime);
+astro_apsis_t Astronomy_NextPlanetApsisCtx(astro_context_t *ctx, astro_body_t body, astro_apsis_t apsis);
+astro_apsis_t Astronomy_SearchLunarApsisIter(astro_event_iterator_t *iter, astro_time_t startTime);
+astro_apsis_t Astronomy_NextLunarApsisIter(astro_event_iterator_t *iter);
+astro_apsis_t Astronomy_SearchPlanetApsisIter(astro_event_iterator_t *iter, astro_body_t body, astro_time_t startTime);
+astro_apsis_t Astronomy_NextPlanetApsisIter(astro_event_iterator_t *iter);
 
 astro_rotation_t Astronomy_IdentityMatrix(void);
 astro_rotation_t Astronomy_InverseRotation(astro_rotation_t rotation);
@@ -1347,6 +1677,7 @@ astro_rotation_t Astronomy_Rotation_EQD_ECL(astro_time_t *time);
 astro_rotation_t Astronomy_Rotation_EQD_ECT(astro_time_t *time);
 astro_rotation_t Astronomy_Rotation_EQD_HOR(astro_time_t *time, astro_observer_t observer);
 astro_rotation_t Astronomy_Rotation_EQJ_EQD(astro_time_t *time);
+astro_rotation_t Astronomy_Rotation_EQJ_EQDCtx(astro_context_t *ctx, astro_time_t *time);
 astro_rotation_t Astronomy_Rotation_EQJ_ECT(astro_time_t *time);
 astro_rotation_t Astronomy_Rotation_EQJ_ECL(void);
 astro_rotation_t Astronomy_Rotation_EQJ_HOR(astro_time_t *time, astro_observer_t observer);
@@ -1365,6 +1696,7 @@ double Astronomy_Refraction(astro_refraction_t refraction, double altitude);
 double Astronomy_InverseRefraction(astro_refraction_t refraction, double bent_altitude);
 
 astro_constellation_t Astronomy_Constellation(double ra, double dec);
+astro_constellation_t Astronomy_ConstellationCtx(astro_context_t *ctx, double ra, double dec);
 
 astro_status_t Astronomy_GravSimInit(
     astro_grav_sim_t **simOut,
@@ -1374,6 +1706,15 @@ astro_status_t Astronomy_GravSimInit(
     const astro_state_vector_t *bodyStateArray
 );
 
+astro_status_t Astronomy_GravSimInitCtx(
+    astro_context_t *ctx,
+    astro_grav_sim_t **simOut,
+    astro_body_t originBody,
+    astro_time_t time,
+    int numBodies,
+    const astro_state_vector_t *bodyStateArray
+);
+
 astro_status_t Astronomy_GravSimUpdate(
     astro_grav_sim_t *sim,
     astro_time_t time,
@@ -1390,6 +1731,13 @@ astro_time_t Astronomy_GravSimTime(const astro_grav_sim_t *sim);
 int Astronomy_GravSimNumBodies(const astro_grav_sim_t *sim);
 astro_body_t Astronomy_GravSimOrigin(const astro_grav_sim_t *sim);
 void Astronomy_GravSimSwap(astro_grav_sim_t *sim);
+astro_status_t Astronomy_GravSimSetIntegrator(astro_grav_sim_t *sim, astro_gravsim_integrator_t integrator, double tolerance);
+astro_gravsim_stats_t Astronomy_GravSimStats(const astro_grav_sim_t *sim);
+astro_status_t Astronomy_GravSimStream(astro_grav_sim_t *sim, const astro_time_t *times, size_t ntimes, double *xyz_out);
+astro_status_t Astronomy_GravSimStreamFile(astro_grav_sim_t *sim, const astro_time_t *times, size_t ntimes, const char *filename);
+astro_status_t Astronomy_GravSimSave(const astro_grav_sim_t *sim, const char *filename);
+astro_status_t Astronomy_GravSimLoad(astro_grav_sim_t **simOut, const char *filename);
+astro_status_t Astronomy_GravSimLoadCtx(astro_context_t *ctx, astro_grav_sim_t **simOut, const char *filename);
 void Astronomy_GravSimFree(astro_grav_sim_t *sim);
 
 /**
@@ -1417,6 +1765,56 @@ astro_vector_t Astronomy_BackdatePosition(
     astro_aberration_t aberration
 );
 
+astro_vector_t Astronomy_BackdatePositionCtx(
+    astro_context_t *ctx,
+    astro_time_t time,
+    astro_body_t observerBody,
+    astro_body_t targetBody,
+    astro_aberration_t aberration
+);
+
+astro_state_vector_t Astronomy_KeplerState(const astro_kepler_elements_t *elements, astro_time_t time);
+
+astro_status_t Astronomy_KeplerStateBatch(
+    const astro_kepler_elements_t *elements,
+    size_t nbodies,
+    const astro_time_t *times,
+    size_t ntimes,
+    double *pv_out
+);
+
+astro_status_t Astronomy_KeplerElementsFromState(const astro_state_vector_t *state, astro_kepler_elements_t *elements);
+
+astro_vector_t Astronomy_KeplerGeoVector(
+    const astro_kepler_elements_t *elements,
+    astro_time_t time,
+    astro_aberration_t aberration
+);
+
+astro_vector_t Astronomy_KeplerGeoVectorCtx(
+    astro_context_t *ctx,
+    const astro_kepler_elements_t *elements,
+    astro_time_t time,
+    astro_aberration_t aberration
+);
+
+astro_equatorial_t Astronomy_KeplerEquator(
+    const astro_kepler_elements_t *elements,
+    astro_time_t *time,
+    astro_observer_t observer,
+    astro_equator_date_t equdate,
+    astro_aberration_t aberration
+);
+
+astro_equatorial_t Astronomy_KeplerEquatorCtx(
+    astro_context_t *ctx,
+    const astro_kepler_elements_t *elements,
+    astro_time_t *time,
+    astro_observer_t observer,
+    astro_equator_date_t equdate,
+    astro_aberration_t aberration
+);
+
 astro_status_t Astronomy_DefineStar(
     astro_body_t body,
     double ra,